@@ -92,7 +92,8 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Uncomment to enable wchar_t support (convert to utf8)
 //
-#ifndef SPDLOG_WCHAR_TO_UTF8_SUPPORT
+// Only supported on Windows; spdlog #errors elsewhere
+#if defined(_WIN32) && !defined(SPDLOG_WCHAR_TO_UTF8_SUPPORT)
 #define SPDLOG_WCHAR_TO_UTF8_SUPPORT
 #endif
 ///////////////////////////////////////////////////////////////////////////////
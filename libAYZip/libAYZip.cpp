@@ -4,36 +4,708 @@
 #include "pch.h"
 #include "framework.h"
 #include "libAYZip.h"
+#include "src/ArchiveReader.hpp"
 #include "src/Archiver.hpp"
+#include "src/ArchiverStats.hpp"
+#include "src/BundleModel.hpp"
+#include "src/CodeResources.hpp"
+#include "src/CompressedEntryCache.hpp"
+#include "src/ContentManifest.hpp"
 #include "src/Error.hpp"
+#include "src/ExtractionCache.hpp"
+#include "src/ZipCodec.hpp"
+#include "src/ZipLog.hpp"
 #include <spdlog/AYLog.h>
+#include <algorithm>
+#include <memory>
 
 void AYZipInitLog(const char* loggerName, AYZipLogCallback callback)
+{
+    AYZipInitLogEx(loggerName, callback, nullptr);
+}
+
+void AYZipInitLogEx(const char* loggerName, AYZipLogCallback callback, const AYZipLogConfig *config)
 {
     if (loggerName == nullptr || callback == nullptr) {
         return;
     }
 
+    ZipLog::SetLevel(config && config->level ? ZipLog::ParseLevel(config->level) : spdlog::level::info);
+
+    if (config && config->async) {
+        ZipLog::StartAsync([callback](const char* level, const char* message) {
+            callback(level, message);
+        }, config->queueSize);
+        AYLog::init(loggerName, [](const char* level, const char* message) {
+            ZipLog::Dispatch(level, message);
+        });
+        return;
+    }
+
+    ZipLog::Stop();
+
     // 将 C 风格回调包装为 std::function
     AYLog::init(loggerName, [callback](const char* level, const char* message) {
         callback(level, message);
     });
 }
 
+void AYZipFlushLog(void)
+{
+    ZipLog::Flush();
+}
+
+void AYZipShutdownLog(void)
+{
+    ZipLog::Stop();
+}
+
+struct AYZipStats
+{
+    ArchiverStats stats;
+    std::string json;
+};
+
+struct AYZipExtractionCache
+{
+    AYZipExtractionCache(const char *root, uint64_t budget, CloneMode mode) : cache(root, budget, mode) {}
+    ExtractionCache cache;
+    std::string json;
+};
+
+struct AYZipCompressedCache
+{
+    AYZipCompressedCache(const char *root, uint64_t budget) : cache(root, budget) {}
+    CompressedEntryCache cache;
+    std::string json;
+};
+
+struct AYZipManifest
+{
+    ContentManifest manifest;
+    std::string json;
+};
+
+struct AYZipBundle
+{
+    BundleModel model;
+    std::vector<uint8_t> content;
+};
+
+struct AYArchive
+{
+    explicit AYArchive(size_t cacheBlocks) : reader(cacheBlocks) {}
+    ArchiveReader reader;
+};
+
+// AYArchiveEntry 只作为不透明句柄，实际指向 ArchiveReader 持有的 ArchiveEntry
+static const AYArchiveEntry *ToArchiveEntryHandle(const ArchiveEntry *entry)
+{
+    return reinterpret_cast<const AYArchiveEntry *>(entry);
+}
+
+static const ArchiveEntry *FromArchiveEntryHandle(const AYArchiveEntry *entry)
+{
+    return reinterpret_cast<const ArchiveEntry *>(entry);
+}
+
+struct AYZipCodeResources
+{
+    CodeResourcesOptions options;
+    bool generated = false;
+};
+
+static CloneMode ToCloneMode(unsigned int mode)
+{
+    return mode <= static_cast<unsigned int>(CloneMode::Copy) ? static_cast<CloneMode>(mode) : CloneMode::Auto;
+}
+
+static ArchiverOptions ToArchiverOptions(const AYZipOptions *options)
+{
+    ArchiverOptions result;
+    if (options) {
+        result.stats = options->stats ? &options->stats->stats : nullptr;
+        result.tracePath = options->tracePath ? options->tracePath : "";
+        result.codec = options->codec ? options->codec : "";
+        result.scanThreads = options->scanThreads;
+        result.deterministic = options->deterministic;
+        result.manifest = options->manifest ? &options->manifest->manifest : nullptr;
+        result.codeResources = options->codeResources ? &options->codeResources->options : nullptr;
+        for (size_t i = 0; options->extraDestinations && i < options->extraDestinationCount; i++) {
+            if (options->extraDestinations[i]) {
+                result.extraDestinations.push_back(options->extraDestinations[i]);
+            }
+        }
+        result.cloneMode = ToCloneMode(options->cloneMode);
+        result.extractionCache = options->extractionCache ? &options->extractionCache->cache : nullptr;
+        result.compressedEntryCache = options->compressedCache ? &options->compressedCache->cache : nullptr;
+        result.incremental = options->incremental;
+        result.incrementalIndexPath = options->incrementalIndexPath ? options->incrementalIndexPath : "";
+        result.restoreTimestamps = !options->keepCurrentTimestamps;
+    }
+    return result;
+}
+
+// 异常不能穿过 C 接口 (损坏的包可能让解析时分配失败)：记录日志后返回 fallback
+template <typename Result, typename Body>
+static Result NoThrow(Result fallback, Body &&body)
+{
+    try {
+        return body();
+    }
+    catch (const std::exception &e) {
+        AYError("{}", e.what());
+    }
+    catch (...) {
+        AYError("Unknown exception");
+    }
+    ZipLog::Flush();
+    return fallback;
+}
+
 bool AYUnzipApp(const char *archivePath, const char *appPath)
+{
+    return AYUnzipAppEx(archivePath, appPath, nullptr);
+}
+
+bool AYZipApp(const char *appPath, const char *archivePath)
+{
+    return AYZipAppEx(appPath, archivePath, nullptr);
+}
+
+bool AYUnzipAppEx(const char *archivePath, const char *appPath, const AYZipOptions *options)
 {
     if (archivePath == nullptr) {
         return false;
     }
 
-    return UnzipAppBundle(archivePath, appPath ? appPath : "");
+    bool result = NoThrow(false, [&] { return UnzipAppBundle(archivePath, appPath ? appPath : "", ToArchiverOptions(options)); });
+    ZipLog::Flush();
+    return result;
 }
 
-bool AYZipApp(const char *appPath, const char *archivePath)
+bool AYZipAppEx(const char *appPath, const char *archivePath, const AYZipOptions *options)
 {
     if (appPath == nullptr) {
         return false;
     }
 
-    return ZipAppBundle(appPath, archivePath ? archivePath : "");
-}
\ No newline at end of file
+    if (options && options->codeResources) {
+        options->codeResources->options.document.clear();
+    }
+    bool result = NoThrow(false, [&] { return ZipAppBundle(appPath, archivePath ? archivePath : "", ToArchiverOptions(options)); });
+    if (options && options->codeResources) {
+        options->codeResources->generated = result;
+    }
+    ZipLog::Flush();
+    return result;
+}
+
+static bool ToArchivePatches(const AYZipPatch *patches, size_t count, std::vector<ArchivePatch> &list)
+{
+    if (patches == nullptr && count > 0) {
+        return false;
+    }
+
+    list.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        if (patches[i].path == nullptr) {
+            return false;
+        }
+        list[i].path = patches[i].path;
+        list[i].remove = patches[i].remove;
+        list[i].file = patches[i].file ? patches[i].file : "";
+        list[i].data = static_cast<const uint8_t *>(patches[i].data);
+        list[i].size = patches[i].size;
+        list[i].mode = patches[i].mode;
+    }
+    return true;
+}
+
+bool AYPatchApp(const char *archivePath, const char *outputPath, const AYZipPatch *patches, size_t count, const AYZipOptions *options)
+{
+    std::vector<ArchivePatch> list;
+    if (archivePath == nullptr || !ToArchivePatches(patches, count, list)) {
+        return false;
+    }
+
+    bool result = NoThrow(false, [&] { return PatchAppArchive(archivePath, outputPath ? outputPath : "", list, ToArchiverOptions(options)); });
+    ZipLog::Flush();
+    return result;
+}
+
+bool AYAppendApp(const char *archivePath, const AYZipPatch *patches, size_t count, const AYZipOptions *options)
+{
+    std::vector<ArchivePatch> list;
+    if (archivePath == nullptr || !ToArchivePatches(patches, count, list)) {
+        return false;
+    }
+
+    bool result = NoThrow(false, [&] { return AppendToAppArchive(archivePath, list, ToArchiverOptions(options)); });
+    ZipLog::Flush();
+    return result;
+}
+
+bool AYCompactApp(const char *archivePath, const char *outputPath, const AYZipOptions *options)
+{
+    if (archivePath == nullptr) {
+        return false;
+    }
+
+    bool result = NoThrow(false, [&] { return CompactAppArchive(archivePath, outputPath ? outputPath : "", ToArchiverOptions(options)); });
+    ZipLog::Flush();
+    return result;
+}
+
+bool AYHashAppMachO(const char *archivePath, const AYZipOptions *options)
+{
+    if (archivePath == nullptr || options == nullptr || options->manifest == nullptr) {
+        return false;
+    }
+
+    bool result = NoThrow(false, [&] { return HashArchiveMachO(archivePath, ToArchiverOptions(options)); });
+    ZipLog::Flush();
+    return result;
+}
+
+AYZipBundle *AYZipBundleOpen(const char *archivePath)
+{
+    if (archivePath == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<AYZipBundle> bundle(new AYZipBundle());
+    bool result = NoThrow(false, [&] { return bundle->model.Load(archivePath); });
+    ZipLog::Flush();
+    return result ? bundle.release() : nullptr;
+}
+
+void AYZipBundleClose(AYZipBundle *bundle)
+{
+    delete bundle;
+}
+
+size_t AYZipBundleCount(AYZipBundle *bundle)
+{
+    return bundle ? bundle->model.Entries().size() : 0;
+}
+
+bool AYZipBundleGetEntry(AYZipBundle *bundle, size_t index, AYZipBundleEntry *entry)
+{
+    if (bundle == nullptr || entry == nullptr || index >= bundle->model.Entries().size()) {
+        return false;
+    }
+
+    const BundleModel::Entry &source = bundle->model.Entries()[index];
+    entry->path = source.path.data();
+    entry->type = static_cast<int>(source.type);
+    entry->mode = source.mode;
+    entry->size = source.size;
+    entry->modified = source.modified || source.source < 0;
+    return true;
+}
+
+const void *AYZipBundleRead(AYZipBundle *bundle, const char *path, size_t *size)
+{
+    if (bundle == nullptr || path == nullptr) {
+        return nullptr;
+    }
+
+    bool result = NoThrow(false, [&] { return bundle->model.Read(path, bundle->content); });
+    ZipLog::Flush();
+    if (!result) {
+        return nullptr;
+    }
+    if (size) {
+        *size = bundle->content.size();
+    }
+    // 空内容也返回非 NULL
+    bundle->content.reserve(1);
+    return bundle->content.data();
+}
+
+bool AYZipBundleSetFile(AYZipBundle *bundle, const char *path, const void *data, size_t size, unsigned int mode)
+{
+    if (bundle == nullptr || path == nullptr || (data == nullptr && size > 0)) {
+        return false;
+    }
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    return NoThrow(false, [&] { return bundle->model.SetFile(path, std::vector<uint8_t>(bytes, bytes + size), mode); });
+}
+
+bool AYZipBundleSetSymlink(AYZipBundle *bundle, const char *path, const char *target)
+{
+    if (bundle == nullptr || path == nullptr || target == nullptr) {
+        return false;
+    }
+
+    return NoThrow(false, [&] { return bundle->model.SetSymlink(path, target); });
+}
+
+bool AYZipBundleAddDirectory(AYZipBundle *bundle, const char *path)
+{
+    if (bundle == nullptr || path == nullptr) {
+        return false;
+    }
+
+    return NoThrow(false, [&] { return bundle->model.AddDirectory(path); });
+}
+
+size_t AYZipBundleRemove(AYZipBundle *bundle, const char *path)
+{
+    if (bundle == nullptr || path == nullptr) {
+        return 0;
+    }
+
+    return bundle->model.Remove(path);
+}
+
+bool AYZipBundleSave(AYZipBundle *bundle, const char *archivePath, const AYZipOptions *options)
+{
+    if (bundle == nullptr || archivePath == nullptr) {
+        return false;
+    }
+
+    bool result = NoThrow(false, [&] { return bundle->model.Save(archivePath, ToArchiverOptions(options)); });
+    ZipLog::Flush();
+    return result;
+}
+
+AYArchive *AYArchiveOpen(const char *archivePath, unsigned int cacheBlocks)
+{
+    if (archivePath == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<AYArchive> archive(new AYArchive(cacheBlocks ? cacheBlocks : kArchiveDefaultCacheBlocks));
+    bool result = NoThrow(false, [&] { return archive->reader.Open(archivePath); });
+    ZipLog::Flush();
+    return result ? archive.release() : nullptr;
+}
+
+void AYArchiveClose(AYArchive *archive)
+{
+    delete archive;
+}
+
+void AYArchiveSetCheckpointSpacing(AYArchive *archive, uint64_t spacing)
+{
+    if (archive) {
+        archive->reader.SetCheckpointSpacing(spacing);
+    }
+}
+
+size_t AYArchiveCount(AYArchive *archive)
+{
+    return archive ? archive->reader.Count() : 0;
+}
+
+const AYArchiveEntry *AYArchiveGetEntry(AYArchive *archive, size_t index)
+{
+    if (archive == nullptr || index >= archive->reader.Count()) {
+        return nullptr;
+    }
+    return ToArchiveEntryHandle(&archive->reader.At(index));
+}
+
+const AYArchiveEntry *AYArchiveFind(AYArchive *archive, const char *path)
+{
+    if (archive == nullptr || path == nullptr) {
+        return nullptr;
+    }
+    const ArchiveEntry *entry = archive->reader.Find(path);
+    return entry ? ToArchiveEntryHandle(entry) : nullptr;
+}
+
+bool AYArchiveGetEntryInfo(const AYArchiveEntry *entry, AYArchiveEntryInfo *info)
+{
+    if (entry == nullptr || info == nullptr) {
+        return false;
+    }
+
+    const ArchiveEntry *source = FromArchiveEntryHandle(entry);
+    info->path = source->path.data();
+    info->size = source->size;
+    info->compressedSize = source->compressedSize;
+    info->crc32 = source->crc;
+    info->mode = source->mode;
+    info->compressionMethod = source->method;
+    info->directory = source->directory;
+    return true;
+}
+
+int64_t AYArchiveRead(AYArchive *archive, const AYArchiveEntry *entry, uint64_t offset, void *buffer, size_t size)
+{
+    if (archive == nullptr || entry == nullptr || (buffer == nullptr && size > 0)) {
+        return -1;
+    }
+
+    // 读取很频繁，只在出错时投递日志
+    int64_t result = NoThrow(int64_t(-1), [&] { return archive->reader.Read(*FromArchiveEntryHandle(entry), offset, buffer, size); });
+    if (result < 0) {
+        ZipLog::Flush();
+    }
+    return result;
+}
+
+AYZipStats *AYZipStatsCreate(void)
+{
+    return new AYZipStats();
+}
+
+void AYZipStatsDestroy(AYZipStats *stats)
+{
+    delete stats;
+}
+
+void AYZipStatsReset(AYZipStats *stats)
+{
+    if (stats) {
+        stats->stats.Reset();
+    }
+}
+
+const char *AYZipStatsToJson(AYZipStats *stats)
+{
+    if (stats == nullptr) {
+        return nullptr;
+    }
+
+    stats->json = stats->stats.ToJson();
+    return stats->json.c_str();
+}
+
+AYZipExtractionCache *AYZipExtractionCacheCreate(const char *root, uint64_t budgetBytes, unsigned int cloneMode)
+{
+    if (root == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<AYZipExtractionCache> cache(new AYZipExtractionCache(root, budgetBytes, ToCloneMode(cloneMode)));
+    bool success = cache->cache.Open();
+    ZipLog::Flush();
+    return success ? cache.release() : nullptr;
+}
+
+void AYZipExtractionCacheDestroy(AYZipExtractionCache *cache)
+{
+    delete cache;
+}
+
+void AYZipExtractionCacheSetOptions(AYZipExtractionCache *cache, uint64_t minEntrySize, bool verify)
+{
+    if (cache) {
+        cache->cache.SetMinEntrySize(minEntrySize);
+        cache->cache.SetVerify(verify);
+    }
+}
+
+void AYZipExtractionCacheTrim(AYZipExtractionCache *cache)
+{
+    if (cache) {
+        cache->cache.Trim();
+        ZipLog::Flush();
+    }
+}
+
+void AYZipExtractionCacheResetStats(AYZipExtractionCache *cache)
+{
+    if (cache) {
+        cache->cache.ResetStats();
+    }
+}
+
+const char *AYZipExtractionCacheGetStatsJson(AYZipExtractionCache *cache)
+{
+    if (cache == nullptr) {
+        return nullptr;
+    }
+
+    cache->json = cache->cache.StatsJson();
+    return cache->json.c_str();
+}
+
+AYZipCompressedCache *AYZipCompressedCacheCreate(const char *root, uint64_t budgetBytes)
+{
+    if (root == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<AYZipCompressedCache> cache(new AYZipCompressedCache(root, budgetBytes));
+    bool success = cache->cache.Open();
+    ZipLog::Flush();
+    return success ? cache.release() : nullptr;
+}
+
+void AYZipCompressedCacheDestroy(AYZipCompressedCache *cache)
+{
+    delete cache;
+}
+
+void AYZipCompressedCacheSetMinEntrySize(AYZipCompressedCache *cache, uint64_t minEntrySize)
+{
+    if (cache) {
+        cache->cache.SetMinEntrySize(minEntrySize);
+    }
+}
+
+void AYZipCompressedCacheTrim(AYZipCompressedCache *cache)
+{
+    if (cache) {
+        cache->cache.Trim();
+        ZipLog::Flush();
+    }
+}
+
+void AYZipCompressedCacheResetStats(AYZipCompressedCache *cache)
+{
+    if (cache) {
+        cache->cache.ResetStats();
+    }
+}
+
+const char *AYZipCompressedCacheGetStatsJson(AYZipCompressedCache *cache)
+{
+    if (cache == nullptr) {
+        return nullptr;
+    }
+
+    cache->json = cache->cache.StatsJson();
+    return cache->json.c_str();
+}
+
+AYZipManifest *AYZipManifestCreate(void)
+{
+    return new AYZipManifest();
+}
+
+void AYZipManifestDestroy(AYZipManifest *manifest)
+{
+    delete manifest;
+}
+
+void AYZipManifestReset(AYZipManifest *manifest)
+{
+    if (manifest) {
+        manifest->manifest.Reset();
+    }
+}
+
+size_t AYZipManifestCount(AYZipManifest *manifest)
+{
+    return manifest ? manifest->manifest.Entries().size() : 0;
+}
+
+bool AYZipManifestGetEntry(AYZipManifest *manifest, size_t index, AYZipManifestEntry *entry)
+{
+    if (manifest == nullptr || entry == nullptr || index >= manifest->manifest.Entries().size()) {
+        return false;
+    }
+
+    const ManifestEntry &source = manifest->manifest.Entries()[index];
+    entry->path = source.path.c_str();
+    entry->size = source.size;
+    entry->crc = source.crc;
+    std::copy(source.sha1.begin(), source.sha1.end(), entry->sha1);
+    std::copy(source.sha256.begin(), source.sha256.end(), entry->sha256);
+    return true;
+}
+
+void AYZipManifestSetMachOPageHashes(AYZipManifest *manifest, bool enabled)
+{
+    if (manifest) {
+        manifest->manifest.SetMachOPageHashes(enabled);
+    }
+}
+
+size_t AYZipManifestGetMachOSliceCount(AYZipManifest *manifest, size_t index)
+{
+    if (manifest == nullptr || index >= manifest->manifest.Entries().size()) {
+        return 0;
+    }
+    return manifest->manifest.Entries()[index].machO.size();
+}
+
+// 页哈希以连续的字节数组交给调用方
+static_assert(sizeof(Sha1Digest) == 20 && sizeof(Sha256Digest) == 32, "digest arrays must be tightly packed");
+
+bool AYZipManifestGetMachOSlice(AYZipManifest *manifest, size_t index, size_t slice, AYZipMachOSlice *out)
+{
+    if (manifest == nullptr || out == nullptr || index >= manifest->manifest.Entries().size()) {
+        return false;
+    }
+    const std::vector<MachOSlice> &slices = manifest->manifest.Entries()[index].machO;
+    if (slice >= slices.size()) {
+        return false;
+    }
+
+    const MachOSlice &source = slices[slice];
+    out->cpuType = source.cpuType;
+    out->cpuSubtype = source.cpuSubtype;
+    out->offset = source.offset;
+    out->size = source.size;
+    out->codeLimit = source.codeLimit;
+    out->hasCodeSignature = source.hasCodeSignature;
+    out->pageSize = kMachOPageSize;
+    out->pageCount = source.sha256Pages.size();
+    out->sha1Pages = source.sha1Pages.empty() ? nullptr : source.sha1Pages.front().data();
+    out->sha256Pages = source.sha256Pages.empty() ? nullptr : source.sha256Pages.front().data();
+    return true;
+}
+
+const char *AYZipManifestToJson(AYZipManifest *manifest)
+{
+    if (manifest == nullptr) {
+        return nullptr;
+    }
+
+    manifest->json = manifest->manifest.ToJson();
+    return manifest->json.c_str();
+}
+
+AYZipCodeResources *AYZipCodeResourcesCreate(const char *executable, bool writeToArchive)
+{
+    AYZipCodeResources *codeResources = new AYZipCodeResources();
+    codeResources->options.executable = executable ? executable : "";
+    codeResources->options.writeToArchive = writeToArchive;
+    return codeResources;
+}
+
+void AYZipCodeResourcesDestroy(AYZipCodeResources *codeResources)
+{
+    delete codeResources;
+}
+
+void AYZipCodeResourcesSetNestedCodeCallback(AYZipCodeResources *codeResources, AYZipNestedCodeCallback callback, void *context)
+{
+    if (codeResources == nullptr) {
+        return;
+    }
+    if (callback == nullptr) {
+        codeResources->options.nestedCode = nullptr;
+        return;
+    }
+    codeResources->options.nestedCode = [callback, context](const std::string &path, NestedCodeInfo &info) {
+        const char *requirement = nullptr;
+        if (!callback(context, path.c_str(), info.cdhash.data(), &requirement)) {
+            return false;
+        }
+        info.requirement = requirement ? requirement : "";
+        return true;
+    };
+}
+
+const char *AYZipCodeResourcesGetDocument(AYZipCodeResources *codeResources)
+{
+    if (codeResources == nullptr || !codeResources->generated) {
+        return nullptr;
+    }
+    return codeResources->options.document.c_str();
+}
+
+const char *AYZipAvailableCodecs(void)
+{
+    static const std::string codecs = AvailableZipCodecs();
+    return codecs.c_str();
+}
@@ -6,7 +6,15 @@
 #   define DLL_EXTERN extern
 #endif
 
-#ifdef LIBAYZIP_EXPORTS
+#if !defined(__cplusplus)
+#   include <stdbool.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(_WIN32)
+#define LIBAYZIP_API DLL_EXTERN __attribute__((visibility("default")))
+#elif defined(LIBAYZIP_EXPORTS)
 #define LIBAYZIP_API DLL_EXTERN __declspec(dllexport)
 #else
 #define LIBAYZIP_API DLL_EXTERN __declspec(dllimport)
@@ -15,5 +23,197 @@
 typedef void (*AYZipLogCallback)(const char* level, const char* message);
 LIBAYZIP_API void AYZipInitLog(const char* loggerName, AYZipLogCallback callback);
 
+typedef struct AYZipLogConfig {
+    bool async;                 // 异步模式：调用线程只入队，由后台线程批量回调 callback
+    const char *level;          // 最低级别 "trace"/"debug"/"info"/"warning"/"error"，NULL 或不认识的名字为 "info"，"off" 关闭日志
+    unsigned int queueSize;     // 异步队列容量（条），0 为默认 8192；队列满时丢弃最旧的日志
+} AYZipLogConfig;
+LIBAYZIP_API void AYZipInitLogEx(const char* loggerName, AYZipLogCallback callback, const AYZipLogConfig *config);
+// 异步模式下请求尽快投递已入队的日志（不阻塞）
+LIBAYZIP_API void AYZipFlushLog(void);
+// 投递剩余日志并停止后台线程，卸载 DLL 前调用（不可在 DllMain 中调用）
+LIBAYZIP_API void AYZipShutdownLog(void);
+
 LIBAYZIP_API bool AYUnzipApp(const char *archivePath, const char *appPath);
-LIBAYZIP_API bool AYZipApp(const char *appPath, const char *archivePath);
\ No newline at end of file
+LIBAYZIP_API bool AYZipApp(const char *appPath, const char *archivePath);
+
+// 分阶段耗时与计数统计，多次调用间累计，直到 AYZipStatsReset
+typedef struct AYZipStats AYZipStats;
+LIBAYZIP_API AYZipStats *AYZipStatsCreate(void);
+LIBAYZIP_API void AYZipStatsDestroy(AYZipStats *stats);
+LIBAYZIP_API void AYZipStatsReset(AYZipStats *stats);
+// 返回的字符串由 stats 持有，下次调用 AYZipStatsToJson 或 AYZipStatsDestroy 前有效
+LIBAYZIP_API const char *AYZipStatsToJson(AYZipStats *stats);
+
+// 解压缓存：以条目原始数据的 SHA-256 + CRC + 大小为键在 root 下保存解压后的文件，之后遇到相同内容时按 cloneMode (见 AYZipOptions) 从缓存克隆
+// 缓存不使用硬链接，cloneMode 为 2 时按 0 处理
+// budgetBytes 为 0 时不限大小，超出时按最近使用时间淘汰；root 不可创建时返回 NULL。可在多个线程的解压调用间共用
+typedef struct AYZipExtractionCache AYZipExtractionCache;
+LIBAYZIP_API AYZipExtractionCache *AYZipExtractionCacheCreate(const char *root, uint64_t budgetBytes, unsigned int cloneMode);
+LIBAYZIP_API void AYZipExtractionCacheDestroy(AYZipExtractionCache *cache);
+// minEntrySize：小于该大小的文件不经过缓存 (默认 16KB)；verify：命中时先校验缓存文件的 CRC
+LIBAYZIP_API void AYZipExtractionCacheSetOptions(AYZipExtractionCache *cache, uint64_t minEntrySize, bool verify);
+LIBAYZIP_API void AYZipExtractionCacheTrim(AYZipExtractionCache *cache);
+LIBAYZIP_API void AYZipExtractionCacheResetStats(AYZipExtractionCache *cache);
+// 命中率等统计；返回的字符串由 cache 持有，下次调用或 Destroy 前有效
+LIBAYZIP_API const char *AYZipExtractionCacheGetStatsJson(AYZipExtractionCache *cache);
+
+// 压缩缓存：以文件内容的 SHA-256 + 后端 + 压缩级别为键保存压缩后的数据，再次打包相同的文件时直接写入，不再压缩
+// budgetBytes 为 0 时不限大小，超出时按最近使用时间淘汰；root 不可创建时返回 NULL。可在多个线程的压缩调用间共用
+typedef struct AYZipCompressedCache AYZipCompressedCache;
+LIBAYZIP_API AYZipCompressedCache *AYZipCompressedCacheCreate(const char *root, uint64_t budgetBytes);
+LIBAYZIP_API void AYZipCompressedCacheDestroy(AYZipCompressedCache *cache);
+// 小于该大小的文件不经过缓存 (默认 64KB)
+LIBAYZIP_API void AYZipCompressedCacheSetMinEntrySize(AYZipCompressedCache *cache, uint64_t minEntrySize);
+LIBAYZIP_API void AYZipCompressedCacheTrim(AYZipCompressedCache *cache);
+LIBAYZIP_API void AYZipCompressedCacheResetStats(AYZipCompressedCache *cache);
+// 命中率等统计；返回的字符串由 cache 持有，下次调用或 Destroy 前有效
+LIBAYZIP_API const char *AYZipCompressedCacheGetStatsJson(AYZipCompressedCache *cache);
+
+// 内容清单：压缩/解压时顺带计算每个普通文件的摘要，多次调用间累计，直到 AYZipManifestReset
+typedef struct AYZipManifest AYZipManifest;
+typedef struct AYZipManifestEntry {
+    const char *path;           // zip 内路径 (UTF-8)，由 manifest 持有，Reset / Destroy 前有效
+    uint64_t size;
+    uint32_t crc;
+    uint8_t sha1[20];
+    uint8_t sha256[32];
+} AYZipManifestEntry;
+LIBAYZIP_API AYZipManifest *AYZipManifestCreate(void);
+LIBAYZIP_API void AYZipManifestDestroy(AYZipManifest *manifest);
+LIBAYZIP_API void AYZipManifestReset(AYZipManifest *manifest);
+// 条目按归档中的顺序排列
+LIBAYZIP_API size_t AYZipManifestCount(AYZipManifest *manifest);
+LIBAYZIP_API bool AYZipManifestGetEntry(AYZipManifest *manifest, size_t index, AYZipManifestEntry *entry);
+// 返回的字符串由 manifest 持有，下次调用 AYZipManifestToJson 或 AYZipManifestDestroy 前有效
+LIBAYZIP_API const char *AYZipManifestToJson(AYZipManifest *manifest);
+
+// Mach-O 切片的代码目录页哈希 (4KB 一页)，覆盖切片的 [0, codeLimit)
+typedef struct AYZipMachOSlice {
+    uint32_t cpuType;
+    uint32_t cpuSubtype;
+    uint64_t offset;            // 切片在文件中的偏移，非 fat 文件为 0
+    uint64_t size;
+    uint64_t codeLimit;         // 已签名时为 LC_CODE_SIGNATURE 的 dataoff，否则为切片大小
+    bool hasCodeSignature;
+    uint32_t pageSize;
+    size_t pageCount;
+    const uint8_t *sha1Pages;   // pageCount * 20 字节，由 manifest 持有
+    const uint8_t *sha256Pages; // pageCount * 32 字节，由 manifest 持有
+} AYZipMachOSlice;
+// 开启后，解压 (或 AYHashAppMachO) 时 Mach-O 文件额外计算各切片的页哈希；第 0 页含加载命令，签名改写头部后需重新计算
+LIBAYZIP_API void AYZipManifestSetMachOPageHashes(AYZipManifest *manifest, bool enabled);
+LIBAYZIP_API size_t AYZipManifestGetMachOSliceCount(AYZipManifest *manifest, size_t index);
+LIBAYZIP_API bool AYZipManifestGetMachOSlice(AYZipManifest *manifest, size_t index, size_t slice, AYZipMachOSlice *out);
+
+// 压缩时在同一遍读取中生成 _CodeSignature/CodeResources (files / files2 / rules / rules2)
+typedef struct AYZipCodeResources AYZipCodeResources;
+// 嵌套代码 (Frameworks/ 下的 .framework、PlugIns/ 下的 .appex、dylib 等) 的 cdhash 与指定要求，path 为包内相对路径
+// 返回 false 时该项不写入 files2；*requirement 只需在回调返回前有效
+typedef bool (*AYZipNestedCodeCallback)(void *context, const char *path, uint8_t cdhash[20], const char **requirement);
+// executable 为 NULL 时读取 Info.plist 的 CFBundleExecutable；writeToArchive 为 true 时文档作为最后一个条目写入 ipa，替换包内原有的 CodeResources
+LIBAYZIP_API AYZipCodeResources *AYZipCodeResourcesCreate(const char *executable, bool writeToArchive);
+LIBAYZIP_API void AYZipCodeResourcesDestroy(AYZipCodeResources *codeResources);
+LIBAYZIP_API void AYZipCodeResourcesSetNestedCodeCallback(AYZipCodeResources *codeResources, AYZipNestedCodeCallback callback, void *context);
+// 最近一次 AYZipAppEx 生成的 XML plist，尚未生成时返回 NULL；字符串由 codeResources 持有
+LIBAYZIP_API const char *AYZipCodeResourcesGetDocument(AYZipCodeResources *codeResources);
+
+typedef struct AYZipOptions {
+    AYZipStats *stats;      // 可为 NULL
+    const char *tracePath;  // 可为 NULL，非空时将 Chrome trace JSON 写入该路径 (chrome://tracing / ui.perfetto.dev)
+    const char *codec;      // 可为 NULL，deflate/inflate 后端："zlib"/"zlib-ng"/"libdeflate"/"isal"/"auto"/"minizip"，NULL 为 "zlib"
+    unsigned int scanThreads;   // 压缩时并行列目录的线程数，0 为按 CPU 数选择，1 为单线程；条目顺序与线程数无关
+    bool deterministic;         // 压缩时生成可复现的 ipa：固定时间戳与权限、固定压缩参数，相同输入得到逐字节相同的输出
+    AYZipManifest *manifest;    // 可为 NULL，非空时把本次处理的文件的 SHA-1 / SHA-256 / CRC 追加到清单
+    AYZipCodeResources *codeResources;  // 可为 NULL，仅压缩时使用
+    // 解压时额外铺到这些目录 (不存在时创建)：只解压一次，其他目录从第一个目录克隆
+    const char *const *extraDestinations;
+    size_t extraDestinationCount;
+    // 0 自动 (reflink，不支持时复制)；1 reflink (同自动，不支持时记录日志)；2 硬链接 (目录间共享文件，原地修改会互相影响)；3 复制
+    unsigned int cloneMode;
+    AYZipExtractionCache *extractionCache;  // 可为 NULL，仅解压时使用
+    AYZipCompressedCache *compressedCache;  // 可为 NULL，仅压缩时使用；codec 为 "minizip" 时不使用
+    // 增量解压到已有目录：与上次解压 (边车索引) 相比未改变的文件跳过，新包中已没有的文件删除
+    bool incremental;
+    const char *incrementalIndexPath;   // 可为 NULL，默认为 <appPath>.ayzip-index
+    // 解压出的文件与目录默认恢复为条目中记录的修改时间，为 true 时保留解压时的当前时间
+    bool keepCurrentTimestamps;
+} AYZipOptions;
+
+// 已编译的后端名，逗号分隔；AYZipOptions.codec 指定未编译的后端时调用失败
+LIBAYZIP_API const char *AYZipAvailableCodecs(void);
+
+LIBAYZIP_API bool AYUnzipAppEx(const char *archivePath, const char *appPath, const AYZipOptions *options);
+LIBAYZIP_API bool AYZipAppEx(const char *appPath, const char *archivePath, const AYZipOptions *options);
+// 对 ipa 的少量条目打补丁：已存在的路径替换 (保持原位置)，不存在的追加到末尾，其余条目原样复制压缩数据
+typedef struct AYZipPatch {
+    const char *path;           // zip 内路径 (UTF-8)，如 "Payload/Example.app/embedded.mobileprovision"
+    bool remove;                // 删除该条目；以 '/' 结尾时删除该目录及其下所有条目
+    const char *file;           // 新内容取自本地文件，为 NULL 时取自 data / size
+    const void *data;
+    size_t size;
+    unsigned int mode;          // unix 权限 (如 0755)，0 时沿用原条目，新增条目为 0644
+} AYZipPatch;
+// outputPath 为 NULL 时原地替换 archivePath；失败时原文件不变
+LIBAYZIP_API bool AYPatchApp(const char *archivePath, const char *outputPath, const AYZipPatch *patches, size_t count, const AYZipOptions *options);
+// 原地追加补丁，只重写文件尾部的中央目录；被替换或删除的条目数据留在包内，失败时恢复原中央目录
+LIBAYZIP_API bool AYAppendApp(const char *archivePath, const AYZipPatch *patches, size_t count, const AYZipOptions *options);
+// 重写 ipa，去掉 AYAppendApp 留下的空洞；outputPath 为 NULL 时原地替换
+LIBAYZIP_API bool AYCompactApp(const char *archivePath, const char *outputPath, const AYZipOptions *options);
+// 不解压到磁盘，直接从 ipa 读取 Mach-O 条目计算页哈希，结果追加到 options->manifest (必填)
+LIBAYZIP_API bool AYHashAppMachO(const char *archivePath, const AYZipOptions *options);
+
+// 内存中的 ipa：载入后增删改条目再写回，重签名时不经过磁盘；未修改的条目写回时原样复制压缩数据
+// 同一 bundle 不可在多个线程上同时使用
+typedef struct AYZipBundle AYZipBundle;
+typedef struct AYZipBundleEntry {
+    const char *path;           // zip 内路径，由 bundle 持有，AYZipBundleClose 或写回载入路径前有效；目录以 '/' 结尾
+    int type;                   // 0 文件，1 目录，2 符号链接
+    unsigned int mode;          // unix mode，含类型位
+    uint64_t size;              // 解压后大小
+    bool modified;              // 载入后新增或修改过
+} AYZipBundleEntry;
+// 只读入中央目录，ipa 保持打开直到 AYZipBundleClose，条目数据读取或写回时才从文件读取；失败返回 NULL
+LIBAYZIP_API AYZipBundle *AYZipBundleOpen(const char *archivePath);
+LIBAYZIP_API void AYZipBundleClose(AYZipBundle *bundle);
+// 条目按原包顺序，新增条目在末尾；删除条目后下标会变化
+LIBAYZIP_API size_t AYZipBundleCount(AYZipBundle *bundle);
+LIBAYZIP_API bool AYZipBundleGetEntry(AYZipBundle *bundle, size_t index, AYZipBundleEntry *entry);
+// 解压条目内容 (符号链接为目标)；返回的数据由 bundle 持有，下次调用 AYZipBundleRead 或 AYZipBundleClose 前有效，失败返回 NULL
+LIBAYZIP_API const void *AYZipBundleRead(AYZipBundle *bundle, const char *path, size_t *size);
+// 路径已存在时替换 (保持原位置)，数据被复制；mode 为 0 时沿用原条目权限，新增文件为 0644
+LIBAYZIP_API bool AYZipBundleSetFile(AYZipBundle *bundle, const char *path, const void *data, size_t size, unsigned int mode);
+LIBAYZIP_API bool AYZipBundleSetSymlink(AYZipBundle *bundle, const char *path, const char *target);
+// path 须以 '/' 结尾
+LIBAYZIP_API bool AYZipBundleAddDirectory(AYZipBundle *bundle, const char *path);
+// 以 '/' 结尾时删除该目录及其下所有条目，返回删除的条目数
+LIBAYZIP_API size_t AYZipBundleRemove(AYZipBundle *bundle, const char *path);
+// 先写 archivePath + ".partial"，成功后改名；可以写回载入时的路径，之后 bundle 改为重新载入写出的 ipa
+LIBAYZIP_API bool AYZipBundleSave(AYZipBundle *bundle, const char *archivePath, const AYZipOptions *options);
+
+// 按需读取 ipa 中的单个条目：打开时只读中央目录，读取时才解压，最近解压的 64KB 块缓存在句柄内
+// 同一句柄不可在多个线程上同时使用，多个句柄之间互不影响
+typedef struct AYArchive AYArchive;
+typedef struct AYArchiveEntry AYArchiveEntry;
+typedef struct AYArchiveEntryInfo {
+    const char *path;           // zip 内路径，由句柄持有，AYArchiveClose 前有效
+    uint64_t size;              // 解压后大小
+    uint64_t compressedSize;
+    uint32_t crc32;
+    unsigned int mode;          // unix mode，Windows 生成的条目为 0
+    int compressionMethod;      // 0 存储，8 deflate；其他方法与加密条目不能读取
+    bool directory;
+} AYArchiveEntryInfo;
+// cacheBlocks 为缓存的解压块数，0 为默认 64 (4MB)；失败返回 NULL
+LIBAYZIP_API AYArchive *AYArchiveOpen(const char *archivePath, unsigned int cacheBlocks);
+LIBAYZIP_API void AYArchiveClose(AYArchive *archive);
+// 大于两个间隔的 deflate 条目在解压时每隔 spacing 字节记录一个检查点 (32KB)，之后的随机读取从最近的检查点开始解压
+// 默认 1MB，0 为关闭；修改时丢弃已记录的检查点
+LIBAYZIP_API void AYArchiveSetCheckpointSpacing(AYArchive *archive, uint64_t spacing);
+LIBAYZIP_API size_t AYArchiveCount(AYArchive *archive);
+// 返回的条目由句柄持有，AYArchiveClose 前有效；不存在时返回 NULL
+LIBAYZIP_API const AYArchiveEntry *AYArchiveGetEntry(AYArchive *archive, size_t index);
+LIBAYZIP_API const AYArchiveEntry *AYArchiveFind(AYArchive *archive, const char *path);
+LIBAYZIP_API bool AYArchiveGetEntryInfo(const AYArchiveEntry *entry, AYArchiveEntryInfo *info);
+// 读取解压后 [offset, offset + size) 的数据，返回读取的字节数 (越过条目末尾时较少)，出错返回 -1
+LIBAYZIP_API int64_t AYArchiveRead(AYArchive *archive, const AYArchiveEntry *entry, uint64_t offset, void *buffer, size_t size);
@@ -0,0 +1,377 @@
+﻿//
+//  ArchiveReader.cpp
+//  libAYZip
+//
+
+#include "ArchiveReader.hpp"
+#include "Crc32.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+#include <spdlog/AYLog.h>
+
+constexpr uint64_t kUnknownDataOffset = std::numeric_limits<uint64_t>::max();
+constexpr size_t kNoEntry = std::numeric_limits<size_t>::max();
+constexpr size_t kInputBufSize = 64 * 1024;
+constexpr uint16_t kMethodStored = 0;
+constexpr uint16_t kMethodDeflate = 8;
+constexpr uint8_t kHostSystemUnix = 3;
+constexpr size_t kInflateWindowSize = 32 * 1024;
+
+// 当前解压中的条目；读取位置只能向后移动，向前跳时从头或从检查点开始
+struct ArchiveReader::Cursor {
+    z_stream stream;
+    bool initialized = false;
+    size_t entry = kNoEntry;
+    uint64_t input = 0;             // 下一段压缩数据的文件偏移
+    uint64_t inputRemaining = 0;
+    uint64_t position = 0;          // 已解压的字节数；从检查点开始时先解压到下一个块边界
+    uint32_t crc = 0;
+    bool crcValid = false;          // 从条目开头解压时才能校验 CRC
+    std::unique_ptr<uint8_t[]> inputBuf;
+
+    Cursor()
+    {
+        memset(&stream, 0, sizeof(stream));
+    }
+
+    ~Cursor()
+    {
+        if (initialized) {
+            inflateEnd(&stream);
+        }
+    }
+};
+
+static uint64_t BlockKey(size_t entry, uint64_t block)
+{
+    return (static_cast<uint64_t>(entry) << 40) | block;
+}
+
+ArchiveReader::ArchiveReader(size_t cacheBlocks, uint64_t checkpointSpacing)
+    : cacheBlocks_(std::max<size_t>(cacheBlocks, 1)), cursor_(new Cursor()), checkpointSpacing_(checkpointSpacing)
+{
+}
+
+ArchiveReader::~ArchiveReader()
+{
+}
+
+bool ArchiveReader::Open(const std::string &archivePath)
+{
+    if (!ReadZipCentralDirectory(archivePath, directory_)) {
+        AYError("ArchiveReader: read central directory failed: {}", archivePath);
+        return false;
+    }
+    file_.open(archivePath, std::ios::binary);
+    if (!file_) {
+        AYError("ArchiveReader: open {} failed", archivePath);
+        return false;
+    }
+    archivePath_ = archivePath;
+
+    entries_.resize(directory_.records.size());
+    dataOffsets_.assign(entries_.size(), kUnknownDataOffset);
+    index_.reserve(entries_.size());
+    for (size_t i = 0; i < entries_.size(); i++) {
+        const ZipCentralRecord &record = directory_.records[i];
+        ArchiveEntry &entry = entries_[i];
+        entry.path = record.name;
+        entry.index = i;
+        entry.method = record.method;
+        entry.crc = record.crc;
+        entry.compressedSize = record.compressedSize;
+        entry.size = record.uncompressedSize;
+        entry.mode = (record.versionMadeBy >> 8) == kHostSystemUnix ? (record.externalAttributes >> 16) : 0;
+        entry.directory = !record.name.empty() && record.name.back() == '/';
+        entry.encrypted = (record.flags & 1) != 0;
+        index_[entry.path] = i;
+    }
+    return true;
+}
+
+void ArchiveReader::SetCheckpointSpacing(uint64_t spacing)
+{
+    checkpointSpacing_ = spacing;
+    checkpoints_.clear();
+    cursor_->entry = kNoEntry;
+}
+
+const ArchiveEntry *ArchiveReader::Find(const std::string &path) const
+{
+    auto it = index_.find(path);
+    return it != index_.end() ? &entries_[it->second] : nullptr;
+}
+
+bool ArchiveReader::ReadFile(uint64_t offset, void *buffer, size_t size)
+{
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(offset));
+    file_.read(static_cast<char *>(buffer), static_cast<std::streamsize>(size));
+    return static_cast<size_t>(file_.gcount()) == size;
+}
+
+bool ArchiveReader::DataOffset(const ArchiveEntry &entry, uint64_t *offset)
+{
+    uint64_t &cached = dataOffsets_[entry.index];
+    if (cached == kUnknownDataOffset) {
+        const ZipCentralRecord &record = directory_.records[entry.index];
+        if (!ReadZipEntryDataOffset(file_, record, &cached) || cached > directory_.offset ||
+            directory_.offset - cached < record.compressedSize) {
+            cached = kUnknownDataOffset;
+            AYError("ArchiveReader: bad local header: {}", record.name);
+            return false;
+        }
+    }
+    *offset = cached;
+    return true;
+}
+
+int64_t ArchiveReader::Read(const ArchiveEntry &entry, uint64_t offset, void *buffer, size_t size)
+{
+    if (entry.index >= entries_.size() || &entries_[entry.index] != &entry) {
+        return -1;
+    }
+    if (entry.encrypted || (entry.method != kMethodStored && entry.method != kMethodDeflate)) {
+        AYError("ArchiveReader: unsupported entry (method {}, flags encrypted {}): {}", entry.method, entry.encrypted, std::string(entry.path));
+        return -1;
+    }
+    if (offset >= entry.size || size == 0) {
+        return 0;
+    }
+    size = static_cast<size_t>(std::min<uint64_t>(size, entry.size - offset));
+
+    uint64_t dataOffset = 0;
+    if (!DataOffset(entry, &dataOffset)) {
+        return -1;
+    }
+    // 存储的条目直接读文件，由系统缓存负责
+    if (entry.method == kMethodStored) {
+        if (entry.compressedSize != entry.size || !ReadFile(dataOffset + offset, buffer, size)) {
+            return -1;
+        }
+        return static_cast<int64_t>(size);
+    }
+
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    size_t total = 0;
+    while (total < size) {
+        uint64_t block = offset / kArchiveBlockSize;
+        const std::vector<uint8_t> *data = Block(entry, block);
+        if (data == nullptr) {
+            return -1;
+        }
+        size_t within = static_cast<size_t>(offset - block * kArchiveBlockSize);
+        if (within >= data->size()) {
+            return -1;
+        }
+        size_t n = std::min(size - total, data->size() - within);
+        memcpy(out + total, data->data() + within, n);
+        total += n;
+        offset += n;
+    }
+    return static_cast<int64_t>(total);
+}
+
+const std::vector<uint8_t> *ArchiveReader::Block(const ArchiveEntry &entry, uint64_t block)
+{
+    auto hit = cache_.find(BlockKey(entry.index, block));
+    if (hit != cache_.end()) {
+        lru_.splice(lru_.begin(), lru_, hit->second);
+        return &hit->second->data;
+    }
+
+    // 当前的解压流在目标之前、且之间没有检查点时接着解压，否则从最近的检查点或条目开头开始
+    Cursor &cursor = *cursor_;
+    uint64_t target = block * kArchiveBlockSize;
+    const Checkpoint *checkpoint = NearestCheckpoint(entry, target);
+    if (cursor.entry != entry.index || cursor.position > target || (checkpoint && checkpoint->out > cursor.position)) {
+        if (!(checkpoint ? Restore(entry, *checkpoint) : Rewind(entry))) {
+            cursor.entry = kNoEntry;
+            return nullptr;
+        }
+    }
+    // 经过的块一并放入缓存，最后放入的正是所需的块；检查点到下一个块边界之间的数据不缓存
+    while (true) {
+        bool aligned = cursor.position % kArchiveBlockSize == 0;
+        uint64_t current = cursor.position / kArchiveBlockSize;
+        std::vector<uint8_t> data;
+        if (!InflateNext(entry, data)) {
+            cursor.entry = kNoEntry;
+            return nullptr;
+        }
+        if (!aligned) {
+            continue;
+        }
+        Insert(BlockKey(entry.index, current), std::move(data));
+        if (current == block) {
+            return &lru_.front().data;
+        }
+    }
+}
+
+static bool ResetInflater(z_stream &stream, bool &initialized)
+{
+    if (!initialized) {
+        initialized = inflateInit2(&stream, -MAX_WBITS) == Z_OK;
+        return initialized;
+    }
+    return inflateReset(&stream) == Z_OK;
+}
+
+bool ArchiveReader::Rewind(const ArchiveEntry &entry)
+{
+    Cursor &cursor = *cursor_;
+    cursor.entry = kNoEntry;
+    uint64_t dataOffset = 0;
+    if (!ResetInflater(cursor.stream, cursor.initialized) || !DataOffset(entry, &dataOffset)) {
+        return false;
+    }
+    if (!cursor.inputBuf) {
+        cursor.inputBuf.reset(new uint8_t[kInputBufSize]);
+    }
+
+    cursor.stream.next_in = nullptr;
+    cursor.stream.avail_in = 0;
+    cursor.entry = entry.index;
+    cursor.input = dataOffset;
+    cursor.inputRemaining = entry.compressedSize;
+    cursor.position = 0;
+    cursor.crc = 0;
+    cursor.crcValid = true;
+    return true;
+}
+
+// 与 zran 相同：先补回检查点所在字节中未消耗的位，再设置窗口
+bool ArchiveReader::Restore(const ArchiveEntry &entry, const Checkpoint &checkpoint)
+{
+    Cursor &cursor = *cursor_;
+    cursor.entry = kNoEntry;
+    uint64_t dataOffset = 0;
+    if (!ResetInflater(cursor.stream, cursor.initialized) || !DataOffset(entry, &dataOffset)) {
+        return false;
+    }
+    if (!cursor.inputBuf) {
+        cursor.inputBuf.reset(new uint8_t[kInputBufSize]);
+    }
+    if (checkpoint.bits > 0) {
+        uint8_t byte = 0;
+        if (!ReadFile(checkpoint.in - 1, &byte, 1) || inflatePrime(&cursor.stream, checkpoint.bits, byte >> (8 - checkpoint.bits)) != Z_OK) {
+            return false;
+        }
+    }
+    if (inflateSetDictionary(&cursor.stream, checkpoint.window.data(), static_cast<uInt>(checkpoint.window.size())) != Z_OK) {
+        return false;
+    }
+
+    cursor.stream.next_in = nullptr;
+    cursor.stream.avail_in = 0;
+    cursor.entry = entry.index;
+    cursor.input = checkpoint.in;
+    cursor.inputRemaining = dataOffset + entry.compressedSize - checkpoint.in;
+    cursor.position = checkpoint.out;
+    cursor.crc = 0;
+    cursor.crcValid = false;
+    return true;
+}
+
+bool ArchiveReader::Indexed(const ArchiveEntry &entry) const
+{
+    return checkpointSpacing_ > 0 && entry.size / 2 > checkpointSpacing_;
+}
+
+const ArchiveReader::Checkpoint *ArchiveReader::NearestCheckpoint(const ArchiveEntry &entry, uint64_t position) const
+{
+    auto it = checkpoints_.find(entry.index);
+    if (it == checkpoints_.end()) {
+        return nullptr;
+    }
+    const std::vector<Checkpoint> &points = it->second;
+    auto next = std::upper_bound(points.begin(), points.end(), position, [](uint64_t value, const Checkpoint &point) {
+        return value < point.out;
+    });
+    return next == points.begin() ? nullptr : &*(next - 1);
+}
+
+// 只在已记录的最后一个检查点之后至少一个间隔处追加，重复解压已覆盖的范围时不会重复记录
+void ArchiveReader::RecordCheckpoint(const ArchiveEntry &entry, uint64_t out)
+{
+    std::vector<Checkpoint> &points = checkpoints_[entry.index];
+    uint64_t last = points.empty() ? 0 : points.back().out;
+    if (out < last + checkpointSpacing_) {
+        return;
+    }
+
+    Cursor &cursor = *cursor_;
+    Checkpoint point;
+    point.out = out;
+    point.in = cursor.input - cursor.stream.avail_in;
+    point.bits = cursor.stream.data_type & 7;
+    point.window.resize(kInflateWindowSize);
+    uInt length = static_cast<uInt>(point.window.size());
+    if (inflateGetDictionary(&cursor.stream, point.window.data(), &length) != Z_OK) {
+        return;
+    }
+    point.window.resize(length);
+    points.push_back(std::move(point));
+}
+
+// 解压到下一个块边界 (或条目末尾)；需要记录检查点时以 Z_BLOCK 在每个 deflate 块结束处停下
+bool ArchiveReader::InflateNext(const ArchiveEntry &entry, std::vector<uint8_t> &data)
+{
+    Cursor &cursor = *cursor_;
+    uint64_t blockEnd = (cursor.position / kArchiveBlockSize + 1) * kArchiveBlockSize;
+    data.resize(static_cast<size_t>(std::min(blockEnd, entry.size) - cursor.position));
+    bool indexing = Indexed(entry);
+    z_stream &stream = cursor.stream;
+    stream.next_out = data.data();
+    stream.avail_out = static_cast<uInt>(data.size());
+    while (stream.avail_out > 0) {
+        if (stream.avail_in == 0) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(kInputBufSize, cursor.inputRemaining));
+            if (n == 0 || !ReadFile(cursor.input, cursor.inputBuf.get(), n)) {
+                break;
+            }
+            cursor.input += n;
+            cursor.inputRemaining -= n;
+            stream.next_in = cursor.inputBuf.get();
+            stream.avail_in = static_cast<uInt>(n);
+        }
+        int ret = inflate(&stream, indexing ? Z_BLOCK : Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            break;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            break;
+        }
+        // bit 7：刚结束一个 deflate 块；bit 6：正在解压最后一个块
+        if (indexing && (stream.data_type & 128) && !(stream.data_type & 64)) {
+            RecordCheckpoint(entry, cursor.position + (data.size() - stream.avail_out));
+        }
+    }
+    if (stream.avail_out != 0) {
+        AYError("ArchiveReader: corrupt deflate data: {}", std::string(entry.path));
+        return false;
+    }
+
+    if (cursor.crcValid) {
+        cursor.crc = Crc32Update(cursor.crc, data.data(), data.size());
+    }
+    cursor.position += data.size();
+    if (cursor.crcValid && cursor.position == entry.size && cursor.crc != entry.crc) {
+        AYError("ArchiveReader: CRC mismatch: {}", std::string(entry.path));
+        return false;
+    }
+    return true;
+}
+
+void ArchiveReader::Insert(uint64_t key, std::vector<uint8_t> &&data)
+{
+    while (lru_.size() >= cacheBlocks_) {
+        cache_.erase(lru_.back().key);
+        lru_.pop_back();
+    }
+    lru_.push_front(CachedBlock{key, std::move(data)});
+    cache_[key] = lru_.begin();
+}
@@ -0,0 +1,105 @@
+﻿//
+//  ArchiveReader.hpp
+//  libAYZip
+//
+//  按需读取 ipa 中的单个条目：打开时只解析中央目录，按名称哈希查找，读取时才解压
+//  deflate 条目按块解压，最近使用的块缓存在 LRU 中；向后顺序读取时沿用同一个解压流
+//  大条目解压时每隔一段记录检查点 (解压状态 + 32KB 窗口，同 zlib 的 zran 示例)，之后的随机读取从最近的检查点开始
+//
+
+#ifndef ArchiveReader_hpp
+#define ArchiveReader_hpp
+
+#include "ZipCentralDirectory.hpp"
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+constexpr size_t kArchiveBlockSize = 64 * 1024;
+constexpr size_t kArchiveDefaultCacheBlocks = 64;      // 4MB
+// 每个检查点占 32KB，间隔 1MB 时约为条目大小的 3%
+constexpr uint64_t kArchiveDefaultCheckpointSpacing = 1024 * 1024;
+
+struct ArchiveEntry {
+    std::string_view path;          // 指向中央目录记录中的名字，以 '\0' 结尾
+    size_t index = 0;
+    uint16_t method = 0;            // 0 存储，8 deflate，其他方法不支持读取
+    uint32_t crc = 0;
+    uint64_t compressedSize = 0;
+    uint64_t size = 0;
+    uint32_t mode = 0;              // unix mode，Windows 生成的条目为 0
+    bool directory = false;
+    bool encrypted = false;
+};
+
+class ArchiveReader
+{
+public:
+    // checkpointSpacing 为 0 时不记录检查点，只对大于两个间隔的条目记录
+    explicit ArchiveReader(size_t cacheBlocks = kArchiveDefaultCacheBlocks, uint64_t checkpointSpacing = kArchiveDefaultCheckpointSpacing);
+    ~ArchiveReader();
+    ArchiveReader(const ArchiveReader &) = delete;
+    ArchiveReader &operator=(const ArchiveReader &) = delete;
+
+    // 保持文件打开直到析构；要求与 ReadZipCentralDirectory 相同的布局
+    bool Open(const std::string &archivePath);
+
+    size_t Count() const { return entries_.size(); }
+    const ArchiveEntry &At(size_t index) const { return entries_[index]; }
+    // 同名条目以中央目录中最后一个为准
+    const ArchiveEntry *Find(const std::string &path) const;
+
+    // 修改间隔时丢弃已记录的检查点
+    void SetCheckpointSpacing(uint64_t spacing);
+
+    // 读取解压后 [offset, offset + size) 的数据，返回读取的字节数 (越过条目末尾时少于 size)，出错返回 -1
+    // 读到条目末尾时校验 CRC；共用一个文件句柄与解压流，不可并发调用
+    int64_t Read(const ArchiveEntry &entry, uint64_t offset, void *buffer, size_t size);
+
+private:
+    struct Cursor;
+    struct CachedBlock {
+        uint64_t key;
+        std::vector<uint8_t> data;
+    };
+    // deflate 块边界处的解压状态：从 in 处 (前一字节的高 bits 位) 继续即可得到 out 之后的数据
+    struct Checkpoint {
+        uint64_t out = 0;
+        uint64_t in = 0;            // 文件偏移
+        int bits = 0;
+        std::vector<uint8_t> window;
+    };
+
+    bool DataOffset(const ArchiveEntry &entry, uint64_t *offset);
+    bool ReadFile(uint64_t offset, void *buffer, size_t size);
+    const std::vector<uint8_t> *Block(const ArchiveEntry &entry, uint64_t block);
+    bool Rewind(const ArchiveEntry &entry);
+    bool Restore(const ArchiveEntry &entry, const Checkpoint &checkpoint);
+    const Checkpoint *NearestCheckpoint(const ArchiveEntry &entry, uint64_t position) const;
+    bool Indexed(const ArchiveEntry &entry) const;
+    bool InflateNext(const ArchiveEntry &entry, std::vector<uint8_t> &data);
+    void RecordCheckpoint(const ArchiveEntry &entry, uint64_t out);
+    void Insert(uint64_t key, std::vector<uint8_t> &&data);
+
+    std::string archivePath_;
+    std::ifstream file_;
+    ZipCentralDirectory directory_;
+    std::vector<ArchiveEntry> entries_;
+    std::vector<uint64_t> dataOffsets_;         // 首次读取时从本地头取得
+    std::unordered_map<std::string_view, size_t> index_;
+
+    size_t cacheBlocks_;
+    std::list<CachedBlock> lru_;                // 最近使用的在前
+    std::unordered_map<uint64_t, std::list<CachedBlock>::iterator> cache_;
+    std::unique_ptr<Cursor> cursor_;
+
+    uint64_t checkpointSpacing_;
+    std::unordered_map<size_t, std::vector<Checkpoint>> checkpoints_;   // 按 out 递增，随解压进度增加
+};
+
+#endif /* ArchiveReader_hpp */
@@ -7,16 +7,41 @@
 //
 
 #include "Archiver.hpp"
+#include "ArchiverStats.hpp"
+#include "BundleModel.hpp"
+#include "BundleScanner.hpp"
+#include "CodeResources.hpp"
+#include "CompressedEntryCache.hpp"
+#include "ContentManifest.hpp"
+#include "ExtractionCache.hpp"
+#include "ExtractionIndex.hpp"
+#include "FileCloner.hpp"
+#include "FileTimes.hpp"
+#include "MachOPageHasher.hpp"
+#include "PathConverter.hpp"
+#include "TraceEvents.hpp"
+#include "ZipCodec.hpp"
+#include "ZipCentralDirectory.hpp"
+#include "ZipLog.hpp"
 #include <chrono>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <spdlog/AYLog.h>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
 namespace fs = std::filesystem;
 
 extern "C" {
 #include <minizip-ng/mz.h>
 #include <minizip-ng/mz_strm.h>
+#include <minizip-ng/mz_strm_os.h>
 #include <minizip-ng/mz_zip.h>
 #include <minizip-ng/mz_zip_rw.h>
 }
@@ -27,7 +52,7 @@ extern "C" {
 constexpr size_t kZipBufSize = 64 * 1024;  // 64KB
 constexpr int kZipMaxPath = 512;
 
-
+#ifdef _WIN32
 static const uint32_t S_IRUSR = 0400;     // owner_read
 static const uint32_t S_IWUSR = 0200;     // owner_write
 static const uint32_t S_IXUSR = 0100;     // owner_exec
@@ -44,74 +69,100 @@ static const uint32_t S_IRWXO = 07;       // others_all
 static const uint32_t S_ISUID = 04000;    // set_uid
 static const uint32_t S_ISGID = 02000;    // set_gid
 static const uint32_t S_ISVTX = 01000;    // sticky_bit
+#endif
 
+// 符号链接目标的最大长度
+constexpr size_t kZipMaxLinkTarget = 4096;
 
-static bool endsWith(const std::string &str, const std::string &suffix)
+// 小于该大小的条目整块读取、整块解压、一次写出
+constexpr uint64_t kZipSmallEntrySize = 1024 * 1024;  // 1MB
+// 压缩缓存可用时整块读入的文件大小上限，更大的文件需要为摘要多读一遍
+constexpr uint64_t kZipWholeReadSize = 64 * 1024 * 1024;  // 64MB
+
+// 整块解压、压缩时整块读入文件使用的缓冲区，在条目间复用
+struct ExtractBuffers {
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> uncompressed;
+};
+
+
+// 单次 UnzipAppBundle / ZipAppBundle 调用内各辅助函数共享的状态
+struct ArchiverContext {
+    ArchiverStats *stats = nullptr;
+    TraceRecorder *trace = nullptr;
+    const ZipCodec *codec = nullptr;    // 为空时走 minizip 内部的压缩/解压与 CRC
+    ExtractBuffers *buffers = nullptr;
+    bool deterministic = false;         // 见 ArchiverOptions::deterministic
+    ManifestHasher *hasher = nullptr;   // 非空时每个文件的数据交给它计算摘要
+    CodeResourcesBuilder *codeResources = nullptr;  // 非空时记录符号链接，文件摘要在压缩结束后从清单取得
+    ExtractionCache *cache = nullptr;   // 见 ArchiverOptions::extractionCache
+    CompressedEntryCache *entryCache = nullptr;     // 见 ArchiverOptions::compressedEntryCache，只在 codec 非空时使用
+};
+
+static ManifestHasher::Job *BeginManifestFile(const ArchiverContext &ctx, const std::string &path)
 {
-    return str.size() >= suffix.size() && 0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix);
+    return ctx.hasher ? ctx.hasher->Begin(path) : nullptr;
 }
 
-static bool startsWith(const std::string &str, const std::string &prefix)
+static void FeedManifestFile(const ArchiverContext &ctx, ManifestHasher::Job *job, const void *data, size_t size)
 {
-    return str.size() >= prefix.size() && 0 == str.compare(0, prefix.size(), prefix);
+    if (job) {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Manifest);
+        ctx.hasher->Feed(job, static_cast<const uint8_t *>(data), size);
+    }
 }
 
-static std::string replace_all(const std::string &str,
-                               const std::string &find,
-                               const std::string &replace)
+static void EndManifestFile(const ArchiverContext &ctx, ManifestHasher::Job *job, bool success)
 {
-    if (find.empty()) {
-        return str;
-    }
-    
-    std::string result;
-    size_t find_len = find.size();
-    size_t pos, from = 0;
-    while (std::string::npos != (pos = str.find(find, from))) {
-        result.append(str, from, pos - from);
-        result.append(replace);
-        from = pos + find_len;
+    if (job) {
+        ctx.hasher->End(job, success);
     }
-    result.append(str, from, std::string::npos);
-    return result;
 }
 
-// Windows 非法字符 -> 占位符 映射表
-// macOS/iOS 允许但 Windows 不允许: < > : " | ? *
-struct CharMapping {
-    const char* original;      // macOS/iOS 中的字符
-    const char* placeholder;   // Windows 上的占位符
-};
-
-static const CharMapping kPathCharMappings[] = {
-    {":",  "__colon__"},
-    {"<",  "__lt__"},
-    {">",  "__gt__"},
-    {"\"", "__quote__"},
-    {"|",  "__pipe__"},
-    {"?",  "__qmark__"},
-    {"*",  "__star__"},
-    // 可在此添加更多映射
-};
-
-// 将 macOS/iOS 路径转换为 Windows 安全路径（解压时使用）
-static std::string ToWindowsSafePath(const std::string &path)
+// 文件不经解压得到时 (如从解压缓存克隆) 读回内容计算摘要
+static bool FeedManifestFromFile(const ArchiverContext &ctx, ManifestHasher::Job *job, const fs::path &path)
 {
-    std::string result = path;
-    for (const auto &mapping : kPathCharMappings) {
-        result = replace_all(result, mapping.original, mapping.placeholder);
+    if (!job) {
+        return true;
+    }
+    std::ifstream ifs(path, std::ios::binary);
+    std::vector<char> buf(kZipBufSize);
+    while (ifs) {
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileRead);
+            ifs.read(buf.data(), buf.size());
+        }
+        FeedManifestFile(ctx, job, buf.data(), static_cast<size_t>(ifs.gcount()));
     }
-    return result;
+    return ifs.eof();
 }
 
-// 将 Windows 占位符还原为 macOS/iOS 字符（压缩时使用）
-static std::string FromWindowsSafePath(const std::string &path)
+// 未指定时使用 zlib 后端，CRC 由 Crc32Update 的硬件实现计算；"minizip" 保留 minizip 内部的流式路径
+// 确定性模式下 "auto" 也固定为 zlib，输出不随编译进来的后端变化
+static bool ResolveCodec(const ArchiverOptions &options, ArchiverContext &ctx)
 {
-    std::string result = path;
-    for (const auto &mapping : kPathCharMappings) {
-        result = replace_all(result, mapping.placeholder, mapping.original);
+    if (options.codec != "minizip") {
+        std::string name = options.codec.empty() || (options.deterministic && options.codec == "auto") ? "zlib" : options.codec;
+        ctx.codec = FindZipCodec(name);
+        if (ctx.codec == nullptr) {
+            AYError("codec not available: {} (available: {})", name, AvailableZipCodecs());
+            return false;
+        }
+    }
+    if (ctx.stats) {
+        ctx.stats->SetCodec(ctx.codec ? ctx.codec->name : "minizip");
     }
-    return result;
+    return true;
+}
+
+static bool endsWith(const std::string &str, const std::string &suffix)
+{
+    return str.size() >= suffix.size() && 0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix);
+}
+
+static bool startsWith(const std::string &str, const std::string &prefix)
+{
+    return str.size() >= prefix.size() && 0 == str.compare(0, prefix.size(), prefix);
 }
 
 static void permissionsToFile(const fs::path &absolute_path, uint32_t mode)
@@ -145,18 +196,39 @@ static void permissionsToFile(const fs::path &absolute_path, uint32_t mode)
  *            UnzipAppBundle                *
  *                                          *
  ********************************************/
-static bool ExtractFileEntry(void *zip_reader, const fs::path &file_path, uint64_t num_bytes_to_extract)
+// 已存在的目标可能是与缓存对象、其他目录共享 inode 的硬链接，或是之前解压出的符号链接，
+// 打开时截断会改写它们，先删除再创建
+static void RemoveExistingFile(const fs::path &file_path, const ArchiverContext &ctx)
 {
-    if (mz_zip_reader_entry_open(zip_reader) != MZ_OK) {
-        return false;
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileWrite);
+    std::error_code ec;
+    fs::remove(file_path, ec);
+}
+
+static bool ExtractFileEntry(void *zip_reader, const fs::path &file_path, uint64_t num_bytes_to_extract, const ArchiverContext &ctx, ManifestHasher::Job *hash_job)
+{
+    {
+        ScopedTraceSpan span(ctx.trace, "open", "unzip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        if (mz_zip_reader_entry_open(zip_reader) != MZ_OK) {
+            return false;
+        }
     }
 
-    fs::path parentDirectory = file_path.parent_path();
-    if (!fs::exists(parentDirectory)) {
-        fs::create_directories(parentDirectory);
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::MakeDirectory);
+        fs::path parentDirectory = file_path.parent_path();
+        if (!fs::exists(parentDirectory)) {
+            fs::create_directories(parentDirectory);
+        }
     }
 
-    std::ofstream ofs(file_path.string(), std::ios::binary);
+    RemoveExistingFile(file_path, ctx);
+    std::ofstream ofs;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileWrite);
+        ofs.open(file_path.string(), std::ios::binary);
+    }
     if (!ofs) {
         mz_zip_reader_entry_close(zip_reader);
         return false;
@@ -165,9 +237,14 @@ static bool ExtractFileEntry(void *zip_reader, const fs::path &file_path, uint64
     std::unique_ptr<char[]> buf(new char[kZipBufSize]);
     uint64_t total_written = 0;
     bool success = true;
+    auto dataStart = ctx.trace ? TraceRecorder::Clock::now() : TraceRecorder::Clock::time_point();
 
     while (total_written < num_bytes_to_extract) {
-        const int32_t num_bytes_read = mz_zip_reader_entry_read(zip_reader, buf.get(), kZipBufSize);
+        int32_t num_bytes_read;
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+            num_bytes_read = mz_zip_reader_entry_read(zip_reader, buf.get(), kZipBufSize);
+        }
 
         if (num_bytes_read < 0) {
             // Read error
@@ -183,11 +260,15 @@ static bool ExtractFileEntry(void *zip_reader, const fs::path &file_path, uint64
         uint64_t remaining = num_bytes_to_extract - total_written;
         uint64_t to_write = std::min<uint64_t>(remaining, static_cast<uint64_t>(num_bytes_read));
 
-        ofs.write(buf.get(), to_write);
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileWrite);
+            ofs.write(buf.get(), to_write);
+        }
         if (!ofs) {
             success = false;
             break;
         }
+        FeedManifestFile(ctx, hash_job, buf.get(), static_cast<size_t>(to_write));
 
         total_written += to_write;
 
@@ -200,6 +281,7 @@ static bool ExtractFileEntry(void *zip_reader, const fs::path &file_path, uint64
 
     // Verify we've reached EOF (file size matches expected)
     if (success && total_written == num_bytes_to_extract) {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
         char extra;
         if (mz_zip_reader_entry_read(zip_reader, &extra, 1) != 0) {
             // File has more data than expected
@@ -207,15 +289,514 @@ static bool ExtractFileEntry(void *zip_reader, const fs::path &file_path, uint64
         }
     }
 
-    ofs.close();
-    mz_zip_reader_entry_close(zip_reader);
+    if (ctx.trace) {
+        ctx.trace->AddComplete("inflate+write", "unzip", dataStart, TraceRecorder::Clock::now());
+    }
+
+    ScopedTraceSpan closeSpan(ctx.trace, "close", "unzip");
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileWrite);
+        ofs.close();
+    }
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        mz_zip_reader_entry_close(zip_reader);
+    }
+
+    return success;
+}
+
+// 读取条目的原始 deflate 数据，由 ctx.codec 解压并校验 CRC
+static bool ExtractDeflateEntry(void *zip_reader, const mz_zip_file *file_info, const fs::path &file_path, const ArchiverContext &ctx, ManifestHasher::Job *hash_job)
+{
+    uint64_t num_bytes_to_extract = static_cast<uint64_t>(file_info->uncompressed_size);
+    const ZipCodec *codec = ZipCodecForEntry(ctx.codec, num_bytes_to_extract);
+    PooledInflater inflater = AcquireInflater(codec, num_bytes_to_extract);
+    if (!inflater) {
+        return false;
+    }
+
+    void *zip_handle = nullptr;
+    {
+        ScopedTraceSpan span(ctx.trace, "open", "unzip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        if (mz_zip_reader_get_zip_handle(zip_reader, &zip_handle) != MZ_OK || mz_zip_entry_read_open(zip_handle, 1, nullptr) != MZ_OK) {
+            return false;
+        }
+    }
+
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::MakeDirectory);
+        fs::path parentDirectory = file_path.parent_path();
+        if (!fs::exists(parentDirectory)) {
+            fs::create_directories(parentDirectory);
+        }
+    }
+
+    RemoveExistingFile(file_path, ctx);
+    std::ofstream ofs;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileWrite);
+        ofs.open(file_path.string(), std::ios::binary);
+    }
+    if (!ofs) {
+        mz_zip_entry_close(zip_handle);
+        return false;
+    }
+
+    uint32_t crc = 0;
+    uint64_t total_written = 0;
+    uint64_t sink_ns = 0;      // 从 Inflate 阶段中扣除 CRC 与写文件的耗时
+    CodecSink sink = [&](const uint8_t *data, size_t size) {
+        if (size > num_bytes_to_extract - total_written) {
+            // 解压结果比条目声明的大
+            return false;
+        }
+
+        auto crcStart = ctx.stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        crc = codec->crc32(crc, data, size);
+        auto writeStart = ctx.stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        ofs.write(reinterpret_cast<const char *>(data), size);
+        if (ctx.stats) {
+            uint64_t crcNs = std::chrono::duration_cast<std::chrono::nanoseconds>(writeStart - crcStart).count();
+            uint64_t writeNs = ElapsedNs(writeStart);
+            ctx.stats->AddPhaseTime(ArchiverPhase::Crc, crcNs);
+            ctx.stats->AddPhaseTime(ArchiverPhase::FileWrite, writeNs);
+            sink_ns += crcNs + writeNs;
+        }
+        total_written += size;
+        if (hash_job) {
+            auto feedStart = std::chrono::steady_clock::now();
+            FeedManifestFile(ctx, hash_job, data, size);
+            sink_ns += ElapsedNs(feedStart);
+        }
+        return static_cast<bool>(ofs);
+    };
+
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[kZipBufSize]);
+    bool success = true;
+    auto dataStart = ctx.trace ? TraceRecorder::Clock::now() : TraceRecorder::Clock::time_point();
+
+    for (;;) {
+        auto inflateStart = ctx.stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        int32_t num_bytes_read = mz_zip_entry_read(zip_handle, buf.get(), kZipBufSize);
+        bool finish = num_bytes_read == 0;
+        if (num_bytes_read < 0 || !inflater->Inflate(buf.get(), static_cast<size_t>(std::max(num_bytes_read, 0)), finish, sink)) {
+            success = false;
+        }
+        if (ctx.stats) {
+            ctx.stats->AddPhaseTime(ArchiverPhase::Inflate, ElapsedNs(inflateStart) - sink_ns);
+            sink_ns = 0;
+        }
+        if (!success || finish) {
+            break;
+        }
+    }
+
+    if (success && (total_written != num_bytes_to_extract || crc != file_info->crc)) {
+        AYError("CRC or size mismatch: {}", file_info->filename);
+        success = false;
+    }
+
+    if (ctx.trace) {
+        ctx.trace->AddComplete("inflate+write", "unzip", dataStart, TraceRecorder::Clock::now(), codec->name);
+    }
+
+    ScopedTraceSpan closeSpan(ctx.trace, "close", "unzip");
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileWrite);
+        ofs.close();
+    }
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        mz_zip_entry_close(zip_handle);
+    }
 
     return success;
 }
 
-bool UnzipAppBundle(const std::string &archivePath, const std::string &outputDirectory)
+// 解压缓存的键：读一遍条目的原始数据计算 SHA-256，不解压；未命中时条目的原始数据会被读两次
+static bool ExtractionCacheKeyOf(void *zip_reader, const mz_zip_file *file_info, ExtractionCacheKey *key)
+{
+    void *zip_handle = nullptr;
+    if (mz_zip_reader_get_zip_handle(zip_reader, &zip_handle) != MZ_OK || mz_zip_entry_read_open(zip_handle, 1, nullptr) != MZ_OK) {
+        return false;
+    }
+
+    Sha256 sha256;
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[kZipBufSize]);
+    uint64_t total = 0;
+    int32_t read;
+    while ((read = mz_zip_entry_read(zip_handle, buf.get(), kZipBufSize)) > 0) {
+        sha256.Update(buf.get(), static_cast<size_t>(read));
+        total += static_cast<uint64_t>(read);
+    }
+    mz_zip_entry_close(zip_handle);
+    if (read < 0 || total != static_cast<uint64_t>(file_info->compressed_size)) {
+        return false;
+    }
+
+    key->crc = file_info->crc;
+    key->size = static_cast<uint64_t>(file_info->uncompressed_size);
+    key->method = file_info->compression_method;
+    key->rawDigest = sha256.Final();
+    return true;
+}
+
+static bool IsSmallEntry(const mz_zip_file *file_info)
+{
+    return !(file_info->flag & MZ_ZIP_FLAG_ENCRYPTED) &&
+           (file_info->compression_method == MZ_COMPRESS_METHOD_DEFLATE || file_info->compression_method == MZ_COMPRESS_METHOD_STORE) &&
+           static_cast<uint64_t>(file_info->uncompressed_size) < kZipSmallEntrySize &&
+           static_cast<uint64_t>(file_info->compressed_size) < kZipSmallEntrySize;
+}
+
+// mz_zip_entry_read 单次可能读不满
+static bool ZipEntryReadAll(void *zip_handle, uint8_t *data, size_t size)
+{
+    while (size > 0) {
+        int32_t read = mz_zip_entry_read(zip_handle, data, static_cast<int32_t>(std::min<size_t>(size, kZipBufSize)));
+        if (read <= 0) {
+            return false;
+        }
+        data += read;
+        size -= static_cast<size_t>(read);
+    }
+    return true;
+}
+
+// 小条目快速路径：大小已知，一次读出压缩数据、一次解压到恰好大小的缓冲区、校验 CRC、一次写出
+// 只在选定了 ctx.codec 时使用；"minizip" 后端 (ctx.codec 为空) 的条目全部由 minizip 解压
+static bool ExtractSmallEntry(void *zip_reader, const mz_zip_file *file_info, const fs::path &file_path, const ArchiverContext &ctx, ManifestHasher::Job *hash_job)
+{
+    const ZipCodec *codec = ctx.codec;
+    size_t compressed_size = static_cast<size_t>(file_info->compressed_size);
+    size_t uncompressed_size = static_cast<size_t>(file_info->uncompressed_size);
+    ExtractBuffers &buffers = *ctx.buffers;
+
+    void *zip_handle = nullptr;
+    {
+        ScopedTraceSpan span(ctx.trace, "open", "unzip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        if (mz_zip_reader_get_zip_handle(zip_reader, &zip_handle) != MZ_OK || mz_zip_entry_read_open(zip_handle, 1, nullptr) != MZ_OK) {
+            return false;
+        }
+    }
+
+    const uint8_t *data = nullptr;
+    bool success;
+    std::string codecName = ctx.trace ? codec->name : std::string();
+    {
+        ScopedTraceSpan span(ctx.trace, "read+inflate", "unzip", codecName);
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        buffers.compressed.resize(compressed_size);
+        success = ZipEntryReadAll(zip_handle, buffers.compressed.data(), compressed_size);
+        mz_zip_entry_close(zip_handle);
+
+        if (success && file_info->compression_method == MZ_COMPRESS_METHOD_STORE) {
+            success = compressed_size == uncompressed_size;
+            data = buffers.compressed.data();
+        }
+        else if (success) {
+            buffers.uncompressed.resize(uncompressed_size);
+            success = codec->inflateBuffer(buffers.compressed.data(), compressed_size, buffers.uncompressed.data(), uncompressed_size);
+            data = buffers.uncompressed.data();
+        }
+    }
+    if (success) {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Crc);
+        if (codec->crc32(0, data, uncompressed_size) != file_info->crc) {
+            AYError("CRC mismatch: {}", file_info->filename);
+            success = false;
+        }
+    }
+    if (!success) {
+        return false;
+    }
+    // 缓冲区在条目间复用，交给摘要线程前复制
+    FeedManifestFile(ctx, hash_job, data, uncompressed_size);
+
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::MakeDirectory);
+        fs::path parentDirectory = file_path.parent_path();
+        if (!fs::exists(parentDirectory)) {
+            fs::create_directories(parentDirectory);
+        }
+    }
+
+    RemoveExistingFile(file_path, ctx);
+    ScopedTraceSpan span(ctx.trace, "write", "unzip");
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileWrite);
+    std::ofstream ofs;
+    ofs.rdbuf()->pubsetbuf(nullptr, 0);     // 不经 filebuf 缓冲，整块一次写出
+    ofs.open(file_path.string(), std::ios::binary);
+    if (!ofs) {
+        return false;
+    }
+    ofs.write(reinterpret_cast<const char *>(data), uncompressed_size);
+    ofs.close();
+    return !ofs.fail();
+}
+
+// 条目的修改时间：minizip 已按 NTFS (0x000a) / Unix (0x000d) 扩展字段或 DOS 时间给出 modified_date，
+// Info-ZIP 扩展时间戳 (0x5455，macOS ditto / zip 写入) 为 UTC 秒数，比 2 秒精度、本地时区的 DOS 时间准确，存在时优先
+static std::time_t EntryModifiedTime(const mz_zip_file *file_info)
+{
+    const uint8_t *field = file_info->extrafield;
+    size_t remaining = file_info->extrafield ? file_info->extrafield_size : 0;
+    while (remaining >= 4) {
+        uint16_t id = static_cast<uint16_t>(field[0] | (field[1] << 8));
+        uint16_t size = static_cast<uint16_t>(field[2] | (field[3] << 8));
+        if (size > remaining - 4) {
+            break;
+        }
+        // 中央目录中只有标志字节与修改时间
+        if (id == 0x5455 && size >= 5 && (field[4] & 1)) {
+            const uint8_t *p = field + 5;
+            int32_t seconds = static_cast<int32_t>(uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24));
+            return static_cast<std::time_t>(seconds);
+        }
+        field += 4 + size;
+        remaining -= 4 + size;
+    }
+    return file_info->modified_date;
+}
+
+#ifndef _WIN32
+// 条目外部属性高 16 位为 unix mode，Windows 生成的包通常为 0
+static bool UnixModeFromEntry(const mz_zip_file *file_info, uint32_t *mode)
+{
+    *mode = (file_info->external_fa >> 16) & 0x01FF;
+    return *mode != 0;
+}
+
+// 防止符号链接指向解压目录之外
+// 链接所在目录已确认不经过符号链接，开头的 ".." 按词法回退即为真实位置；
+// 名字之后的 ".." 可能跟在另一个符号链接之后 (如已有 "l -> ." 时 "l/../x" 实际在根目录的上一级)，词法规范化判断不了，拒绝
+static bool IsLinkTargetInside(const fs::path &root, const fs::path &link_path, const fs::path &target)
+{
+    if (target.empty() || target.has_root_path()) {
+        return false;
+    }
+    bool descended = false;
+    for (const fs::path &part : target) {
+        if (part == "..") {
+            if (descended) {
+                return false;
+            }
+        }
+        else if (!part.empty() && part != ".") {
+            descended = true;
+        }
+    }
+    fs::path resolved = (link_path.parent_path() / target).lexically_normal();
+    fs::path relative = resolved.lexically_relative(root.lexically_normal());
+    return !relative.empty() && *relative.begin() != "..";
+}
+
+// 符号链接条目的内容即链接目标，创建真正的符号链接而不是写出文本文件
+static bool ExtractSymlinkEntry(void *zip_reader, const mz_zip_file *file_info, const fs::path &root, const fs::path &link_path, const ArchiverContext &ctx)
+{
+    std::string target;
+    if (file_info->uncompressed_size > 0 && static_cast<uint64_t>(file_info->uncompressed_size) <= kZipMaxLinkTarget) {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        if (mz_zip_reader_entry_open(zip_reader) != MZ_OK) {
+            return false;
+        }
+        target.resize(static_cast<size_t>(file_info->uncompressed_size));
+        int32_t read = mz_zip_reader_entry_read(zip_reader, &target[0], static_cast<int32_t>(target.size()));
+        mz_zip_reader_entry_close(zip_reader);
+        if (read != static_cast<int32_t>(target.size())) {
+            return false;
+        }
+    }
+    else if (file_info->linkname && *file_info->linkname) {
+        target = file_info->linkname;
+    }
+
+    if (!IsLinkTargetInside(root, link_path, target)) {
+        AYError("Symlink target outside of output directory: {} -> {}", file_info->filename, target);
+        return false;
+    }
+
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileWrite);
+    fs::create_directories(link_path.parent_path());
+    std::error_code ec;
+    fs::remove(link_path, ec);
+    fs::create_symlink(target, link_path);
+    return true;
+}
+#endif
+
+// 解压目录中已存在的符号链接不能作为后续条目的上级目录，否则条目会经由链接写到别处
+// (如 "d -> ." 之后的 "d/x -> ../../evil"，或 "sub/d -> ../.." 之后的 "sub/d/f")；目录条目连同自身一起检查
+// verified_parent 为上一个确认过的目录，同一目录下的连续条目不再逐级 lstat；创建符号链接后需清空
+static bool IsEntryParentReal(const fs::path &root, const std::string &relative_path, fs::path &verified_parent)
+{
+    fs::path parent = fs::path(relative_path).parent_path();
+    if (parent.empty() || parent == verified_parent) {
+        return true;
+    }
+    fs::path current = root;
+    for (const fs::path &part : parent) {
+        current /= part;
+        std::error_code ec;
+        fs::file_status status = fs::symlink_status(current, ec);
+        if (fs::is_symlink(status)) {
+            return false;
+        }
+        if (!fs::exists(status)) {
+            // 之后的各级尚未创建
+            break;
+        }
+    }
+    verified_parent = parent;
+    return true;
+}
+
+// IPA 根目录下的 iTunesMetadata.plist、META-INF/ 等不属于应用包
+static bool IsPayloadEntry(const std::string &filename)
+{
+#ifdef _WIN32
+    if (startsWith(filename, "Payload\\")) {
+        return true;
+    }
+#endif
+    return startsWith(filename, "Payload/");
+}
+
+// 解压到第一个目录的条目，供铺到其他目录时按原顺序重放；mode 为 0 时不设置权限
+struct ExtractedItem {
+    fs::path relativePath;
+    BundleEntryType type;
+    uint32_t mode;
+    std::time_t modifiedTime;
+};
+
+static bool ReplicateExtraction(const fs::path &source_root, const std::vector<ExtractedItem> &items, const ArchiverOptions &options, const ArchiverContext &ctx)
+{
+    for (const std::string &destination : options.extraDestinations) {
+        ScopedTraceSpan span(ctx.trace, "replicate", "unzip", destination);
+        fs::path root = destination;
+        std::error_code ec;
+        fs::create_directories(root, ec);
+
+        FileCloner cloner(options.cloneMode);
+        size_t counts[4] = {};
+        fs::path last_parent;
+        // 文件的修改时间随克隆保留，重建的符号链接与目录需要另外设置
+        std::vector<PendingFileTime> linkTimes;
+        std::vector<PendingFileTime> directoryTimes;
+#ifndef _WIN32
+        std::vector<std::pair<fs::path, uint32_t>> directoryModes;
+#endif
+        for (const ExtractedItem &item : items) {
+            fs::path source = source_root / item.relativePath;
+            fs::path target = root / item.relativePath;
+            if (item.type == BundleEntryType::Directory) {
+                ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::MakeDirectory);
+                fs::create_directories(target, ec);
+                if (ec) {
+                    AYError("Create directory {} failed: {}", target.string(), ec.message());
+                    return false;
+                }
+                if (options.restoreTimestamps) {
+                    directoryTimes.push_back({target, item.modifiedTime});
+                }
+#ifndef _WIN32
+                if (item.mode) {
+                    directoryModes.emplace_back(target, item.mode);
+                }
+#endif
+                continue;
+            }
+
+            // 包内可能没有目录条目
+            if (target.parent_path() != last_parent) {
+                ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::MakeDirectory);
+                last_parent = target.parent_path();
+                fs::create_directories(last_parent, ec);
+            }
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Clone);
+            if (item.type == BundleEntryType::Symlink) {
+                fs::path link_target = fs::read_symlink(source, ec);
+                if (!ec) {
+                    fs::remove(target, ec);
+                    fs::create_symlink(link_target, target, ec);
+                }
+                if (ec) {
+                    AYError("Replicate symlink {} failed: {}", target.string(), ec.message());
+                    return false;
+                }
+                if (options.restoreTimestamps) {
+                    linkTimes.push_back({target, item.modifiedTime});
+                }
+                continue;
+            }
+            CloneResult result = cloner.Clone(source, target);
+            if (result == CloneResult::Failed) {
+                AYError("Replicate {} failed", target.string());
+                return false;
+            }
+            counts[static_cast<size_t>(result)]++;
+        }
+#ifndef _WIN32
+        for (auto it = directoryModes.rbegin(); it != directoryModes.rend(); ++it) {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+            permissionsToFile(it->first, it->second);
+        }
+#endif
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+            ApplyFileTimes(linkTimes, ctx.trace);
+            ApplyFileTimes(directoryTimes, ctx.trace);
+        }
+        AYZipLogInfo("replicated to {}: {} reflinked, {} hardlinked, {} copied", destination,
+                     counts[static_cast<size_t>(CloneResult::Reflink)], counts[static_cast<size_t>(CloneResult::Hardlink)], counts[static_cast<size_t>(CloneResult::Copy)]);
+    }
+    return true;
+}
+
+// 增量解压删除旧文件后，清理因此变空的目录，直到解压根目录或新包中存在的目录为止
+static void RemoveEmptyParents(const fs::path &root, fs::path directory, const std::unordered_set<std::string> &kept)
+{
+    std::error_code ec;
+    while (directory != root && directory.has_relative_path() && !kept.count(directory.string())) {
+        if (!fs::is_empty(directory, ec) || ec || !fs::remove(directory, ec)) {
+            break;
+        }
+        directory = directory.parent_path();
+    }
+}
+
+static std::string NormalizedDirectory(const fs::path &path)
+{
+    fs::path normal = path.lexically_normal();
+    return (normal.filename().empty() ? normal.parent_path() : normal).string();
+}
+
+bool UnzipAppBundle(const std::string &archivePath, const std::string &outputDirectory, const ArchiverOptions &options)
 {
     fs::path appBundlePath = outputDirectory;
+    TraceSession traceSession(options.tracePath);
+    ExtractBuffers buffers;
+    ArchiverContext ctx;
+    ctx.stats = options.stats;
+    ctx.trace = traceSession.recorder();
+    ctx.buffers = &buffers;
+    ctx.cache = options.extractionCache;
+    // 最后声明、最先析构：返回前等摘要线程算完，清单完整
+    std::unique_ptr<ManifestHasher> hasher;
+    if (options.manifest) {
+        hasher.reset(new ManifestHasher(options.manifest, ctx.trace));
+        ctx.hasher = hasher.get();
+    }
+    ScopedRunTimer runTimer(ctx.stats);
+    ScopedTraceSpan runSpan(ctx.trace, "UnzipAppBundle", "unzip", archivePath);
+
+    if (!ResolveCodec(options, ctx)) {
+        return false;
+    }
 
     if (!fs::exists(appBundlePath)) {
         return false;
@@ -229,14 +810,22 @@ bool UnzipAppBundle(const std::string &archivePath, const std::string &outputDir
             return false;
         }
 
-        int32_t err = mz_zip_reader_open_file(zip_reader, archivePath.c_str());
+        int32_t err;
+        {
+            ScopedTraceSpan span(ctx.trace, "open archive", "unzip");
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+            err = mz_zip_reader_open_file(zip_reader, archivePath.c_str());
+        }
         if (err != MZ_OK) {
             AYError("mz_zip_reader_open_file failed: {}", archivePath);
             mz_zip_reader_delete(&zip_reader);
             return false;
         }
 
-        err = mz_zip_reader_goto_first_entry(zip_reader);
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+            err = mz_zip_reader_goto_first_entry(zip_reader);
+        }
         if (err == MZ_END_OF_LIST) {
             // Empty zip file
             mz_zip_reader_close(zip_reader);
@@ -249,15 +838,58 @@ bool UnzipAppBundle(const std::string &archivePath, const std::string &outputDir
             return false;
         }
 
-        auto toWin32Path = [](std::string filename) -> std::string {
-            std::replace(filename.begin(), filename.end(), '/', '\\');
+        // 绝大多数条目走 ZipPathToLocalPath 单次扫描，localPath 在条目间复用
+        // 含空段、"."、".." 段的路径按词法规范化，结果为空、绝对路径或以 ".." 开头 (落在解压目录之外) 时返回 false
+        std::string localPath;
+        auto toWin32Path = [&localPath](const std::string &filename) -> bool {
+            if (ZipPathToLocalPath(filename, localPath)) {
+                return true;
+            }
+#ifdef _WIN32
             std::string outname = ToWindowsSafePath(filename);
-            return fs::relative(outname, "Payload\\").string();
+            std::replace(outname.begin(), outname.end(), '/', '\\');
+            fs::path relative = fs::path(outname).lexically_normal().lexically_relative("Payload");
+#else
+            fs::path relative = fs::path(filename).lexically_normal().lexically_relative("Payload");
+#endif
+            if (relative.empty() || relative.has_root_path() || *relative.begin() == "..") {
+                return false;
+            }
+            localPath = relative == "." ? std::string() : relative.string();
+            return true;
         };
+        fs::path verifiedParent;
+
+#ifndef _WIN32
+        // 目录权限最后设置（由深到浅），避免只读目录导致后续条目无法写入
+        std::vector<std::pair<fs::path, uint32_t>> directoryModes;
+#endif
+        bool replicate = !options.extraDestinations.empty();
+        std::vector<ExtractedItem> extracted;
+
+        // 增量解压：previousIndex 为上次解压的结果，nextIndex 记录本次解压出的文件，结束时替换边车索引
+        bool incremental = options.incremental;
+        fs::path indexPath;
+        ExtractionIndex previousIndex;
+        ExtractionIndex nextIndex;
+        std::unordered_set<std::string> keptDirectories;
+        size_t unchangedCount = 0;
+
+        // 修改时间在全部条目写完后批量恢复，目录最后设置
+        bool restoreTimes = options.restoreTimestamps;
+        std::vector<PendingFileTime> fileTimes;
+        std::vector<PendingFileTime> directoryTimes;
+        if (incremental) {
+            indexPath = options.incrementalIndexPath.empty() ? DefaultExtractionIndexPath(appBundlePath) : fs::u8path(options.incrementalIndexPath);
+            previousIndex.Load(indexPath);
+        }
 
         while (err == MZ_OK) {
             mz_zip_file *file_info = NULL;
-            err = mz_zip_reader_entry_get_info(zip_reader, &file_info);
+            {
+                ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+                err = mz_zip_reader_entry_get_info(zip_reader, &file_info);
+            }
             if (err != MZ_OK) {
                 break;
             }
@@ -270,31 +902,224 @@ bool UnzipAppBundle(const std::string &archivePath, const std::string &outputDir
                 filename = fs::path(file_info->filename).string();
             }
 
-            if (!startsWith(filename, "__MACOSX")) {
-                fs::path absolute_path = appBundlePath / toWin32Path(filename);
+            bool skip = startsWith(filename, "__MACOSX");
+            if (!skip && !IsPayloadEntry(filename)) {
+                AYZipLogInfo("skip entry outside of Payload/: {}", filename);
+                skip = true;
+            }
+            if (!skip) {
+                fs::path absolute_path;
+                bool inside;
+                {
+                    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::PathConversion);
+                    inside = toWin32Path(filename) && IsEntryParentReal(appBundlePath, localPath, verifiedParent);
+                    absolute_path = appBundlePath / localPath;
+                }
+                if (!inside) {
+                    AYError("Entry path outside of output directory: {}", filename);
+                    mz_zip_reader_close(zip_reader);
+                    mz_zip_reader_delete(&zip_reader);
+                    return false;
+                }
+                if (replicate) {
+                    extracted.push_back({localPath, BundleEntryType::File, 0, EntryModifiedTime(file_info)});
+                }
                 if (endsWith(filename, "/")) { // directory
+                    ScopedTraceSpan span(ctx.trace, "mkdir", "unzip", filename);
+                    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::MakeDirectory);
                     fs::create_directories(absolute_path); // must create_directories inculde parent path 
+                    if (ctx.stats) {
+                        ctx.stats->AddDirectory();
+                    }
+                    if (replicate) {
+                        extracted.back().type = BundleEntryType::Directory;
+                    }
+                    if (incremental) {
+                        keptDirectories.insert(NormalizedDirectory(absolute_path));
+                    }
+                    if (restoreTimes) {
+                        directoryTimes.push_back({absolute_path, EntryModifiedTime(file_info)});
+                    }
+#ifndef _WIN32
+                    uint32_t mode;
+                    if (UnixModeFromEntry(file_info, &mode)) {
+                        directoryModes.emplace_back(absolute_path, mode);
+                        if (replicate) {
+                            extracted.back().mode = mode;
+                        }
+                    }
+#endif
+                }
+#ifndef _WIN32
+                else if (mz_zip_attrib_is_symlink(file_info->external_fa, file_info->version_madeby) == MZ_OK) {
+                    ScopedTraceSpan span(ctx.trace, "symlink", "unzip", filename);
+                    if (replicate) {
+                        extracted.back().type = BundleEntryType::Symlink;
+                    }
+                    // 链接可能替换了一个空目录
+                    verifiedParent.clear();
+                    if (!ExtractSymlinkEntry(zip_reader, file_info, appBundlePath, absolute_path, ctx)) {
+                        AYError("Extracted symlink failed: {}", filename);
+                        mz_zip_reader_close(zip_reader);
+                        mz_zip_reader_delete(&zip_reader);
+                        return false;
+                    }
+                    if (incremental) {
+                        // 符号链接每次都重建，记录下来只为之后能删除；localPath 为本条目的相对路径
+                        ExtractionIndexRecord record;
+                        record.symlink = true;
+                        nextIndex.Set(localPath, record);
+                    }
+                    if (restoreTimes) {
+                        fileTimes.push_back({absolute_path, EntryModifiedTime(file_info)});
+                    }
                 }
+#endif
                 else { // file
-                    if (!ExtractFileEntry(zip_reader, absolute_path, file_info->uncompressed_size)) {
+                    ScopedTraceSpan span(ctx.trace, "extract", "unzip", filename);
+                    AYZipLogDebug("extract {} ({} bytes)", filename, file_info->uncompressed_size);
+                    auto entryStart = ctx.stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                    ManifestHasher::Job *hash_job = BeginManifestFile(ctx, file_info->filename);
+                    // 条目的 CRC、大小与上次解压时相同，且磁盘上的文件没有被改动过，则保留现有文件
+                    const ExtractionIndexRecord *previous = incremental ? previousIndex.Find(localPath) : nullptr;
+                    bool unchanged = false;
+                    if (previous && !(file_info->flag & MZ_ZIP_FLAG_ENCRYPTED)) {
+                        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+                        unchanged = previous->crc == file_info->crc && previous->size == static_cast<uint64_t>(file_info->uncompressed_size) &&
+                                    ExtractionIndex::Matches(*previous, absolute_path);
+                    }
+                    // 缓存按原始数据的 SHA-256 匹配，加密条目的原始数据随密钥而变、CRC 可能被置零 (AE-2)，不参与
+                    bool cacheable = !unchanged && ctx.cache && !(file_info->flag & MZ_ZIP_FLAG_ENCRYPTED) &&
+                                     ctx.cache->Eligible(static_cast<uint64_t>(file_info->uncompressed_size));
+                    bool cached = false;
+                    ExtractionCacheKey cacheKey;
+                    if (cacheable) {
+                        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Cache);
+                        cacheable = ExtractionCacheKeyOf(zip_reader, file_info, &cacheKey);
+                        cached = cacheable && ctx.cache->Materialize(cacheKey, absolute_path);
+                    }
+                    bool entryOk;
+                    if (unchanged || cached) {
+                        entryOk = FeedManifestFromFile(ctx, hash_job, absolute_path);
+                        unchangedCount += unchanged ? 1 : 0;
+                    }
+                    else if (ctx.codec && IsSmallEntry(file_info)) {
+                        entryOk = ExtractSmallEntry(zip_reader, file_info, absolute_path, ctx, hash_job);
+                    }
+                    else if (ctx.codec && file_info->compression_method == MZ_COMPRESS_METHOD_DEFLATE && !(file_info->flag & MZ_ZIP_FLAG_ENCRYPTED)) {
+                        entryOk = ExtractDeflateEntry(zip_reader, file_info, absolute_path, ctx, hash_job);
+                    }
+                    else {
+                        entryOk = ExtractFileEntry(zip_reader, absolute_path, file_info->uncompressed_size, ctx, hash_job);
+                    }
+                    EndManifestFile(ctx, hash_job, entryOk);
+                    if (!entryOk) {
                         AYError("Extracted file failed: {}", filename);
                         mz_zip_reader_close(zip_reader);
                         mz_zip_reader_delete(&zip_reader);
                         return false;
                     }
+                    if (cacheable && !cached) {
+                        // 解压过程已校验 CRC，放入的内容与键一致
+                        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Cache);
+                        ctx.cache->Insert(cacheKey, absolute_path);
+                    }
+                    if (ctx.stats && !unchanged) {
+                        ArchiverEntryStat entry;
+                        entry.name = filename;
+                        entry.compressionMethod = file_info->compression_method;
+                        entry.bytesIn = static_cast<uint64_t>(file_info->compressed_size);
+                        entry.bytesOut = static_cast<uint64_t>(file_info->uncompressed_size);
+                        entry.uncompressedSize = entry.bytesOut;
+                        entry.elapsedNs = ElapsedNs(entryStart);
+                        ctx.stats->AddEntry(std::move(entry));
+                    }
 
+#ifndef _WIN32
+                    uint32_t mode;
+                    if (UnixModeFromEntry(file_info, &mode)) {
+                        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+                        permissionsToFile(absolute_path, mode);
+                    }
+#else
                     //permissionsToFile(absolute_path, (file_info->external_fa >> 16) & 0x01FF);
                     //_wchmod(absolute_path.wstring().c_str(), (file_info->external_fa >> 16) & 0x01FF);
+#endif
+                    if (restoreTimes) {
+                        fileTimes.push_back({absolute_path, EntryModifiedTime(file_info)});
+                    }
+                    if (incremental) {
+                        // 大小与修改时间在恢复修改时间之后由 Refresh 取得
+                        ExtractionIndexRecord record;
+                        record.crc = file_info->crc;
+                        nextIndex.Set(localPath, record);
+                    }
                 }
             }
 
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
             err = mz_zip_reader_goto_next_entry(zip_reader);
         }
 
-        mz_zip_reader_close(zip_reader);
-        mz_zip_reader_delete(&zip_reader);
-
-        return true;
+        // 中央目录读取中途出错：未读到的条目不能当作已从包中删除，增量解压的删除与索引更新都不能进行
+        if (err != MZ_END_OF_LIST) {
+            AYError("Read central directory failed ({}): {}", err, archivePath);
+            mz_zip_reader_close(zip_reader);
+            mz_zip_reader_delete(&zip_reader);
+            return false;
+        }
+
+        if (restoreTimes) {
+            ScopedTraceSpan span(ctx.trace, "restore times", "unzip");
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+            size_t failures = ApplyFileTimes(fileTimes, ctx.trace);
+            if (failures > 0) {
+                AYZipLogInfo("failed to restore modification time of {} files", failures);
+            }
+        }
+
+        if (incremental) {
+            // 只删除上次由解压写出的文件，目录中其他文件不受影响；在恢复目录权限之前删除，避免只读目录
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+            nextIndex.Refresh(appBundlePath);
+            size_t removedCount = 0;
+            for (const auto &item : previousIndex.Records()) {
+                if (nextIndex.Find(item.first)) {
+                    continue;
+                }
+                fs::path stale = appBundlePath / item.first;
+                std::error_code ec;
+                if (fs::remove(stale, ec)) {
+                    removedCount++;
+                    RemoveEmptyParents(appBundlePath.lexically_normal(), stale.lexically_normal().parent_path(), keptDirectories);
+                }
+            }
+            nextIndex.Save(indexPath);
+            AYZipLogInfo("incremental unzip: {} unchanged, {} written, {} removed", unchangedCount,
+                         nextIndex.Records().size() - unchangedCount, removedCount);
+        }
+
+#ifndef _WIN32
+        for (auto it = directoryModes.rbegin(); it != directoryModes.rend(); ++it) {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+            permissionsToFile(it->first, it->second);
+        }
+#endif
+        // 目录的修改时间在其中的文件全部写入、删除之后才能确定
+        if (restoreTimes) {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+            ApplyFileTimes(directoryTimes, ctx.trace);
+        }
+
+        mz_zip_reader_close(zip_reader);
+        mz_zip_reader_delete(&zip_reader);
+
+        if (ctx.cache) {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Cache);
+            ctx.cache->TrimIfNeeded();
+        }
+
+        return !replicate || ReplicateExtraction(appBundlePath, extracted, options, ctx);
     }
     catch (const std::exception &e) {
         AYError("{}", e.what());
@@ -308,100 +1133,315 @@ bool UnzipAppBundle(const std::string &archivePath, const std::string &outputDir
 }
 
 
+/********************************************
+ *                                          *
+ *            HashArchiveMachO              *
+ *                                          *
+ ********************************************/
+// 读出条目的解压数据交给 sink，不落盘；sink 返回 false 时提前结束 (不算失败)
+// 有 ctx.codec 且为 deflate 时走原始数据 + codec 解压并校验 CRC，否则由 minizip 解压
+static bool ReadEntryContent(void *zip_reader, const mz_zip_file *file_info, const ArchiverContext &ctx, const CodecSink &sink)
+{
+    bool stopped = false;
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[kZipBufSize]);
+    uint8_t *buf = buffer.get();
+
+    if (!ctx.codec || file_info->compression_method != MZ_COMPRESS_METHOD_DEFLATE || (file_info->flag & MZ_ZIP_FLAG_ENCRYPTED)) {
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+            if (mz_zip_reader_entry_open(zip_reader) != MZ_OK) {
+                return false;
+            }
+        }
+        bool success = true;
+        while (!stopped) {
+            int32_t read;
+            {
+                ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+                read = mz_zip_reader_entry_read(zip_reader, buf, kZipBufSize);
+            }
+            if (read <= 0) {
+                success = read == 0;
+                break;
+            }
+            stopped = !sink(buf, static_cast<size_t>(read));
+        }
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        mz_zip_reader_entry_close(zip_reader);
+        return success;
+    }
+
+    uint64_t expected = static_cast<uint64_t>(file_info->uncompressed_size);
+    const ZipCodec *codec = ZipCodecForEntry(ctx.codec, expected);
+    PooledInflater inflater = AcquireInflater(codec, expected);
+    void *zip_handle = nullptr;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+        if (!inflater || mz_zip_reader_get_zip_handle(zip_reader, &zip_handle) != MZ_OK || mz_zip_entry_read_open(zip_handle, 1, nullptr) != MZ_OK) {
+            return false;
+        }
+    }
+
+    uint32_t crc = 0;
+    uint64_t total = 0;
+    CodecSink checked = [&](const uint8_t *data, size_t size) {
+        if (size > expected - total) {
+            return false;
+        }
+        total += size;
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Crc);
+            crc = codec->crc32(crc, data, size);
+        }
+        stopped = !sink(data, size);
+        return !stopped;
+    };
+
+    bool success = true;
+    for (;;) {
+        int32_t read;
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+            read = mz_zip_entry_read(zip_handle, buf, kZipBufSize);
+        }
+        bool finish = read == 0;
+        if (read < 0 || !inflater->Inflate(buf, static_cast<size_t>(std::max(read, 0)), finish, checked)) {
+            success = stopped;
+            break;
+        }
+        if (finish) {
+            break;
+        }
+    }
+    if (success && !stopped && (total != expected || crc != file_info->crc)) {
+        AYError("CRC or size mismatch: {}", file_info->filename);
+        success = false;
+    }
+
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Inflate);
+    mz_zip_entry_close(zip_handle);
+    return success;
+}
+
+bool HashArchiveMachO(const std::string &archivePath, const ArchiverOptions &options)
+{
+    if (options.manifest == nullptr) {
+        AYError("HashArchiveMachO: manifest is required");
+        return false;
+    }
+    options.manifest->SetMachOPageHashes(true);
+
+    TraceSession traceSession(options.tracePath);
+    ArchiverContext ctx;
+    ctx.stats = options.stats;
+    ctx.trace = traceSession.recorder();
+    ManifestHasher hasher(options.manifest);
+    ctx.hasher = &hasher;
+    ScopedRunTimer runTimer(ctx.stats);
+    ScopedTraceSpan runSpan(ctx.trace, "HashArchiveMachO", "unzip", archivePath);
+
+    if (!ResolveCodec(options, ctx)) {
+        return false;
+    }
+
+    void *zip_reader = mz_zip_reader_create();
+    if (zip_reader == nullptr) {
+        AYError("mz_zip_reader_create failed");
+        return false;
+    }
+
+    bool success = true;
+    try {
+        int32_t err;
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+            err = mz_zip_reader_open_file(zip_reader, archivePath.c_str());
+            if (err == MZ_OK) {
+                err = mz_zip_reader_goto_first_entry(zip_reader);
+            }
+        }
+        if (err != MZ_OK && err != MZ_END_OF_LIST) {
+            AYError("mz_zip_reader_open_file failed: {}", archivePath);
+            success = false;
+        }
+
+        std::vector<uint8_t> head;
+        while (success && err == MZ_OK) {
+            mz_zip_file *file_info = nullptr;
+            {
+                ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+                err = mz_zip_reader_entry_get_info(zip_reader, &file_info);
+            }
+            if (err != MZ_OK) {
+                break;
+            }
+
+            // 小于 Mach-O 头的条目、目录与符号链接不必打开
+            std::string filename = file_info->filename;
+            bool candidate = file_info->uncompressed_size >= 28 && !endsWith(filename, "/") && !startsWith(filename, "__MACOSX") &&
+                             mz_zip_attrib_is_symlink(file_info->external_fa, file_info->version_madeby) != MZ_OK;
+            if (candidate) {
+                // 前 4 字节不是 Mach-O 魔数时停止读取该条目
+                ManifestHasher::Job *job = nullptr;
+                head.clear();
+                bool read = ReadEntryContent(zip_reader, file_info, ctx, [&](const uint8_t *data, size_t size) {
+                    if (job) {
+                        FeedManifestFile(ctx, job, data, size);
+                        return true;
+                    }
+                    head.insert(head.end(), data, data + size);
+                    if (head.size() < 4) {
+                        return true;
+                    }
+                    uint32_t magic = (uint32_t(head[0]) << 24) | (uint32_t(head[1]) << 16) | (uint32_t(head[2]) << 8) | head[3];
+                    if (!IsMachOMagic(magic)) {
+                        return false;
+                    }
+                    job = BeginManifestFile(ctx, filename);
+                    FeedManifestFile(ctx, job, head.data(), head.size());
+                    return true;
+                });
+                EndManifestFile(ctx, job, read);
+                if (!read) {
+                    AYError("Read entry failed: {}", filename);
+                    success = false;
+                    break;
+                }
+            }
+
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+            err = mz_zip_reader_goto_next_entry(zip_reader);
+        }
+    }
+    catch (const std::exception &e) {
+        AYError("{}", e.what());
+        success = false;
+    }
+
+    mz_zip_reader_close(zip_reader);
+    mz_zip_reader_delete(&zip_reader);
+    return success;
+}
+
 /********************************************
  *                                          *
  *              ZipAppBundle                *
  *                                          *
  ********************************************/
-static uint32_t permissionsFromFile(const fs::path &absolute_path)
-{
-    fs::file_status status = fs::status(absolute_path);
-    fs::perms permissions = status.permissions();
-    uint32_t mode = 0;
-
-    if ((permissions & fs::perms::owner_read) != fs::perms::none)
-        mode |= S_IRUSR;
-    if ((permissions & fs::perms::owner_write) != fs::perms::none)
-        mode |= S_IWUSR;
-    if ((permissions & fs::perms::owner_exec) != fs::perms::none)
-        mode |= S_IXUSR;
-    if ((permissions & fs::perms::group_read) != fs::perms::none)
-        mode |= S_IRGRP;
-    if ((permissions & fs::perms::group_write) != fs::perms::none)
-        mode |= S_IWGRP;
-    if ((permissions & fs::perms::group_exec) != fs::perms::none)
-        mode |= S_IXGRP;
-    if ((permissions & fs::perms::others_read) != fs::perms::none)
-        mode |= S_IROTH;
-    if ((permissions & fs::perms::others_write) != fs::perms::none)
-        mode |= S_IWOTH;
-    if ((permissions & fs::perms::others_exec) != fs::perms::none)
-        mode |= S_IXOTH;
-
-    if (permissions == fs::perms::all) {
+// IOS 13 later need permissions
+// POSIX 下保留扫描得到的真实权限，可执行位不会丢失；Windows 的扫描结果已是 0644 / 0755
+// 确定性模式只区分是否可执行：目录 0755，文件 0644 / 0755
+static uint32_t EntryMode(const BundleEntry &entry, const ArchiverContext &ctx)
+{
+    if (ctx.deterministic) {
+        if (entry.type == BundleEntryType::Directory) {
+            return 0040000 | 0755;
+        }
+        return (entry.mode & (S_IXUSR | S_IXGRP | S_IXOTH)) ? (0100000 | 0755) : (0100000 | 0644);
+    }
+
+    uint32_t mode = entry.mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+    if (mode == (S_IRWXU | S_IRWXG | S_IRWXO)) {
         mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
     }
 
     // fix mode
-    switch (status.type()) {
-        case fs::file_type::regular: mode |= 0100000; break; // 0644
-        case fs::file_type::directory: mode |= 0040000 | S_IXUSR | S_IXGRP | S_IXOTH; break; // 0755
-        case fs::file_type::symlink: mode |= 0020000; break;
+    if (entry.type == BundleEntryType::Directory) {
+        mode |= 0040000 | S_IXUSR | S_IXGRP | S_IXOTH; // 0755
+    }
+    else {
+        mode |= 0100000; // 0644
     }
-
     return mode;
 }
 
-static std::string ToZipPath(const fs::path &relative_path, bool is_directory)
+// bundle_prefix 为 "Payload/<App>" 加本地分隔符 (UTF-8)，relative_path 为扫描记录中的本地相对路径
+static std::string ToZipPath(const std::string &bundle_prefix, const BundleEntry &entry)
 {
-    std::string str_path = relative_path.u8string();
-    std::replace(str_path.begin(), str_path.end(), '\\', '/');
-    str_path = FromWindowsSafePath(str_path);  // 还原为 macOS/iOS 原始字符
-    if (is_directory && !str_path.empty() && str_path.back() != '/')
-        str_path += "/";
+    std::string local_path = bundle_prefix;
+#ifdef _WIN32
+    local_path += fs::path(entry.relativePath).u8string();
+#else
+    local_path += entry.relativePath;
+#endif
+    std::string str_path;
+    LocalPathToZipPath(local_path, entry.type == BundleEntryType::Directory, str_path);  // 还原为 macOS/iOS 原始字符
     return str_path;
 }
 
-static bool OpenNewFileEntry(void *zip_writer, const std::string &filename_in_zip, const fs::path &absolute_path, bool is_directory)
+// 确定性模式的条目时间：本地时间 1980-01-01 00:00:00 (DOS 时间起点)
+// minizip 按本地时区把 time_t 转为 DOS 时间，用 mktime 构造才能在任何时区写出相同的日期字段
+static std::time_t DeterministicEntryTime()
+{
+    static const std::time_t time = [] {
+        std::tm tm = {};
+        tm.tm_year = 80;
+        tm.tm_mon = 0;
+        tm.tm_mday = 1;
+        tm.tm_isdst = -1;
+        return std::mktime(&tm);
+    }();
+    return time;
+}
+
+// raw 为 true 时数据由 ctx.codec 压缩，minizip 只负责写入，需用 CloseRawFileEntry 关闭
+static bool OpenNewFileEntry(void *zip_writer, const std::string &filename_in_zip, std::time_t modified_time, uint32_t mode, const ArchiverContext &ctx, bool raw = false)
 {
     mz_zip_file file_info = {};
     file_info.filename = filename_in_zip.c_str();
     file_info.flag = MZ_ZIP_FLAG_UTF8;
     file_info.compression_method = MZ_COMPRESS_METHOD_DEFLATE;
 
-    // Get file time
-    std::time_t t = 0;
-    if (fs::exists(absolute_path)) {
-        using namespace std::chrono_literals;
-        auto ftime = fs::last_write_time(absolute_path);
-        auto tmp = fs::file_time_type::clock::now().time_since_epoch() - ftime.time_since_epoch();
-        auto sys = std::chrono::system_clock::now() - tmp;
-        t = std::chrono::system_clock::to_time_t(sys);
+    // 修改时间由扫描时一并取得
+    if (ctx.deterministic) {
+        // 访问/创建时间为 0 时 minizip 不写 NTFS 时间扩展字段，只保留 DOS 时间
+        file_info.modified_date = DeterministicEntryTime();
     }
     else {
-        auto sys = std::chrono::system_clock::now();
-        t = std::chrono::system_clock::to_time_t(sys);
+        file_info.modified_date = modified_time;
+        file_info.accessed_date = modified_time;
+        file_info.creation_date = modified_time;
     }
-    file_info.modified_date = t;
-    file_info.accessed_date = t;
-    file_info.creation_date = t;
 
-    // IOS 13 later need permissions
-    uint32_t mode = is_directory ? (0040000 | 0755) : (0100000 | 0644);
     file_info.external_fa = (uint32_t)(mode << 16L);
 
+    ScopedTraceSpan span(ctx.trace, "open", "zip");
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
+    if (raw) {
+        // CRC 与大小在压缩结束后才知道，写入数据描述符
+        file_info.flag |= MZ_ZIP_FLAG_DATA_DESCRIPTOR;
+        void *zip_handle = nullptr;
+        return mz_zip_writer_get_zip_handle(zip_writer, &zip_handle) == MZ_OK &&
+               mz_zip_entry_write_open(zip_handle, &file_info, MZ_COMPRESS_LEVEL_DEFAULT, 1, nullptr) == MZ_OK;
+    }
     int32_t err = mz_zip_writer_entry_open(zip_writer, &file_info);
     return err == MZ_OK;
 }
 
-static bool CloseNewFileEntry(void *zip_writer)
+static bool CloseNewFileEntry(void *zip_writer, const ArchiverContext &ctx)
 {
+    ScopedTraceSpan span(ctx.trace, "close", "zip");
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
     return mz_zip_writer_entry_close(zip_writer) == MZ_OK;
 }
 
-static bool AddFileContentToZip(void *zip_writer, const fs::path &file_path)
+static bool CloseRawFileEntry(void *zip_writer, uint64_t uncompressed_size, uint32_t crc, const ArchiverContext &ctx)
 {
-    std::ifstream input(file_path.string(), std::ios::binary);
+    ScopedTraceSpan span(ctx.trace, "close", "zip");
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
+    void *zip_handle = nullptr;
+    return mz_zip_writer_get_zip_handle(zip_writer, &zip_handle) == MZ_OK &&
+           mz_zip_entry_close_raw(zip_handle, static_cast<int64_t>(uncompressed_size), crc) == MZ_OK;
+}
+
+static bool AddFileContentToZip(void *zip_writer, const fs::path &file_path, const ArchiverContext &ctx, ManifestHasher::Job *hash_job, uint64_t *total_read)
+{
+    ScopedTraceSpan span(ctx.trace, "read+deflate", "zip");
+    std::ifstream input;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileRead);
+        input.open(file_path.string(), std::ios::binary);
+    }
     if (!input) {
         return false;
     }
@@ -411,7 +1451,10 @@ static bool AddFileContentToZip(void *zip_writer, const fs::path &file_path)
     bool success = true;
 
     do {
-        input.read(buff.data(), buff.size());
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileRead);
+            input.read(buff.data(), buff.size());
+        }
         sizeRead = static_cast<size_t>(input.gcount());
 
         if (input.bad()) {
@@ -421,47 +1464,426 @@ static bool AddFileContentToZip(void *zip_writer, const fs::path &file_path)
 
         if (sizeRead > 0) {
             // mz_zip_writer_entry_write returns bytes written (>0) on success, or negative error code
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
             int32_t written = mz_zip_writer_entry_write(zip_writer, buff.data(), static_cast<int32_t>(sizeRead));
             if (written < 0 || static_cast<size_t>(written) != sizeRead) {
                 success = false;
                 break;
             }
+            *total_read += sizeRead;
         }
+        FeedManifestFile(ctx, hash_job, buff.data(), sizeRead);
     } while (sizeRead > 0 && !input.eof());
 
     input.close();
     return success;
 }
 
-static bool AddFileEntryToZip(void *zip_writer, const fs::path &relative_path, const fs::path &absolute_path)
+// mz_zip_entry_write 一次最多写 int32 字节
+static bool ZipEntryWriteAll(void *zip_handle, const uint8_t *data, size_t size)
 {
-    if (!fs::exists(absolute_path))
+    while (size > 0) {
+        int32_t chunk = static_cast<int32_t>(std::min<size_t>(size, kZipBufSize));
+        if (mz_zip_entry_write(zip_handle, data, chunk) != chunk) {
+            return false;
+        }
+        data += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+// 由 codec 压缩并计算 CRC，压缩结果作为原始数据写入已用 raw 方式打开的条目；capture 非空时压缩数据同时写入压缩缓存
+static bool DeflateFileContentToZip(void *zip_writer, const fs::path &file_path, const ZipCodec *codec, uint64_t size_hint, const ArchiverContext &ctx, ManifestHasher::Job *hash_job, uint64_t *total_read, uint32_t *crc,
+                                    CompressedEntryCache::Writer *capture = nullptr)
+{
+    // span 只保存 detail 的指针，须用活得比它长的字符串
+    std::string codecName = ctx.trace ? codec->name : std::string();
+    ScopedTraceSpan span(ctx.trace, "read+deflate", "zip", codecName);
+    void *zip_handle = nullptr;
+    if (mz_zip_writer_get_zip_handle(zip_writer, &zip_handle) != MZ_OK) {
+        return false;
+    }
+    PooledDeflater deflater = AcquireDeflater(codec, MZ_COMPRESS_LEVEL_DEFAULT, size_hint);
+    if (!deflater) {
         return false;
+    }
 
-    // Keep filename alive until entry is closed
-    std::string filename_in_zip = ToZipPath(relative_path, false);
-    
-    if (!OpenNewFileEntry(zip_writer, filename_in_zip, absolute_path, false))
+    std::ifstream input;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileRead);
+        input.open(file_path.string(), std::ios::binary);
+    }
+    if (!input) {
         return false;
+    }
+
+    CodecSink sink = [zip_handle, capture](const uint8_t *data, size_t size) {
+        if (capture) {
+            // 缓存写入失败只放弃这次放入，不影响归档
+            capture->Append(data, size);
+        }
+        return ZipEntryWriteAll(zip_handle, data, size);
+    };
+
+    std::vector<char> buff(kZipBufSize);
+    bool success = true;
+
+    for (;;) {
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileRead);
+            input.read(buff.data(), buff.size());
+        }
+        size_t sizeRead = static_cast<size_t>(input.gcount());
+
+        if (input.bad()) {
+            success = false;
+            break;
+        }
+
+        bool finish = input.eof() || sizeRead == 0;
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(buff.data());
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Crc);
+            *crc = codec->crc32(*crc, data, sizeRead);
+        }
+        FeedManifestFile(ctx, hash_job, data, sizeRead);
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
+        if (!deflater->Deflate(data, sizeRead, finish, sink)) {
+            success = false;
+            break;
+        }
+        *total_read += sizeRead;
+        if (finish) {
+            break;
+        }
+    }
+
+    input.close();
+    return success;
+}
+
+// 内存中的内容写入已打开的条目：有 codec 时由它压缩并以 raw 方式写入，否则交给 minizip；capture 非空时压缩数据同时写入压缩缓存
+static bool AddBufferContentToZip(void *zip_writer, const uint8_t *data, size_t size, const ZipCodec *codec, const ArchiverContext &ctx, ManifestHasher::Job *hash_job, uint32_t *crc,
+                                  CompressedEntryCache::Writer *capture = nullptr)
+{
+    FeedManifestFile(ctx, hash_job, data, size);
+    if (codec) {
+        void *zip_handle = nullptr;
+        if (mz_zip_writer_get_zip_handle(zip_writer, &zip_handle) != MZ_OK) {
+            return false;
+        }
+        PooledDeflater deflater = AcquireDeflater(codec, MZ_COMPRESS_LEVEL_DEFAULT, size);
+        if (!deflater) {
+            return false;
+        }
+        {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Crc);
+            *crc = codec->crc32(0, data, size);
+        }
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
+        return deflater->Deflate(data, size, true, [zip_handle, capture](const uint8_t *out, size_t outSize) {
+            if (capture) {
+                capture->Append(out, outSize);
+            }
+            return ZipEntryWriteAll(zip_handle, out, outSize);
+        });
+    }
+
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
+    while (size > 0) {
+        int32_t chunk = static_cast<int32_t>(std::min<size_t>(size, kZipBufSize));
+        if (mz_zip_writer_entry_write(zip_writer, data, chunk) != chunk) {
+            return false;
+        }
+        data += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+// 当前写入位置，用于统计单个条目写入归档的字节数（含本地文件头）
+static int64_t ZipWriterTell(void *zip_writer)
+{
+    void *zip_handle = nullptr;
+    void *stream = nullptr;
+    if (mz_zip_writer_get_zip_handle(zip_writer, &zip_handle) != MZ_OK || mz_zip_get_stream(zip_handle, &stream) != MZ_OK) {
+        return 0;
+    }
+    return mz_stream_tell(stream);
+}
+
+// 整块读入文件；大小与扫描时不同 (文件正被改动) 时返回 false
+static bool ReadFileContent(const fs::path &file_path, uint64_t size, std::vector<uint8_t> &data, const ArchiverContext &ctx)
+{
+    ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::FileRead);
+    std::ifstream input(file_path.string(), std::ios::binary);
+    data.resize(static_cast<size_t>(size));
+    input.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(size));
+    return input && input.peek() == std::ifstream::traits_type::eof();
+}
 
-    bool success = AddFileContentToZip(zip_writer, absolute_path);
-    if (!CloseNewFileEntry(zip_writer))
+// 压缩缓存命中时写入缓存中的压缩数据；content 为已读入的文件内容，为空时清单摘要从原文件读取
+static bool AddCachedFileContentToZip(void *zip_writer, CompressedEntryCache::Object &object, const std::vector<uint8_t> *content, const fs::path &file_path, const ArchiverContext &ctx,
+                                      ManifestHasher::Job *hash_job)
+{
+    ScopedTraceSpan span(ctx.trace, "cached", "zip");
+    void *zip_handle = nullptr;
+    if (mz_zip_writer_get_zip_handle(zip_writer, &zip_handle) != MZ_OK) {
         return false;
+    }
+    bool success;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Cache);
+        success = ctx.entryCache->ReadObject(object, [zip_handle](const uint8_t *data, size_t size) {
+            return ZipEntryWriteAll(zip_handle, data, size);
+        });
+    }
+    if (content) {
+        FeedManifestFile(ctx, hash_job, content->data(), content->size());
+        return success;
+    }
+    return FeedManifestFromFile(ctx, hash_job, file_path) && success;
+}
+
+static bool AddFileEntryToZip(void *zip_writer, const std::string &bundle_prefix, const BundleEntry &entry, const fs::path &absolute_path, const ArchiverContext &ctx)
+{
+    auto entryStart = ctx.stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    int64_t archiveOffset = ctx.stats ? ZipWriterTell(zip_writer) : 0;
+
+    // Keep filename alive until entry is closed
+    std::string filename_in_zip;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::PathConversion);
+        filename_in_zip = ToZipPath(bundle_prefix, entry);
+    }
+    ScopedTraceSpan span(ctx.trace, "compress", "zip", filename_in_zip);
+    AYZipLogDebug("compress {}", filename_in_zip);
+
+    uint64_t file_size = entry.size;
+    const ZipCodec *codec = ctx.codec ? ZipCodecForEntry(ctx.codec, file_size) : nullptr;
+    if (!OpenNewFileEntry(zip_writer, filename_in_zip, entry.modifiedTime, EntryMode(entry, ctx), ctx, codec != nullptr))
+        return false;
+
+    // 压缩缓存以内容摘要为键；后端、级别相同时压缩数据相同，确定性模式的输出不受缓存影响
+    // 不超过 kZipWholeReadSize 的文件整块读入，摘要、压缩与清单共用这一次读取；更大的文件单独读一遍算摘要
+    CompressedEntryKey key;
+    CompressedEntryCache::Object cached;
+    std::vector<uint8_t> &content = ctx.buffers->uncompressed;
+    bool cacheable = codec && ctx.entryCache && ctx.entryCache->Eligible(file_size);
+    bool inMemory = false;
+    if (cacheable && file_size <= kZipWholeReadSize) {
+        inMemory = ReadFileContent(absolute_path, file_size, content, ctx);
+        cacheable = inMemory;
+    }
+    bool hit = false;
+    if (cacheable) {
+        key.codec = codec->name;
+        key.level = MZ_COMPRESS_LEVEL_DEFAULT;
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Cache);
+        if (inMemory) {
+            key.digest = Sha256Of(content.data(), content.size());
+        }
+        else {
+            cacheable = Sha256OfFile(absolute_path, &key.digest);
+        }
+        hit = cacheable && ctx.entryCache->Lookup(key, cached) && cached.method == MZ_COMPRESS_METHOD_DEFLATE && cached.uncompressedSize == file_size;
+    }
+
+    uint64_t total_read = 0;
+    bool success;
+    ManifestHasher::Job *hash_job = BeginManifestFile(ctx, filename_in_zip);
+    if (hit) {
+        success = AddCachedFileContentToZip(zip_writer, cached, inMemory ? &content : nullptr, absolute_path, ctx, hash_job);
+        total_read = cached.uncompressedSize;
+        success = CloseRawFileEntry(zip_writer, total_read, cached.crc, ctx) && success;
+    }
+    else if (codec) {
+        std::unique_ptr<CompressedEntryCache::Writer> capture;
+        if (cacheable) {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Cache);
+            capture = ctx.entryCache->BeginInsert(key, MZ_COMPRESS_METHOD_DEFLATE);
+        }
+        uint32_t crc = 0;
+        if (inMemory) {
+            success = AddBufferContentToZip(zip_writer, content.data(), content.size(), codec, ctx, hash_job, &crc, capture.get());
+            total_read = content.size();
+        }
+        else {
+            success = DeflateFileContentToZip(zip_writer, absolute_path, codec, file_size, ctx, hash_job, &total_read, &crc, capture.get());
+        }
+        success = CloseRawFileEntry(zip_writer, total_read, crc, ctx) && success;
+        // 大小与扫描时不同说明文件在算摘要之后被改动，摘要已不对应压缩的内容
+        if (capture && success && total_read == file_size) {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Cache);
+            capture->Commit(crc, total_read);
+        }
+    }
+    else {
+        success = AddFileContentToZip(zip_writer, absolute_path, ctx, hash_job, &total_read);
+        success = CloseNewFileEntry(zip_writer, ctx) && success;
+    }
+    EndManifestFile(ctx, hash_job, success);
+
+    if (ctx.stats && success) {
+        ArchiverEntryStat entry;
+        entry.name = filename_in_zip;
+        entry.compressionMethod = MZ_COMPRESS_METHOD_DEFLATE;
+        entry.bytesIn = total_read;
+        entry.bytesOut = static_cast<uint64_t>(std::max<int64_t>(ZipWriterTell(zip_writer) - archiveOffset, 0));
+        entry.uncompressedSize = total_read;
+        entry.elapsedNs = ElapsedNs(entryStart);
+        ctx.stats->AddEntry(std::move(entry));
+    }
 
     return success;
 }
 
-static bool AddDirectoryEntryToZip(void *zip_writer, const fs::path &relative_path, const fs::path &absolute_path)
+static bool AddDirectoryEntryToZip(void *zip_writer, const std::string &bundle_prefix, const BundleEntry &entry, const ArchiverContext &ctx)
 {
     // Keep filename alive until entry is closed
-    std::string filename_in_zip = ToZipPath(relative_path, true);
-    return OpenNewFileEntry(zip_writer, filename_in_zip, absolute_path, true) && CloseNewFileEntry(zip_writer);
+    std::string filename_in_zip;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::PathConversion);
+        filename_in_zip = ToZipPath(bundle_prefix, entry);
+    }
+    ScopedTraceSpan span(ctx.trace, "directory", "zip", filename_in_zip);
+    if (ctx.stats) {
+        ctx.stats->AddDirectory();
+    }
+    return OpenNewFileEntry(zip_writer, filename_in_zip, entry.modifiedTime, EntryMode(entry, ctx), ctx) && CloseNewFileEntry(zip_writer, ctx);
+}
+
+#ifndef _WIN32
+// 与 Info-ZIP / ditto 一致：S_IFLNK 属性，条目内容为链接目标
+static bool AddSymlinkEntryToZip(void *zip_writer, const std::string &bundle_prefix, const BundleEntry &entry, const fs::path &absolute_path, const ArchiverContext &ctx)
+{
+    std::string target;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+        target = fs::read_symlink(absolute_path).string();
+    }
+
+    std::string filename_in_zip;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::PathConversion);
+        filename_in_zip = ToZipPath(bundle_prefix, entry);
+    }
+    ScopedTraceSpan span(ctx.trace, "symlink", "zip", filename_in_zip);
+    if (ctx.codeResources) {
+        ctx.codeResources->AddSymlink(filename_in_zip, target);
+    }
+
+    if (!OpenNewFileEntry(zip_writer, filename_in_zip, entry.modifiedTime, 0120755, ctx))
+        return false;
+
+    bool success;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
+        int32_t written = mz_zip_writer_entry_write(zip_writer, target.data(), static_cast<int32_t>(target.size()));
+        success = written == static_cast<int32_t>(target.size());
+    }
+    return CloseNewFileEntry(zip_writer, ctx) && success;
+}
+#endif
+
+static bool IsCodeSignatureDirectory(const BundleEntry &entry)
+{
+    static const fs::path::string_type kDirectory = fs::path("_CodeSignature").native();
+    return entry.type == BundleEntryType::Directory && entry.relativePath == kDirectory;
+}
+
+static bool IsCodeResourcesFile(const BundleEntry &entry)
+{
+    static const fs::path::string_type kFile = (fs::path("_CodeSignature") / "CodeResources").native();
+    return entry.type != BundleEntryType::Directory && entry.relativePath == kFile;
 }
 
-bool ZipAppBundle(const std::string &appPath, const std::string &archivePath)
+// 等所有文件的摘要算完后生成文档；writeToArchive 时作为最后一个条目写入，包内没有 _CodeSignature 目录时先补上目录条目
+static bool FinishCodeResources(void *zip_writer, const std::string &bundle_prefix, CodeResourcesBuilder &builder, const ContentManifest &manifest, size_t manifest_start,
+                                bool has_signature_directory, CodeResourcesOptions &options, const ArchiverContext &ctx)
+{
+    {
+        ScopedTraceSpan span(ctx.trace, "wait for hashes", "zip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Manifest);
+        ctx.hasher->Wait();
+    }
+    {
+        ScopedTraceSpan span(ctx.trace, "CodeResources", "zip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CodeResources);
+        const std::vector<ManifestEntry> &entries = manifest.Entries();
+        for (size_t i = manifest_start; i < entries.size(); i++) {
+            builder.AddFile(entries[i]);
+        }
+        options.document = builder.Build(options.nestedCode);
+    }
+    if (!options.writeToArchive) {
+        return true;
+    }
+
+    BundleEntry entry;
+    entry.modifiedTime = std::time(nullptr);
+    if (!has_signature_directory) {
+        entry.type = BundleEntryType::Directory;
+        entry.relativePath = fs::path("_CodeSignature").native();
+        entry.mode = 0040755;
+        if (!AddDirectoryEntryToZip(zip_writer, bundle_prefix, entry, ctx)) {
+            return false;
+        }
+    }
+
+    entry.type = BundleEntryType::File;
+    entry.relativePath = (fs::path("_CodeSignature") / "CodeResources").native();
+    entry.size = options.document.size();
+    entry.mode = 0100644;
+    std::string filename_in_zip = ToZipPath(bundle_prefix, entry);
+    if (!OpenNewFileEntry(zip_writer, filename_in_zip, entry.modifiedTime, EntryMode(entry, ctx), ctx))
+        return false;
+
+    ManifestHasher::Job *hash_job = BeginManifestFile(ctx, filename_in_zip);
+    bool success;
+    {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Deflate);
+        int32_t written = mz_zip_writer_entry_write(zip_writer, options.document.data(), static_cast<int32_t>(options.document.size()));
+        success = written == static_cast<int32_t>(options.document.size());
+    }
+    FeedManifestFile(ctx, hash_job, options.document.data(), options.document.size());
+    success = CloseNewFileEntry(zip_writer, ctx) && success;
+    EndManifestFile(ctx, hash_job, success);
+    return success;
+}
+
+bool ZipAppBundle(const std::string &appPath, const std::string &archivePath, const ArchiverOptions &options)
 {
     fs::path appBundlePath = appPath;
     fs::path ipaPath = archivePath;
+    TraceSession traceSession(options.tracePath);
+    ExtractBuffers buffers;
+    ArchiverContext ctx;
+    ctx.stats = options.stats;
+    ctx.deterministic = options.deterministic;
+    ctx.trace = traceSession.recorder();
+    ctx.buffers = &buffers;
+    ctx.entryCache = options.compressedEntryCache;
+    // CodeResources 需要每个文件的摘要，调用方没有提供清单时使用本次压缩私有的清单
+    ContentManifest localManifest;
+    ContentManifest *manifest = options.manifest ? options.manifest : (options.codeResources ? &localManifest : nullptr);
+    size_t manifestStart = manifest ? manifest->Entries().size() : 0;
+    std::unique_ptr<ManifestHasher> hasher;
+    if (manifest) {
+        hasher.reset(new ManifestHasher(manifest, ctx.trace));
+        ctx.hasher = hasher.get();
+    }
+    ScopedRunTimer runTimer(ctx.stats);
+    ScopedTraceSpan runSpan(ctx.trace, "ZipAppBundle", "zip", appPath);
+
+    if (!ResolveCodec(options, ctx)) {
+        return false;
+    }
+    if (ctx.codec == nullptr) {
+        // minizip 流式路径不以 raw 方式写入，无法写出缓存中的压缩数据
+        ctx.entryCache = nullptr;
+    }
 
     auto appBundleFilename = appBundlePath.filename();
 
@@ -482,7 +1904,6 @@ bool ZipAppBundle(const std::string &appPath, const std::string &archivePath)
             AYError("mz_zip_writer_create failed");
             return false;
         }
-
         int32_t err = mz_zip_writer_open_file(zip_writer, ipaPath.string().c_str(), 0, 0);
         if (err != MZ_OK) {
             AYError("mz_zip_writer_open_file failed: {}", archivePath);
@@ -490,33 +1911,83 @@ bool ZipAppBundle(const std::string &appPath, const std::string &archivePath)
             return false;
         }
 
-        fs::path appBundleDirectory = fs::path("Payload") / appBundleFilename;
+        std::string bundlePrefix = (fs::path("Payload") / appBundleFilename).u8string();
+        bundlePrefix += static_cast<char>(fs::path::preferred_separator);
+
+        std::unique_ptr<CodeResourcesBuilder> codeResources;
+        bool replaceCodeResources = options.codeResources && options.codeResources->writeToArchive;
+        bool hasSignatureDirectory = false;
+        if (options.codeResources) {
+            std::string zipPrefix;
+            LocalPathToZipPath(bundlePrefix, true, zipPrefix);
+            std::string executable = options.codeResources->executable;
+            if (executable.empty()) {
+                executable = ReadInfoPlistString(appBundlePath / "Info.plist", "CFBundleExecutable");
+            }
+            codeResources.reset(new CodeResourcesBuilder(zipPrefix, executable));
+            ctx.codeResources = codeResources.get();
+        }
 
         // must add
         //AddDirectoryEntryToZip(zip_writer, "Payload", "");
 
-        for (auto &entry : fs::recursive_directory_iterator(appBundlePath)) {
-            auto absolute_path = entry.path();
-            auto relativePath = appBundleDirectory / fs::relative(absolute_path, appBundlePath);
+        // 类型、大小、时间、权限在扫描时一次取得，压缩阶段不再查询元数据
+        // 子目录由工作线程并行列出，本线程按确定顺序边遍历边压缩；等待目录列出的时间计入 Scan
+        auto scanStart = std::chrono::steady_clock::now();
+        bool success = WalkBundle(appBundlePath, options.scanThreads, [&](const BundleEntry &entry) {
+            if (ctx.stats) {
+                ctx.stats->AddPhaseTime(ArchiverPhase::Scan, ElapsedNs(scanStart));
+            }
 
-            if (entry.is_directory()) {
-                if (!AddDirectoryEntryToZip(zip_writer, relativePath, absolute_path)) {
-                    mz_zip_writer_close(zip_writer);
-                    mz_zip_writer_delete(&zip_writer);
-                    return false;
-                }
+            if (replaceCodeResources && IsCodeResourcesFile(entry)) {
+                // 由生成的文档替换
+                scanStart = std::chrono::steady_clock::now();
+                return true;
             }
-            else {
-                if (!AddFileEntryToZip(zip_writer, relativePath, absolute_path)) {
-                    mz_zip_writer_close(zip_writer);
-                    mz_zip_writer_delete(&zip_writer);
-                    return false;
-                }
+            hasSignatureDirectory = hasSignatureDirectory || IsCodeSignatureDirectory(entry);
+
+            bool added;
+            switch (entry.type) {
+                case BundleEntryType::Directory:
+                    added = AddDirectoryEntryToZip(zip_writer, bundlePrefix, entry, ctx);
+                    break;
+#ifndef _WIN32
+                case BundleEntryType::Symlink:
+                    added = AddSymlinkEntryToZip(zip_writer, bundlePrefix, entry, appBundlePath / entry.relativePath, ctx);
+                    break;
+#endif
+                default:
+                    added = AddFileEntryToZip(zip_writer, bundlePrefix, entry, appBundlePath / entry.relativePath, ctx);
+                    break;
             }
+            scanStart = std::chrono::steady_clock::now();
+            return added;
+        }, ctx.trace);
+        if (!success) {
+            mz_zip_writer_close(zip_writer);
+            mz_zip_writer_delete(&zip_writer);
+            return false;
+        }
+        if (ctx.stats) {
+            ctx.stats->AddPhaseTime(ArchiverPhase::Scan, ElapsedNs(scanStart));
+        }
+
+        if (codeResources && !FinishCodeResources(zip_writer, bundlePrefix, *codeResources, *manifest, manifestStart, hasSignatureDirectory, *options.codeResources, ctx)) {
+            mz_zip_writer_close(zip_writer);
+            mz_zip_writer_delete(&zip_writer);
+            return false;
         }
 
-        mz_zip_writer_close(zip_writer);
+        {
+            ScopedTraceSpan span(ctx.trace, "write central directory", "zip");
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+            mz_zip_writer_close(zip_writer);
+        }
         mz_zip_writer_delete(&zip_writer);
+        if (ctx.entryCache) {
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Cache);
+            ctx.entryCache->TrimIfNeeded();
+        }
         return true;
     }
     catch (const std::exception &e) {
@@ -529,3 +2000,555 @@ bool ZipAppBundle(const std::string &appPath, const std::string &archivePath)
 
     return false;
 }
+
+
+/********************************************
+ *                                          *
+ *            PatchAppArchive               *
+ *                                          *
+ ********************************************/
+// 同一路径以最后一个补丁为准；additions 按路径首次出现的顺序
+struct PatchSet {
+    std::unordered_map<std::string, const ArchivePatch *> puts;
+    std::vector<const ArchivePatch *> additions;
+    std::unordered_set<std::string> removals;
+    std::vector<std::string> removedDirectories;
+
+    bool Build(const std::vector<ArchivePatch> &patches, const char *caller)
+    {
+        for (const ArchivePatch &patch : patches) {
+            if (patch.path.empty()) {
+                AYError("{}: empty entry path", caller);
+                return false;
+            }
+            if (patch.remove) {
+                puts.erase(patch.path);
+                removals.insert(patch.path);
+                if (endsWith(patch.path, "/")) {
+                    removedDirectories.push_back(patch.path);
+                }
+                continue;
+            }
+            if (patch.file.empty() && patch.data == nullptr && patch.size != 0) {
+                AYError("{}: no content for {}", caller, patch.path);
+                return false;
+            }
+            removals.erase(patch.path);
+            if (puts.find(patch.path) == puts.end()) {
+                additions.push_back(&patch);
+            }
+            puts[patch.path] = &patch;
+        }
+        return true;
+    }
+
+    bool IsRemoved(const std::string &name) const
+    {
+        if (removals.count(name)) {
+            return true;
+        }
+        for (const std::string &directory : removedDirectories) {
+            if (startsWith(name, directory)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static bool AddPatchEntryToZip(void *zip_writer, const ArchivePatch &patch, uint32_t mode, const ArchiverContext &ctx)
+{
+    ScopedTraceSpan span(ctx.trace, "patch", "zip", patch.path);
+    AYZipLogDebug("patch {}", patch.path);
+
+    uint64_t size = patch.size;
+    if (!patch.file.empty()) {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::Metadata);
+        std::error_code ec;
+        size = fs::file_size(patch.file, ec);
+        if (ec) {
+            AYError("Patch source not found: {}", patch.file);
+            return false;
+        }
+    }
+
+    const ZipCodec *codec = ctx.codec ? ZipCodecForEntry(ctx.codec, size) : nullptr;
+    if (!OpenNewFileEntry(zip_writer, patch.path, std::time(nullptr), mode, ctx, codec != nullptr))
+        return false;
+
+    uint64_t total_read = 0;
+    uint32_t crc = 0;
+    bool success;
+    ManifestHasher::Job *hash_job = BeginManifestFile(ctx, patch.path);
+    if (patch.file.empty()) {
+        success = AddBufferContentToZip(zip_writer, patch.data, patch.size, codec, ctx, hash_job, &crc);
+        total_read = patch.size;
+    }
+    else if (codec) {
+        success = DeflateFileContentToZip(zip_writer, patch.file, codec, size, ctx, hash_job, &total_read, &crc);
+    }
+    else {
+        success = AddFileContentToZip(zip_writer, patch.file, ctx, hash_job, &total_read);
+    }
+    if (codec) {
+        success = CloseRawFileEntry(zip_writer, total_read, crc, ctx) && success;
+    }
+    else {
+        success = CloseNewFileEntry(zip_writer, ctx) && success;
+    }
+    EndManifestFile(ctx, hash_job, success);
+    return success;
+}
+
+// 替换时沿用原条目的类型与权限；新增条目或原条目没有 unix 属性 (Windows 生成) 时为普通文件 0644
+// 补丁总是提供文件内容，类型位固定为普通文件 (原条目可能是符号链接)，权限沿用原条目
+static uint32_t PatchEntryMode(const ArchivePatch &patch, uint32_t original_external_fa)
+{
+    uint32_t permissions = patch.mode ? (patch.mode & 07777) : ((original_external_fa >> 16) & 07777);
+    if (permissions == 0) {
+        permissions = 0644;
+    }
+    return 0100000 | permissions;
+}
+
+bool PatchAppArchive(const std::string &archivePath, const std::string &outputPath, const std::vector<ArchivePatch> &patches, const ArchiverOptions &options)
+{
+    TraceSession traceSession(options.tracePath);
+    ArchiverContext ctx;
+    ctx.stats = options.stats;
+    ctx.deterministic = options.deterministic;
+    ctx.trace = traceSession.recorder();
+    std::unique_ptr<ManifestHasher> hasher;
+    if (options.manifest) {
+        hasher.reset(new ManifestHasher(options.manifest, ctx.trace));
+        ctx.hasher = hasher.get();
+    }
+    ScopedRunTimer runTimer(ctx.stats);
+    ScopedTraceSpan runSpan(ctx.trace, "PatchAppArchive", "zip", archivePath);
+
+    if (!ResolveCodec(options, ctx)) {
+        return false;
+    }
+
+    PatchSet patchSet;
+    if (!patchSet.Build(patches, "PatchAppArchive")) {
+        return false;
+    }
+
+    fs::path targetPath = outputPath.empty() ? archivePath : outputPath;
+    fs::path partialPath = targetPath;
+    partialPath += ".partial";
+
+    void *zip_reader = nullptr;
+    void *zip_writer = nullptr;
+    bool success = true;
+    try {
+        zip_reader = mz_zip_reader_create();
+        zip_writer = mz_zip_writer_create();
+        if (zip_reader == nullptr || zip_writer == nullptr) {
+            AYError("mz_zip_reader_create / mz_zip_writer_create failed");
+            success = false;
+        }
+
+        int32_t err = MZ_OK;
+        if (success) {
+            ScopedTraceSpan span(ctx.trace, "open archive", "zip");
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+            err = mz_zip_reader_open_file(zip_reader, archivePath.c_str());
+            if (err != MZ_OK) {
+                AYError("mz_zip_reader_open_file failed: {}", archivePath);
+                success = false;
+            }
+            else if (mz_zip_writer_open_file(zip_writer, partialPath.string().c_str(), 0, 0) != MZ_OK) {
+                AYError("mz_zip_writer_open_file failed: {}", partialPath.string());
+                success = false;
+            }
+            else {
+                err = mz_zip_reader_goto_first_entry(zip_reader);
+            }
+        }
+
+        std::unordered_set<std::string> replaced;
+        while (success && err == MZ_OK) {
+            mz_zip_file *file_info = nullptr;
+            {
+                ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+                err = mz_zip_reader_entry_get_info(zip_reader, &file_info);
+            }
+            if (err != MZ_OK) {
+                break;
+            }
+
+            std::string name = file_info->filename;
+            auto put = patchSet.puts.find(name);
+            if (put != patchSet.puts.end()) {
+                success = AddPatchEntryToZip(zip_writer, *put->second, PatchEntryMode(*put->second, file_info->external_fa), ctx);
+                replaced.insert(name);
+            }
+            else if (!patchSet.IsRemoved(name)) {
+                ScopedTraceSpan span(ctx.trace, "copy", "zip", name);
+                auto copyStart = std::chrono::steady_clock::now();
+                success = mz_zip_writer_copy_from_reader(zip_writer, zip_reader) == MZ_OK;
+                if (ctx.stats) {
+                    uint64_t elapsed = ElapsedNs(copyStart);
+                    ctx.stats->AddPhaseTime(ArchiverPhase::RawCopy, elapsed);
+                    ArchiverEntryStat entry;
+                    entry.name = name;
+                    entry.compressionMethod = file_info->compression_method;
+                    entry.bytesIn = static_cast<uint64_t>(file_info->compressed_size);
+                    entry.bytesOut = entry.bytesIn;
+                    entry.uncompressedSize = static_cast<uint64_t>(file_info->uncompressed_size);
+                    entry.elapsedNs = elapsed;
+                    ctx.stats->AddEntry(std::move(entry));
+                }
+            }
+            if (!success) {
+                AYError("Patch entry failed: {}", name);
+                break;
+            }
+
+            ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+            err = mz_zip_reader_goto_next_entry(zip_reader);
+        }
+        if (success && err != MZ_OK && err != MZ_END_OF_LIST) {
+            AYError("Read central directory failed: {}", archivePath);
+            success = false;
+        }
+
+        // 原包中没有的路径按补丁顺序追加
+        for (const ArchivePatch *patch : patchSet.additions) {
+            if (!success) {
+                break;
+            }
+            if (!replaced.count(patch->path) && patchSet.puts[patch->path] == patch) {
+                success = AddPatchEntryToZip(zip_writer, *patch, PatchEntryMode(*patch, 0), ctx);
+            }
+        }
+    }
+    catch (const std::exception &e) {
+        AYError("{}", e.what());
+        success = false;
+    }
+
+    if (zip_writer) {
+        ScopedTraceSpan span(ctx.trace, "write central directory", "zip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+        success = mz_zip_writer_close(zip_writer) == MZ_OK && success;
+        mz_zip_writer_delete(&zip_writer);
+    }
+    if (zip_reader) {
+        mz_zip_reader_close(zip_reader);
+        mz_zip_reader_delete(&zip_reader);
+    }
+
+    std::error_code ec;
+    if (success) {
+        fs::rename(partialPath, targetPath, ec);
+        if (ec) {
+            AYError("Rename {} failed: {}", partialPath.string(), ec.message());
+            success = false;
+        }
+    }
+    if (!success) {
+        fs::remove(partialPath, ec);
+    }
+    return success;
+}
+
+bool CompactAppArchive(const std::string &archivePath, const std::string &outputPath, const ArchiverOptions &options)
+{
+    // 原样复制中央目录引用的条目，追加留下的空洞与旧中央目录随之丢弃
+    return PatchAppArchive(archivePath, outputPath, std::vector<ArchivePatch>(), options);
+}
+
+/********************************************
+ *                                          *
+ *            AppendToAppArchive            *
+ *                                          *
+ ********************************************/
+bool AppendToAppArchive(const std::string &archivePath, const std::vector<ArchivePatch> &patches, const ArchiverOptions &options)
+{
+    TraceSession traceSession(options.tracePath);
+    ArchiverContext ctx;
+    ctx.stats = options.stats;
+    ctx.deterministic = options.deterministic;
+    ctx.trace = traceSession.recorder();
+    std::unique_ptr<ManifestHasher> hasher;
+    if (options.manifest) {
+        hasher.reset(new ManifestHasher(options.manifest, ctx.trace));
+        ctx.hasher = hasher.get();
+    }
+    ScopedRunTimer runTimer(ctx.stats);
+    ScopedTraceSpan runSpan(ctx.trace, "AppendToAppArchive", "zip", archivePath);
+
+    if (!ResolveCodec(options, ctx)) {
+        return false;
+    }
+    PatchSet patchSet;
+    if (!patchSet.Build(patches, "AppendToAppArchive")) {
+        return false;
+    }
+
+    ZipCentralDirectory original;
+    {
+        ScopedTraceSpan span(ctx.trace, "read central directory", "zip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+        if (!ReadZipCentralDirectory(archivePath, original)) {
+            AYError("AppendToAppArchive: unsupported archive layout: {}", archivePath);
+            return false;
+        }
+    }
+    std::unordered_map<std::string, uint32_t> originalAttributes;
+    for (const ZipCentralRecord &record : original.records) {
+        originalAttributes[record.name] = record.externalAttributes;
+    }
+
+    // 写入开始后失败需要回滚尾部，能提前发现的错误先检查
+    std::error_code ec;
+    for (const ArchivePatch *patch : patchSet.additions) {
+        if (patchSet.puts[patch->path] == patch && !patch->file.empty() && !fs::is_regular_file(patch->file, ec)) {
+            AYError("Patch source not found: {}", patch->file);
+            return false;
+        }
+    }
+
+    void *stream = mz_stream_os_create();
+    void *zip_writer = mz_zip_writer_create();
+    bool success = true;
+    bool touched = false;
+    int64_t data_end = 0;
+    int64_t tail_end = 0;
+    try {
+        if (stream == nullptr || zip_writer == nullptr) {
+            AYError("mz_stream_os_create / mz_zip_writer_create failed");
+            success = false;
+        }
+        else if (mz_stream_os_open(stream, archivePath.c_str(), MZ_OPEN_MODE_READWRITE | MZ_OPEN_MODE_APPEND) != MZ_OK ||
+                 mz_stream_seek(stream, static_cast<int64_t>(original.offset), MZ_SEEK_SET) != MZ_OK) {
+            AYError("Open {} for append failed", archivePath);
+            success = false;
+        }
+        else if (mz_zip_writer_open(zip_writer, stream, 0) != MZ_OK) {
+            AYError("mz_zip_writer_open failed: {}", archivePath);
+            success = false;
+        }
+        touched = success;
+
+        // 新条目从旧中央目录的位置开始写，替换的条目只在中央目录里换成新记录
+        for (const ArchivePatch *patch : patchSet.additions) {
+            if (!success) {
+                break;
+            }
+            if (patchSet.puts[patch->path] != patch) {
+                continue;
+            }
+            auto attributes = originalAttributes.find(patch->path);
+            uint32_t external_fa = attributes != originalAttributes.end() ? attributes->second : 0;
+            success = AddPatchEntryToZip(zip_writer, *patch, PatchEntryMode(*patch, external_fa), ctx);
+            if (!success) {
+                AYError("Append entry failed: {}", patch->path);
+            }
+        }
+        if (success) {
+            data_end = ZipWriterTell(zip_writer);
+        }
+    }
+    catch (const std::exception &e) {
+        AYError("{}", e.what());
+        success = false;
+    }
+
+    // minizip 关闭时只写出新条目的中央目录，随后整体替换为合并后的中央目录
+    if (zip_writer) {
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+        success = mz_zip_writer_close(zip_writer) == MZ_OK && success;
+        mz_zip_writer_delete(&zip_writer);
+    }
+    if (stream) {
+        tail_end = mz_stream_tell(stream);
+        mz_stream_close(stream);
+        mz_stream_delete(&stream);
+    }
+
+    if (success) {
+        ScopedTraceSpan span(ctx.trace, "write central directory", "zip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+        // 新内容比旧尾部短时文件末尾还留着旧的 EOCD，先截断再读回新记录
+        ZipCentralDirectory appended;
+        fs::resize_file(archivePath, static_cast<uint64_t>(tail_end), ec);
+        success = !ec && ReadZipCentralDirectory(archivePath, appended) && appended.offset == static_cast<uint64_t>(data_end);
+        if (!success) {
+            AYError("Read appended central directory failed: {}", archivePath);
+        }
+        else {
+            std::vector<ZipCentralRecord> records;
+            records.reserve(original.records.size() + appended.records.size());
+            for (const ZipCentralRecord &record : original.records) {
+                if (!patchSet.puts.count(record.name) && !patchSet.IsRemoved(record.name)) {
+                    records.push_back(record);
+                }
+            }
+            records.insert(records.end(), appended.records.begin(), appended.records.end());
+            success = WriteZipCentralDirectory(archivePath, static_cast<uint64_t>(data_end), records, original.comment);
+            if (!success) {
+                AYError("Write central directory failed: {}", archivePath);
+            }
+        }
+    }
+
+    // 旧的本地条目没有被改动，写回原中央目录即可恢复原包
+    if (!success && touched && !WriteZipCentralDirectory(archivePath, original.offset, original.records, original.comment)) {
+        AYError("Restore central directory failed: {}", archivePath);
+    }
+    return success;
+}
+
+/********************************************
+ *                                          *
+ *             ZipBundleModel               *
+ *                                          *
+ ********************************************/
+// 从原包复制压缩数据，不解压也不重新计算 CRC
+static bool CopyRawEntryToZip(void *zip_writer, void *source_handle, int64_t source, const ArchiverContext &ctx)
+{
+    mz_zip_file *file_info = nullptr;
+    void *zip_handle = nullptr;
+    if (mz_zip_goto_entry(source_handle, source) != MZ_OK || mz_zip_entry_get_info(source_handle, &file_info) != MZ_OK ||
+        mz_zip_writer_get_zip_handle(zip_writer, &zip_handle) != MZ_OK) {
+        return false;
+    }
+
+    std::string name(file_info->filename ? file_info->filename : "");
+    ScopedTraceSpan span(ctx.trace, "copy", "zip", name);
+    auto copyStart = std::chrono::steady_clock::now();
+    if (mz_zip_entry_read_open(source_handle, 1, nullptr) != MZ_OK) {
+        return false;
+    }
+    bool success = mz_zip_entry_write_open(zip_handle, file_info, MZ_COMPRESS_LEVEL_DEFAULT, 1, nullptr) == MZ_OK;
+    if (success) {
+        std::unique_ptr<uint8_t[]> buf(new uint8_t[kZipBufSize]);
+        int32_t read;
+        while ((read = mz_zip_entry_read(source_handle, buf.get(), static_cast<int32_t>(kZipBufSize))) > 0) {
+            if (!ZipEntryWriteAll(zip_handle, buf.get(), static_cast<size_t>(read))) {
+                success = false;
+                break;
+            }
+        }
+        success = success && read == 0;
+        success = mz_zip_entry_close_raw(zip_handle, file_info->uncompressed_size, file_info->crc) == MZ_OK && success;
+    }
+    mz_zip_entry_close(source_handle);
+
+    if (ctx.stats) {
+        uint64_t elapsed = ElapsedNs(copyStart);
+        ctx.stats->AddPhaseTime(ArchiverPhase::RawCopy, elapsed);
+        ArchiverEntryStat entry;
+        entry.name = name;
+        entry.compressionMethod = file_info->compression_method;
+        entry.bytesIn = static_cast<uint64_t>(file_info->compressed_size);
+        entry.bytesOut = entry.bytesIn;
+        entry.uncompressedSize = static_cast<uint64_t>(file_info->uncompressed_size);
+        entry.elapsedNs = elapsed;
+        ctx.stats->AddEntry(std::move(entry));
+    }
+    return success;
+}
+
+static bool AddModelEntryToZip(void *zip_writer, const BundleModel::Entry &entry, const ArchiverContext &ctx)
+{
+    std::string path(entry.path);
+    ScopedTraceSpan span(ctx.trace, "model", "zip", path);
+    if (entry.type == BundleEntryType::Directory) {
+        return OpenNewFileEntry(zip_writer, path, entry.modifiedTime, entry.mode, ctx) && CloseNewFileEntry(zip_writer, ctx);
+    }
+
+    const ZipCodec *codec = ctx.codec && entry.type == BundleEntryType::File ? ZipCodecForEntry(ctx.codec, entry.content.size()) : nullptr;
+    if (!OpenNewFileEntry(zip_writer, path, entry.modifiedTime, entry.mode, ctx, codec != nullptr))
+        return false;
+
+    uint32_t crc = 0;
+    ManifestHasher::Job *hash_job = entry.type == BundleEntryType::File ? BeginManifestFile(ctx, path) : nullptr;
+    bool success = AddBufferContentToZip(zip_writer, entry.content.data(), entry.content.size(), codec, ctx, hash_job, &crc);
+    if (codec) {
+        success = CloseRawFileEntry(zip_writer, entry.content.size(), crc, ctx) && success;
+    }
+    else {
+        success = CloseNewFileEntry(zip_writer, ctx) && success;
+    }
+    EndManifestFile(ctx, hash_job, success);
+    return success;
+}
+
+bool ZipBundleModel(BundleModel &model, const std::string &archivePath, const ArchiverOptions &options)
+{
+    TraceSession traceSession(options.tracePath);
+    ArchiverContext ctx;
+    ctx.stats = options.stats;
+    ctx.deterministic = options.deterministic;
+    ctx.trace = traceSession.recorder();
+    std::unique_ptr<ManifestHasher> hasher;
+    if (options.manifest) {
+        hasher.reset(new ManifestHasher(options.manifest, ctx.trace));
+        ctx.hasher = hasher.get();
+    }
+    ScopedRunTimer runTimer(ctx.stats);
+    ScopedTraceSpan runSpan(ctx.trace, "ZipBundleModel", "zip", archivePath);
+
+    if (!ResolveCodec(options, ctx)) {
+        return false;
+    }
+
+    fs::path partialPath = archivePath;
+    partialPath += ".partial";
+
+    void *zip_writer = mz_zip_writer_create();
+    bool success = zip_writer != nullptr;
+    try {
+        if (!success) {
+            AYError("mz_zip_writer_create failed");
+        }
+        else if (mz_zip_writer_open_file(zip_writer, partialPath.string().c_str(), 0, 0) != MZ_OK) {
+            AYError("mz_zip_writer_open_file failed: {}", partialPath.string());
+            success = false;
+        }
+
+        for (const BundleModel::Entry &entry : model.Entries()) {
+            if (!success) {
+                break;
+            }
+            if (entry.modified || entry.source < 0) {
+                success = AddModelEntryToZip(zip_writer, entry, ctx);
+            }
+            else {
+                success = CopyRawEntryToZip(zip_writer, model.SourceHandle(), entry.source, ctx);
+            }
+            if (!success) {
+                AYError("Write entry failed: {}", std::string(entry.path));
+            }
+        }
+    }
+    catch (const std::exception &e) {
+        AYError("{}", e.what());
+        success = false;
+    }
+
+    if (zip_writer) {
+        ScopedTraceSpan span(ctx.trace, "write central directory", "zip");
+        ScopedPhaseTimer timer(ctx.stats, ArchiverPhase::CentralDirectory);
+        success = mz_zip_writer_close(zip_writer) == MZ_OK && success;
+        mz_zip_writer_delete(&zip_writer);
+    }
+
+    std::error_code ec;
+    if (success) {
+        fs::rename(partialPath, archivePath, ec);
+        if (ec) {
+            AYError("Rename {} failed: {}", partialPath.string(), ec.message());
+            success = false;
+        }
+    }
+    if (!success) {
+        fs::remove(partialPath, ec);
+    }
+    return success;
+}
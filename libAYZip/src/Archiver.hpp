@@ -1,4 +1,4 @@
-//
+﻿//
 //  Archiver.hpp
 //  AltSign-Windows
 //
@@ -9,9 +9,71 @@
 #ifndef Archiver_hpp
 #define Archiver_hpp
 
+#include "FileCloner.hpp"
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
+
+class ArchiverStats;
+class BundleModel;
+class CompressedEntryCache;
+class ContentManifest;
+class ExtractionCache;
+struct CodeResourcesOptions;
+
+struct ArchiverOptions {
+    ArchiverStats *stats = nullptr;     // 可选，非空时累计分阶段耗时与计数
+    std::string tracePath;              // 可选，非空时写出 Chrome trace JSON
+    std::string codec;                  // 可选，deflate/inflate 后端名（见 ZipCodec.hpp），为空时为 "zlib"；"minizip" 使用 minizip 内部的流式路径
+    unsigned int scanThreads = 0;       // 压缩时并行列目录的线程数，0 为按 CPU 数选择，1 为单线程
+    // 压缩时生成可复现的归档：条目时间固定为 1980-01-01、不写 NTFS 时间、权限只保留可执行位、"auto" 固定为 zlib
+    // 条目顺序总是确定的 (见 WalkBundle)；相同输入、相同后端版本得到逐字节相同的 ipa
+    bool deterministic = false;
+    // 可选，非空时在数据流上计算每个普通文件的 SHA-1 / SHA-256 / CRC 并追加到清单 (符号链接与目录不计入)
+    ContentManifest *manifest = nullptr;
+    // 可选，压缩时在同一遍读取中生成 _CodeSignature/CodeResources，结果写回 codeResources->document
+    CodeResourcesOptions *codeResources = nullptr;
+    // 解压时额外铺到这些目录 (不存在时创建)：数据只解压一次，其他目录按 cloneMode 从第一个目录克隆
+    std::vector<std::string> extraDestinations;
+    CloneMode cloneMode = CloneMode::Auto;
+    // 可选，解压时大文件先按原始数据的 SHA-256 + CRC + 大小从缓存克隆，未命中时解压后放入缓存；可在多次、多线程的解压间共用
+    ExtractionCache *extractionCache = nullptr;
+    // 可选，压缩时按文件内容的 SHA-256 (与压缩共用同一次读取) 查找已压缩的数据，命中时直接写入，未命中时压缩后放入；codec 为 "minizip" 时不使用
+    CompressedEntryCache *compressedEntryCache = nullptr;
+    // 增量解压到已有目录：条目的大小、CRC 与上次解压时的边车索引一致且文件未被改动时跳过，删除新包中已没有的文件 (见 ExtractionIndex.hpp)
+    bool incremental = false;
+    std::string incrementalIndexPath;   // 为空时为 <outputDirectory>.ayzip-index
+    // 解压时把文件、符号链接与目录的修改时间恢复为条目中记录的时间 (DOS / NTFS / Unix / Info-ZIP 扩展时间戳)，关闭时为解压时的当前时间
+    bool restoreTimestamps = true;
+};
+
+bool UnzipAppBundle(const std::string &archivePath, const std::string &outputDirectory, const ArchiverOptions &options = ArchiverOptions());
+bool ZipAppBundle(const std::string &appPath, const std::string &archivePath, const ArchiverOptions &options = ArchiverOptions());
+// 对已有 ipa 的少量条目打补丁：path 已存在时替换 (保持原位置)，不存在时追加到末尾
+struct ArchivePatch {
+    std::string path;               // zip 内路径 (UTF-8，'/' 分隔)，如 "Payload/Example.app/embedded.mobileprovision"
+    bool remove = false;            // 删除该条目；以 '/' 结尾时删除该目录及其下所有条目
+    std::string file;               // 新内容取自本地文件
+    const uint8_t *data = nullptr;  // file 为空时取自内存，调用期间有效
+    size_t size = 0;
+    uint32_t mode = 0;              // unix 权限 (如 0755)，0 时沿用原条目，新增条目为 0644
+};
+
+// 未修改的条目原样复制压缩数据，只压缩新内容并重写中央目录；outputPath 为空或与 archivePath 相同时原地替换
+// 先写入 outputPath + ".partial"，成功后再改名，失败时不影响原文件
+bool PatchAppArchive(const std::string &archivePath, const std::string &outputPath, const std::vector<ArchivePatch> &patches, const ArchiverOptions &options = ArchiverOptions());
+
+// 原地追加：新条目写在最后一个本地条目之后，只重写文件尾部的中央目录；被替换或删除的条目从中央目录去掉，数据留作空洞
+// 包很大而补丁很小时比 PatchAppArchive 少复制整个包；失败时写回原中央目录
+bool AppendToAppArchive(const std::string &archivePath, const std::vector<ArchivePatch> &patches, const ArchiverOptions &options = ArchiverOptions());
+// 回收多次追加留下的空洞，即不带补丁的 PatchAppArchive
+bool CompactAppArchive(const std::string &archivePath, const std::string &outputPath = "", const ArchiverOptions &options = ArchiverOptions());
+
+// 把内存中的包写成 ipa，未修改的条目原样复制压缩数据；通常通过 BundleModel::Save 调用
+bool ZipBundleModel(BundleModel &model, const std::string &archivePath, const ArchiverOptions &options = ArchiverOptions());
 
-bool UnzipAppBundle(const std::string &archivePath, const std::string &outputDirectory);
-bool ZipAppBundle(const std::string &appPath, const std::string &archivePath);
+// 不解压到磁盘，直接读取 ipa 中的 Mach-O 条目 (按魔数识别)，把摘要与各切片的页哈希追加到 options.manifest (必填，会开启页哈希)
+bool HashArchiveMachO(const std::string &archivePath, const ArchiverOptions &options);
 
 #endif /* Archiver_hpp */
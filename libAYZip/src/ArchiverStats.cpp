@@ -0,0 +1,177 @@
+﻿//
+//  ArchiverStats.cpp
+//  libAYZip
+//
+
+#include "ArchiverStats.hpp"
+#include <algorithm>
+#include <json/json.h>
+
+extern "C" {
+#include <minizip-ng/mz.h>
+}
+
+static const char *kPhaseNames[] = {
+    "centralDirectory",
+    "inflate",
+    "deflate",
+    "pathConversion",
+    "makeDirectory",
+    "fileRead",
+    "fileWrite",
+    "metadata",
+    "scan",
+    "crc",
+    "manifest",
+    "codeResources",
+    "rawCopy",
+    "clone",
+    "cache",
+};
+static_assert(sizeof(kPhaseNames) / sizeof(kPhaseNames[0]) == static_cast<size_t>(ArchiverPhase::Count),
+              "kPhaseNames must match ArchiverPhase");
+
+// 条目大小分桶上限，最后一桶为 >= 16MB
+static const uint64_t kSizeBucketLimits[] = { 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+static const char *kSizeBucketNames[] = { "<4K", "<64K", "<1M", "<16M", ">=16M" };
+
+static size_t SizeBucketIndex(uint64_t size)
+{
+    size_t i = 0;
+    for (; i < sizeof(kSizeBucketLimits) / sizeof(kSizeBucketLimits[0]); i++) {
+        if (size < kSizeBucketLimits[i])
+            break;
+    }
+    return i;
+}
+
+static std::string CompressionMethodName(uint16_t method)
+{
+    switch (method) {
+        case MZ_COMPRESS_METHOD_STORE: return "store";
+        case MZ_COMPRESS_METHOD_DEFLATE: return "deflate";
+        case MZ_COMPRESS_METHOD_BZIP2: return "bzip2";
+        case MZ_COMPRESS_METHOD_LZMA: return "lzma";
+        case MZ_COMPRESS_METHOD_ZSTD: return "zstd";
+        case MZ_COMPRESS_METHOD_XZ: return "xz";
+        case MZ_COMPRESS_METHOD_AES: return "aes";
+    }
+    return "method_" + std::to_string(method);
+}
+
+ArchiverStats::ArchiverStats(size_t slowestCount) : slowestCount_(slowestCount)
+{
+    for (auto &ns : phaseNs_) {
+        ns.store(0, std::memory_order_relaxed);
+    }
+}
+
+void ArchiverStats::AddRun(uint64_t ns)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    runs_++;
+    wallNs_ += ns;
+}
+
+void ArchiverStats::AddDirectory()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    directories_++;
+}
+
+void ArchiverStats::AddEntry(ArchiverEntryStat entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_++;
+    bytesIn_ += entry.bytesIn;
+    bytesOut_ += entry.bytesOut;
+    sizeBuckets_[SizeBucketIndex(entry.uncompressedSize)]++;
+    methods_[entry.compressionMethod]++;
+
+    if (slowestCount_ == 0)
+        return;
+    if (slowest_.size() >= slowestCount_ && slowest_.back().elapsedNs >= entry.elapsedNs)
+        return;
+
+    auto pos = std::upper_bound(slowest_.begin(), slowest_.end(), entry.elapsedNs,
+                                [](uint64_t ns, const ArchiverEntryStat &e) { return ns > e.elapsedNs; });
+    slowest_.insert(pos, std::move(entry));
+    if (slowest_.size() > slowestCount_) {
+        slowest_.pop_back();
+    }
+}
+
+void ArchiverStats::SetCodec(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    codec_ = name;
+}
+
+void ArchiverStats::Reset()
+{
+    for (auto &ns : phaseNs_) {
+        ns.store(0, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    runs_ = 0;
+    wallNs_ = 0;
+    codec_.clear();
+    files_ = 0;
+    directories_ = 0;
+    bytesIn_ = 0;
+    bytesOut_ = 0;
+    sizeBuckets_ = {};
+    methods_.clear();
+    slowest_.clear();
+}
+
+std::string ArchiverStats::ToJson() const
+{
+    Json::Value root;
+
+    Json::Value phases(Json::objectValue);
+    for (size_t i = 0; i < phaseNs_.size(); i++) {
+        phases[kPhaseNames[i]] = Json::UInt64(phaseNs_[i].load(std::memory_order_relaxed));
+    }
+    root["phasesNs"] = phases;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    root["runs"] = Json::UInt64(runs_);
+    root["wallNs"] = Json::UInt64(wallNs_);
+    root["codec"] = codec_;
+    root["bytesIn"] = Json::UInt64(bytesIn_);
+    root["bytesOut"] = Json::UInt64(bytesOut_);
+
+    Json::Value entries;
+    entries["files"] = Json::UInt64(files_);
+    entries["directories"] = Json::UInt64(directories_);
+
+    Json::Value buckets(Json::objectValue);
+    for (size_t i = 0; i < sizeBuckets_.size(); i++) {
+        buckets[kSizeBucketNames[i]] = Json::UInt64(sizeBuckets_[i]);
+    }
+    entries["sizeBuckets"] = buckets;
+
+    Json::Value methods(Json::objectValue);
+    for (const auto &method : methods_) {
+        methods[CompressionMethodName(method.first)] = Json::UInt64(method.second);
+    }
+    entries["methods"] = methods;
+    root["entries"] = entries;
+
+    Json::Value slowest(Json::arrayValue);
+    for (const auto &entry : slowest_) {
+        Json::Value item;
+        item["name"] = entry.name;
+        item["ns"] = Json::UInt64(entry.elapsedNs);
+        item["size"] = Json::UInt64(entry.uncompressedSize);
+        item["method"] = CompressionMethodName(entry.compressionMethod);
+        slowest.append(item);
+    }
+    root["slowest"] = slowest;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, root);
+}
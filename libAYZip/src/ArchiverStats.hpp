@@ -0,0 +1,144 @@
+﻿//
+//  ArchiverStats.hpp
+//  libAYZip
+//
+//  压缩/解压过程的分阶段耗时与计数统计
+//
+
+#ifndef ArchiverStats_hpp
+#define ArchiverStats_hpp
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 统计的阶段，耗时按纳秒累计
+enum class ArchiverPhase : int {
+    CentralDirectory = 0,   // 遍历中央目录、读取条目信息
+    Inflate,                // 解压（含 minizip 内部 CRC 校验）
+    Deflate,                // 压缩（含 minizip 内部 CRC 计算）
+    PathConversion,         // ToWindowsSafePath / FromWindowsSafePath / fs::relative
+    MakeDirectory,          // 创建目录
+    FileRead,               // 读取源文件
+    FileWrite,              // 写入目标文件
+    Metadata,               // fs::exists / last_write_time 等元数据查询
+    Scan,                   // 目录遍历
+    Crc,                    // CRC-32 计算与校验（minizip 内部路径计入 Inflate / Deflate）
+    Manifest,               // 把数据交给摘要线程（复制与排队满时的等待），摘要本身不在 I/O 线程上
+    CodeResources,          // 生成 CodeResources 文档
+    RawCopy,                // 打补丁时原样复制未修改条目的压缩数据
+    Clone,                  // 解压到多个目录时 reflink / 硬链接 / 复制到其他目录
+    Cache,                  // 解压缓存 / 压缩缓存的查找、校验、读取与放入
+    Count
+};
+
+struct ArchiverEntryStat {
+    std::string name;
+    uint16_t compressionMethod = 0;
+    uint64_t bytesIn = 0;           // 解压时为压缩数据，压缩时为原始数据
+    uint64_t bytesOut = 0;          // 解压时为原始数据，压缩时为压缩数据
+    uint64_t uncompressedSize = 0;  // 用于按大小分桶
+    uint64_t elapsedNs = 0;
+};
+
+class ArchiverStats
+{
+public:
+    explicit ArchiverStats(size_t slowestCount = 10);
+
+    void AddPhaseTime(ArchiverPhase phase, uint64_t ns)
+    {
+        phaseNs_[static_cast<int>(phase)].fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    void AddRun(uint64_t ns);
+    void AddDirectory();
+    void AddEntry(ArchiverEntryStat entry);
+    // 本次运行使用的 deflate/inflate 后端
+    void SetCodec(const std::string &name);
+
+    void Reset();
+    std::string ToJson() const;
+
+private:
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(ArchiverPhase::Count)> phaseNs_;
+
+    mutable std::mutex mutex_;
+    size_t slowestCount_;
+    uint64_t runs_ = 0;
+    uint64_t wallNs_ = 0;
+    std::string codec_;
+    uint64_t files_ = 0;
+    uint64_t directories_ = 0;
+    uint64_t bytesIn_ = 0;
+    uint64_t bytesOut_ = 0;
+    std::array<uint64_t, 5> sizeBuckets_ = {};
+    std::map<uint16_t, uint64_t> methods_;
+    std::vector<ArchiverEntryStat> slowest_;    // 按耗时降序
+};
+
+inline uint64_t ElapsedNs(std::chrono::steady_clock::time_point start)
+{
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+// 未启用统计时 (stats == nullptr) 仅有一次分支判断
+class ScopedPhaseTimer
+{
+public:
+    ScopedPhaseTimer(ArchiverStats *stats, ArchiverPhase phase) : stats_(stats), phase_(phase)
+    {
+        if (stats_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedPhaseTimer()
+    {
+        if (stats_) {
+            stats_->AddPhaseTime(phase_, ElapsedNs(start_));
+        }
+    }
+
+    ScopedPhaseTimer(const ScopedPhaseTimer &) = delete;
+    ScopedPhaseTimer &operator=(const ScopedPhaseTimer &) = delete;
+
+private:
+    ArchiverStats *stats_;
+    ArchiverPhase phase_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// 记录一次 UnzipAppBundle / ZipAppBundle 调用的总耗时
+class ScopedRunTimer
+{
+public:
+    explicit ScopedRunTimer(ArchiverStats *stats) : stats_(stats)
+    {
+        if (stats_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedRunTimer()
+    {
+        if (stats_) {
+            stats_->AddRun(ElapsedNs(start_));
+        }
+    }
+
+    ScopedRunTimer(const ScopedRunTimer &) = delete;
+    ScopedRunTimer &operator=(const ScopedRunTimer &) = delete;
+
+private:
+    ArchiverStats *stats_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif /* ArchiverStats_hpp */
@@ -0,0 +1,330 @@
+﻿//
+//  BundleModel.cpp
+//  libAYZip
+//
+
+#include "BundleModel.hpp"
+#include "Archiver.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <spdlog/AYLog.h>
+
+extern "C" {
+#include <minizip-ng/mz.h>
+#include <minizip-ng/mz_strm.h>
+#include <minizip-ng/mz_strm_mem.h>
+#include <minizip-ng/mz_strm_os.h>
+#include <minizip-ng/mz_zip.h>
+}
+
+namespace fs = std::filesystem;
+
+// 路径名按块分配，3 万个条目只需几十次分配
+constexpr size_t kArenaBlockSize = 64 * 1024;
+
+static bool EndsWithSlash(const std::string &path)
+{
+    return !path.empty() && path.back() == '/';
+}
+
+// 条目外部属性转为 unix mode；Windows 生成的包按类型给出默认值
+static uint32_t EntryModeFromInfo(const mz_zip_file *file_info, BundleEntryType type)
+{
+    uint32_t mode = 0;
+    if (mz_zip_attrib_convert(MZ_HOST_SYSTEM(file_info->version_madeby), file_info->external_fa, MZ_HOST_SYSTEM_UNIX, &mode) != MZ_OK) {
+        mode = 0;
+    }
+    if ((mode & 07777) == 0) {
+        switch (type) {
+            case BundleEntryType::Directory: return 040755;
+            case BundleEntryType::Symlink: return 0120755;
+            default: return 0100644;
+        }
+    }
+    return mode;
+}
+
+BundleModel::BundleModel()
+{
+}
+
+BundleModel::~BundleModel()
+{
+    Close();
+}
+
+void BundleModel::Close()
+{
+    if (zip_handle_) {
+        mz_zip_close(zip_handle_);
+        mz_zip_delete(&zip_handle_);
+    }
+    if (stream_) {
+        mz_stream_close(stream_);
+        mz_stream_delete(&stream_);
+    }
+    std::vector<uint8_t>().swap(archive_);
+    archivePath_.clear();
+    entries_.clear();
+    index_.clear();
+    arena_.clear();
+    arenaUsed_ = 0;
+    arenaBlockSize_ = 0;
+}
+
+std::string_view BundleModel::Intern(const std::string &path)
+{
+    size_t size = path.size() + 1;
+    if (arena_.empty() || arenaBlockSize_ - arenaUsed_ < size) {
+        arenaBlockSize_ = std::max(kArenaBlockSize, size);
+        arena_.emplace_back(new char[arenaBlockSize_]);
+        arenaUsed_ = 0;
+    }
+    char *name = arena_.back().get() + arenaUsed_;
+    std::memcpy(name, path.c_str(), size);
+    arenaUsed_ += size;
+    return std::string_view(name, path.size());
+}
+
+void BundleModel::Reindex()
+{
+    index_.clear();
+    index_.reserve(entries_.size());
+    for (size_t i = 0; i < entries_.size(); i++) {
+        index_[entries_[i].path] = i;
+    }
+}
+
+bool BundleModel::Load(const std::string &archivePath)
+{
+    Close();
+    // 直接从文件读取：只有 minizip 解析出的中央目录留在内存中，条目数据在 Read / 写回时按偏移读取
+    stream_ = mz_stream_os_create();
+    zip_handle_ = mz_zip_create();
+    if (stream_ == nullptr || zip_handle_ == nullptr) {
+        AYError("mz_stream_os_create / mz_zip_create failed");
+        Close();
+        return false;
+    }
+    if (mz_stream_open(stream_, archivePath.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+        AYError("Open {} failed", archivePath);
+        Close();
+        return false;
+    }
+    archivePath_ = archivePath;
+    return Open();
+}
+
+bool BundleModel::Load(std::vector<uint8_t> &&archive)
+{
+    Close();
+    // minizip 的内存流以 int32 表示长度
+    if (archive.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+        AYError("BundleModel: archive is too large to load into memory");
+        return false;
+    }
+    archive_ = std::move(archive);
+
+    stream_ = mz_stream_mem_create();
+    zip_handle_ = mz_zip_create();
+    if (stream_ == nullptr || zip_handle_ == nullptr) {
+        AYError("mz_stream_mem_create / mz_zip_create failed");
+        Close();
+        return false;
+    }
+    mz_stream_mem_set_buffer(stream_, archive_.data(), static_cast<int32_t>(archive_.size()));
+    if (mz_stream_open(stream_, nullptr, MZ_OPEN_MODE_READ) != MZ_OK) {
+        AYError("BundleModel: open memory stream failed");
+        Close();
+        return false;
+    }
+    return Open();
+}
+
+bool BundleModel::Open()
+{
+    if (mz_zip_open(zip_handle_, stream_, MZ_OPEN_MODE_READ) != MZ_OK) {
+        AYError("BundleModel: not a zip archive");
+        Close();
+        return false;
+    }
+
+    int32_t err = mz_zip_goto_first_entry(zip_handle_);
+    while (err == MZ_OK) {
+        mz_zip_file *file_info = nullptr;
+        if (mz_zip_entry_get_info(zip_handle_, &file_info) != MZ_OK) {
+            break;
+        }
+        Entry entry;
+        entry.path = Intern(file_info->filename ? file_info->filename : "");
+        if (mz_zip_entry_is_dir(zip_handle_) == MZ_OK) {
+            entry.type = BundleEntryType::Directory;
+        }
+        else if (mz_zip_entry_is_symlink(zip_handle_) == MZ_OK) {
+            entry.type = BundleEntryType::Symlink;
+        }
+        entry.mode = EntryModeFromInfo(file_info, entry.type);
+        entry.modifiedTime = file_info->modified_date;
+        entry.size = static_cast<uint64_t>(file_info->uncompressed_size);
+        entry.source = mz_zip_get_entry(zip_handle_);
+        entries_.push_back(std::move(entry));
+
+        err = mz_zip_goto_next_entry(zip_handle_);
+    }
+    if (err != MZ_END_OF_LIST) {
+        AYError("BundleModel: read central directory failed");
+        Close();
+        return false;
+    }
+    Reindex();
+    return true;
+}
+
+const BundleModel::Entry *BundleModel::Find(const std::string &path) const
+{
+    auto it = index_.find(path);
+    return it != index_.end() ? &entries_[it->second] : nullptr;
+}
+
+bool BundleModel::Read(const std::string &path, std::vector<uint8_t> &out)
+{
+    const Entry *entry = Find(path);
+    if (entry == nullptr) {
+        return false;
+    }
+    if (entry->modified || entry->source < 0) {
+        out = entry->content;
+        return true;
+    }
+    if (entry->size > static_cast<uint64_t>(std::numeric_limits<int32_t>::max())) {
+        return false;
+    }
+
+    if (mz_zip_goto_entry(zip_handle_, entry->source) != MZ_OK || mz_zip_entry_read_open(zip_handle_, 0, nullptr) != MZ_OK) {
+        AYError("BundleModel: open entry failed: {}", path);
+        return false;
+    }
+    out.resize(static_cast<size_t>(entry->size));
+    size_t total = 0;
+    while (total < out.size()) {
+        int32_t read = mz_zip_entry_read(zip_handle_, out.data() + total, static_cast<int32_t>(out.size() - total));
+        if (read <= 0) {
+            break;
+        }
+        total += static_cast<size_t>(read);
+    }
+    // 关闭时校验 CRC
+    bool success = mz_zip_entry_close(zip_handle_) == MZ_OK && total == out.size();
+    if (!success) {
+        AYError("BundleModel: read entry failed: {}", path);
+        out.clear();
+    }
+    return success;
+}
+
+BundleModel::Entry &BundleModel::Upsert(const std::string &path, BundleEntryType type)
+{
+    auto it = index_.find(path);
+    if (it == index_.end()) {
+        Entry entry;
+        entry.path = Intern(path);
+        entry.type = type;
+        entries_.push_back(std::move(entry));
+        index_[entries_.back().path] = entries_.size() - 1;
+        return entries_.back();
+    }
+    Entry &entry = entries_[it->second];
+    if (entry.type != type) {
+        entry.mode = 0;
+    }
+    entry.type = type;
+    return entry;
+}
+
+bool BundleModel::SetFile(const std::string &path, std::vector<uint8_t> content, uint32_t mode)
+{
+    if (path.empty() || EndsWithSlash(path)) {
+        return false;
+    }
+    Entry &entry = Upsert(path, BundleEntryType::File);
+    uint32_t permissions = mode ? (mode & 07777) : (entry.mode ? (entry.mode & 07777) : 0644);
+    entry.mode = 0100000 | permissions;
+    entry.modifiedTime = std::time(nullptr);
+    entry.size = content.size();
+    entry.content = std::move(content);
+    entry.modified = true;
+    return true;
+}
+
+bool BundleModel::SetSymlink(const std::string &path, const std::string &target)
+{
+    if (path.empty() || EndsWithSlash(path) || target.empty()) {
+        return false;
+    }
+    Entry &entry = Upsert(path, BundleEntryType::Symlink);
+    entry.mode = 0120755;
+    entry.modifiedTime = std::time(nullptr);
+    entry.size = target.size();
+    entry.content.assign(target.begin(), target.end());
+    entry.modified = true;
+    return true;
+}
+
+bool BundleModel::AddDirectory(const std::string &path)
+{
+    if (!EndsWithSlash(path)) {
+        return false;
+    }
+    if (Find(path)) {
+        return true;
+    }
+    Entry &entry = Upsert(path, BundleEntryType::Directory);
+    entry.mode = 040755;
+    entry.modifiedTime = std::time(nullptr);
+    entry.modified = true;
+    return true;
+}
+
+size_t BundleModel::Remove(const std::string &path)
+{
+    if (path.empty()) {
+        return 0;
+    }
+    bool directory = EndsWithSlash(path);
+    auto removed = std::remove_if(entries_.begin(), entries_.end(), [&](const Entry &entry) {
+        return directory ? entry.path.compare(0, path.size(), path) == 0 : entry.path == path;
+    });
+    size_t count = static_cast<size_t>(entries_.end() - removed);
+    if (count > 0) {
+        entries_.erase(removed, entries_.end());
+        Reindex();
+    }
+    return count;
+}
+
+bool BundleModel::Save(const std::string &archivePath, const ArchiverOptions &options)
+{
+    std::error_code ec;
+    if (archivePath_.empty() || !fs::equivalent(archivePath_, archivePath, ec)) {
+        return ZipBundleModel(*this, archivePath, options);
+    }
+
+    // 未修改条目从原文件复制，写完之前不能替换它；Windows 上打开中的文件也不能被改名覆盖
+    fs::path savedPath = archivePath;
+    savedPath += ".saved";
+    if (!ZipBundleModel(*this, savedPath.string(), options)) {
+        return false;
+    }
+    std::string sourcePath = archivePath_;
+    Close();
+    fs::rename(savedPath, archivePath, ec);
+    if (ec) {
+        AYError("Rename {} failed: {}", savedPath.string(), ec.message());
+        fs::remove(savedPath, ec);
+        Load(sourcePath);
+        return false;
+    }
+    return Load(archivePath);
+}
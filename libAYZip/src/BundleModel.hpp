@@ -0,0 +1,87 @@
+﻿//
+//  BundleModel.hpp
+//  libAYZip
+//
+//  内存中的 ipa：从归档载入条目表，增删改后直接写回 ipa，重签名时不必解压到磁盘再压缩
+//  只在内存中保留中央目录得到的条目表；条目内容在读取时才从归档文件解压，未修改的条目写回时原样复制压缩数据
+//
+
+#ifndef BundleModel_hpp
+#define BundleModel_hpp
+
+#include "BundleScanner.hpp"
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct ArchiverOptions;
+
+class BundleModel
+{
+public:
+    struct Entry {
+        std::string_view path;          // zip 内路径，存放在 arena 中，以 '\0' 结尾；目录以 '/' 结尾
+        BundleEntryType type = BundleEntryType::File;
+        uint32_t mode = 0;              // 含类型位
+        std::time_t modifiedTime = 0;
+        uint64_t size = 0;              // 解压后大小；符号链接为目标长度
+        int64_t source = -1;            // 在原包中央目录中的位置，-1 表示新增条目
+        bool modified = false;          // 为 true 时内容取自 content
+        std::vector<uint8_t> content;
+    };
+
+    BundleModel();
+    ~BundleModel();
+    BundleModel(const BundleModel &) = delete;
+    BundleModel &operator=(const BundleModel &) = delete;
+
+    // 打开归档并解析中央目录，之前的内容被丢弃；归档文件保持打开直到下次 Load 或析构，大小不受限制
+    bool Load(const std::string &archivePath);
+    // 归档已在内存中时使用，minizip 内存流限制为 2 GB
+    bool Load(std::vector<uint8_t> &&archive);
+
+    // 按原包顺序，新增条目在末尾
+    const std::vector<Entry> &Entries() const { return entries_; }
+    const Entry *Find(const std::string &path) const;
+
+    // 解压条目内容 (符号链接为目标)；共用一个 zip 句柄，不可并发调用
+    bool Read(const std::string &path, std::vector<uint8_t> &out);
+
+    // 路径已存在时替换，保持原位置；mode 为 0 时沿用原条目权限，新增文件为 0644
+    bool SetFile(const std::string &path, std::vector<uint8_t> content, uint32_t mode = 0);
+    bool SetSymlink(const std::string &path, const std::string &target);
+    bool AddDirectory(const std::string &path);
+    // 以 '/' 结尾时删除该目录及其下所有条目，返回删除的条目数
+    size_t Remove(const std::string &path);
+
+    // 写出 ipa：先写 archivePath + ".partial"，成功后改名
+    // 写回载入时的归档时，替换前先关闭原文件，成功后重新载入写出的归档，未修改标记随之清除
+    bool Save(const std::string &archivePath, const ArchiverOptions &options);
+
+    // 原包的 zip 句柄 (minizip mz_zip)，写回时复制未修改条目的压缩数据
+    void *SourceHandle() const { return zip_handle_; }
+
+private:
+    void Close();
+    bool Open();
+    std::string_view Intern(const std::string &path);
+    Entry &Upsert(const std::string &path, BundleEntryType type);
+    void Reindex();
+
+    std::vector<std::unique_ptr<char[]>> arena_;
+    size_t arenaUsed_ = 0;
+    size_t arenaBlockSize_ = 0;
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string_view, size_t> index_;
+
+    std::string archivePath_;           // Load(path) 打开的文件，内存归档时为空
+    std::vector<uint8_t> archive_;
+    void *stream_ = nullptr;
+    void *zip_handle_ = nullptr;
+};
+
+#endif /* BundleModel_hpp */
@@ -0,0 +1,420 @@
+﻿//
+//  BundleScanner.cpp
+//  libAYZip
+//
+
+#include "BundleScanner.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <spdlog/AYLog.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// 默认线程数上限；目录遍历受存储延迟限制，更多线程收益很小
+constexpr unsigned int kMaxWalkThreads = 8;
+
+struct ListedEntry {
+    BundleEntry entry;
+    bool descend;       // 是否进入该目录
+};
+
+/********************************************
+ *                                          *
+ *               列出单个目录                *
+ *                                          *
+ ********************************************/
+#ifdef _WIN32
+// FILETIME 为 1601-01-01 起的 100ns 计数
+static std::time_t FileTimeToTime(const FILETIME &fileTime)
+{
+    uint64_t ticks = (static_cast<uint64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+    return static_cast<std::time_t>(ticks / 10000000ULL) - 11644473600LL;
+}
+
+class DirectoryLister
+{
+public:
+    bool Open(const fs::path &root)
+    {
+        root_ = root.wstring();
+        return true;
+    }
+
+    bool List(const std::wstring &relative, std::vector<ListedEntry> &listed) const
+    {
+        std::wstring directory = relative.empty() ? root_ : root_ + L'\\' + relative;
+        std::wstring pattern = directory + L"\\*";
+        WIN32_FIND_DATAW data;
+        // FindExInfoBasic 不取短文件名，LARGE_FETCH 每次系统调用取回更多条目
+        HANDLE find = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (find == INVALID_HANDLE_VALUE) {
+            AYError("scan failed: {} ({})", fs::path(directory).u8string(), GetLastError());
+            return false;
+        }
+
+        do {
+            const wchar_t *name = data.cFileName;
+            if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0) {
+                continue;
+            }
+
+            ListedEntry item;
+            BundleEntry &entry = item.entry;
+            entry.relativePath = relative.empty() ? std::wstring(name) : relative + L'\\' + name;
+            entry.modifiedTime = FileTimeToTime(data.ftLastWriteTime);
+            bool isDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            if (isDirectory) {
+                entry.type = BundleEntryType::Directory;
+                entry.mode = 0040000 | 0755;
+            }
+            else {
+                entry.type = BundleEntryType::File;
+                entry.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+                entry.mode = 0100000 | 0644;
+            }
+            // 与 recursive_directory_iterator 默认行为一致，不进入目录联接 / 目录符号链接
+            item.descend = isDirectory && !(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT);
+            listed.push_back(std::move(item));
+        } while (FindNextFileW(find, &data));
+
+        DWORD error = GetLastError();
+        FindClose(find);
+        if (error != ERROR_NO_MORE_FILES) {
+            AYError("scan failed: {} ({})", fs::path(directory).u8string(), error);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::wstring root_;
+};
+#else
+class DirectoryLister
+{
+public:
+    ~DirectoryLister()
+    {
+        if (rootFd_ >= 0) {
+            close(rootFd_);
+        }
+    }
+
+    bool Open(const fs::path &root)
+    {
+        rootFd_ = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (rootFd_ < 0) {
+            AYError("scan failed: {} ({})", root.string(), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    // 相对根目录 fd 打开，每个条目一次 fstatat，不跟随符号链接
+    bool List(const std::string &relative, std::vector<ListedEntry> &listed) const
+    {
+        int fd = openat(rootFd_, relative.empty() ? "." : relative.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        DIR *dir = fd < 0 ? nullptr : fdopendir(fd);
+        if (dir == nullptr) {
+            AYError("scan failed: {} ({})", relative, strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+
+        bool success = true;
+        for (;;) {
+            errno = 0;
+            struct dirent *dirEntry = readdir(dir);
+            if (dirEntry == nullptr) {
+                if (errno != 0) {
+                    AYError("scan failed: {} ({})", relative, strerror(errno));
+                    success = false;
+                }
+                break;
+            }
+            const char *name = dirEntry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+
+            struct stat st;
+            if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                AYError("stat failed: {}/{} ({})", relative, name, strerror(errno));
+                success = false;
+                break;
+            }
+
+            ListedEntry item;
+            BundleEntry &entry = item.entry;
+            if (S_ISREG(st.st_mode)) {
+                entry.type = BundleEntryType::File;
+            }
+            else if (S_ISDIR(st.st_mode)) {
+                entry.type = BundleEntryType::Directory;
+            }
+            else if (S_ISLNK(st.st_mode)) {
+                entry.type = BundleEntryType::Symlink;
+            }
+            else {
+                continue;
+            }
+            entry.relativePath = relative.empty() ? std::string(name) : relative + '/' + name;
+            entry.size = entry.type == BundleEntryType::Directory ? 0 : static_cast<uint64_t>(st.st_size);
+            entry.modifiedTime = st.st_mtime;
+            entry.mode = static_cast<uint32_t>(st.st_mode);
+            item.descend = entry.type == BundleEntryType::Directory;
+            listed.push_back(std::move(item));
+        }
+
+        closedir(dir);
+        return success;
+    }
+
+private:
+    int rootFd_ = -1;
+};
+#endif
+
+/********************************************
+ *                                          *
+ *               并行遍历                    *
+ *                                          *
+ ********************************************/
+// 一个目录的列出结果；子目录节点由父节点持有，调用线程处理完后释放
+struct DirectoryNode {
+    fs::path::string_type relativePath;
+    std::vector<BundleEntry> entries;                           // 按名称排序
+    std::vector<std::unique_ptr<DirectoryNode>> subdirectories; // entries 中需要进入的目录，顺序相同
+    std::vector<bool> descend;
+    bool listed = false;        // 由 BundleWalker::mutex_ 保护
+    bool success = true;
+};
+
+// 每个工作线程一个任务队列：自己从尾部取 (深度优先，局部性好)，空闲时从其它队列头部窃取 (较浅的大目录)
+struct WalkQueue {
+    std::mutex mutex;
+    std::deque<DirectoryNode *> tasks;
+};
+
+class BundleWalker
+{
+public:
+    BundleWalker(const DirectoryLister &lister, unsigned int threads, TraceRecorder *trace) : lister_(lister), trace_(trace), queues_(threads)
+    {
+        root_.reset(new DirectoryNode());
+        if (threads == 0) {
+            return;
+        }
+
+        pending_ = 1;
+        queued_ = 1;
+        queues_[0].tasks.push_back(root_.get());
+        workers_.reserve(threads);
+        for (unsigned int i = 0; i < threads; i++) {
+            workers_.emplace_back(&BundleWalker::WorkerMain, this, i);
+        }
+    }
+
+    ~BundleWalker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (std::thread &worker : workers_) {
+            worker.join();
+        }
+    }
+
+    bool Walk(const std::function<bool(const BundleEntry &)> &visit)
+    {
+        return Emit(*root_, visit);
+    }
+
+private:
+    // 列出目录并为子目录建立节点
+    void ListNode(DirectoryNode &node)
+    {
+        std::string detail = trace_ ? fs::path(node.relativePath).u8string() : std::string();
+        ScopedTraceSpan span(trace_, "list", "scan", detail);
+        std::vector<ListedEntry> listed;
+        node.success = lister_.List(node.relativePath, listed);
+        if (!node.success) {
+            return;
+        }
+
+        // 文件系统返回的顺序不确定，同一目录内按名称字节序排列
+        std::sort(listed.begin(), listed.end(), [](const ListedEntry &lhs, const ListedEntry &rhs) {
+            return lhs.entry.relativePath < rhs.entry.relativePath;
+        });
+        node.entries.reserve(listed.size());
+        node.descend.reserve(listed.size());
+        for (ListedEntry &item : listed) {
+            if (item.descend) {
+                std::unique_ptr<DirectoryNode> child(new DirectoryNode());
+                child->relativePath = item.entry.relativePath;
+                node.subdirectories.push_back(std::move(child));
+            }
+            node.descend.push_back(item.descend);
+            node.entries.push_back(std::move(item.entry));
+        }
+    }
+
+    DirectoryNode *PopTask(unsigned int index)
+    {
+        {
+            WalkQueue &queue = queues_[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                DirectoryNode *node = queue.tasks.back();
+                queue.tasks.pop_back();
+                queued_--;
+                return node;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); i++) {
+            WalkQueue &queue = queues_[(index + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                DirectoryNode *node = queue.tasks.front();
+                queue.tasks.pop_front();
+                queued_--;
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    void WorkerMain(unsigned int index)
+    {
+        if (trace_) {
+            trace_->SetThreadName("walk " + std::to_string(index + 1));
+        }
+        for (;;) {
+            DirectoryNode *node = PopTask(index);
+            if (node == nullptr) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || pending_ == 0 || queued_ > 0; });
+                if (stop_ || pending_ == 0) {
+                    return;
+                }
+                continue;
+            }
+
+            bool stopped;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopped = stop_;
+            }
+            if (!stopped) {
+                ListNode(*node);
+            }
+
+            if (!node->subdirectories.empty()) {
+                WalkQueue &queue = queues_[index];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queued_ += node->subdirectories.size();
+                // 逆序入队，使本线程先取到排在前面的子目录，与调用线程的消费顺序一致
+                for (auto it = node->subdirectories.rbegin(); it != node->subdirectories.rend(); ++it) {
+                    queue.tasks.push_back(it->get());
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_ += node->subdirectories.size();
+                pending_--;
+                node->listed = true;
+            }
+            cv_.notify_all();
+        }
+    }
+
+    // 在调用线程上按确定顺序输出，某目录尚未列出时等待
+    bool Emit(DirectoryNode &node, const std::function<bool(const BundleEntry &)> &visit)
+    {
+        if (workers_.empty()) {
+            ListNode(node);
+        }
+        else {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!node.listed) {
+                ScopedTraceSpan span(trace_, "wait list", "scan");
+                cv_.wait(lock, [&node] { return node.listed; });
+            }
+        }
+        if (!node.success) {
+            return false;
+        }
+
+        size_t subdirectory = 0;
+        for (size_t i = 0; i < node.entries.size(); i++) {
+            if (!visit(node.entries[i])) {
+                return false;
+            }
+            if (node.descend[i]) {
+                std::unique_ptr<DirectoryNode> &child = node.subdirectories[subdirectory++];
+                if (!Emit(*child, visit)) {
+                    return false;
+                }
+                // 工作线程已不再访问已列出的节点
+                child.reset();
+            }
+        }
+        return true;
+    }
+
+    const DirectoryLister &lister_;
+    TraceRecorder *trace_;
+    std::unique_ptr<DirectoryNode> root_;
+    std::vector<WalkQueue> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    size_t pending_ = 0;                // 已入队但尚未列出的目录数，由 mutex_ 保护
+    std::atomic<size_t> queued_{0};     // 各队列中的任务总数，入队时先于任务可见增加
+};
+
+bool WalkBundle(const fs::path &root, unsigned int threads, const std::function<bool(const BundleEntry &)> &visit, TraceRecorder *trace)
+{
+    DirectoryLister lister;
+    if (!lister.Open(root)) {
+        return false;
+    }
+    if (threads == 0) {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        threads = hardware == 0 ? 1 : (hardware < kMaxWalkThreads ? hardware : kMaxWalkThreads);
+    }
+    // 单线程时在调用线程上按需列出，不启动工作线程
+    BundleWalker walker(lister, threads > 1 ? threads : 0, trace);
+    return walker.Walk(visit);
+}
+
+bool ScanBundle(const fs::path &root, std::vector<BundleEntry> &entries)
+{
+    return WalkBundle(root, 1, [&entries](const BundleEntry &entry) {
+        entries.push_back(entry);
+        return true;
+    });
+}
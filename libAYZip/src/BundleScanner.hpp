@@ -0,0 +1,45 @@
+﻿//
+//  BundleScanner.hpp
+//  libAYZip
+//
+//  压缩前的目录扫描：每个条目只做一次元数据查询，类型、大小、修改时间、权限一并记录
+//  POSIX 使用 readdir + fstatat，Windows 使用 FindFirstFileEx（枚举结果已含属性、大小与时间，无需再查询）
+//  多个线程并行列出子目录，调用线程按确定的顺序边遍历边处理
+//
+
+#ifndef BundleScanner_hpp
+#define BundleScanner_hpp
+
+#include "TraceEvents.hpp"
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+enum class BundleEntryType : uint8_t {
+    File,
+    Directory,
+    Symlink,
+};
+
+struct BundleEntry {
+    std::filesystem::path::string_type relativePath;   // 相对扫描根目录，本地分隔符
+    uint64_t size = 0;              // 文件大小；符号链接为目标路径长度；目录为 0
+    std::time_t modifiedTime = 0;
+    uint32_t mode = 0;              // st_mode（含类型位）；Windows 按类型给出 0100644 / 0040755
+    BundleEntryType type = BundleEntryType::File;
+};
+
+// 深度优先、目录先于其内容，同一目录内按名称字节序，与文件系统返回的顺序及线程调度无关；不跟随符号链接
+// 设备、管道、套接字等特殊文件被跳过；任一目录无法读取、或 visit 返回 false 时返回 false
+// threads 个线程以任务窃取方式并行列出目录，visit 在调用线程上依次收到条目，某目录列出后即可处理其内容
+// threads 为 0 时按 CPU 数选择 (至多 8)，为 1 时在调用线程上按需列出
+// trace 非空时记录每个目录的列出与调用线程等待目录列出的时间
+bool WalkBundle(const std::filesystem::path &root, unsigned int threads, const std::function<bool(const BundleEntry &)> &visit,
+                TraceRecorder *trace = nullptr);
+
+// 单线程遍历，结果按 WalkBundle 的顺序存入 entries
+bool ScanBundle(const std::filesystem::path &root, std::vector<BundleEntry> &entries);
+
+#endif /* BundleScanner_hpp */
@@ -0,0 +1,724 @@
+﻿//
+//  CodeResources.cpp
+//  libAYZip
+//
+
+#include "CodeResources.hpp"
+#include "MachOPageHasher.hpp"
+#include "ZipLog.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <vector>
+#include <spdlog/AYLog.h>
+
+namespace fs = std::filesystem;
+
+/********************************************
+ *                                          *
+ *                 规则                      *
+ *                                          *
+ ********************************************/
+// 模式原样写入 rules / rules2；匹配用等价的字符串判断，避免对每个文件跑十几个 std::regex
+struct ResourceRule {
+    const char *pattern;
+    bool (*matches)(const std::string &path);
+    int weight;
+    bool omit;
+    bool optional;
+    bool nested;
+};
+
+static bool StartsWith(const std::string &s, const char *prefix)
+{
+    return s.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+static bool EndsWith(const std::string &s, const char *suffix)
+{
+    size_t n = std::char_traits<char>::length(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool MatchAll(const std::string &)
+{
+    return true;
+}
+
+static bool MatchLproj(const std::string &path)
+{
+    return path.find(".lproj/") != std::string::npos;
+}
+
+static bool MatchLocversion(const std::string &path)
+{
+    return EndsWith(path, ".lproj/locversion.plist");
+}
+
+static bool MatchBaseLproj(const std::string &path)
+{
+    return StartsWith(path, "Base.lproj/");
+}
+
+static bool MatchVersionPlist(const std::string &path)
+{
+    return path == "version.plist";
+}
+
+static bool MatchDsym(const std::string &path)
+{
+    return path.find(".dSYM/") != std::string::npos || EndsWith(path, ".dSYM");
+}
+
+static bool MatchDsStore(const std::string &path)
+{
+    return path == ".DS_Store" || EndsWith(path, "/.DS_Store");
+}
+
+static bool MatchInfoPlist(const std::string &path)
+{
+    return path == "Info.plist";
+}
+
+static bool MatchPkgInfo(const std::string &path)
+{
+    return path == "PkgInfo";
+}
+
+static bool MatchProvisionProfile(const std::string &path)
+{
+    return path == "embedded.provisionprofile";
+}
+
+static bool MatchNested(const std::string &path)
+{
+    static const char *const kNestedDirectories[] = {
+        "Frameworks/", "SharedFrameworks/", "PlugIns/", "Plug-ins/", "XPCServices/", "Helpers/", "MacOS/",
+        "Library/Automator/", "Library/Spotlight/", "Library/LoginItems/",
+    };
+    for (const char *directory : kNestedDirectories) {
+        if (StartsWith(path, directory)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 键按字节序排列，与 plist 中的顺序一致
+static const ResourceRule kRules[] = {
+    { "^.*",                                MatchAll,           1,      false,  false,  false },
+    { "^.*\\.lproj/",                       MatchLproj,         1000,   false,  true,   false },
+    { "^.*\\.lproj/locversion.plist$",      MatchLocversion,    1100,   true,   false,  false },
+    { "^Base\\.lproj/",                     MatchBaseLproj,     1010,   false,  false,  false },
+    { "^version.plist$",                    MatchVersionPlist,  1,      false,  false,  false },
+};
+
+static const ResourceRule kRules2[] = {
+    { ".*\\.dSYM($|/)",                     MatchDsym,          11,     false,  false,  false },
+    { "^(.*/)?\\.DS_Store$",                MatchDsStore,       2000,   true,   false,  false },
+    { "^(Frameworks|SharedFrameworks|PlugIns|Plug-ins|XPCServices|Helpers|MacOS|Library/(Automator|Spotlight|LoginItems))/",
+                                            MatchNested,        10,     false,  false,  true },
+    { "^.*",                                MatchAll,           1,      false,  false,  false },
+    { "^.*\\.lproj/",                       MatchLproj,         1000,   false,  true,   false },
+    { "^.*\\.lproj/locversion.plist$",      MatchLocversion,    1100,   true,   false,  false },
+    { "^Base\\.lproj/",                     MatchBaseLproj,     1010,   false,  false,  false },
+    { "^Info\\.plist$",                     MatchInfoPlist,     20,     true,   false,  false },
+    { "^PkgInfo$",                          MatchPkgInfo,       20,     true,   false,  false },
+    { "^embedded\\.provisionprofile$",      MatchProvisionProfile, 20,  false,  false,  false },
+    { "^version\\.plist$",                  MatchVersionPlist,  20,     false,  false,  false },
+};
+
+// 权重最高的匹配规则，同权重取先出现的；没有匹配时返回 nullptr
+template <size_t N>
+static const ResourceRule *MatchRule(const ResourceRule (&rules)[N], const std::string &path)
+{
+    const ResourceRule *best = nullptr;
+    for (const ResourceRule &rule : rules) {
+        if ((best == nullptr || rule.weight > best->weight) && rule.matches(path)) {
+            best = &rule;
+        }
+    }
+    return best;
+}
+
+/********************************************
+ *                                          *
+ *               XML plist                  *
+ *                                          *
+ ********************************************/
+static std::string Base64(const uint8_t *data, size_t size)
+{
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < size; i += 3) {
+        uint32_t v = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+        out += kAlphabet[v >> 18];
+        out += kAlphabet[(v >> 12) & 0x3F];
+        out += kAlphabet[(v >> 6) & 0x3F];
+        out += kAlphabet[v & 0x3F];
+    }
+    if (i < size) {
+        uint32_t v = uint32_t(data[i]) << 16;
+        if (i + 1 < size) {
+            v |= uint32_t(data[i + 1]) << 8;
+        }
+        out += kAlphabet[v >> 18];
+        out += kAlphabet[(v >> 12) & 0x3F];
+        out += i + 1 < size ? kAlphabet[(v >> 6) & 0x3F] : '=';
+        out += '=';
+    }
+    return out;
+}
+
+// 与 CFPropertyList 的输出格式一致：tab 缩进，data 内容单独成行
+class PlistWriter
+{
+public:
+    PlistWriter()
+    {
+        out_ = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+               "<plist version=\"1.0\">\n";
+    }
+
+    void BeginDict()
+    {
+        Line("<dict>");
+        depth_++;
+    }
+
+    void EndDict()
+    {
+        depth_--;
+        Line("</dict>");
+    }
+
+    void Key(const std::string &key)
+    {
+        Indent();
+        out_ += "<key>";
+        AppendEscaped(key);
+        out_ += "</key>\n";
+    }
+
+    void String(const std::string &value)
+    {
+        Indent();
+        out_ += "<string>";
+        AppendEscaped(value);
+        out_ += "</string>\n";
+    }
+
+    template <size_t N>
+    void Data(const std::array<uint8_t, N> &value)
+    {
+        Line("<data>");
+        Line(Base64(value.data(), value.size()));
+        Line("</data>");
+    }
+
+    void True()
+    {
+        Line("<true/>");
+    }
+
+    void Real(int value)
+    {
+        Line("<real>" + std::to_string(value) + "</real>");
+    }
+
+    std::string Finish()
+    {
+        out_ += "</plist>\n";
+        return std::move(out_);
+    }
+
+private:
+    void Indent()
+    {
+        out_.append(depth_, '\t');
+    }
+
+    void Line(const std::string &text)
+    {
+        Indent();
+        out_ += text;
+        out_ += '\n';
+    }
+
+    void AppendEscaped(const std::string &text)
+    {
+        for (char c : text) {
+            switch (c) {
+                case '&': out_ += "&amp;"; break;
+                case '<': out_ += "&lt;"; break;
+                case '>': out_ += "&gt;"; break;
+                default: out_ += c; break;
+            }
+        }
+    }
+
+    std::string out_;
+    size_t depth_ = 0;
+};
+
+template <size_t N>
+static void WriteRules(PlistWriter &writer, const ResourceRule (&rules)[N])
+{
+    // 模式按字节序排列
+    std::vector<const ResourceRule *> sorted;
+    for (const ResourceRule &rule : rules) {
+        sorted.push_back(&rule);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const ResourceRule *a, const ResourceRule *b) {
+        return std::char_traits<char>::compare(a->pattern, b->pattern, std::char_traits<char>::length(a->pattern) + 1) < 0;
+    });
+
+    writer.BeginDict();
+    for (const ResourceRule *rule : sorted) {
+        writer.Key(rule->pattern);
+        if (rule->weight == 1 && !rule->omit && !rule->optional && !rule->nested) {
+            writer.True();
+            continue;
+        }
+        writer.BeginDict();
+        if (rule->nested) {
+            writer.Key("nested");
+            writer.True();
+        }
+        if (rule->omit) {
+            writer.Key("omit");
+            writer.True();
+        }
+        if (rule->optional) {
+            writer.Key("optional");
+            writer.True();
+        }
+        writer.Key("weight");
+        writer.Real(rule->weight);
+        writer.EndDict();
+    }
+    writer.EndDict();
+}
+
+/********************************************
+ *                                          *
+ *          CodeResourcesBuilder            *
+ *                                          *
+ ********************************************/
+CodeResourcesBuilder::CodeResourcesBuilder(const std::string &bundlePrefix, const std::string &executable)
+    : bundlePrefix_(bundlePrefix), executable_(executable)
+{
+}
+
+bool CodeResourcesBuilder::RelativePath(const std::string &pathInZip, std::string &out) const
+{
+    if (pathInZip.size() <= bundlePrefix_.size() || pathInZip.compare(0, bundlePrefix_.size(), bundlePrefix_) != 0) {
+        return false;
+    }
+    out.assign(pathInZip, bundlePrefix_.size(), std::string::npos);
+    return true;
+}
+
+// 主可执行文件与签名目录本身不属于资源
+bool CodeResourcesBuilder::IsExcluded(const std::string &path) const
+{
+    return path == executable_ || StartsWith(path, "_CodeSignature/");
+}
+
+void CodeResourcesBuilder::AddFile(const ManifestEntry &entry)
+{
+    std::string path;
+    if (!RelativePath(entry.path, path)) {
+        return;
+    }
+    Resource &resource = resources_[path];
+    resource.magic = entry.magic;
+    resource.sha1 = entry.sha1;
+    resource.sha256 = entry.sha256;
+}
+
+void CodeResourcesBuilder::AddSymlink(const std::string &pathInZip, const std::string &target)
+{
+    std::string path;
+    if (!RelativePath(pathInZip, path)) {
+        return;
+    }
+    Resource &resource = resources_[path];
+    resource.symlink = true;
+    resource.target = target;
+}
+
+std::string CodeResourcesBuilder::Build(const NestedCodeResolver &nestedCode) const
+{
+    // 嵌套包：nested 规则下、含 Info.plist 的带扩展名目录，只取最外层；包内文件在 files2 中由包整体代替
+    std::set<std::string> nestedBundles;
+    for (const auto &item : resources_) {
+        const std::string &path = item.first;
+        if (item.second.symlink || !EndsWith(path, "/Info.plist")) {
+            continue;
+        }
+        std::string directory = path.substr(0, path.size() - std::char_traits<char>::length("/Info.plist"));
+        size_t slash = directory.rfind('/');
+        if (directory.find('.', slash == std::string::npos ? 0 : slash) == std::string::npos) {
+            continue;
+        }
+        const ResourceRule *rule = MatchRule(kRules2, directory + "/");
+        if (rule && rule->nested) {
+            nestedBundles.insert(directory);
+        }
+    }
+    std::vector<std::string> outermost;
+    for (const std::string &bundle : nestedBundles) {
+        if (outermost.empty() || !(StartsWith(bundle, outermost.back().c_str()) && bundle[outermost.back().size()] == '/')) {
+            outermost.push_back(bundle);
+        }
+    }
+    auto insideNestedBundle = [&](const std::string &path) {
+        auto it = std::upper_bound(outermost.begin(), outermost.end(), path);
+        if (it == outermost.begin()) {
+            return false;
+        }
+        --it;
+        return path.size() > it->size() && StartsWith(path, it->c_str()) && path[it->size()] == '/';
+    };
+
+    auto resolveNested = [&](const std::string &path, NestedCodeInfo &info) {
+        if (nestedCode && nestedCode(path, info)) {
+            return true;
+        }
+        AYZipLogInfo("CodeResources: no signature info for nested code {}, omitted from files2", path);
+        return false;
+    };
+
+    PlistWriter writer;
+    writer.BeginDict();
+
+    // files：旧版格式，只有 SHA-1；不含符号链接，嵌套包内的文件照常列出
+    writer.Key("files");
+    writer.BeginDict();
+    for (const auto &item : resources_) {
+        const std::string &path = item.first;
+        const Resource &resource = item.second;
+        if (resource.symlink || IsExcluded(path)) {
+            continue;
+        }
+        const ResourceRule *rule = MatchRule(kRules, path);
+        if (rule == nullptr || rule->omit) {
+            continue;
+        }
+        writer.Key(path);
+        if (rule->optional) {
+            writer.BeginDict();
+            writer.Key("hash");
+            writer.Data(resource.sha1);
+            writer.Key("optional");
+            writer.True();
+            writer.EndDict();
+        }
+        else {
+            writer.Data(resource.sha1);
+        }
+    }
+    writer.EndDict();
+
+    // files2：嵌套包按目录路径与文件一同排序
+    writer.Key("files2");
+    writer.BeginDict();
+    auto nextBundle = outermost.begin();
+    auto writeNested = [&](const std::string &path) {
+        NestedCodeInfo info;
+        if (!resolveNested(path, info)) {
+            return;
+        }
+        writer.Key(path);
+        writer.BeginDict();
+        writer.Key("cdhash");
+        writer.Data(info.cdhash);
+        writer.Key("requirement");
+        writer.String(info.requirement);
+        writer.EndDict();
+    };
+    for (const auto &item : resources_) {
+        const std::string &path = item.first;
+        const Resource &resource = item.second;
+        for (; nextBundle != outermost.end() && *nextBundle < path; ++nextBundle) {
+            writeNested(*nextBundle);
+        }
+        if (IsExcluded(path) || insideNestedBundle(path)) {
+            continue;
+        }
+        const ResourceRule *rule = MatchRule(kRules2, path);
+        if (rule == nullptr || rule->omit) {
+            continue;
+        }
+        if (rule->nested && !resource.symlink && IsMachOMagic(resource.magic)) {
+            writeNested(path);
+            continue;
+        }
+        writer.Key(path);
+        writer.BeginDict();
+        if (resource.symlink) {
+            writer.Key("symlink");
+            writer.String(resource.target);
+        }
+        else {
+            writer.Key("hash");
+            writer.Data(resource.sha1);
+            writer.Key("hash2");
+            writer.Data(resource.sha256);
+            if (rule->optional) {
+                writer.Key("optional");
+                writer.True();
+            }
+        }
+        writer.EndDict();
+    }
+    for (; nextBundle != outermost.end(); ++nextBundle) {
+        writeNested(*nextBundle);
+    }
+    writer.EndDict();
+
+    writer.Key("rules");
+    WriteRules(writer, kRules);
+    writer.Key("rules2");
+    WriteRules(writer, kRules2);
+
+    writer.EndDict();
+    return writer.Finish();
+}
+
+/********************************************
+ *                                          *
+ *              Info.plist                  *
+ *                                          *
+ ********************************************/
+static uint64_t ReadBigEndian(const uint8_t *p, size_t size)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static void AppendUtf8(uint32_t codepoint, std::string &out)
+{
+    if (codepoint < 0x80) {
+        out += static_cast<char>(codepoint);
+    }
+    else if (codepoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else {
+        out += static_cast<char>(0xF0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+// bplist00：只支持顶层字典中 ASCII / UTF-16 字符串值
+class BinaryPlist
+{
+public:
+    explicit BinaryPlist(const std::vector<uint8_t> &data) : data_(data) {}
+
+    bool TopLevelString(const std::string &key, std::string &out)
+    {
+        if (data_.size() < 8 + 32) {
+            return false;
+        }
+        const uint8_t *trailer = data_.data() + data_.size() - 32;
+        offsetSize_ = trailer[6];
+        refSize_ = trailer[7];
+        objectCount_ = ReadBigEndian(trailer + 8, 8);
+        uint64_t top = ReadBigEndian(trailer + 16, 8);
+        offsetTable_ = ReadBigEndian(trailer + 24, 8);
+        if (offsetSize_ == 0 || offsetSize_ > 8 || refSize_ == 0 || refSize_ > 8 ||
+            offsetTable_ > data_.size() - 32 || objectCount_ > (data_.size() - 32 - offsetTable_) / offsetSize_) {
+            return false;
+        }
+
+        uint8_t type;
+        uint64_t count, start;
+        if (!ObjectHeader(top, type, count, start) || type != 0xD || count > (data_.size() - start) / (2 * refSize_)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            std::string name;
+            if (String(ReadBigEndian(&data_[start + i * refSize_], refSize_), name) && name == key) {
+                return String(ReadBigEndian(&data_[start + (count + i) * refSize_], refSize_), out);
+            }
+        }
+        return false;
+    }
+
+private:
+    bool ObjectHeader(uint64_t index, uint8_t &type, uint64_t &count, uint64_t &start) const
+    {
+        if (index >= objectCount_) {
+            return false;
+        }
+        uint64_t offset = ReadBigEndian(&data_[offsetTable_ + index * offsetSize_], offsetSize_);
+        if (offset >= offsetTable_) {
+            return false;
+        }
+        uint8_t marker = data_[offset];
+        type = marker >> 4;
+        count = marker & 0x0F;
+        start = offset + 1;
+        if (count == 0x0F) {
+            // 长度以整数对象表示：0x1n 后跟 2^n 字节
+            if (start >= offsetTable_ || (data_[start] >> 4) != 0x1) {
+                return false;
+            }
+            size_t size = size_t(1) << (data_[start] & 0x0F);
+            if (size > 8 || start + 1 + size > offsetTable_) {
+                return false;
+            }
+            count = ReadBigEndian(&data_[start + 1], size);
+            start += 1 + size;
+        }
+        return true;
+    }
+
+    bool String(uint64_t index, std::string &out) const
+    {
+        uint8_t type;
+        uint64_t count, start;
+        if (!ObjectHeader(index, type, count, start)) {
+            return false;
+        }
+        out.clear();
+        if (type == 0x5) {
+            if (count > offsetTable_ - start) {
+                return false;
+            }
+            out.assign(reinterpret_cast<const char *>(&data_[start]), static_cast<size_t>(count));
+            return true;
+        }
+        if (type == 0x6) {
+            if (count > (offsetTable_ - start) / 2) {
+                return false;
+            }
+            for (uint64_t i = 0; i < count; i++) {
+                uint32_t unit = static_cast<uint32_t>(ReadBigEndian(&data_[start + i * 2], 2));
+                if (unit >= 0xD800 && unit < 0xDC00 && i + 1 < count) {
+                    uint32_t low = static_cast<uint32_t>(ReadBigEndian(&data_[start + (i + 1) * 2], 2));
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                        i++;
+                    }
+                }
+                AppendUtf8(unit, out);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    const std::vector<uint8_t> &data_;
+    size_t offsetSize_ = 0;
+    size_t refSize_ = 0;
+    uint64_t objectCount_ = 0;
+    uint64_t offsetTable_ = 0;
+};
+
+static std::string XmlUnescape(const std::string &text)
+{
+    static const std::pair<const char *, char> kEntities[] = {
+        { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' },
+    };
+    std::string out;
+    for (size_t i = 0; i < text.size(); i++) {
+        bool replaced = false;
+        if (text[i] == '&') {
+            for (const auto &entity : kEntities) {
+                size_t n = std::char_traits<char>::length(entity.first);
+                if (text.compare(i, n, entity.first) == 0) {
+                    out += entity.second;
+                    i += n - 1;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced) {
+            out += text[i];
+        }
+    }
+    return out;
+}
+
+// XML：顶层字典的键在第一层 <dict> 下，嵌套字典中的同名键不取
+static bool XmlTopLevelString(const std::string &xml, const std::string &key, std::string &out)
+{
+    size_t pos = xml.find("<dict>");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos += 6;
+    int depth = 1;
+    while (depth > 0) {
+        pos = xml.find('<', pos);
+        if (pos == std::string::npos) {
+            return false;
+        }
+        if (xml.compare(pos, 6, "<dict>") == 0) {
+            depth++;
+        }
+        else if (xml.compare(pos, 7, "</dict>") == 0) {
+            depth--;
+        }
+        else if (depth == 1 && xml.compare(pos, 5, "<key>") == 0) {
+            size_t end = xml.find("</key>", pos);
+            if (end == std::string::npos) {
+                return false;
+            }
+            if (XmlUnescape(xml.substr(pos + 5, end - pos - 5)) == key) {
+                size_t value = xml.find_first_not_of(" \t\r\n", end + 6);
+                if (value == std::string::npos || xml.compare(value, 8, "<string>") != 0) {
+                    return false;
+                }
+                size_t valueEnd = xml.find("</string>", value);
+                if (valueEnd == std::string::npos) {
+                    return false;
+                }
+                out = XmlUnescape(xml.substr(value + 8, valueEnd - value - 8));
+                return true;
+            }
+            pos = end;
+        }
+        pos++;
+    }
+    return false;
+}
+
+std::string ReadInfoPlistString(const fs::path &path, const std::string &key)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        return std::string();
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+    std::string value;
+    static const char kBinaryMagic[] = "bplist00";
+    if (data.size() >= 8 && std::equal(data.begin(), data.begin() + 8, kBinaryMagic)) {
+        BinaryPlist(data).TopLevelString(key, value);
+    }
+    else {
+        XmlTopLevelString(std::string(data.begin(), data.end()), key, value);
+    }
+    return value;
+}
@@ -0,0 +1,69 @@
+﻿//
+//  CodeResources.hpp
+//  libAYZip
+//
+//  _CodeSignature/CodeResources 文档 (files / files2 / rules / rules2)
+//  压缩时直接用内容清单里的摘要生成，签名前不必再把资源文件读一遍
+//
+
+#ifndef CodeResources_hpp
+#define CodeResources_hpp
+
+#include "ContentManifest.hpp"
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+
+// 嵌套代码 (Frameworks/ 下的 .framework、PlugIns/ 下的 .appex、单独的 dylib 等) 的签名信息，由签名方提供
+struct NestedCodeInfo {
+    std::array<uint8_t, 20> cdhash = {};
+    std::string requirement;    // 指定要求的文本形式，如 identifier "com.example.Kit" and anchor apple generic
+};
+
+// path 为包内相对路径；返回 false 时该项不写入 files2
+using NestedCodeResolver = std::function<bool(const std::string &path, NestedCodeInfo &info)>;
+
+struct CodeResourcesOptions {
+    std::string executable;             // 主可执行文件名，为空时读取 Info.plist 的 CFBundleExecutable
+    NestedCodeResolver nestedCode;      // 可选，为空时嵌套代码不写入 files2
+    bool writeToArchive = false;        // 作为最后一个条目写入 Payload/<App>.app/_CodeSignature/CodeResources，替换包内原有的文件
+    std::string document;               // 输出：生成的 XML plist
+};
+
+// 规则与 codesign / ldid 对 iOS 包使用的默认规则相同
+class CodeResourcesBuilder
+{
+public:
+    // bundlePrefix 为 zip 内的包路径前缀，如 "Payload/Example.app/"
+    CodeResourcesBuilder(const std::string &bundlePrefix, const std::string &executable);
+
+    // 参数均为 zip 内路径，不在包内的忽略
+    void AddFile(const ManifestEntry &entry);
+    void AddSymlink(const std::string &pathInZip, const std::string &target);
+
+    std::string Build(const NestedCodeResolver &nestedCode) const;
+
+private:
+    struct Resource {
+        bool symlink = false;
+        std::string target;
+        uint32_t magic = 0;
+        Sha1Digest sha1 = {};
+        Sha256Digest sha256 = {};
+    };
+
+    bool RelativePath(const std::string &pathInZip, std::string &out) const;
+    bool IsExcluded(const std::string &path) const;
+
+    std::string bundlePrefix_;
+    std::string executable_;
+    std::map<std::string, Resource> resources_;     // 按路径字节序，即 plist 键的顺序
+};
+
+// 读取 Info.plist (XML 或二进制) 顶层字典中的字符串值，读取失败或不存在时返回空
+std::string ReadInfoPlistString(const std::filesystem::path &path, const std::string &key);
+
+#endif /* CodeResources_hpp */
@@ -0,0 +1,377 @@
+﻿//
+//  CompressedEntryCache.cpp
+//  libAYZip
+//
+
+#include "CompressedEntryCache.hpp"
+#include "Crc32.hpp"
+#include "ExtractionCache.hpp"
+#include "ZipLog.hpp"
+#include <algorithm>
+#include <json/json.h>
+#include <random>
+#include <spdlog/AYLog.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+constexpr uint64_t kDefaultMinEntrySize = 64 * 1024;
+constexpr size_t kObjectBufferSize = 1024 * 1024;
+
+// 对象头：magic、版本、压缩方法、CRC、原始大小、压缩大小、压缩数据的 CRC、头本身前 36 字节的 CRC，均为小端
+constexpr size_t kObjectHeaderSize = 40;
+constexpr uint32_t kObjectMagic = 0x435A5941;      // "AYZC"
+constexpr uint32_t kObjectVersion = 1;
+
+struct ObjectHeader {
+    uint16_t method = 0;
+    uint32_t crc = 0;
+    uint64_t uncompressedSize = 0;
+    uint64_t compressedSize = 0;
+    uint32_t payloadCrc = 0;
+};
+
+static uint32_t Read32(const uint8_t *p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static uint64_t Read64(const uint8_t *p)
+{
+    return uint64_t(Read32(p)) | (uint64_t(Read32(p + 4)) << 32);
+}
+
+static void Write32(uint8_t *p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+static void Write64(uint8_t *p, uint64_t value)
+{
+    Write32(p, static_cast<uint32_t>(value));
+    Write32(p + 4, static_cast<uint32_t>(value >> 32));
+}
+
+static void EncodeHeader(const ObjectHeader &header, uint8_t *out)
+{
+    Write32(out, kObjectMagic);
+    Write32(out + 4, kObjectVersion);
+    out[8] = static_cast<uint8_t>(header.method);
+    out[9] = static_cast<uint8_t>(header.method >> 8);
+    out[10] = 0;
+    out[11] = 0;
+    Write32(out + 12, header.crc);
+    Write64(out + 16, header.uncompressedSize);
+    Write64(out + 24, header.compressedSize);
+    Write32(out + 32, header.payloadCrc);
+    Write32(out + 36, Crc32Update(0, out, 36));
+}
+
+static bool DecodeHeader(const uint8_t *in, ObjectHeader *header)
+{
+    if (Read32(in) != kObjectMagic || Read32(in + 4) != kObjectVersion || Read32(in + 36) != Crc32Update(0, in, 36)) {
+        return false;
+    }
+    header->method = static_cast<uint16_t>(in[8] | (in[9] << 8));
+    header->crc = Read32(in + 12);
+    header->uncompressedSize = Read64(in + 16);
+    header->compressedSize = Read64(in + 24);
+    header->payloadCrc = Read32(in + 32);
+    return true;
+}
+
+bool Sha256OfFile(const fs::path &path, Sha256Digest *digest)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::vector<char> buffer(kObjectBufferSize);
+    Sha256 sha;
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        sha.Update(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    if (!file.eof()) {
+        return false;
+    }
+    *digest = sha.Final();
+    return true;
+}
+
+/********************************************
+ *                                          *
+ *                 Writer                   *
+ *                                          *
+ ********************************************/
+CompressedEntryCache::Writer::Writer(CompressedEntryCache &cache, fs::path object, fs::path temporary, uint16_t method)
+    : cache_(cache),
+      object_(std::move(object)),
+      temporary_(std::move(temporary)),
+      file_(temporary_, std::ios::binary | std::ios::trunc),
+      method_(method)
+{
+    // 头在 Commit 时回填
+    uint8_t header[kObjectHeaderSize] = {};
+    file_.write(reinterpret_cast<const char *>(header), sizeof(header));
+    failed_ = !file_;
+}
+
+CompressedEntryCache::Writer::~Writer()
+{
+    if (!temporary_.empty()) {
+        file_.close();
+        std::error_code ec;
+        fs::remove(temporary_, ec);
+    }
+}
+
+bool CompressedEntryCache::Writer::Append(const uint8_t *data, size_t size)
+{
+    if (failed_) {
+        return false;
+    }
+    file_.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+    failed_ = !file_;
+    compressedSize_ += size;
+    payloadCrc_ = Crc32Update(payloadCrc_, data, size);
+    return !failed_;
+}
+
+void CompressedEntryCache::Writer::Commit(uint32_t crc, uint64_t uncompressedSize)
+{
+    if (failed_) {
+        return;
+    }
+
+    ObjectHeader header;
+    header.method = method_;
+    header.crc = crc;
+    header.uncompressedSize = uncompressedSize;
+    header.compressedSize = compressedSize_;
+    header.payloadCrc = payloadCrc_;
+    uint8_t encoded[kObjectHeaderSize];
+    EncodeHeader(header, encoded);
+    file_.seekp(0);
+    file_.write(reinterpret_cast<const char *>(encoded), sizeof(encoded));
+    file_.close();
+    if (!file_) {
+        return;
+    }
+
+    // 先写到临时名再改名，其他进程不会看到写了一半的对象
+    std::error_code ec;
+    bool replaced = fs::exists(object_, ec);
+    fs::rename(temporary_, object_, ec);
+    if (ec) {
+        AYError("Insert {} into compressed entry cache failed: {}", object_.string(), ec.message());
+        return;
+    }
+    temporary_.clear();
+    if (!replaced) {
+        cache_.Inserted(kObjectHeaderSize + compressedSize_);
+    }
+}
+
+/********************************************
+ *                                          *
+ *          CompressedEntryCache            *
+ *                                          *
+ ********************************************/
+CompressedEntryCache::CompressedEntryCache(const std::string &root, uint64_t budget)
+    : root_(fs::u8path(root)),
+      budget_(budget),
+      minEntrySize_(kDefaultMinEntrySize)
+{
+    tempCounter_ = std::random_device()();
+    tempCounter_ <<= 32;
+}
+
+bool CompressedEntryCache::Open()
+{
+    std::error_code ec;
+    fs::create_directories(root_ / "objects", ec);
+    if (ec) {
+        AYError("Create compressed entry cache {} failed: {}", root_.string(), ec.message());
+        return false;
+    }
+
+    uint64_t total = 0;
+    if (!CacheObjectsSize(root_ / "objects", &total)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ = total;
+    return true;
+}
+
+fs::path CompressedEntryCache::ObjectPath(const CompressedEntryKey &key) const
+{
+    std::string name = ToHex(key.digest) + "-" + key.codec + "-l" + std::to_string(key.level);
+    return root_ / "objects" / name.substr(0, 2) / name;
+}
+
+bool CompressedEntryCache::Lookup(const CompressedEntryKey &key, Object &object)
+{
+    fs::path path = ObjectPath(key);
+    object.file = std::ifstream(path, std::ios::binary);
+    bool found = static_cast<bool>(object.file);
+
+    if (found) {
+        // 头或数据损坏时写出的条目无法解压，写入归档前先完整校验一遍；对象刚读过，第二遍读取来自页缓存
+        uint8_t encoded[kObjectHeaderSize];
+        ObjectHeader header;
+        object.file.read(reinterpret_cast<char *>(encoded), sizeof(encoded));
+        std::error_code ec;
+        bool valid = object.file && DecodeHeader(encoded, &header) && fs::file_size(path, ec) == kObjectHeaderSize + header.compressedSize;
+        if (valid) {
+            object.method = header.method;
+            object.crc = header.crc;
+            object.uncompressedSize = header.uncompressedSize;
+            object.compressedSize = header.compressedSize;
+            uint32_t payloadCrc = 0;
+            valid = ReadObject(object, [&payloadCrc](const uint8_t *data, size_t size) {
+                payloadCrc = Crc32Update(payloadCrc, data, size);
+                return true;
+            });
+            valid = valid && payloadCrc == header.payloadCrc;
+            object.file.clear();
+            object.file.seekg(static_cast<std::streamoff>(kObjectHeaderSize));
+        }
+
+        if (!valid) {
+            AYZipLogInfo("compressed entry cache object {} is corrupt, removing", path.string());
+            object.file.close();
+            uint64_t objectSize = fs::file_size(path, ec);
+            if (ec) {
+                objectSize = 0;
+            }
+            fs::remove(path, ec);
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.corrupt++;
+            size_ -= std::min(size_, objectSize);
+            found = false;
+        }
+        else {
+            // 命中的对象移到 LRU 的最新端
+            fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.lookups++;
+    if (found) {
+        stats_.hits++;
+        stats_.bytesHit += object.uncompressedSize;
+    }
+    return found;
+}
+
+bool CompressedEntryCache::ReadObject(Object &object, const std::function<bool(const uint8_t *data, size_t size)> &sink)
+{
+    std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(object.compressedSize, kObjectBufferSize)));
+    uint64_t remaining = object.compressedSize;
+    while (remaining > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        object.file.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(chunk));
+        if (!object.file || !sink(buffer.data(), chunk)) {
+            return false;
+        }
+        remaining -= chunk;
+    }
+    return true;
+}
+
+std::unique_ptr<CompressedEntryCache::Writer> CompressedEntryCache::BeginInsert(const CompressedEntryKey &key, uint16_t method)
+{
+    fs::path object = ObjectPath(key);
+    uint64_t counter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        counter = tempCounter_++;
+    }
+
+    std::error_code ec;
+    fs::create_directories(object.parent_path(), ec);
+    fs::path temporary = object;
+    temporary += ".tmp" + std::to_string(counter);
+    std::unique_ptr<Writer> writer(new Writer(*this, object, temporary, method));
+    if (writer->failed_) {
+        return nullptr;
+    }
+    return writer;
+}
+
+void CompressedEntryCache::Inserted(uint64_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ += size;
+    stats_.inserted++;
+    stats_.bytesInserted += size;
+}
+
+void CompressedEntryCache::TrimIfNeeded()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (budget_ == 0 || size_ <= budget_) {
+            return;
+        }
+    }
+    Trim();
+}
+
+void CompressedEntryCache::Trim()
+{
+    CacheTrimResult result = TrimCacheObjects(root_ / "objects", budget_);
+    if (result.evicted > 0) {
+        AYZipLogInfo("compressed entry cache trimmed {} objects ({} bytes), {} bytes left", result.evicted, result.bytesEvicted, result.remaining);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ = result.remaining;
+    stats_.evicted += result.evicted;
+    stats_.bytesEvicted += result.bytesEvicted;
+}
+
+uint64_t CompressedEntryCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+CompressedEntryCacheStats CompressedEntryCache::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void CompressedEntryCache::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = CompressedEntryCacheStats();
+}
+
+std::string CompressedEntryCache::StatsJson() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value root;
+    root["size"] = Json::UInt64(size_);
+    root["budget"] = Json::UInt64(budget_);
+    root["lookups"] = Json::UInt64(stats_.lookups);
+    root["hits"] = Json::UInt64(stats_.hits);
+    root["hitRate"] = stats_.lookups == 0 ? 0.0 : static_cast<double>(stats_.hits) / stats_.lookups;
+    root["bytesHit"] = Json::UInt64(stats_.bytesHit);
+    root["inserted"] = Json::UInt64(stats_.inserted);
+    root["bytesInserted"] = Json::UInt64(stats_.bytesInserted);
+    root["evicted"] = Json::UInt64(stats_.evicted);
+    root["bytesEvicted"] = Json::UInt64(stats_.bytesEvicted);
+    root["corrupt"] = Json::UInt64(stats_.corrupt);
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, root);
+}
@@ -0,0 +1,116 @@
+﻿//
+//  CompressedEntryCache.hpp
+//  libAYZip
+//
+//  压缩结果缓存：以文件内容的 SHA-256 + 后端 + 压缩级别为键，保存压缩后的数据、CRC 与大小
+//  多次打包含有相同 framework / 动态库的 ipa 时，命中的文件直接写入缓存中的压缩数据，不再重新压缩
+//  对象为 <root>/objects/<摘要前两位>/<摘要>-<后端>-l<级别>：固定大小的头 + 压缩数据，按修改时间淘汰 (命中时更新)
+//
+
+#ifndef CompressedEntryCache_hpp
+#define CompressedEntryCache_hpp
+
+#include "Sha.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct CompressedEntryKey {
+    Sha256Digest digest = {};
+    std::string codec;              // ZipCodec::name；同一后端的不同版本可能得到不同的压缩数据，升级后端后应清空缓存
+    int level = -1;
+};
+
+struct CompressedEntryCacheStats {
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t bytesHit = 0;          // 命中而省去压缩的原始字节数
+    uint64_t inserted = 0;
+    uint64_t bytesInserted = 0;     // 放入的压缩数据字节数
+    uint64_t evicted = 0;
+    uint64_t bytesEvicted = 0;
+    uint64_t corrupt = 0;           // 头或压缩数据校验失败，已删除
+};
+
+// 同一个实例可在多个线程的压缩调用间共用；多个进程共用同一目录时对象以改名方式原子地放入
+class CompressedEntryCache
+{
+public:
+    // 命中的对象，头与压缩数据的校验和已检查
+    struct Object {
+        uint16_t method = 0;
+        uint32_t crc = 0;
+        uint64_t uncompressedSize = 0;
+        uint64_t compressedSize = 0;
+        std::ifstream file;         // 位于压缩数据开头
+    };
+
+    // 未命中时边压缩边写入临时对象，Commit 后改名放入；未 Commit 即析构时删除临时对象
+    class Writer
+    {
+    public:
+        ~Writer();
+        bool Append(const uint8_t *data, size_t size);
+        void Commit(uint32_t crc, uint64_t uncompressedSize);
+
+    private:
+        friend class CompressedEntryCache;
+        Writer(CompressedEntryCache &cache, std::filesystem::path object, std::filesystem::path temporary, uint16_t method);
+
+        CompressedEntryCache &cache_;
+        std::filesystem::path object_;
+        std::filesystem::path temporary_;
+        std::ofstream file_;
+        uint16_t method_;
+        uint64_t compressedSize_ = 0;
+        uint32_t payloadCrc_ = 0;
+        bool failed_ = false;
+    };
+
+    // budget 为 0 时不限大小
+    CompressedEntryCache(const std::string &root, uint64_t budget);
+
+    // 创建目录并统计现有对象的大小
+    bool Open();
+
+    // 小于 minEntrySize 的文件压缩很快，计算摘要、读写缓存反而更慢，不进入缓存
+    void SetMinEntrySize(uint64_t size) { minEntrySize_ = size; }
+    bool Eligible(uint64_t size) const { return size >= minEntrySize_; }
+
+    bool Lookup(const CompressedEntryKey &key, Object &object);
+    // 把 object 的压缩数据依次交给 sink
+    bool ReadObject(Object &object, const std::function<bool(const uint8_t *data, size_t size)> &sink);
+    // 无法创建临时对象时返回空
+    std::unique_ptr<Writer> BeginInsert(const CompressedEntryKey &key, uint16_t method);
+
+    void TrimIfNeeded();
+    void Trim();
+
+    uint64_t Size() const;
+    CompressedEntryCacheStats Stats() const;
+    void ResetStats();
+    // {"size", "budget", "hitRate", "lookups", "hits", ...}
+    std::string StatsJson() const;
+
+private:
+    std::filesystem::path ObjectPath(const CompressedEntryKey &key) const;
+    void Inserted(uint64_t size);
+
+    std::filesystem::path root_;
+    uint64_t budget_;
+    uint64_t minEntrySize_;
+
+    mutable std::mutex mutex_;
+    uint64_t size_ = 0;
+    uint64_t tempCounter_ = 0;
+    CompressedEntryCacheStats stats_;
+};
+
+// 文件内容的 SHA-256，用于超过整块读入上限的文件
+bool Sha256OfFile(const std::filesystem::path &path, Sha256Digest *digest);
+
+#endif /* CompressedEntryCache_hpp */
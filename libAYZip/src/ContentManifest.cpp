@@ -0,0 +1,277 @@
+﻿//
+//  ContentManifest.cpp
+//  libAYZip
+//
+
+#include "ContentManifest.hpp"
+#include "Crc32.hpp"
+#include <json/json.h>
+#include <string>
+
+// 已复制、尚未算完的数据上限；超过后 Feed 阻塞，I/O 不会无限领先
+constexpr size_t kManifestMaxQueuedBytes = 64 * 1024 * 1024;
+constexpr unsigned int kManifestMaxThreads = 4;
+constexpr size_t kManifestMaxFreeBuffers = 64;
+
+/********************************************
+ *                                          *
+ *            ContentManifest               *
+ *                                          *
+ ********************************************/
+void ContentManifest::Reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+}
+
+size_t ContentManifest::AddPending(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.emplace_back();
+    entries_.back().path = path;
+    return entries_.size() - 1;
+}
+
+void ContentManifest::Complete(size_t index, ManifestEntry &&entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ManifestEntry &slot = entries_[index];
+    slot.size = entry.size;
+    slot.crc = entry.crc;
+    slot.magic = entry.magic;
+    slot.sha1 = entry.sha1;
+    slot.sha256 = entry.sha256;
+    slot.machO = std::move(entry.machO);
+}
+
+std::string ContentManifest::ToJson() const
+{
+    Json::Value files(Json::arrayValue);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const ManifestEntry &entry : entries_) {
+            Json::Value item;
+            item["path"] = entry.path;
+            item["size"] = Json::UInt64(entry.size);
+            item["crc"] = Json::UInt(entry.crc);
+            item["sha1"] = ToHex(entry.sha1);
+            item["sha256"] = ToHex(entry.sha256);
+            if (!entry.machO.empty()) {
+                Json::Value slices(Json::arrayValue);
+                for (const MachOSlice &slice : entry.machO) {
+                    Json::Value value;
+                    value["cpuType"] = Json::UInt(slice.cpuType);
+                    value["cpuSubtype"] = Json::UInt(slice.cpuSubtype);
+                    value["offset"] = Json::UInt64(slice.offset);
+                    value["size"] = Json::UInt64(slice.size);
+                    value["codeLimit"] = Json::UInt64(slice.codeLimit);
+                    value["codeSignature"] = slice.hasCodeSignature;
+                    value["pages"] = Json::UInt64(slice.sha256Pages.size());
+                    slices.append(value);
+                }
+                item["machO"] = slices;
+            }
+            files.append(item);
+        }
+    }
+
+    Json::Value root;
+    root["files"] = files;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, root);
+}
+
+/********************************************
+ *                                          *
+ *             ManifestHasher               *
+ *                                          *
+ ********************************************/
+struct ManifestHasher::Job {
+    std::string path;
+    Sha1 sha1;
+    Sha256 sha256;
+    uint32_t crc = 0;
+    uint64_t size = 0;
+    uint8_t head[4] = {};
+    std::unique_ptr<MachOPageHasher> machO;     // 清单开启页哈希时创建，不是 Mach-O 时只看前 4 字节
+
+    // 以下由 ManifestHasher::mutex_ 保护
+    std::deque<std::vector<uint8_t>> chunks;
+    bool ended = false;
+    bool success = false;
+    bool scheduled = false;     // 已在 ready_ 中或正被某个工作线程处理
+    size_t index = 0;           // End 时在清单中占位，保持归档顺序
+};
+
+ManifestHasher::ManifestHasher(ContentManifest *manifest, TraceRecorder *trace, unsigned int threads) : manifest_(manifest), trace_(trace)
+{
+    if (threads == 0) {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        threads = hardware == 0 ? 1 : (hardware < kManifestMaxThreads ? hardware : kManifestMaxThreads);
+    }
+    workers_.reserve(threads);
+    for (unsigned int i = 0; i < threads; i++) {
+        workers_.emplace_back(&ManifestHasher::WorkerMain, this, i);
+    }
+}
+
+ManifestHasher::~ManifestHasher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    readyCv_.notify_all();
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+}
+
+ManifestHasher::Job *ManifestHasher::Begin(const std::string &path)
+{
+    Job *job = new Job();
+    job->path = path;
+    if (manifest_->MachOPageHashes()) {
+        job->machO.reset(new MachOPageHasher());
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    activeJobs_++;
+    return job;
+}
+
+void ManifestHasher::Feed(Job *job, const uint8_t *data, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    std::vector<uint8_t> chunk;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto hasSpace = [&] { return queuedBytes_ == 0 || queuedBytes_ + size <= kManifestMaxQueuedBytes; };
+        if (!hasSpace()) {
+            // 摘要线程跟不上时解压 / 压缩线程在这里被拖慢
+            ScopedTraceSpan span(trace_, "wait hash space", "manifest");
+            spaceCv_.wait(lock, hasSpace);
+        }
+        queuedBytes_ += size;
+        if (!freeBuffers_.empty()) {
+            chunk.swap(freeBuffers_.back());
+            freeBuffers_.pop_back();
+        }
+    }
+
+    chunk.assign(data, data + size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    job->chunks.push_back(std::move(chunk));
+    Schedule(job);
+}
+
+void ManifestHasher::End(Job *job, bool success)
+{
+    size_t index = success ? manifest_->AddPending(job->path) : 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    job->index = index;
+    job->success = success;
+    job->ended = true;
+    Schedule(job);
+}
+
+void ManifestHasher::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idleCv_.wait(lock, [this] { return activeJobs_ == 0; });
+}
+
+// 调用方持有 mutex_
+void ManifestHasher::Schedule(Job *job)
+{
+    if (!job->scheduled) {
+        job->scheduled = true;
+        ready_.push_back(job);
+        readyCv_.notify_one();
+    }
+}
+
+void ManifestHasher::WorkerMain(unsigned int index)
+{
+    if (trace_) {
+        trace_->SetThreadName("manifest " + std::to_string(index + 1));
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        // stop_ 后仍处理完已提交的文件
+        auto hasWork = [this] { return stop_ || !ready_.empty(); };
+        if (!hasWork()) {
+            ScopedTraceSpan span(trace_, "wait ready", "manifest");
+            readyCv_.wait(lock, hasWork);
+        }
+        if (ready_.empty()) {
+            return;
+        }
+        Job *job = ready_.front();
+        ready_.pop_front();
+        auto hashStart = trace_ ? TraceRecorder::Clock::now() : TraceRecorder::Clock::time_point();
+
+        // 一个文件同一时刻只由一个线程处理，块按提交顺序计算
+        while (!job->chunks.empty()) {
+            std::vector<uint8_t> chunk = std::move(job->chunks.front());
+            job->chunks.pop_front();
+            lock.unlock();
+
+            for (size_t i = 0; job->size + i < sizeof(job->head) && i < chunk.size(); i++) {
+                job->head[job->size + i] = chunk[i];
+            }
+            job->sha1.Update(chunk.data(), chunk.size());
+            job->sha256.Update(chunk.data(), chunk.size());
+            job->crc = Crc32Update(job->crc, chunk.data(), chunk.size());
+            if (job->machO) {
+                job->machO->Update(chunk.data(), chunk.size());
+            }
+            job->size += chunk.size();
+
+            lock.lock();
+            queuedBytes_ -= chunk.size();
+            if (freeBuffers_.size() < kManifestMaxFreeBuffers) {
+                freeBuffers_.push_back(std::move(chunk));
+            }
+            spaceCv_.notify_all();
+        }
+
+        if (!job->ended) {
+            job->scheduled = false;
+            if (trace_) {
+                trace_->AddComplete("hash", "manifest", hashStart, TraceRecorder::Clock::now(), job->path);
+            }
+            continue;
+        }
+
+        lock.unlock();
+        if (job->success) {
+            ManifestEntry entry;
+            entry.size = job->size;
+            entry.crc = job->crc;
+            if (job->size >= sizeof(job->head)) {
+                entry.magic = (uint32_t(job->head[0]) << 24) | (uint32_t(job->head[1]) << 16) | (uint32_t(job->head[2]) << 8) | job->head[3];
+            }
+            entry.sha1 = job->sha1.Final();
+            entry.sha256 = job->sha256.Final();
+            if (job->machO) {
+                entry.machO = job->machO->Final();
+            }
+            manifest_->Complete(job->index, std::move(entry));
+        }
+        if (trace_) {
+            trace_->AddComplete("hash", "manifest", hashStart, TraceRecorder::Clock::now(), job->path);
+        }
+        delete job;
+        lock.lock();
+        if (--activeJobs_ == 0) {
+            idleCv_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,99 @@
+﻿//
+//  ContentManifest.hpp
+//  libAYZip
+//
+//  压缩/解压时在数据流上顺带计算每个文件的 SHA-1 / SHA-256，避免签名前再读一遍文件
+//  I/O 线程只复制数据入队，摘要由工作线程计算；不同文件并行，同一文件的数据按顺序处理
+//
+
+#ifndef ContentManifest_hpp
+#define ContentManifest_hpp
+
+#include "MachOPageHasher.hpp"
+#include "Sha.hpp"
+#include "TraceEvents.hpp"
+#include <memory>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ManifestEntry {
+    std::string path;           // zip 内路径 (UTF-8，'/' 分隔)
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    uint32_t magic = 0;         // 前 4 字节 (大端)，不足 4 字节时为 0；用于识别 Mach-O
+    Sha1Digest sha1 = {};
+    Sha256Digest sha256 = {};
+    std::vector<MachOSlice> machO;  // 开启页哈希且文件为 Mach-O 时，各切片的代码页哈希
+};
+
+// 多次调用间累计，直到 Reset；条目按文件处理完成的顺序 (即归档中的顺序) 排列
+class ContentManifest
+{
+public:
+    void Reset();
+
+    // 开启后，Mach-O 文件额外计算每个切片的 4KB 页哈希 (代码目录的 code slots)；压缩/解压进行中不可修改
+    void SetMachOPageHashes(bool enabled) { machOPageHashes_ = enabled; }
+    bool MachOPageHashes() const { return machOPageHashes_; }
+
+    // 压缩/解压进行中不可调用
+    const std::vector<ManifestEntry> &Entries() const { return entries_; }
+
+    // {"files":[{"path","size","crc","sha1","sha256","machO":[...]}]}，摘要为小写十六进制
+    // machO 只含切片信息与页数，页哈希通过 Entries() 取得
+    std::string ToJson() const;
+
+private:
+    friend class ManifestHasher;
+
+    size_t AddPending(const std::string &path);
+    void Complete(size_t index, ManifestEntry &&entry);
+
+    mutable std::mutex mutex_;
+    std::vector<ManifestEntry> entries_;
+    bool machOPageHashes_ = false;
+};
+
+class ManifestHasher
+{
+public:
+    struct Job;
+
+    // threads 为 0 时按 CPU 数选择 (至多 4)；trace 非空时记录工作线程的计算与等待、Feed 因排队数据超限而阻塞的时间
+    explicit ManifestHasher(ContentManifest *manifest, TraceRecorder *trace = nullptr, unsigned int threads = 0);
+    // 等待已提交的文件全部算完
+    ~ManifestHasher();
+
+    Job *Begin(const std::string &path);
+    // 复制数据后入队；排队数据超过上限时阻塞，直到工作线程赶上
+    void Feed(Job *job, const uint8_t *data, size_t size);
+    // success 为 false 时丢弃该文件 (如解压失败)，不写入清单
+    void End(Job *job, bool success);
+    // 等待已 End 的文件全部写入清单；调用时不能有未 End 的文件
+    void Wait();
+
+private:
+    void Schedule(Job *job);
+    void WorkerMain(unsigned int index);
+
+    ContentManifest *manifest_;
+    TraceRecorder *trace_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable readyCv_;       // 有文件待处理
+    std::condition_variable spaceCv_;       // 排队数据量下降
+    std::condition_variable idleCv_;        // 未完成的文件数降为 0
+    std::deque<Job *> ready_;
+    std::vector<std::vector<uint8_t>> freeBuffers_;
+    size_t queuedBytes_ = 0;
+    size_t activeJobs_ = 0;                 // 已 Begin 未算完的文件数
+    bool stop_ = false;
+};
+
+#endif /* ContentManifest_hpp */
@@ -0,0 +1,452 @@
+﻿//
+//  Crc32.cpp
+//  libAYZip
+//
+//  折叠常数与约简步骤见 Intel 白皮书 "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+//
+
+#include "Crc32.hpp"
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define AYZIP_CRC32_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define AYZIP_CRC32_ARM 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <windows.h>
+#else
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AYZIP_TARGET(x)
+#else
+#define AYZIP_TARGET(x) __attribute__((target(x)))
+#endif
+
+constexpr uint32_t kCrc32Polynomial = 0xEDB88320;
+
+/********************************************
+ *                                          *
+ *          查表实现 (slice-by-8)            *
+ *                                          *
+ ********************************************/
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    Crc32Tables()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; k++) {
+                crc = (crc & 1) ? (crc >> 1) ^ kCrc32Polynomial : crc >> 1;
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+static const Crc32Tables &Tables()
+{
+    static const Crc32Tables tables;
+    return tables;
+}
+
+// 支持的平台均为小端
+static uint32_t Crc32Table(uint32_t crc, const uint8_t *data, size_t size)
+{
+    const auto &t = Tables().table;
+    crc = ~crc;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+        crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+    while (size >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+    return ~crc;
+}
+
+/********************************************
+ *                                          *
+ *        x86 PCLMULQDQ / VPCLMULQDQ        *
+ *                                          *
+ ********************************************/
+#ifdef AYZIP_CRC32_X86
+// 反射域折叠常数：bitreflect(x^n mod P) << 1，向前折叠 D 位使用 (n = D + 32, n = D - 32)
+constexpr uint64_t XPowModP(unsigned n)
+{
+    uint64_t r = 1;
+    for (unsigned i = 0; i < n; i++) {
+        r <<= 1;
+        if (r & 0x100000000ULL) {
+            r ^= 0x104C11DB7ULL;
+        }
+    }
+    return r;
+}
+
+constexpr uint64_t FoldConstant(unsigned n)
+{
+    uint64_t r = XPowModP(n);
+    uint64_t reflected = 0;
+    for (int i = 0; i < 32; i++) {
+        reflected |= ((r >> i) & 1) << (31 - i);
+    }
+    return reflected << 1;
+}
+
+static_assert(FoldConstant(512 + 32) == 0x154442bd4ULL, "fold constant");
+static_assert(FoldConstant(512 - 32) == 0x1c6e41596ULL, "fold constant");
+
+// 低 64 位乘 x^(D+32)，高 64 位乘 x^(D-32)；模板保证常数在编译期求值
+template <unsigned Bits>
+struct FoldConstants {
+    static constexpr long long lo = static_cast<long long>(FoldConstant(Bits + 32));
+    static constexpr long long hi = static_cast<long long>(FoldConstant(Bits - 32));
+};
+
+#define FOLD_CONSTANTS(bits) _mm_set_epi64x(FoldConstants<bits>::hi, FoldConstants<bits>::lo)
+
+AYZIP_TARGET("sse4.1,pclmul")
+static inline __m128i Fold128(__m128i x, __m128i k, __m128i next)
+{
+    __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(lo, hi), next);
+}
+
+// 逐 16 字节折叠剩余数据，再把 128 位约简为 32 位（返回未取反的内部状态）
+AYZIP_TARGET("sse4.1,pclmul")
+static uint32_t FoldTailAndReduce(__m128i x1, const uint8_t *&data, size_t &size)
+{
+    const __m128i k3k4 = FOLD_CONSTANTS(128);
+    while (size >= 16) {
+        x1 = Fold128(x1, k3k4, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+        data += 16;
+        size -= 16;
+    }
+
+    // 128 -> 64
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+    const __m128i k5 = _mm_set_epi64x(0, FoldConstants<32>::lo);   // x^64
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett 约简 64 -> 32
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+AYZIP_TARGET("sse4.1,pclmul")
+static uint32_t Crc32Pclmul(uint32_t crc, const uint8_t *data, size_t size)
+{
+    if (size < 64) {
+        return Crc32Table(crc, data, size);
+    }
+
+    const __m128i *p = reinterpret_cast<const __m128i *>(data);
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128(p), _mm_cvtsi32_si128(static_cast<int>(~crc)));
+    __m128i x2 = _mm_loadu_si128(p + 1);
+    __m128i x3 = _mm_loadu_si128(p + 2);
+    __m128i x4 = _mm_loadu_si128(p + 3);
+    data += 64;
+    size -= 64;
+
+    // 4 路并行，每次折叠 64 字节
+    const __m128i k1k2 = FOLD_CONSTANTS(512);
+    while (size >= 64) {
+        p = reinterpret_cast<const __m128i *>(data);
+        x1 = Fold128(x1, k1k2, _mm_loadu_si128(p));
+        x2 = Fold128(x2, k1k2, _mm_loadu_si128(p + 1));
+        x3 = Fold128(x3, k1k2, _mm_loadu_si128(p + 2));
+        x4 = Fold128(x4, k1k2, _mm_loadu_si128(p + 3));
+        data += 64;
+        size -= 64;
+    }
+
+    const __m128i k3k4 = FOLD_CONSTANTS(128);
+    x1 = Fold128(x1, k3k4, x2);
+    x1 = Fold128(x1, k3k4, x3);
+    x1 = Fold128(x1, k3k4, x4);
+
+    crc = ~FoldTailAndReduce(x1, data, size);
+    return Crc32Table(crc, data, size);
+}
+
+#define FOLD_CONSTANTS_512(bits) _mm512_set_epi64(FoldConstants<bits>::hi, FoldConstants<bits>::lo, FoldConstants<bits>::hi, FoldConstants<bits>::lo, \
+                                                  FoldConstants<bits>::hi, FoldConstants<bits>::lo, FoldConstants<bits>::hi, FoldConstants<bits>::lo)
+
+AYZIP_TARGET("avx512f,avx512vl,vpclmulqdq,sse4.1,pclmul")
+static inline __m512i Fold512(__m512i x, __m512i k, __m512i next)
+{
+    __m512i lo = _mm512_clmulepi64_epi128(x, k, 0x00);
+    __m512i hi = _mm512_clmulepi64_epi128(x, k, 0x11);
+    return _mm512_ternarylogic_epi64(lo, hi, next, 0x96);   // lo ^ hi ^ next
+}
+
+AYZIP_TARGET("avx512f,avx512vl,vpclmulqdq,sse4.1,pclmul")
+static uint32_t Crc32Vpclmul(uint32_t crc, const uint8_t *data, size_t size)
+{
+    if (size < 256) {
+        return Crc32Pclmul(crc, data, size);
+    }
+
+    __m512i z0 = _mm512_xor_si512(_mm512_loadu_si512(data), _mm512_maskz_set1_epi32(1, static_cast<int>(~crc)));
+    __m512i z1 = _mm512_loadu_si512(data + 64);
+    __m512i z2 = _mm512_loadu_si512(data + 128);
+    __m512i z3 = _mm512_loadu_si512(data + 192);
+    data += 256;
+    size -= 256;
+
+    // 4 个 zmm 并行，每次折叠 256 字节
+    const __m512i k2048 = FOLD_CONSTANTS_512(2048);
+    while (size >= 256) {
+        z0 = Fold512(z0, k2048, _mm512_loadu_si512(data));
+        z1 = Fold512(z1, k2048, _mm512_loadu_si512(data + 64));
+        z2 = Fold512(z2, k2048, _mm512_loadu_si512(data + 128));
+        z3 = Fold512(z3, k2048, _mm512_loadu_si512(data + 192));
+        data += 256;
+        size -= 256;
+    }
+
+    const __m512i k512 = FOLD_CONSTANTS_512(512);
+    z1 = Fold512(z0, k512, z1);
+    z2 = Fold512(z1, k512, z2);
+    z3 = Fold512(z2, k512, z3);
+
+    // zmm 的 4 个 128 位通道分别折叠到最后一个通道
+    __m128i x1 = _mm512_extracti32x4_epi32(z3, 3);
+    x1 = Fold128(_mm512_extracti32x4_epi32(z3, 2), FOLD_CONSTANTS(128), x1);
+    x1 = Fold128(_mm512_extracti32x4_epi32(z3, 1), FOLD_CONSTANTS(256), x1);
+    x1 = Fold128(_mm512_extracti32x4_epi32(z3, 0), FOLD_CONSTANTS(384), x1);
+    // 之后是非 VEX 编码的 SSE 代码，先清除高位状态避免 AVX-SSE 切换开销
+    _mm256_zeroupper();
+
+    crc = ~FoldTailAndReduce(x1, data, size);
+    return Crc32Table(crc, data, size);
+}
+
+static void CpuId(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; i++) {
+        regs[i] = static_cast<uint32_t>(info[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t XGetBv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static void AddX86Kernels(std::vector<Crc32Kernel> &kernels)
+{
+    uint32_t regs[4];
+    CpuId(0, 0, regs);
+    uint32_t maxLeaf = regs[0];
+
+    CpuId(1, 0, regs);
+    bool pclmul = (regs[2] & (1u << 1)) && (regs[2] & (1u << 19));     // PCLMULQDQ + SSE4.1
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    if (!pclmul) {
+        return;
+    }
+
+    if (maxLeaf >= 7 && osxsave) {
+        CpuId(7, 0, regs);
+        bool avx512 = (regs[1] & (1u << 16)) && (regs[1] & (1u << 31));   // AVX512F + AVX512VL
+        bool vpclmul = (regs[2] & (1u << 10)) != 0;
+        bool zmmEnabled = (XGetBv() & 0xE6) == 0xE6;                       // 系统保存 zmm 状态
+        if (avx512 && vpclmul && zmmEnabled) {
+            kernels.push_back({ "vpclmulqdq", Crc32Vpclmul });
+        }
+    }
+    kernels.push_back({ "pclmulqdq", Crc32Pclmul });
+}
+#endif
+
+/********************************************
+ *                                          *
+ *             ARMv8 CRC32 指令              *
+ *                                          *
+ ********************************************/
+#ifdef AYZIP_CRC32_ARM
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AYZIP_TARGET_CRC
+#elif defined(__clang__)
+#define AYZIP_TARGET_CRC AYZIP_TARGET("crc")
+#else
+#define AYZIP_TARGET_CRC AYZIP_TARGET("+crc")
+#endif
+
+AYZIP_TARGET_CRC
+static uint32_t Crc32Arm(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+        crc = __crc32b(crc, *data++);
+        size--;
+    }
+    while (size >= 32) {
+        uint64_t v[4];
+        memcpy(v, data, sizeof(v));
+        crc = __crc32d(crc, v[0]);
+        crc = __crc32d(crc, v[1]);
+        crc = __crc32d(crc, v[2]);
+        crc = __crc32d(crc, v[3]);
+        data += 32;
+        size -= 32;
+    }
+    while (size >= 8) {
+        uint64_t v;
+        memcpy(&v, data, sizeof(v));
+        crc = __crc32d(crc, v);
+        data += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = __crc32b(crc, *data++);
+        size--;
+    }
+    return ~crc;
+}
+
+static bool HasArmCrc32()
+{
+#if defined(__APPLE__)
+    return true;
+#elif defined(_WIN32)
+    return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE) != 0;
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return false;
+#endif
+}
+#endif
+
+std::vector<Crc32Kernel> AvailableCrc32Kernels()
+{
+    std::vector<Crc32Kernel> kernels;
+#ifdef AYZIP_CRC32_X86
+    AddX86Kernels(kernels);
+#endif
+#ifdef AYZIP_CRC32_ARM
+    if (HasArmCrc32()) {
+        kernels.push_back({ "armv8-crc32", Crc32Arm });
+    }
+#endif
+    kernels.push_back({ "table", Crc32Table });
+    return kernels;
+}
+
+uint32_t Crc32Update(uint32_t crc, const uint8_t *data, size_t size)
+{
+    static const auto update = AvailableCrc32Kernels().front().update;
+    return update(crc, data, size);
+}
+
+/********************************************
+ *                                          *
+ *              Crc32Combine                *
+ *                                          *
+ ********************************************/
+// GF(2) 上 a * b mod P（反射表示）
+static uint32_t MultModP(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ kCrc32Polynomial : b >> 1;
+    }
+    return p;
+}
+
+// x^(2^k) mod P，k = 0..31
+struct Crc32PowerTable {
+    uint32_t x2n[32];
+
+    Crc32PowerTable()
+    {
+        uint32_t p = 1u << 30;  // x^1
+        x2n[0] = p;
+        for (int n = 1; n < 32; n++) {
+            x2n[n] = p = MultModP(p, p);
+        }
+    }
+};
+
+uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, uint64_t size2)
+{
+    static const Crc32PowerTable powers;
+
+    // crc1 * x^(8 * size2) mod P
+    uint32_t p = 1u << 31;  // x^0
+    unsigned k = 3;
+    while (size2) {
+        if (size2 & 1) {
+            p = MultModP(powers.x2n[k & 31], p);
+        }
+        size2 >>= 1;
+        k++;
+    }
+    return MultModP(p, crc1) ^ crc2;
+}
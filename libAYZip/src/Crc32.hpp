@@ -0,0 +1,34 @@
+﻿//
+//  Crc32.hpp
+//  libAYZip
+//
+//  zip / zlib 使用的 CRC-32（反射多项式 0xEDB88320），结果与 zlib crc32() 一致
+//  x86 使用 PCLMULQDQ / VPCLMULQDQ 折叠，ARMv8 使用 CRC32 指令，首次调用时按 CPU 选择实现
+//
+
+#ifndef Crc32_hpp
+#define Crc32_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+uint32_t Crc32Update(uint32_t crc, const uint8_t *data, size_t size);
+
+// 由 crc(A)、crc(B) 与 B 的长度得到 crc(A + B)，用于分块并行计算后合并
+uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, uint64_t size2);
+
+struct Crc32Kernel {
+    const char *name;
+    uint32_t (*update)(uint32_t crc, const uint8_t *data, size_t size);
+};
+
+// 当前 CPU 支持的全部实现，供基准测试与交叉校验；第一个为 Crc32Update 使用的实现
+std::vector<Crc32Kernel> AvailableCrc32Kernels();
+
+// 各实现与 zlib crc32() 的吞吐量 (GB/s)，分别测整块与 4KB 分块（小条目）两种情形，返回 JSON
+// 实现在 Crc32Benchmark.cpp，只编译进 testAYZip，不属于 libAYZip
+std::string BenchmarkCrc32Kernels(size_t bufferSize);
+
+#endif /* Crc32_hpp */
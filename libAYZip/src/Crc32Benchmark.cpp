@@ -0,0 +1,86 @@
+//
+//  Crc32Benchmark.cpp
+//  libAYZip
+//
+
+#include "Crc32.hpp"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <json/json.h>
+#include <zlib.h>
+
+constexpr size_t kBenchmarkBlockSize = 4 * 1024;
+constexpr auto kBenchmarkMinDuration = std::chrono::milliseconds(200);
+
+static uint32_t ZlibCrc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    return static_cast<uint32_t>(crc32_z(crc, data, size));
+}
+
+// 重复计算直到累计超过 kBenchmarkMinDuration，blockSize 为 0 时整块计算
+static double MeasureGBps(const Crc32Kernel &kernel, const std::vector<uint8_t> &buffer, size_t blockSize, uint32_t *crc)
+{
+    using Clock = std::chrono::steady_clock;
+    size_t step = blockSize ? blockSize : buffer.size();
+    uint64_t bytes = 0;
+    uint32_t result = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    do {
+        result = 0;
+        for (size_t offset = 0; offset < buffer.size(); offset += step) {
+            size_t size = std::min(step, buffer.size() - offset);
+            // 分块时各块独立计算，与逐个校验小条目相同
+            uint32_t blockCrc = kernel.update(0, buffer.data() + offset, size);
+            result = blockSize ? result ^ blockCrc : blockCrc;
+        }
+        bytes += buffer.size();
+        elapsed = Clock::now() - start;
+    } while (elapsed < kBenchmarkMinDuration);
+
+    *crc = result;
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    return static_cast<double>(bytes) / seconds / 1e9;
+}
+
+std::string BenchmarkCrc32Kernels(size_t bufferSize)
+{
+    std::vector<uint8_t> buffer(bufferSize);
+    std::mt19937 rng(20191208);
+    for (auto &byte : buffer) {
+        byte = static_cast<uint8_t>(rng());
+    }
+
+    std::vector<Crc32Kernel> kernels = AvailableCrc32Kernels();
+    kernels.push_back({ "zlib", ZlibCrc32 });
+
+    Json::Value root;
+    root["selected"] = kernels.front().name;
+    root["bufferBytes"] = Json::UInt64(bufferSize);
+
+    Json::Value results(Json::arrayValue);
+    uint32_t expected = 0;
+    bool agree = true;
+    for (size_t i = 0; i < kernels.size(); i++) {
+        uint32_t crc = 0;
+        uint32_t blockCrc = 0;
+        Json::Value item;
+        item["name"] = kernels[i].name;
+        item["gbps"] = MeasureGBps(kernels[i], buffer, 0, &crc);
+        item["gbps4k"] = MeasureGBps(kernels[i], buffer, kBenchmarkBlockSize, &blockCrc);
+        item["crc"] = crc;
+        results.append(item);
+
+        if (i == 0) {
+            expected = crc;
+        }
+        agree = agree && crc == expected;
+    }
+    root["kernels"] = results;
+    root["agree"] = agree;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, root);
+}
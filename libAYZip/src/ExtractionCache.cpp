@@ -0,0 +1,296 @@
+﻿//
+//  ExtractionCache.cpp
+//  libAYZip
+//
+
+#include "ExtractionCache.hpp"
+#include "Crc32.hpp"
+#include "ZipLog.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <json/json.h>
+#include <random>
+#include <spdlog/AYLog.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+constexpr uint64_t kDefaultMinEntrySize = 16 * 1024;
+
+static uint32_t FileCrc32(const fs::path &path, bool *success)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> buffer(1024 * 1024);
+    uint32_t crc = 0;
+    while (file) {
+        file.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+        crc = Crc32Update(crc, buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    *success = file.eof();
+    return crc;
+}
+
+// 正在写入的临时对象，扫描与淘汰时跳过
+static bool IsTemporaryObject(const fs::path &path)
+{
+    return path.filename().string().find(".tmp") != std::string::npos;
+}
+
+bool CacheObjectsSize(const fs::path &directory, uint64_t *size)
+{
+    std::error_code ec;
+    uint64_t total = 0;
+    for (fs::recursive_directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entryError;
+        if (it->is_regular_file(entryError) && !IsTemporaryObject(it->path())) {
+            uint64_t objectSize = it->file_size(entryError);
+            total += entryError ? 0 : objectSize;
+        }
+    }
+    if (ec) {
+        AYError("Scan cache {} failed: {}", directory.string(), ec.message());
+        return false;
+    }
+    *size = total;
+    return true;
+}
+
+CacheTrimResult TrimCacheObjects(const fs::path &directory, uint64_t budget)
+{
+    struct Object {
+        fs::file_time_type time;
+        uint64_t size;
+        fs::path path;
+    };
+    std::vector<Object> objects;
+    CacheTrimResult result;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entryError;
+        if (!it->is_regular_file(entryError) || IsTemporaryObject(it->path())) {
+            continue;
+        }
+        Object object{it->last_write_time(entryError), it->file_size(entryError), it->path()};
+        if (!entryError) {
+            result.remaining += object.size;
+            objects.push_back(std::move(object));
+        }
+    }
+
+    if (budget == 0 || result.remaining <= budget) {
+        return result;
+    }
+    uint64_t target = budget / 10 * 9;
+    std::sort(objects.begin(), objects.end(), [](const Object &a, const Object &b) { return a.time < b.time; });
+    for (const Object &object : objects) {
+        if (result.remaining <= target) {
+            break;
+        }
+        if (fs::remove(object.path, ec)) {
+            result.remaining -= object.size;
+            result.evicted++;
+            result.bytesEvicted += object.size;
+        }
+    }
+    return result;
+}
+
+ExtractionCache::ExtractionCache(const std::string &root, uint64_t budget, CloneMode mode)
+    : root_(fs::u8path(root)),
+      budget_(budget),
+      minEntrySize_(kDefaultMinEntrySize),
+      // 解压结果之后还要设置权限与修改时间、可能被原地修改，与存储共享 inode 会改动存储，硬链接按 Auto 处理
+      cloner_(mode == CloneMode::Hardlink ? CloneMode::Auto : mode),
+      // 放入存储的对象不能与解压结果共享 inode，否则之后对解压结果的修改 (如重签名) 会改动存储
+      inserter_(CloneMode::Auto)
+{
+    tempCounter_ = std::random_device()();
+    tempCounter_ <<= 32;
+}
+
+bool ExtractionCache::Open()
+{
+    std::error_code ec;
+    fs::create_directories(root_ / "objects", ec);
+    if (ec) {
+        AYError("Create extraction cache {} failed: {}", root_.string(), ec.message());
+        return false;
+    }
+
+    uint64_t total = 0;
+    if (!CacheObjectsSize(root_ / "objects", &total)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ = total;
+    return true;
+}
+
+fs::path ExtractionCache::ObjectPath(const ExtractionCacheKey &key) const
+{
+    // 按 SHA-256 的第一个字节分 256 个子目录，避免单个目录下文件过多
+    // 旧版本以 "<crc>-<size>" 命名的对象不再命中，随 LRU 淘汰
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), "-%08x-%016llx-%u", key.crc, static_cast<unsigned long long>(key.size), static_cast<unsigned>(key.method));
+    std::string name = ToHex(key.rawDigest) + suffix;
+    return root_ / "objects" / name.substr(0, 2) / name;
+}
+
+bool ExtractionCache::Materialize(const ExtractionCacheKey &key, const fs::path &destination)
+{
+    uint32_t crc = key.crc;
+    uint64_t size = key.size;
+    fs::path object = ObjectPath(key);
+    std::error_code ec;
+    uint64_t objectSize = fs::file_size(object, ec);
+    bool found = !ec && objectSize == size;
+
+    if (found && verify_) {
+        bool readable = false;
+        if (FileCrc32(object, &readable) != crc || !readable) {
+            AYZipLogInfo("extraction cache object {} is corrupt, removing", object.string());
+            fs::remove(object, ec);
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.verifyFailures++;
+            size_ -= std::min(size_, objectSize);
+            found = false;
+        }
+    }
+
+    if (found) {
+        // 克隆期间不持锁，reflink / 硬链接是否可用的状态在克隆后写回
+        FileCloner cloner = [&] {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return cloner_;
+        }();
+        fs::create_directories(destination.parent_path(), ec);
+        found = cloner.Clone(object, destination) != CloneResult::Failed;
+        if (found) {
+            // 命中的对象移到 LRU 的最新端；解压结果的修改时间与正常解压一致
+            fs::file_time_type now = fs::file_time_type::clock::now();
+            fs::last_write_time(object, now, ec);
+            fs::last_write_time(destination, now, ec);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        cloner_ = cloner;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.lookups++;
+    if (found) {
+        stats_.hits++;
+        stats_.bytesHit += size;
+    }
+    return found;
+}
+
+void ExtractionCache::Insert(const ExtractionCacheKey &key, const fs::path &source)
+{
+    uint64_t size = key.size;
+    fs::path object = ObjectPath(key);
+    std::error_code ec;
+    if (fs::exists(object, ec)) {
+        return;
+    }
+
+    FileCloner inserter(CloneMode::Auto);
+    uint64_t counter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inserter = inserter_;
+        counter = tempCounter_++;
+    }
+
+    // 先写到临时名再改名，其他进程不会看到写了一半的对象
+    fs::path temporary = object;
+    temporary += ".tmp" + std::to_string(counter);
+    fs::create_directories(object.parent_path(), ec);
+    bool success = inserter.Clone(source, temporary) != CloneResult::Failed;
+    if (success) {
+        // 克隆保留了源文件的修改时间 (可能是条目时间)，改为现在，否则新对象会最先被淘汰
+        fs::last_write_time(temporary, fs::file_time_type::clock::now(), ec);
+        bool replaced = fs::exists(object, ec);
+        fs::rename(temporary, object, ec);
+        success = !ec;
+        if (!success) {
+            AYError("Insert {} into extraction cache failed: {}", object.string(), ec.message());
+        }
+        success = success && !replaced;
+    }
+    if (!success) {
+        fs::remove(temporary, ec);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    inserter_ = inserter;
+    if (success) {
+        size_ += size;
+        stats_.inserted++;
+        stats_.bytesInserted += size;
+    }
+}
+
+void ExtractionCache::TrimIfNeeded()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (budget_ == 0 || size_ <= budget_) {
+            return;
+        }
+    }
+    Trim();
+}
+
+void ExtractionCache::Trim()
+{
+    CacheTrimResult result = TrimCacheObjects(root_ / "objects", budget_);
+    if (result.evicted > 0) {
+        AYZipLogInfo("extraction cache trimmed {} objects ({} bytes), {} bytes left", result.evicted, result.bytesEvicted, result.remaining);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ = result.remaining;
+    stats_.evicted += result.evicted;
+    stats_.bytesEvicted += result.bytesEvicted;
+}
+
+uint64_t ExtractionCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+ExtractionCacheStats ExtractionCache::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ExtractionCache::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = ExtractionCacheStats();
+}
+
+std::string ExtractionCache::StatsJson() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value root;
+    root["size"] = Json::UInt64(size_);
+    root["budget"] = Json::UInt64(budget_);
+    root["lookups"] = Json::UInt64(stats_.lookups);
+    root["hits"] = Json::UInt64(stats_.hits);
+    root["hitRate"] = stats_.lookups == 0 ? 0.0 : static_cast<double>(stats_.hits) / stats_.lookups;
+    root["bytesHit"] = Json::UInt64(stats_.bytesHit);
+    root["inserted"] = Json::UInt64(stats_.inserted);
+    root["bytesInserted"] = Json::UInt64(stats_.bytesInserted);
+    root["evicted"] = Json::UInt64(stats_.evicted);
+    root["bytesEvicted"] = Json::UInt64(stats_.bytesEvicted);
+    root["verifyFailures"] = Json::UInt64(stats_.verifyFailures);
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, root);
+}
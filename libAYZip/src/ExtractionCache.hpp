@@ -0,0 +1,98 @@
+﻿//
+//  ExtractionCache.hpp
+//  libAYZip
+//
+//  跨 ipa 共用的解压结果存储：以条目原始 (压缩后) 数据的 SHA-256、压缩方法、CRC-32 与解压后大小为键保存一份解压后的文件，
+//  相同的 framework / 运行库再次出现时从存储克隆 (reflink / 复制)，不再解压
+//  CRC-32 可以任意伪造，只凭 CRC + 大小命中会让构造的包把内容塞给之后的包；原始数据的哈希不解压即可得到
+//  按修改时间淘汰 (命中时更新)，存储超过预算时删除最久未用的对象
+//
+
+#ifndef ExtractionCache_hpp
+#define ExtractionCache_hpp
+
+#include "FileCloner.hpp"
+#include "Sha.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+// 缓存目录的公共部分，供解压缓存与压缩缓存使用；名字含 ".tmp" 的临时对象不计入
+bool CacheObjectsSize(const std::filesystem::path &directory, uint64_t *size);
+
+struct CacheTrimResult {
+    uint64_t remaining = 0;         // 删除后剩余的总大小
+    uint64_t evicted = 0;
+    uint64_t bytesEvicted = 0;
+};
+
+// 超过 budget 时按修改时间从旧到新删除对象，删到预算的 90%，避免每次写入后都刚好超出而反复扫描；budget 为 0 时只统计大小
+CacheTrimResult TrimCacheObjects(const std::filesystem::path &directory, uint64_t budget);
+
+struct ExtractionCacheStats {
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t bytesHit = 0;          // 命中而省去解压的字节数
+    uint64_t inserted = 0;
+    uint64_t bytesInserted = 0;
+    uint64_t evicted = 0;
+    uint64_t bytesEvicted = 0;
+    uint64_t verifyFailures = 0;    // 对象内容与键的 CRC 不符 (存储被改动或损坏)，已删除
+};
+
+struct ExtractionCacheKey {
+    uint32_t crc = 0;
+    uint64_t size = 0;              // 解压后大小
+    uint16_t method = 0;            // 压缩方法，相同的原始数据按不同方法解出的内容不同
+    Sha256Digest rawDigest = {};    // 条目原始数据的 SHA-256
+};
+
+// 同一个实例可在多个线程的解压调用间共用；多个进程共用同一目录时对象以改名方式原子地放入
+class ExtractionCache
+{
+public:
+    // budget 为 0 时不限大小；mode 为从存储取出文件的方式，不使用硬链接 (Hardlink 按 Auto 处理)：
+    // 解压结果会被设置权限、修改时间，与存储共享 inode 时会改动存储对象
+    ExtractionCache(const std::string &root, uint64_t budget, CloneMode mode = CloneMode::Auto);
+
+    // 创建目录并统计现有对象的大小
+    bool Open();
+
+    // 小于 minEntrySize 的条目解压比克隆更快，不进入存储；verify 为 true 时命中后先校验对象的 CRC，发现损坏的对象
+    void SetMinEntrySize(uint64_t size) { minEntrySize_ = size; }
+    void SetVerify(bool verify) { verify_ = verify; }
+    bool Eligible(uint64_t size) const { return size >= minEntrySize_; }
+
+    // 命中时把对象放到 destination 并返回 true
+    bool Materialize(const ExtractionCacheKey &key, const std::filesystem::path &destination);
+    // source 为刚由 key 对应的条目解压且已通过 CRC 校验的文件；失败只记录日志，不影响解压
+    void Insert(const ExtractionCacheKey &key, const std::filesystem::path &source);
+
+    // 超过预算时按修改时间从旧到新删除对象，删到预算的 90%
+    void TrimIfNeeded();
+    void Trim();
+
+    uint64_t Size() const;
+    ExtractionCacheStats Stats() const;
+    void ResetStats();
+    // {"size", "budget", "hitRate", "lookups", "hits", ...}
+    std::string StatsJson() const;
+
+private:
+    std::filesystem::path ObjectPath(const ExtractionCacheKey &key) const;
+
+    std::filesystem::path root_;
+    uint64_t budget_;
+    uint64_t minEntrySize_;
+    bool verify_ = false;
+
+    mutable std::mutex mutex_;
+    FileCloner cloner_;             // 从存储取出
+    FileCloner inserter_;           // 放入存储，总是 reflink 或复制
+    uint64_t size_ = 0;
+    uint64_t tempCounter_ = 0;
+    ExtractionCacheStats stats_;
+};
+
+#endif /* ExtractionCache_hpp */
@@ -0,0 +1,157 @@
+﻿//
+//  ExtractionIndex.cpp
+//  libAYZip
+//
+
+#include "ExtractionIndex.hpp"
+#include <fstream>
+#include <json/json.h>
+#include <spdlog/AYLog.h>
+
+namespace fs = std::filesystem;
+
+// {"version":1,"files":[{"path","size","crc","mtime","symlink"}]}
+constexpr int kIndexVersion = 1;
+
+// 记录的路径用于删除旧文件，必须是解压目录内的规范相对路径：非空、不带根、没有空段与 "." / ".." 段
+static bool IsSafeRelativePath(const std::string &relativePath)
+{
+    fs::path path(relativePath);
+    if (relativePath.empty() || path.has_root_path()) {
+        return false;
+    }
+    for (const fs::path &part : path) {
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ExtractionIndex::Load(const fs::path &path)
+{
+    records_.clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return true;
+    }
+
+    Json::CharReaderBuilder builder;
+    Json::Value root;
+    std::string errors;
+    if (!Json::parseFromStream(builder, file, &root, &errors) || !root.isObject() || root["version"].asInt() != kIndexVersion ||
+        !root["files"].isArray()) {
+        AYError("Invalid extraction index {}: {}", path.string(), errors);
+        return false;
+    }
+
+    for (const Json::Value &item : root["files"]) {
+        if (!item.isObject() || !item["path"].isString() || !IsSafeRelativePath(item["path"].asString())) {
+            AYError("Invalid extraction index {}", path.string());
+            records_.clear();
+            return false;
+        }
+        ExtractionIndexRecord record;
+        record.size = item["size"].asUInt64();
+        record.crc = item["crc"].asUInt();
+        record.modifiedTime = item["mtime"].asInt64();
+        record.symlink = item["symlink"].asBool();
+        records_[item["path"].asString()] = record;
+    }
+    return true;
+}
+
+bool ExtractionIndex::Save(const fs::path &path) const
+{
+    Json::Value files(Json::arrayValue);
+    for (const auto &item : records_) {
+        Json::Value value;
+        value["path"] = item.first;
+        value["size"] = Json::UInt64(item.second.size);
+        value["crc"] = item.second.crc;
+        value["mtime"] = Json::Int64(item.second.modifiedTime);
+        if (item.second.symlink) {
+            value["symlink"] = true;
+        }
+        files.append(std::move(value));
+    }
+    Json::Value root;
+    root["version"] = kIndexVersion;
+    root["files"] = std::move(files);
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    fs::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file << Json::writeString(builder, root);
+        if (!file) {
+            AYError("Write extraction index {} failed", temporary.string());
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temporary, path, ec);
+    if (ec) {
+        AYError("Write extraction index {} failed: {}", path.string(), ec.message());
+        fs::remove(temporary, ec);
+        return false;
+    }
+    return true;
+}
+
+const ExtractionIndexRecord *ExtractionIndex::Find(const std::string &relativePath) const
+{
+    auto it = records_.find(relativePath);
+    return it == records_.end() ? nullptr : &it->second;
+}
+
+void ExtractionIndex::Set(const std::string &relativePath, const ExtractionIndexRecord &record)
+{
+    records_[relativePath] = record;
+}
+
+void ExtractionIndex::Refresh(const fs::path &root)
+{
+    for (auto it = records_.begin(); it != records_.end();) {
+        if (!it->second.symlink && !Stat(root / it->first, &it->second)) {
+            it = records_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+bool ExtractionIndex::Matches(const ExtractionIndexRecord &record, const fs::path &file)
+{
+    ExtractionIndexRecord current;
+    return !record.symlink && Stat(file, &current) && current.size == record.size && current.modifiedTime == record.modifiedTime;
+}
+
+bool ExtractionIndex::Stat(const fs::path &file, ExtractionIndexRecord *record)
+{
+    std::error_code ec;
+    fs::file_status status = fs::symlink_status(file, ec);
+    if (ec || !fs::is_regular_file(status)) {
+        return false;
+    }
+    record->size = fs::file_size(file, ec);
+    if (ec) {
+        return false;
+    }
+    record->modifiedTime = static_cast<int64_t>(fs::last_write_time(file, ec).time_since_epoch().count());
+    return !ec;
+}
+
+fs::path DefaultExtractionIndexPath(const fs::path &outputDirectory)
+{
+    fs::path directory = outputDirectory.lexically_normal();
+    if (directory.filename().empty()) {
+        directory = directory.parent_path();
+    }
+    directory += ".ayzip-index";
+    return directory;
+}
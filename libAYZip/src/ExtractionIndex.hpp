@@ -0,0 +1,52 @@
+﻿//
+//  ExtractionIndex.hpp
+//  libAYZip
+//
+//  增量解压的边车索引：记录上次解压出的每个文件的大小、条目 CRC 与写入后的修改时间
+//  再次解压到同一目录时，大小、CRC 与索引一致且磁盘上的文件未被改动 (大小、修改时间不变) 的条目跳过，
+//  索引中有而新包中没有的文件被删除
+//
+
+#ifndef ExtractionIndex_hpp
+#define ExtractionIndex_hpp
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+struct ExtractionIndexRecord {
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    int64_t modifiedTime = 0;       // 写入后磁盘上的 file_time_type 计数
+    bool symlink = false;           // 符号链接只用于删除，每次都重建
+};
+
+class ExtractionIndex
+{
+public:
+    // 文件不存在时得到空索引并返回 true；格式不对或路径不是解压目录内的相对路径时记录日志、清空并返回 false (之后按全量解压处理)
+    bool Load(const std::filesystem::path &path);
+    // 先写临时文件再改名
+    bool Save(const std::filesystem::path &path) const;
+
+    // relativePath 为相对解压目录的本地路径
+    const ExtractionIndexRecord *Find(const std::string &relativePath) const;
+    void Set(const std::string &relativePath, const ExtractionIndexRecord &record);
+    // 重新取得 root 下各文件 (符号链接除外) 的大小与修改时间，文件已不存在的记录被移除；在恢复修改时间之后调用
+    void Refresh(const std::filesystem::path &root);
+    const std::unordered_map<std::string, ExtractionIndexRecord> &Records() const { return records_; }
+
+    // 磁盘上的文件与记录一致 (大小与修改时间未变)
+    static bool Matches(const ExtractionIndexRecord &record, const std::filesystem::path &file);
+    // 取得刚写入的文件的大小与修改时间
+    static bool Stat(const std::filesystem::path &file, ExtractionIndexRecord *record);
+
+private:
+    std::unordered_map<std::string, ExtractionIndexRecord> records_;
+};
+
+// 未指定索引路径时放在解压目录旁 (<outputDirectory>.ayzip-index)，不混入解压出的内容
+std::filesystem::path DefaultExtractionIndexPath(const std::filesystem::path &outputDirectory);
+
+#endif /* ExtractionIndex_hpp */
@@ -0,0 +1,120 @@
+﻿//
+//  FileCloner.cpp
+//  libAYZip
+//
+
+#include "FileCloner.hpp"
+#include "ZipLog.hpp"
+#include <cerrno>
+#include <spdlog/AYLog.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// 成功返回 true；文件系统不支持时 unsupported 置为 true
+static bool ReflinkFile(const fs::path &source, const fs::path &destination, bool *unsupported)
+{
+#if defined(__linux__) && defined(FICLONE)
+    int src = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(src, &st) != 0) {
+        close(src);
+        return false;
+    }
+    int dst = open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+    if (dst < 0) {
+        close(src);
+        return false;
+    }
+    bool success = ioctl(dst, FICLONE, src) == 0;
+    if (!success) {
+        // EXDEV：跨文件系统；EOPNOTSUPP / ENOTTY / EINVAL：文件系统不支持
+        *unsupported = errno == EXDEV || errno == EOPNOTSUPP || errno == ENOTTY || errno == EINVAL;
+    }
+    else {
+        // O_CREAT 的权限受 umask 影响，且文件已存在时不生效
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        fchmod(dst, st.st_mode & 07777);
+        futimens(dst, times);
+    }
+    close(dst);
+    close(src);
+    return success;
+#elif defined(__APPLE__)
+    // clonefile 要求目标不存在，权限与时间随克隆保留
+    unlink(destination.c_str());
+    if (clonefile(source.c_str(), destination.c_str(), CLONE_NOFOLLOW) == 0) {
+        return true;
+    }
+    *unsupported = errno == ENOTSUP || errno == EXDEV;
+    return false;
+#else
+    // Windows 的 ReFS 块克隆需要逐区间调用 FSCTL_DUPLICATE_EXTENTS_TO_FILE，这里统一退到复制
+    *unsupported = true;
+    return false;
+#endif
+}
+
+static bool CopyFileWithMetadata(const fs::path &source, const fs::path &destination)
+{
+    std::error_code ec;
+    if (!fs::copy_file(source, destination, fs::copy_options::overwrite_existing, ec)) {
+        AYError("Copy {} failed: {}", destination.string(), ec.message());
+        return false;
+    }
+    fs::permissions(destination, fs::status(source, ec).permissions(), ec);
+    fs::file_time_type time = fs::last_write_time(source, ec);
+    if (!ec) {
+        fs::last_write_time(destination, time, ec);
+    }
+    return true;
+}
+
+FileCloner::FileCloner(CloneMode mode)
+    : mode_(mode)
+{
+}
+
+CloneResult FileCloner::Clone(const fs::path &source, const fs::path &destination)
+{
+    // 目标可能是与其他文件共享 inode 的硬链接，O_TRUNC / 覆盖复制会改写那些文件，先删除再创建
+    std::error_code ec;
+    fs::remove(destination, ec);
+
+    if ((mode_ == CloneMode::Auto || mode_ == CloneMode::Reflink) && !reflinkUnsupported_) {
+        bool unsupported = false;
+        if (ReflinkFile(source, destination, &unsupported)) {
+            return CloneResult::Reflink;
+        }
+        if (unsupported) {
+            reflinkUnsupported_ = true;
+            if (mode_ == CloneMode::Reflink) {
+                AYZipLogInfo("reflink not supported for {}, falling back to copy", destination.parent_path().string());
+            }
+        }
+    }
+
+    if (mode_ == CloneMode::Hardlink && !hardlinkUnsupported_) {
+        fs::create_hard_link(source, destination, ec);
+        if (!ec) {
+            return CloneResult::Hardlink;
+        }
+        // 跨卷或文件系统不支持硬链接，之后的文件直接复制
+        hardlinkUnsupported_ = true;
+    }
+
+    return CopyFileWithMetadata(source, destination) ? CloneResult::Copy : CloneResult::Failed;
+}
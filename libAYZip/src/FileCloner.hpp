@@ -0,0 +1,44 @@
+﻿//
+//  FileCloner.hpp
+//  libAYZip
+//
+//  把已解压的文件铺到其他目录：reflink (Linux FICLONE / macOS clonefile) 只复制元数据并共享数据块，
+//  硬链接共享同一个 inode，复制为最后的退路；不支持时自动退到下一种方式
+//
+
+#ifndef FileCloner_hpp
+#define FileCloner_hpp
+
+#include <cstdint>
+#include <filesystem>
+
+enum class CloneMode : uint8_t {
+    Auto,       // reflink，不支持时复制；各目录之间互不影响
+    Reflink,    // 同 Auto，不支持时记录警告
+    Hardlink,   // 硬链接，跨卷时复制；原地修改一个目录中的文件会影响其他目录
+    Copy,
+};
+
+enum class CloneResult : uint8_t {
+    Reflink,
+    Hardlink,
+    Copy,
+    Failed,
+};
+
+// 同一目标卷上的一组文件；reflink / 硬链接失败一次后不再尝试，避免每个文件都多一次系统调用
+class FileCloner
+{
+public:
+    explicit FileCloner(CloneMode mode);
+
+    // destination 已存在时先删除 (不改写与它共享 inode 的文件) 再创建；复制时保留权限与修改时间
+    CloneResult Clone(const std::filesystem::path &source, const std::filesystem::path &destination);
+
+private:
+    CloneMode mode_;
+    bool reflinkUnsupported_ = false;
+    bool hardlinkUnsupported_ = false;
+};
+
+#endif /* FileCloner_hpp */
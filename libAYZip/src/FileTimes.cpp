@@ -0,0 +1,91 @@
+﻿//
+//  FileTimes.cpp
+//  libAYZip
+//
+
+#include "FileTimes.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// 每个文件一次系统调用，条目少于该数量时启动线程不划算
+constexpr size_t kParallelFileTimes = 1024;
+constexpr unsigned int kMaxFileTimeThreads = 8;
+
+bool SetFileModifiedTime(const fs::path &path, std::time_t modifiedTime)
+{
+#ifdef _WIN32
+    // FILE_FLAG_BACKUP_SEMANTICS 才能打开目录，OPEN_REPARSE_POINT 不跟随链接
+    HANDLE handle = CreateFileW(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    // FILETIME 为 1601-01-01 起的 100ns 计数
+    uint64_t ticks = (static_cast<uint64_t>(modifiedTime) + 11644473600ULL) * 10000000ULL;
+    FILETIME fileTime;
+    fileTime.dwLowDateTime = static_cast<DWORD>(ticks);
+    fileTime.dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+    bool success = SetFileTime(handle, nullptr, &fileTime, &fileTime) != 0;
+    CloseHandle(handle);
+    return success;
+#else
+    struct timespec times[2];
+    times[0].tv_sec = modifiedTime;
+    times[0].tv_nsec = 0;
+    times[1] = times[0];
+    return utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW) == 0;
+#endif
+}
+
+size_t ApplyFileTimes(const std::vector<PendingFileTime> &items, TraceRecorder *trace, unsigned int threads)
+{
+    if (threads == 0) {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        threads = std::min(hardware == 0 ? 1u : hardware, kMaxFileTimeThreads);
+    }
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, items.size() / kParallelFileTimes));
+
+    std::atomic<size_t> failures{0};
+    auto apply = [&items, &failures, trace](size_t begin, size_t end) {
+        std::string detail = trace ? std::to_string(end - begin) + " items" : std::string();
+        ScopedTraceSpan span(trace, "set times", "unzip", detail);
+        for (size_t i = begin; i < end; i++) {
+            if (!SetFileModifiedTime(items[i].path, items[i].modifiedTime)) {
+                failures++;
+            }
+        }
+    };
+
+    if (threads <= 1) {
+        apply(0, items.size());
+        return failures;
+    }
+
+    // 按连续区间划分，同一目录下的文件大多落在同一线程
+    std::vector<std::thread> workers;
+    size_t chunk = (items.size() + threads - 1) / threads;
+    for (size_t begin = 0; begin < items.size(); begin += chunk) {
+        workers.emplace_back([&apply, trace, begin, chunk, &items] {
+            if (trace) {
+                trace->SetThreadName("file times " + std::to_string(begin / chunk + 1));
+            }
+            apply(begin, std::min(items.size(), begin + chunk));
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    return failures;
+}
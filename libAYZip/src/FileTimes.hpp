@@ -0,0 +1,30 @@
+﻿//
+//  FileTimes.hpp
+//  libAYZip
+//
+//  解压后恢复条目的修改时间：先收集，最后批量设置 (条目多时分给多个线程)
+//  目录中的文件被创建或删除都会改动目录的修改时间，目录需在其内容全部写完之后设置
+//
+
+#ifndef FileTimes_hpp
+#define FileTimes_hpp
+
+#include "TraceEvents.hpp"
+#include <cstddef>
+#include <ctime>
+#include <filesystem>
+#include <vector>
+
+struct PendingFileTime {
+    std::filesystem::path path;
+    std::time_t modifiedTime;
+};
+
+// 修改时间与访问时间都设为 modifiedTime；不跟随符号链接 (设置链接本身)
+bool SetFileModifiedTime(const std::filesystem::path &path, std::time_t modifiedTime);
+
+// threads 为 0 时按 CPU 数选择；条目较少时在调用线程上完成。返回设置失败的个数
+// trace 非空时每个线程记录一段 "set times"
+size_t ApplyFileTimes(const std::vector<PendingFileTime> &items, TraceRecorder *trace = nullptr, unsigned int threads = 0);
+
+#endif /* FileTimes_hpp */
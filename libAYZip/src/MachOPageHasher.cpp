@@ -0,0 +1,318 @@
+﻿//
+//  MachOPageHasher.cpp
+//  libAYZip
+//
+
+#include "MachOPageHasher.hpp"
+#include <algorithm>
+#include <limits>
+
+constexpr uint32_t kFatMagic = 0xCAFEBABE;
+constexpr uint32_t kFatMagic64 = 0xCAFEBABF;
+constexpr uint32_t kMachMagic = 0xFEEDFACE;
+constexpr uint32_t kMachMagic64 = 0xFEEDFACF;
+constexpr uint32_t kLoadCommandCodeSignature = 0x1D;
+
+// Java class 文件同样以 0xCAFEBABE 开头，其后是版本号 (>= 45)；fat 文件的切片数远小于此
+constexpr uint32_t kMaxFatArches = 30;
+constexpr uint32_t kMaxLoadCommandsSize = 16 * 1024 * 1024;
+constexpr size_t kMachHeaderMinSize = 28;
+constexpr uint64_t kUnknownSize = std::numeric_limits<uint64_t>::max();
+
+static uint32_t ReadBig32(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+static uint64_t ReadBig64(const uint8_t *p)
+{
+    return (uint64_t(ReadBig32(p)) << 32) | ReadBig32(p + 4);
+}
+
+static uint32_t ReadLittle32(const uint8_t *p)
+{
+    return (uint32_t(p[3]) << 24) | (uint32_t(p[2]) << 16) | (uint32_t(p[1]) << 8) | p[0];
+}
+
+bool IsMachOMagic(uint32_t magic)
+{
+    switch (magic) {
+        case kMachMagic: case 0xCEFAEDFE:       // 32 位
+        case kMachMagic64: case 0xCFFAEDFE:     // 64 位
+        case kFatMagic: case kFatMagic64:
+            return true;
+        default:
+            return false;
+    }
+}
+
+MachOPageHasher::MachOPageHasher()
+{
+}
+
+void MachOPageHasher::Update(const uint8_t *data, size_t size)
+{
+    if (state_ == State::Slices) {
+        Route(data, size);
+        return;
+    }
+    if (state_ == State::NotMachO) {
+        return;
+    }
+
+    head_.insert(head_.end(), data, data + size);
+    if (state_ == State::Magic) {
+        if (head_.size() < 4) {
+            return;
+        }
+        uint32_t magic = ReadBig32(head_.data());
+        if (magic == kFatMagic || magic == kFatMagic64) {
+            state_ = State::FatHeader;
+        }
+        else if (magic == kMachMagic || magic == kMachMagic64 || ReadLittle32(head_.data()) == kMachMagic || ReadLittle32(head_.data()) == kMachMagic64) {
+            slices_.emplace_back();
+            slices_.back().result.size = kUnknownSize;
+            state_ = State::Slices;
+        }
+        else {
+            state_ = State::NotMachO;
+        }
+    }
+    if (state_ == State::FatHeader) {
+        ParseFatHeader();
+    }
+
+    if (state_ == State::Slices) {
+        std::vector<uint8_t> head;
+        head.swap(head_);
+        Route(head.data(), head.size());
+    }
+    else if (state_ == State::NotMachO) {
+        std::vector<uint8_t>().swap(head_);
+    }
+}
+
+// 头部不完整时保持 FatHeader 状态；格式不合法时转为 NotMachO
+void MachOPageHasher::ParseFatHeader()
+{
+    if (head_.size() < 8) {
+        return;
+    }
+    bool is64 = ReadBig32(head_.data()) == kFatMagic64;
+    uint32_t count = ReadBig32(head_.data() + 4);
+    if (count == 0 || count > kMaxFatArches) {
+        state_ = State::NotMachO;
+        return;
+    }
+    size_t archSize = is64 ? 32 : 20;
+    size_t headerSize = 8 + count * archSize;
+    if (head_.size() < headerSize) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *arch = head_.data() + 8 + i * archSize;
+        Slice slice;
+        slice.result.cpuType = ReadBig32(arch);
+        slice.result.cpuSubtype = ReadBig32(arch + 4);
+        slice.result.offset = is64 ? ReadBig64(arch + 8) : ReadBig32(arch + 8);
+        slice.result.size = is64 ? ReadBig64(arch + 16) : ReadBig32(arch + 12);
+        slices_.push_back(std::move(slice));
+    }
+    std::sort(slices_.begin(), slices_.end(), [](const Slice &a, const Slice &b) {
+        return a.result.offset < b.result.offset;
+    });
+
+    uint64_t end = headerSize;
+    for (const Slice &slice : slices_) {
+        if (slice.result.offset < end || slice.result.size < kMachHeaderMinSize || slice.result.size > kUnknownSize - slice.result.offset) {
+            slices_.clear();
+            state_ = State::NotMachO;
+            return;
+        }
+        end = slice.result.offset + slice.result.size;
+    }
+    state_ = State::Slices;
+}
+
+// 把文件偏移 [position_, position_ + size) 的数据分给对应的切片，切片之间的填充跳过
+void MachOPageHasher::Route(const uint8_t *data, size_t size)
+{
+    while (size > 0 && current_ < slices_.size()) {
+        Slice &slice = slices_[current_];
+        if (position_ < slice.result.offset) {
+            size_t skip = static_cast<size_t>(std::min<uint64_t>(size, slice.result.offset - position_));
+            data += skip;
+            size -= skip;
+            position_ += skip;
+            continue;
+        }
+        uint64_t sliceEnd = slice.result.offset + slice.result.size;
+        if (position_ >= sliceEnd) {
+            current_++;
+            continue;
+        }
+        size_t n = static_cast<size_t>(std::min<uint64_t>(size, sliceEnd - position_));
+        UpdateSlice(slice, data, n);
+        data += n;
+        size -= n;
+        position_ += n;
+    }
+    position_ += size;
+}
+
+void MachOPageHasher::UpdateSlice(Slice &slice, const uint8_t *data, size_t size)
+{
+    // 先收集头部：解析完成后才知道 codeLimit，收集到的字节随后补进页哈希
+    if (slice.valid && !slice.headerParsed) {
+        size_t taken = CollectHeader(slice, data, size);
+        slice.consumed += taken;
+        data += taken;
+        size -= taken;
+        if (slice.headerParsed) {
+            HashBytes(slice, 0, slice.header.data(), slice.header.size());
+            std::vector<uint8_t>().swap(slice.header);
+        }
+    }
+    if (slice.valid && slice.headerParsed) {
+        HashBytes(slice, slice.consumed, data, size);
+    }
+    slice.consumed += size;
+}
+
+// 返回放进 slice.header 的字节数；头部完整或切片不合法时停止
+size_t MachOPageHasher::CollectHeader(Slice &slice, const uint8_t *data, size_t size)
+{
+    size_t offset = 0;
+    while (!slice.headerParsed && slice.valid) {
+        size_t want = kMachHeaderMinSize;
+        if (slice.header.size() >= kMachHeaderMinSize) {
+            bool swapped = ReadBig32(slice.header.data()) == kMachMagic || ReadBig32(slice.header.data()) == kMachMagic64;
+            uint32_t magic = swapped ? ReadBig32(slice.header.data()) : ReadLittle32(slice.header.data());
+            uint32_t sizeOfCommands = swapped ? ReadBig32(slice.header.data() + 20) : ReadLittle32(slice.header.data() + 20);
+            if (sizeOfCommands > kMaxLoadCommandsSize) {
+                slice.valid = false;
+                break;
+            }
+            want = (magic == kMachMagic64 ? 32 : 28) + sizeOfCommands;
+        }
+        if (slice.header.size() >= want) {
+            ParseSliceHeader(slice);
+            break;
+        }
+        if (offset == size) {
+            break;
+        }
+        size_t take = std::min(want - slice.header.size(), size - offset);
+        slice.header.insert(slice.header.end(), data + offset, data + offset + take);
+        offset += take;
+    }
+    return offset;
+}
+
+// data 位于切片偏移 position 处；只有 codeLimit 之前的部分参与页哈希
+void MachOPageHasher::HashBytes(Slice &slice, uint64_t position, const uint8_t *data, size_t size)
+{
+    uint64_t limit = slice.result.codeLimit;
+    size_t hashable = position >= limit ? 0 : static_cast<size_t>(std::min<uint64_t>(size, limit - position));
+
+    if (!slice.page.empty()) {
+        size_t take = std::min<size_t>(kMachOPageSize - slice.page.size(), hashable);
+        slice.page.insert(slice.page.end(), data, data + take);
+        data += take;
+        hashable -= take;
+        if (slice.page.size() == kMachOPageSize) {
+            HashPage(slice, slice.page.data(), slice.page.size());
+            slice.page.clear();
+        }
+    }
+    while (hashable >= kMachOPageSize) {
+        HashPage(slice, data, kMachOPageSize);
+        data += kMachOPageSize;
+        hashable -= kMachOPageSize;
+    }
+    slice.page.insert(slice.page.end(), data, data + hashable);
+}
+
+bool MachOPageHasher::ParseSliceHeader(Slice &slice)
+{
+    const uint8_t *header = slice.header.data();
+    bool swapped = ReadBig32(header) == kMachMagic || ReadBig32(header) == kMachMagic64;
+    auto read32 = [swapped](const uint8_t *p) {
+        return swapped ? ReadBig32(p) : ReadLittle32(p);
+    };
+
+    uint32_t magic = read32(header);
+    if (magic != kMachMagic && magic != kMachMagic64) {
+        slice.valid = false;
+        return false;
+    }
+    size_t headerSize = magic == kMachMagic64 ? 32 : 28;
+    uint32_t commandCount = read32(header + 16);
+    size_t end = headerSize + read32(header + 20);
+
+    MachOSlice &result = slice.result;
+    result.cpuType = read32(header + 4);
+    result.cpuSubtype = read32(header + 8);
+    result.codeLimit = result.size;
+
+    size_t offset = headerSize;
+    for (uint32_t i = 0; i < commandCount; i++) {
+        if (offset + 8 > end) {
+            slice.valid = false;
+            return false;
+        }
+        uint32_t command = read32(header + offset);
+        uint32_t commandSize = read32(header + offset + 4);
+        if (commandSize < 8 || commandSize > end - offset) {
+            slice.valid = false;
+            return false;
+        }
+        if (command == kLoadCommandCodeSignature && commandSize >= 16) {
+            result.hasCodeSignature = true;
+            result.codeLimit = read32(header + offset + 8);
+        }
+        offset += commandSize;
+    }
+    if (result.codeLimit > result.size) {
+        slice.valid = false;
+        return false;
+    }
+
+    slice.headerParsed = true;
+    return true;
+}
+
+void MachOPageHasher::HashPage(Slice &slice, const uint8_t *data, size_t size)
+{
+    slice.result.sha1Pages.push_back(Sha1Of(data, size));
+    slice.result.sha256Pages.push_back(Sha256Of(data, size));
+}
+
+std::vector<MachOSlice> MachOPageHasher::Final()
+{
+    std::vector<MachOSlice> result;
+    if (state_ != State::Slices) {
+        return result;
+    }
+
+    for (Slice &slice : slices_) {
+        if (slice.result.size == kUnknownSize) {
+            // 非 fat 文件：切片即整个文件
+            slice.result.size = slice.consumed;
+            if (slice.result.codeLimit == kUnknownSize) {
+                slice.result.codeLimit = slice.consumed;
+            }
+        }
+        if (!slice.valid || !slice.headerParsed || slice.consumed < slice.result.size || slice.consumed < slice.result.codeLimit) {
+            continue;
+        }
+        if (!slice.page.empty()) {
+            HashPage(slice, slice.page.data(), slice.page.size());
+        }
+        result.push_back(std::move(slice.result));
+    }
+    slices_.clear();
+    state_ = State::NotMachO;
+    return result;
+}
@@ -0,0 +1,77 @@
+﻿//
+//  MachOPageHasher.hpp
+//  libAYZip
+//
+//  在数据流上识别 Mach-O / fat 文件，按切片计算代码目录的页哈希 (SHA-1 与 SHA-256)
+//  解压或直接读取归档时顺带完成，签名时不必再读一遍二进制
+//
+
+#ifndef MachOPageHasher_hpp
+#define MachOPageHasher_hpp
+
+#include "Sha.hpp"
+#include <cstdint>
+#include <vector>
+
+constexpr uint32_t kMachOPageSize = 4096;
+
+struct MachOSlice {
+    uint32_t cpuType = 0;
+    uint32_t cpuSubtype = 0;
+    uint64_t offset = 0;            // 切片在文件中的偏移，非 fat 文件为 0
+    uint64_t size = 0;
+    // 页哈希覆盖切片的 [0, codeLimit)：已签名时为 LC_CODE_SIGNATURE 的 dataoff，否则为切片大小
+    // 第 0 页含 Mach-O 头与加载命令，签名时若改写 LC_CODE_SIGNATURE / __LINKEDIT 需要重新计算
+    uint64_t codeLimit = 0;
+    bool hasCodeSignature = false;
+    std::vector<Sha1Digest> sha1Pages;
+    std::vector<Sha256Digest> sha256Pages;
+};
+
+// magic 为文件前 4 字节按大端读出的值；包括 fat 文件
+bool IsMachOMagic(uint32_t magic);
+
+// 依次喂入整个文件的数据；前 4 字节不是 Mach-O / fat 魔数时之后的数据直接忽略
+class MachOPageHasher
+{
+public:
+    MachOPageHasher();
+
+    void Update(const uint8_t *data, size_t size);
+
+    // 数据结束；不是 Mach-O、或文件被截断 / 头部损坏的切片不返回
+    std::vector<MachOSlice> Final();
+
+private:
+    struct Slice {
+        MachOSlice result;
+        std::vector<uint8_t> header;    // 收集 Mach-O 头与加载命令，补进页哈希后释放
+        uint64_t consumed = 0;          // 已收到的切片字节数
+        bool headerParsed = false;
+        bool valid = true;
+        std::vector<uint8_t> page;      // 未满一页的数据
+    };
+
+    enum class State {
+        Magic,          // 等待前 4 字节
+        FatHeader,      // 等待完整的 fat 头
+        Slices,
+        NotMachO,
+    };
+
+    void ParseFatHeader();
+    void Route(const uint8_t *data, size_t size);
+    void UpdateSlice(Slice &slice, const uint8_t *data, size_t size);
+    size_t CollectHeader(Slice &slice, const uint8_t *data, size_t size);
+    void HashBytes(Slice &slice, uint64_t position, const uint8_t *data, size_t size);
+    bool ParseSliceHeader(Slice &slice);
+    void HashPage(Slice &slice, const uint8_t *data, size_t size);
+
+    State state_ = State::Magic;
+    std::vector<uint8_t> head_;         // 解析出切片前的数据
+    uint64_t position_ = 0;             // 已路由到切片的文件偏移
+    std::vector<Slice> slices_;         // 按偏移排列
+    size_t current_ = 0;
+};
+
+#endif /* MachOPageHasher_hpp */
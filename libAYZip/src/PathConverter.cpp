@@ -0,0 +1,267 @@
+﻿//
+//  PathConverter.cpp
+//  libAYZip
+//
+
+#include "PathConverter.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define AYZIP_PATH_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Windows 非法字符 -> 占位符 映射表
+// macOS/iOS 允许但 Windows 不允许: < > : " | ? *
+// 单字节字符才能走查表扫描，占位符均以 "__" 开头
+struct CharMapping {
+    char original;              // macOS/iOS 中的字符
+    const char* placeholder;    // Windows 上的占位符
+    size_t placeholderLength;
+};
+
+#define CHAR_MAPPING(c, p) { c, p, sizeof(p) - 1 }
+
+static const CharMapping kPathCharMappings[] = {
+    CHAR_MAPPING(':',  "__colon__"),
+    CHAR_MAPPING('<',  "__lt__"),
+    CHAR_MAPPING('>',  "__gt__"),
+    CHAR_MAPPING('"',  "__quote__"),
+    CHAR_MAPPING('|',  "__pipe__"),
+    CHAR_MAPPING('?',  "__qmark__"),
+    CHAR_MAPPING('*',  "__star__"),
+    // 可在此添加更多映射
+};
+
+#undef CHAR_MAPPING
+
+constexpr size_t kMappingCount = sizeof(kPathCharMappings) / sizeof(kPathCharMappings[0]);
+constexpr uint8_t kPlain = 0xFF;
+constexpr uint8_t kSeparator = 0xFE;
+
+static const char kPayloadPrefix[] = "Payload/";
+constexpr size_t kPayloadPrefixLength = sizeof(kPayloadPrefix) - 1;
+
+// 每个字节在两个方向上的分类：kPlain / kSeparator / 映射下标
+struct ByteTables {
+    uint8_t toSafe[256];
+    uint8_t fromSafe[256];
+    char toSafeSpecials[kMappingCount + 1];
+    char fromSafeSpecials[1];
+
+    ByteTables()
+    {
+        std::fill(std::begin(toSafe), std::end(toSafe), kPlain);
+        std::fill(std::begin(fromSafe), std::end(fromSafe), kPlain);
+        for (size_t i = 0; i < kMappingCount; i++) {
+            toSafe[static_cast<uint8_t>(kPathCharMappings[i].original)] = static_cast<uint8_t>(i);
+            toSafeSpecials[i] = kPathCharMappings[i].original;
+        }
+        toSafe[static_cast<uint8_t>('/')] = kSeparator;
+        toSafeSpecials[kMappingCount] = '/';
+
+        fromSafe[static_cast<uint8_t>('\\')] = kSeparator;
+        fromSafeSpecials[0] = '\\';
+    }
+};
+
+static const ByteTables &Tables()
+{
+    static const ByteTables tables;
+    return tables;
+}
+
+// 返回第一个需要处理的字节位置；绝大多数路径没有特殊字符，SSE2 下每次判断 16 字节
+template <size_t N>
+static size_t SkipPlainBytes(const char *data, size_t size, const uint8_t *table, const char (&specials)[N])
+{
+    size_t i = 0;
+#ifdef AYZIP_PATH_SSE2
+    __m128i needles[N];
+    for (size_t k = 0; k < N; k++) {
+        needles[k] = _mm_set1_epi8(specials[k]);
+    }
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i hit = _mm_cmpeq_epi8(chunk, needles[0]);
+        for (size_t k = 1; k < N; k++) {
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, needles[k]));
+        }
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hit));
+        if (mask != 0) {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return i + index;
+#else
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+#endif
+        }
+    }
+#else
+    (void)specials;
+#endif
+    for (; i < size; i++) {
+        if (table[static_cast<uint8_t>(data[i])] != kPlain)
+            return i;
+    }
+    return size;
+}
+
+// 非法字符 -> 占位符，'/' -> separator
+static void AppendToSafe(const char *data, size_t size, char separator, std::string &out)
+{
+    const ByteTables &tables = Tables();
+    size_t pos = 0;
+    while (pos < size) {
+        size_t next = pos + SkipPlainBytes(data + pos, size - pos, tables.toSafe, tables.toSafeSpecials);
+        out.append(data + pos, next - pos);
+        if (next == size)
+            break;
+
+        uint8_t kind = tables.toSafe[static_cast<uint8_t>(data[next])];
+        if (kind == kSeparator) {
+            out.push_back(separator);
+        }
+        else {
+            out.append(kPathCharMappings[kind].placeholder, kPathCharMappings[kind].placeholderLength);
+        }
+        pos = next + 1;
+    }
+}
+
+// 只做分隔符替换
+static void AppendWithSeparator(const char *data, size_t size, char separator, std::string &out)
+{
+    const ByteTables &tables = Tables();
+    size_t pos = 0;
+    while (pos < size) {
+        size_t next = pos + SkipPlainBytes(data + pos, size - pos, tables.fromSafe, tables.fromSafeSpecials);
+        out.append(data + pos, next - pos);
+        if (next == size)
+            break;
+        out.push_back(separator);
+        pos = next + 1;
+    }
+}
+
+static bool ContainsDoubleUnderscore(const char *data, size_t size)
+{
+    const char *end = data + size;
+    for (const char *p = data; p < end; p++) {
+        p = static_cast<const char *>(memchr(p, '_', end - p));
+        if (!p || p + 1 == end)
+            return false;
+        if (p[1] == '_')
+            return true;
+    }
+    return false;
+}
+
+// 占位符 -> 原字符，'\\' -> separator
+// 占位符按映射表顺序逐个整体替换，与旧的 replace_all 链结果一致：
+// 重叠的输入 (如 "__lt__colon__" -> "__lt:") 由表中靠前的占位符先匹配，而不是从左到右贪心匹配
+// 占位符都以 "__" 开头，不含 "__" 的路径 (绝大多数) 只做分隔符替换
+static void AppendFromSafe(const char *data, size_t size, char separator, std::string &out)
+{
+    if (!ContainsDoubleUnderscore(data, size)) {
+        AppendWithSeparator(data, size, separator, out);
+        return;
+    }
+
+    std::string text(data, size);
+    std::string replaced;
+    for (const auto &mapping : kPathCharMappings) {
+        size_t found = text.find(mapping.placeholder, 0, mapping.placeholderLength);
+        if (found == std::string::npos)
+            continue;
+        replaced.clear();
+        size_t from = 0;
+        for (; found != std::string::npos; found = text.find(mapping.placeholder, from, mapping.placeholderLength)) {
+            replaced.append(text, from, found - from);
+            replaced.push_back(mapping.original);
+            from = found + mapping.placeholderLength;
+        }
+        replaced.append(text, from, std::string::npos);
+        text.swap(replaced);
+    }
+    AppendWithSeparator(text.data(), text.size(), separator, out);
+}
+
+std::string ToWindowsSafePath(const std::string &path)
+{
+    std::string result;
+    result.reserve(path.size());
+    AppendToSafe(path.data(), path.size(), '/', result);
+    return result;
+}
+
+std::string FromWindowsSafePath(const std::string &path)
+{
+    std::string result;
+    result.reserve(path.size());
+    AppendFromSafe(path.data(), path.size(), '\\', result);
+    return result;
+}
+
+// 空段、"." 或 ".." 段需要 fs::relative 规范化
+static bool HasSpecialSegment(const char *data, size_t size)
+{
+    size_t start = 0;
+    while (start <= size) {
+        const void *slash = memchr(data + start, '/', size - start);
+        size_t end = slash ? static_cast<size_t>(static_cast<const char *>(slash) - data) : size;
+        size_t length = end - start;
+        bool isLast = (end == size);
+
+        if (length == 0 && !isLast)
+            return true;
+        if (length == 1 && data[start] == '.')
+            return true;
+        if (length == 2 && data[start] == '.' && data[start + 1] == '.')
+            return true;
+
+        if (isLast)
+            break;
+        start = end + 1;
+    }
+    return false;
+}
+
+bool ZipPathToLocalPath(const std::string &zipPath, std::string &out)
+{
+    if (zipPath.size() < kPayloadPrefixLength || zipPath.compare(0, kPayloadPrefixLength, kPayloadPrefix) != 0)
+        return false;
+
+    const char *data = zipPath.data() + kPayloadPrefixLength;
+    size_t size = zipPath.size() - kPayloadPrefixLength;
+    if (HasSpecialSegment(data, size))
+        return false;
+
+#ifdef _WIN32
+    out.clear();
+    AppendToSafe(data, size, static_cast<char>(std::filesystem::path::preferred_separator), out);
+#else
+    // POSIX 文件系统允许这些字符，保留原始文件名
+    out.assign(data, size);
+#endif
+    return true;
+}
+
+void LocalPathToZipPath(const std::string &localPath, bool isDirectory, std::string &out)
+{
+#ifdef _WIN32
+    out.clear();
+    AppendFromSafe(localPath.data(), localPath.size(), '/', out);
+#else
+    out = localPath;
+#endif
+    if (isDirectory && !out.empty() && out.back() != '/')
+        out.push_back('/');
+}
@@ -0,0 +1,28 @@
+﻿//
+//  PathConverter.hpp
+//  libAYZip
+//
+//  zip 内路径与本地路径的单次扫描转换
+//
+
+#ifndef PathConverter_hpp
+#define PathConverter_hpp
+
+#include <string>
+
+// 将 macOS/iOS 路径转换为 Windows 安全路径（解压时使用）
+std::string ToWindowsSafePath(const std::string &path);
+
+// 将 Windows 占位符还原为 macOS/iOS 字符（压缩时使用）
+std::string FromWindowsSafePath(const std::string &path);
+
+// 解压：zip 内 "Payload/..." 路径 -> 相对输出目录的本地路径
+// 一次扫描完成 "Payload/" 前缀剥离、'/' -> 本地分隔符、非法字符 -> 占位符，结果写入可复用的 out
+// 不在 Payload/ 下、或含空段 / "." / ".." 段的路径返回 false，由调用方走 fs::relative
+bool ZipPathToLocalPath(const std::string &zipPath, std::string &out);
+
+// 压缩：本地相对路径 (fs::path::u8string) -> zip 内路径，'\\' -> '/'，占位符还原，目录补 '/'
+// 非 Windows 平台不做占位符映射，文件名原样保留
+void LocalPathToZipPath(const std::string &localPath, bool isDirectory, std::string &out);
+
+#endif /* PathConverter_hpp */
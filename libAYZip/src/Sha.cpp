@@ -0,0 +1,448 @@
+﻿//
+//  Sha.cpp
+//  libAYZip
+//
+//  SHA 扩展的轮函数组织方式见 Intel 白皮书 "Intel SHA Extensions"
+//
+
+#include "Sha.hpp"
+#include <cstring>
+#include <utility>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define AYZIP_SHA_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AYZIP_TARGET(x)
+#else
+#define AYZIP_TARGET(x) __attribute__((target(x)))
+#endif
+
+static const uint32_t kSha1Init[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+static const uint32_t kSha256Init[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+alignas(16) static const uint32_t kSha256K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static inline uint32_t LoadBigEndian32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline uint32_t Rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t Rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+/********************************************
+ *                                          *
+ *               通用实现                    *
+ *                                          *
+ ********************************************/
+static void Sha1BlocksPortable(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+    uint32_t w[80];
+    for (; blocks > 0; blocks--, data += 64) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = LoadBigEndian32(data + i * 4);
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = Rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        auto round = [&](uint32_t f, uint32_t k, uint32_t w) {
+            uint32_t t = Rotl(a, 5) + f + e + k + w;
+            e = d;
+            d = c;
+            c = Rotl(b, 30);
+            b = a;
+            a = t;
+        };
+        for (int i = 0; i < 20; i++) {
+            round(d ^ (b & (c ^ d)), 0x5A827999, w[i]);
+        }
+        for (int i = 20; i < 40; i++) {
+            round(b ^ c ^ d, 0x6ED9EBA1, w[i]);
+        }
+        for (int i = 40; i < 60; i++) {
+            round((b & c) | (d & (b | c)), 0x8F1BBCDC, w[i]);
+        }
+        for (int i = 60; i < 80; i++) {
+            round(b ^ c ^ d, 0xCA62C1D6, w[i]);
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+static void Sha256BlocksPortable(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+    uint32_t w[64];
+    for (; blocks > 0; blocks--, data += 64) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = LoadBigEndian32(data + i * 4);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + kSha256K[i] + w[i];
+            uint32_t s0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef AYZIP_SHA_X86
+/********************************************
+ *                                          *
+ *             x86 SHA 扩展                  *
+ *                                          *
+ ********************************************/
+#define AYZIP_TARGET_SHA AYZIP_TARGET("sha,sse4.1,ssse3")
+
+// SHA-1 每组 4 轮；消息扩展 W[k] = msg2(msg1(W[k-4], W[k-3]) ^ W[k-2], W[k-1])
+// 分别在处理第 k-3、k-2、k-1 组时完成，四个寄存器轮流存放各组消息
+struct Sha1NiState {
+    __m128i abcd;
+    __m128i e[2];
+    __m128i msg[4];
+};
+
+template <int G>
+AYZIP_TARGET_SHA
+static inline void Sha1NiGroup(Sha1NiState &s)
+{
+    __m128i &m = s.msg[G % 4];
+    __m128i &e = s.e[G % 2];
+    if (G == 0) {
+        e = _mm_add_epi32(e, m);
+    }
+    else {
+        e = _mm_sha1nexte_epu32(e, m);
+    }
+    s.e[(G + 1) % 2] = s.abcd;
+    if (G >= 3 && G <= 18) {
+        s.msg[(G + 1) % 4] = _mm_sha1msg2_epu32(s.msg[(G + 1) % 4], m);
+    }
+    s.abcd = _mm_sha1rnds4_epu32(s.abcd, e, G / 5);
+    if (G >= 1 && G <= 16) {
+        s.msg[(G + 3) % 4] = _mm_sha1msg1_epu32(s.msg[(G + 3) % 4], m);
+    }
+    if (G >= 2 && G <= 17) {
+        s.msg[(G + 2) % 4] = _mm_xor_si128(s.msg[(G + 2) % 4], m);
+    }
+}
+
+template <int... G>
+AYZIP_TARGET_SHA
+static inline void Sha1NiGroups(Sha1NiState &s, std::integer_sequence<int, G...>)
+{
+    (Sha1NiGroup<G>(s), ...);
+}
+
+AYZIP_TARGET_SHA
+static void Sha1BlocksNi(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+    Sha1NiState s;
+    s.abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0x1B);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        __m128i abcdSave = s.abcd;
+        __m128i e0Save = e0;
+        for (int i = 0; i < 4; i++) {
+            s.msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16)), mask);
+        }
+        s.e[0] = e0;
+        Sha1NiGroups(s, std::make_integer_sequence<int, 20>());
+        e0 = _mm_sha1nexte_epu32(s.e[0], e0Save);
+        s.abcd = _mm_add_epi32(s.abcd, abcdSave);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_shuffle_epi32(s.abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+// SHA-256 每组 4 轮 (两次 rnds2)；W[k] = msg2(msg1(W[k-4], W[k-3]) + alignr(W[k-1], W[k-2]), W[k-1])
+// 第 G 组用完后原位计算第 G+4 组
+struct Sha256NiState {
+    __m128i state0;     // ABEF
+    __m128i state1;     // CDGH
+    __m128i msg[4];
+};
+
+template <int G>
+AYZIP_TARGET_SHA
+static inline void Sha256NiGroup(Sha256NiState &s)
+{
+    __m128i &m = s.msg[G % 4];
+    __m128i wk = _mm_add_epi32(m, _mm_load_si128(reinterpret_cast<const __m128i *>(kSha256K + G * 4)));
+    s.state1 = _mm_sha256rnds2_epu32(s.state1, s.state0, wk);
+    s.state0 = _mm_sha256rnds2_epu32(s.state0, s.state1, _mm_shuffle_epi32(wk, 0x0E));
+    if (G < 12) {
+        __m128i next = _mm_sha256msg1_epu32(m, s.msg[(G + 1) % 4]);
+        next = _mm_add_epi32(next, _mm_alignr_epi8(s.msg[(G + 3) % 4], s.msg[(G + 2) % 4], 4));
+        m = _mm_sha256msg2_epu32(next, s.msg[(G + 3) % 4]);
+    }
+}
+
+template <int... G>
+AYZIP_TARGET_SHA
+static inline void Sha256NiGroups(Sha256NiState &s, std::integer_sequence<int, G...>)
+{
+    (Sha256NiGroup<G>(s), ...);
+}
+
+AYZIP_TARGET_SHA
+static void Sha256BlocksNi(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+    Sha256NiState s;
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xB1);         // CDAB
+    s.state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1B);       // EFGH
+    s.state0 = _mm_alignr_epi8(tmp, s.state1, 8);           // ABEF
+    s.state1 = _mm_blend_epi16(s.state1, tmp, 0xF0);        // CDGH
+
+    for (; blocks > 0; blocks--, data += 64) {
+        __m128i abefSave = s.state0;
+        __m128i cdghSave = s.state1;
+        for (int i = 0; i < 4; i++) {
+            s.msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16)), mask);
+        }
+        Sha256NiGroups(s, std::make_integer_sequence<int, 16>());
+        s.state0 = _mm_add_epi32(s.state0, abefSave);
+        s.state1 = _mm_add_epi32(s.state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(s.state0, 0x1B);                // FEBA
+    __m128i state1 = _mm_shuffle_epi32(s.state1, 0xB1);     // DCHG
+    __m128i state0 = _mm_blend_epi16(tmp, state1, 0xF0);    // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);               // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), state1);
+}
+
+static bool HasShaNi()
+{
+    unsigned int eax, ebx, ecx, edx;
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) {
+        return false;
+    }
+    __cpuid(regs, 1);
+    ecx = static_cast<unsigned int>(regs[2]);
+    __cpuidex(regs, 7, 0);
+    ebx = static_cast<unsigned int>(regs[1]);
+    (void)eax;
+    (void)edx;
+#else
+    if (__get_cpuid_max(0, nullptr) < 7) {
+        return false;
+    }
+    __cpuid(1, eax, ebx, ecx, edx);
+    unsigned int leaf1Ecx = ecx;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    ecx = leaf1Ecx;
+#endif
+    bool ssse3 = (ecx & (1u << 9)) != 0;
+    bool sse41 = (ecx & (1u << 19)) != 0;
+    bool sha = (ebx & (1u << 29)) != 0;
+    return ssse3 && sse41 && sha;
+}
+#endif
+
+struct ShaKernels {
+    const char *name;
+    void (*sha1)(uint32_t *state, const uint8_t *data, size_t blocks);
+    void (*sha256)(uint32_t *state, const uint8_t *data, size_t blocks);
+};
+
+static const ShaKernels &SelectedKernels()
+{
+    static const ShaKernels kernels = [] {
+#ifdef AYZIP_SHA_X86
+        if (HasShaNi()) {
+            return ShaKernels{ "sha-ni", Sha1BlocksNi, Sha256BlocksNi };
+        }
+#endif
+        return ShaKernels{ "portable", Sha1BlocksPortable, Sha256BlocksPortable };
+    }();
+    return kernels;
+}
+
+const char *ShaImplementation()
+{
+    return SelectedKernels().name;
+}
+
+/********************************************
+ *                                          *
+ *            分块、填充与输出               *
+ *                                          *
+ ********************************************/
+template <size_t StateWords, size_t DigestSize>
+ShaHash<StateWords, DigestSize>::ShaHash(const uint32_t (&init)[StateWords], BlocksFn blocks) : init_(init), blocks_(blocks)
+{
+    Reset();
+}
+
+template <size_t StateWords, size_t DigestSize>
+void ShaHash<StateWords, DigestSize>::Reset()
+{
+    memcpy(state_, init_, sizeof(state_));
+    bufferSize_ = 0;
+    length_ = 0;
+}
+
+template <size_t StateWords, size_t DigestSize>
+void ShaHash<StateWords, DigestSize>::Update(const void *data, size_t size)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    length_ += size;
+
+    if (bufferSize_ > 0) {
+        size_t take = sizeof(buffer_) - bufferSize_;
+        if (take > size) {
+            take = size;
+        }
+        memcpy(buffer_ + bufferSize_, p, take);
+        bufferSize_ += take;
+        p += take;
+        size -= take;
+        if (bufferSize_ < sizeof(buffer_)) {
+            return;
+        }
+        blocks_(state_, buffer_, 1);
+        bufferSize_ = 0;
+    }
+
+    size_t blocks = size / 64;
+    if (blocks > 0) {
+        blocks_(state_, p, blocks);
+        p += blocks * 64;
+        size -= blocks * 64;
+    }
+
+    if (size > 0) {
+        memcpy(buffer_, p, size);
+        bufferSize_ = size;
+    }
+}
+
+template <size_t StateWords, size_t DigestSize>
+typename ShaHash<StateWords, DigestSize>::Digest ShaHash<StateWords, DigestSize>::Final()
+{
+    uint64_t bits = length_ * 8;
+    buffer_[bufferSize_++] = 0x80;
+    if (bufferSize_ > 56) {
+        memset(buffer_ + bufferSize_, 0, sizeof(buffer_) - bufferSize_);
+        blocks_(state_, buffer_, 1);
+        bufferSize_ = 0;
+    }
+    memset(buffer_ + bufferSize_, 0, 56 - bufferSize_);
+    for (int i = 0; i < 8; i++) {
+        buffer_[56 + i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+    }
+    blocks_(state_, buffer_, 1);
+
+    Digest digest;
+    for (size_t i = 0; i < DigestSize / 4; i++) {
+        digest[i * 4 + 0] = static_cast<uint8_t>(state_[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state_[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state_[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state_[i]);
+    }
+    Reset();
+    return digest;
+}
+
+template class ShaHash<5, 20>;
+template class ShaHash<8, 32>;
+
+Sha1::Sha1() : ShaHash<5, 20>(kSha1Init, SelectedKernels().sha1)
+{
+}
+
+Sha256::Sha256() : ShaHash<8, 32>(kSha256Init, SelectedKernels().sha256)
+{
+}
+
+Sha1Digest Sha1Of(const void *data, size_t size)
+{
+    Sha1 sha;
+    sha.Update(data, size);
+    return sha.Final();
+}
+
+Sha256Digest Sha256Of(const void *data, size_t size)
+{
+    Sha256 sha;
+    sha.Update(data, size);
+    return sha.Final();
+}
+
+std::string ToHex(const uint8_t *data, size_t size)
+{
+    static const char kDigits[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; i++) {
+        hex[i * 2] = kDigits[data[i] >> 4];
+        hex[i * 2 + 1] = kDigits[data[i] & 0x0F];
+    }
+    return hex;
+}
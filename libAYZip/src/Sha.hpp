@@ -0,0 +1,73 @@
+﻿//
+//  Sha.hpp
+//  libAYZip
+//
+//  SHA-1 / SHA-256，用于内容清单与代码签名资源的摘要
+//  x86 支持 SHA 扩展 (SHA-NI) 时使用硬件指令，首次使用时按 CPU 选择实现
+//
+
+#ifndef Sha_hpp
+#define Sha_hpp
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+template <size_t StateWords, size_t DigestSize>
+class ShaHash
+{
+public:
+    using Digest = std::array<uint8_t, DigestSize>;
+    using BlocksFn = void (*)(uint32_t *state, const uint8_t *data, size_t blocks);
+
+    void Update(const void *data, size_t size);
+
+    // 结束后回到初始状态，可继续计算下一段数据
+    Digest Final();
+
+protected:
+    ShaHash(const uint32_t (&init)[StateWords], BlocksFn blocks);
+
+private:
+    void Reset();
+
+    const uint32_t *init_;
+    BlocksFn blocks_;
+    uint32_t state_[StateWords];
+    uint8_t buffer_[64];
+    size_t bufferSize_;
+    uint64_t length_;
+};
+
+class Sha1 : public ShaHash<5, 20>
+{
+public:
+    Sha1();
+};
+
+class Sha256 : public ShaHash<8, 32>
+{
+public:
+    Sha256();
+};
+
+using Sha1Digest = Sha1::Digest;
+using Sha256Digest = Sha256::Digest;
+
+Sha1Digest Sha1Of(const void *data, size_t size);
+Sha256Digest Sha256Of(const void *data, size_t size);
+
+// 小写十六进制
+std::string ToHex(const uint8_t *data, size_t size);
+
+template <size_t N>
+std::string ToHex(const std::array<uint8_t, N> &digest)
+{
+    return ToHex(digest.data(), digest.size());
+}
+
+// 当前使用的实现："sha-ni" / "portable"
+const char *ShaImplementation();
+
+#endif /* Sha_hpp */
@@ -0,0 +1,103 @@
+﻿//
+//  TraceEvents.cpp
+//  libAYZip
+//
+
+#include "TraceEvents.hpp"
+#include <fstream>
+#include <json/json.h>
+#include <spdlog/AYLog.h>
+
+TraceRecorder::TraceRecorder() : origin_(Clock::now())
+{
+}
+
+uint32_t TraceRecorder::ThreadIndex()
+{
+    auto result = threads_.emplace(std::this_thread::get_id(), static_cast<uint32_t>(threads_.size() + 1));
+    return result.first->second;
+}
+
+void TraceRecorder::AddComplete(std::string name, const char *category, Clock::time_point start, Clock::time_point end, std::string detail)
+{
+    Event event;
+    event.name = std::move(name);
+    event.category = category;
+    event.ts = std::chrono::duration_cast<std::chrono::microseconds>(start - origin_).count();
+    event.dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    event.detail = std::move(detail);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    event.tid = ThreadIndex();
+    events_.push_back(std::move(event));
+}
+
+void TraceRecorder::SetThreadName(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    threadNames_.emplace_back(ThreadIndex(), name);
+}
+
+bool TraceRecorder::Save(const std::string &path) const
+{
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        return false;
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 逐条写出，避免 50k 条目时构造整棵 Json::Value
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto &threadName : threadNames_) {
+        Json::Value item;
+        item["ph"] = "M";
+        item["name"] = "thread_name";
+        item["pid"] = 1;
+        item["tid"] = threadName.first;
+        item["args"]["name"] = threadName.second;
+        ofs << (first ? "\n" : ",\n");
+        writer->write(item, &ofs);
+        first = false;
+    }
+    for (const auto &event : events_) {
+        Json::Value item;
+        item["ph"] = "X";
+        item["name"] = event.name;
+        item["cat"] = event.category;
+        item["pid"] = 1;
+        item["tid"] = event.tid;
+        item["ts"] = Json::Int64(event.ts);
+        item["dur"] = Json::Int64(event.dur);
+        if (!event.detail.empty()) {
+            item["args"]["detail"] = event.detail;
+        }
+        ofs << (first ? "\n" : ",\n");
+        writer->write(item, &ofs);
+        first = false;
+    }
+    ofs << "\n]}\n";
+
+    return static_cast<bool>(ofs);
+}
+
+TraceSession::TraceSession(const std::string &path) : path_(path)
+{
+    if (!path_.empty()) {
+        recorder_.reset(new TraceRecorder());
+        // 会话在发起调用的线程上创建，工作线程各自命名
+        recorder_->SetThreadName("caller");
+    }
+}
+
+TraceSession::~TraceSession()
+{
+    if (recorder_ && !recorder_->Save(path_)) {
+        AYError("write trace file failed: {}", path_);
+    }
+}
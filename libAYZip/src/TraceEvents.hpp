@@ -0,0 +1,111 @@
+﻿//
+//  TraceEvents.hpp
+//  libAYZip
+//
+//  Chrome trace (chrome://tracing / Perfetto) 事件记录
+//
+
+#ifndef TraceEvents_hpp
+#define TraceEvents_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class TraceRecorder
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TraceRecorder();
+
+    // 完整事件 ("ph":"X")，detail 写入 args.detail
+    void AddComplete(std::string name, const char *category, Clock::time_point start, Clock::time_point end, std::string detail = std::string());
+    // 为当前线程命名，显示在时间线左侧
+    void SetThreadName(const std::string &name);
+
+    bool Save(const std::string &path) const;
+
+private:
+    struct Event {
+        std::string name;
+        const char *category;
+        int64_t ts;         // 微秒，相对于 TraceRecorder 创建时间
+        int64_t dur;
+        uint32_t tid;
+        std::string detail;
+    };
+
+    uint32_t ThreadIndex();     // 调用方需持有 mutex_
+
+    Clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+    std::unordered_map<std::thread::id, uint32_t> threads_;
+    std::vector<std::pair<uint32_t, std::string>> threadNames_;
+};
+
+// trace == nullptr 时不记录
+class ScopedTraceSpan
+{
+public:
+    ScopedTraceSpan(TraceRecorder *trace, const char *name, const char *category)
+        : trace_(trace), name_(name), category_(category), detail_(nullptr)
+    {
+        if (trace_) {
+            start_ = TraceRecorder::Clock::now();
+        }
+    }
+
+    // detail 须在 span 结束前保持有效，仅在启用时复制
+    ScopedTraceSpan(TraceRecorder *trace, const char *name, const char *category, const std::string &detail)
+        : trace_(trace), name_(name), category_(category), detail_(&detail)
+    {
+        if (trace_) {
+            start_ = TraceRecorder::Clock::now();
+        }
+    }
+    // 只保存 detail 的指针：临时字符串 (含由 const char * 隐式构造的) 在声明结束时即被销毁，不允许传入
+    ScopedTraceSpan(TraceRecorder *trace, const char *name, const char *category, std::string &&detail) = delete;
+
+    ~ScopedTraceSpan()
+    {
+        if (trace_) {
+            trace_->AddComplete(name_, category_, start_, TraceRecorder::Clock::now(), detail_ ? *detail_ : std::string());
+        }
+    }
+
+    ScopedTraceSpan(const ScopedTraceSpan &) = delete;
+    ScopedTraceSpan &operator=(const ScopedTraceSpan &) = delete;
+
+private:
+    TraceRecorder *trace_;
+    const char *name_;
+    const char *category_;
+    const std::string *detail_;
+    TraceRecorder::Clock::time_point start_;
+};
+
+// 持有一次调用的 TraceRecorder，析构时写出到 path；path 为空则不启用
+class TraceSession
+{
+public:
+    explicit TraceSession(const std::string &path);
+    ~TraceSession();
+
+    TraceRecorder *recorder() const { return recorder_.get(); }
+
+    TraceSession(const TraceSession &) = delete;
+    TraceSession &operator=(const TraceSession &) = delete;
+
+private:
+    std::string path_;
+    std::unique_ptr<TraceRecorder> recorder_;
+};
+
+#endif /* TraceEvents_hpp */
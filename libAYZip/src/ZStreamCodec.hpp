@@ -0,0 +1,209 @@
+﻿//
+//  ZStreamCodec.hpp
+//  libAYZip
+//
+//  zlib 与 zlib-ng 原生 API 共用的流式实现，Api 提供 Stream 类型与 init/deflate/inflate/reset/end
+//  zlib-ng.h 与 zlib.h 不能在同一个编译单元中包含，两个后端分别在 ZipCodec.cpp / ZipCodecZlibNg.cpp 实例化
+//
+
+#ifndef ZStreamCodec_hpp
+#define ZStreamCodec_hpp
+
+#include "ZipCodec.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+constexpr size_t kZStreamBufSize = 64 * 1024;
+
+template <typename Api>
+class ZStreamDeflater : public DeflateStream
+{
+public:
+    explicit ZStreamDeflater(int level)
+    {
+        memset(&stream_, 0, sizeof(stream_));
+        valid_ = Api::DeflateInit(&stream_, level) == Z_OK;
+    }
+
+    ~ZStreamDeflater() override
+    {
+        if (valid_) {
+            Api::DeflateEnd(&stream_);
+        }
+    }
+
+    bool Valid() const { return valid_; }
+
+    bool Deflate(const uint8_t *data, size_t size, bool finish, const CodecSink &sink) override
+    {
+        do {
+            size_t chunk = std::min<size_t>(size, UINT_MAX);
+            stream_.next_in = const_cast<uint8_t *>(data);
+            stream_.avail_in = static_cast<unsigned int>(chunk);
+            data += chunk;
+            size -= chunk;
+
+            int flush = (finish && size == 0) ? Z_FINISH : Z_NO_FLUSH;
+            int ret;
+            do {
+                stream_.next_out = out_;
+                stream_.avail_out = sizeof(out_);
+                ret = Api::Deflate(&stream_, flush);
+                if (ret == Z_STREAM_ERROR) {
+                    return false;
+                }
+                size_t produced = sizeof(out_) - stream_.avail_out;
+                if (produced > 0 && !sink(out_, produced)) {
+                    return false;
+                }
+            } while (stream_.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+        } while (size > 0);
+        return true;
+    }
+
+    bool Reset(uint64_t) override
+    {
+        return valid_ && Api::DeflateReset(&stream_) == Z_OK;
+    }
+
+private:
+    typename Api::Stream stream_;
+    bool valid_ = false;
+    uint8_t out_[kZStreamBufSize];
+};
+
+template <typename Api>
+class ZStreamInflater : public InflateStream
+{
+public:
+    ZStreamInflater()
+    {
+        memset(&stream_, 0, sizeof(stream_));
+        valid_ = Api::InflateInit(&stream_) == Z_OK;
+    }
+
+    ~ZStreamInflater() override
+    {
+        if (valid_) {
+            Api::InflateEnd(&stream_);
+        }
+    }
+
+    bool Valid() const { return valid_; }
+
+    bool Inflate(const uint8_t *data, size_t size, bool finish, const CodecSink &sink) override
+    {
+        while (!done_ && size > 0) {
+            size_t chunk = std::min<size_t>(size, UINT_MAX);
+            stream_.next_in = const_cast<uint8_t *>(data);
+            stream_.avail_in = static_cast<unsigned int>(chunk);
+            data += chunk;
+            size -= chunk;
+
+            do {
+                stream_.next_out = out_;
+                stream_.avail_out = sizeof(out_);
+                int ret = Api::Inflate(&stream_, Z_NO_FLUSH);
+                if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR) {
+                    return false;
+                }
+                size_t produced = sizeof(out_) - stream_.avail_out;
+                if (produced > 0 && !sink(out_, produced)) {
+                    return false;
+                }
+                if (ret == Z_STREAM_END) {
+                    done_ = true;
+                    break;
+                }
+            } while (stream_.avail_out == 0);
+        }
+        return !finish || done_;
+    }
+
+    bool Reset(uint64_t) override
+    {
+        done_ = false;
+        return valid_ && Api::InflateReset(&stream_) == Z_OK;
+    }
+
+private:
+    typename Api::Stream stream_;
+    bool valid_ = false;
+    bool done_ = false;
+    uint8_t out_[kZStreamBufSize];
+};
+
+template <typename Stream>
+std::unique_ptr<DeflateStream> NewZStreamDeflater(int level)
+{
+    std::unique_ptr<Stream> deflater(new Stream(level));
+    if (!deflater->Valid()) {
+        return nullptr;
+    }
+    return deflater;
+}
+
+template <typename Stream>
+std::unique_ptr<InflateStream> NewZStreamInflater()
+{
+    std::unique_ptr<Stream> inflater(new Stream());
+    if (!inflater->Valid()) {
+        return nullptr;
+    }
+    return inflater;
+}
+
+// 每个线程保留一个 inflate 流，小条目之间只 InflateReset，不重新分配 32KB 窗口与状态
+template <typename Api>
+class ZStreamThreadInflater
+{
+public:
+    ZStreamThreadInflater()
+    {
+        memset(&stream_, 0, sizeof(stream_));
+        valid_ = Api::InflateInit(&stream_) == Z_OK;
+    }
+
+    ~ZStreamThreadInflater()
+    {
+        if (valid_) {
+            Api::InflateEnd(&stream_);
+        }
+    }
+
+    typename Api::Stream *Acquire()
+    {
+        if (!valid_ || Api::InflateReset(&stream_) != Z_OK) {
+            return nullptr;
+        }
+        return &stream_;
+    }
+
+private:
+    typename Api::Stream stream_;
+    bool valid_ = false;
+};
+
+template <typename Api>
+bool ZStreamInflateBuffer(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize)
+{
+    if (inSize > UINT_MAX || outSize > UINT_MAX) {
+        return false;
+    }
+
+    static thread_local ZStreamThreadInflater<Api> threadInflater;
+    typename Api::Stream *stream = threadInflater.Acquire();
+    if (stream == nullptr) {
+        return false;
+    }
+    stream->next_in = const_cast<uint8_t *>(in);
+    stream->avail_in = static_cast<unsigned int>(inSize);
+    uint8_t empty;  // zlib 不接受空的 next_out
+    stream->next_out = out ? out : &empty;
+    stream->avail_out = static_cast<unsigned int>(outSize);
+    int ret = Api::Inflate(stream, Z_FINISH);
+    return ret == Z_STREAM_END && stream->avail_out == 0;
+}
+
+#endif /* ZStreamCodec_hpp */
@@ -0,0 +1,281 @@
+﻿//
+//  ZipCentralDirectory.cpp
+//  libAYZip
+//
+
+#include "ZipCentralDirectory.hpp"
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t kCentralRecordSignature = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirectorySignature = 0x06054b50;
+constexpr uint32_t kZip64EndOfCentralDirectorySignature = 0x06064b50;
+constexpr uint32_t kZip64LocatorSignature = 0x07064b50;
+constexpr uint32_t kLocalHeaderSignature = 0x04034b50;
+constexpr uint16_t kZip64ExtraFieldId = 0x0001;
+
+constexpr size_t kCentralRecordSize = 46;
+constexpr size_t kLocalHeaderSize = 30;
+constexpr size_t kEndOfCentralDirectorySize = 22;
+constexpr size_t kZip64EndOfCentralDirectorySize = 56;
+constexpr size_t kZip64LocatorSize = 20;
+constexpr size_t kMaxCommentSize = 0xFFFF;
+
+static uint16_t Read16(const uint8_t *p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t Read32(const uint8_t *p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static uint64_t Read64(const uint8_t *p)
+{
+    return uint64_t(Read32(p)) | (uint64_t(Read32(p + 4)) << 32);
+}
+
+static void Write16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void Write32(std::vector<uint8_t> &out, uint32_t value)
+{
+    Write16(out, static_cast<uint16_t>(value));
+    Write16(out, static_cast<uint16_t>(value >> 16));
+}
+
+static void Write64(std::vector<uint8_t> &out, uint64_t value)
+{
+    Write32(out, static_cast<uint32_t>(value));
+    Write32(out, static_cast<uint32_t>(value >> 32));
+}
+
+static bool ReadAt(std::ifstream &in, uint64_t offset, uint8_t *data, size_t size)
+{
+    in.seekg(static_cast<std::streamoff>(offset));
+    in.read(reinterpret_cast<char *>(data), static_cast<std::streamsize>(size));
+    return static_cast<size_t>(in.gcount()) == size;
+}
+
+// 32 位字段为 0xFFFFFFFF 时，真实值按 解压大小、压缩大小、本地头偏移 的顺序出现在 ZIP64 扩展字段中
+static bool ParseCentralRecord(const uint8_t *fixed, ZipCentralRecord &entry)
+{
+    size_t nameSize = Read16(fixed + 28);
+    size_t extraSize = Read16(fixed + 30);
+    entry.versionMadeBy = Read16(fixed + 4);
+    entry.flags = Read16(fixed + 8);
+    entry.method = Read16(fixed + 10);
+    entry.crc = Read32(fixed + 16);
+    entry.compressedSize = Read32(fixed + 20);
+    entry.uncompressedSize = Read32(fixed + 24);
+    entry.externalAttributes = Read32(fixed + 38);
+    entry.localHeaderOffset = Read32(fixed + 42);
+
+    const uint8_t *extra = fixed + kCentralRecordSize + nameSize;
+    const uint8_t *extraEnd = extra + extraSize;
+    while (extraEnd - extra >= 4) {
+        uint16_t id = Read16(extra);
+        size_t size = Read16(extra + 2);
+        extra += 4;
+        if (static_cast<size_t>(extraEnd - extra) < size) {
+            break;
+        }
+        if (id == kZip64ExtraFieldId) {
+            const uint8_t *field = extra;
+            const uint8_t *fieldEnd = extra + size;
+            for (uint64_t *value : {&entry.uncompressedSize, &entry.compressedSize, &entry.localHeaderOffset}) {
+                if (*value != 0xFFFFFFFF) {
+                    continue;
+                }
+                if (fieldEnd - field < 8) {
+                    return false;
+                }
+                *value = Read64(field);
+                field += 8;
+            }
+        }
+        extra += size;
+    }
+    return true;
+}
+
+bool ReadZipEntryDataOffset(std::istream &in, const ZipCentralRecord &record, uint64_t *dataOffset)
+{
+    uint8_t header[kLocalHeaderSize];
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(record.localHeaderOffset));
+    in.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (static_cast<size_t>(in.gcount()) != sizeof(header) || Read32(header) != kLocalHeaderSignature) {
+        return false;
+    }
+    *dataOffset = record.localHeaderOffset + kLocalHeaderSize + Read16(header + 26) + Read16(header + 28);
+    return true;
+}
+
+bool ReadZipCentralDirectory(const fs::path &path, ZipCentralDirectory &directory)
+{
+    std::error_code ec;
+    uint64_t fileSize = fs::file_size(path, ec);
+    if (ec || fileSize < kEndOfCentralDirectorySize) {
+        return false;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    // EOCD 在最后 22 + 注释长度 字节内；从后往前找注释长度恰好到文件末尾的签名
+    size_t tailSize = static_cast<size_t>(std::min<uint64_t>(fileSize, kEndOfCentralDirectorySize + kMaxCommentSize));
+    std::vector<uint8_t> tail(tailSize);
+    if (!ReadAt(in, fileSize - tailSize, tail.data(), tailSize)) {
+        return false;
+    }
+    size_t eocd = tailSize;
+    for (size_t i = tailSize - kEndOfCentralDirectorySize + 1; i-- > 0;) {
+        if (Read32(&tail[i]) == kEndOfCentralDirectorySignature && i + kEndOfCentralDirectorySize + Read16(&tail[i + 20]) == tailSize) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd == tailSize) {
+        return false;
+    }
+
+    const uint8_t *record = &tail[eocd];
+    uint64_t eocdOffset = fileSize - tailSize + eocd;
+    if (Read16(record + 4) != 0 || Read16(record + 6) != 0) {
+        return false;   // 分卷
+    }
+    uint64_t count = Read16(record + 10);
+    uint64_t size = Read32(record + 12);
+    uint64_t offset = Read32(record + 16);
+    directory.comment.assign(reinterpret_cast<const char *>(record + kEndOfCentralDirectorySize), Read16(record + 20));
+    uint64_t directoryEnd = eocdOffset;
+
+    if (count == 0xFFFF || size == 0xFFFFFFFF || offset == 0xFFFFFFFF) {
+        uint8_t locator[kZip64LocatorSize];
+        if (eocdOffset < kZip64LocatorSize || !ReadAt(in, eocdOffset - kZip64LocatorSize, locator, sizeof(locator)) ||
+            Read32(locator) != kZip64LocatorSignature) {
+            return false;
+        }
+        uint64_t zip64Offset = Read64(locator + 8);
+        uint8_t zip64[kZip64EndOfCentralDirectorySize];
+        if (zip64Offset + sizeof(zip64) > eocdOffset - kZip64LocatorSize || !ReadAt(in, zip64Offset, zip64, sizeof(zip64)) ||
+            Read32(zip64) != kZip64EndOfCentralDirectorySignature) {
+            return false;
+        }
+        count = Read64(zip64 + 32);
+        size = Read64(zip64 + 40);
+        offset = Read64(zip64 + 48);
+        directoryEnd = zip64Offset;
+    }
+    if (offset > directoryEnd || directoryEnd - offset != size) {
+        return false;   // 中央目录与 EOCD 之间还有数据，或包前有附加数据
+    }
+    if (count > size / kCentralRecordSize) {
+        return false;   // 条目数放不进中央目录，不按它预留内存
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(size));
+    if (!ReadAt(in, offset, data.data(), data.size())) {
+        return false;
+    }
+    directory.records.clear();
+    directory.records.reserve(static_cast<size_t>(count));
+    size_t position = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (data.size() - position < kCentralRecordSize || Read32(&data[position]) != kCentralRecordSignature) {
+            return false;
+        }
+        const uint8_t *fixed = &data[position];
+        size_t nameSize = Read16(fixed + 28);
+        size_t recordSize = kCentralRecordSize + nameSize + Read16(fixed + 30) + Read16(fixed + 32);
+        if (data.size() - position < recordSize) {
+            return false;
+        }
+        ZipCentralRecord entry;
+        entry.name.assign(reinterpret_cast<const char *>(fixed + kCentralRecordSize), nameSize);
+        if (!ParseCentralRecord(fixed, entry)) {
+            return false;
+        }
+        entry.raw.assign(fixed, fixed + recordSize);
+        directory.records.push_back(std::move(entry));
+        position += recordSize;
+    }
+    if (position != data.size()) {
+        return false;
+    }
+
+    directory.offset = offset;
+    directory.size = size;
+    directory.end = fileSize;
+    return true;
+}
+
+bool WriteZipCentralDirectory(const fs::path &path, uint64_t offset, const std::vector<ZipCentralRecord> &records, const std::string &comment, uint64_t *end)
+{
+    std::vector<uint8_t> tail;
+    for (const ZipCentralRecord &record : records) {
+        tail.insert(tail.end(), record.raw.begin(), record.raw.end());
+    }
+    uint64_t size = tail.size();
+    uint64_t count = records.size();
+    uint16_t commentSize = static_cast<uint16_t>(std::min<size_t>(comment.size(), kMaxCommentSize));
+
+    bool zip64 = count >= 0xFFFF || size >= 0xFFFFFFFF || offset >= 0xFFFFFFFF;
+    if (zip64) {
+        uint64_t zip64Offset = offset + size;
+        Write32(tail, kZip64EndOfCentralDirectorySignature);
+        Write64(tail, kZip64EndOfCentralDirectorySize - 12);
+        Write16(tail, 45);              // version made by
+        Write16(tail, 45);              // version needed
+        Write32(tail, 0);
+        Write32(tail, 0);
+        Write64(tail, count);
+        Write64(tail, count);
+        Write64(tail, size);
+        Write64(tail, offset);
+
+        Write32(tail, kZip64LocatorSignature);
+        Write32(tail, 0);
+        Write64(tail, zip64Offset);
+        Write32(tail, 1);
+    }
+    Write32(tail, kEndOfCentralDirectorySignature);
+    Write16(tail, 0);
+    Write16(tail, 0);
+    Write16(tail, zip64 ? 0xFFFF : static_cast<uint16_t>(count));
+    Write16(tail, zip64 ? 0xFFFF : static_cast<uint16_t>(count));
+    Write32(tail, zip64 ? 0xFFFFFFFF : static_cast<uint32_t>(size));
+    Write32(tail, zip64 ? 0xFFFFFFFF : static_cast<uint32_t>(offset));
+    Write16(tail, commentSize);
+    tail.insert(tail.end(), comment.begin(), comment.begin() + commentSize);
+
+    {
+        std::fstream out(path, std::ios::in | std::ios::out | std::ios::binary);
+        if (!out) {
+            return false;
+        }
+        out.seekp(static_cast<std::streamoff>(offset));
+        out.write(reinterpret_cast<const char *>(tail.data()), static_cast<std::streamsize>(tail.size()));
+        out.close();
+        if (out.fail()) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::resize_file(path, offset + tail.size(), ec);
+    if (ec) {
+        return false;
+    }
+    if (end) {
+        *end = offset + tail.size();
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+﻿//
+//  ZipCentralDirectory.hpp
+//  libAYZip
+//
+//  直接读写 zip 的中央目录与 EOCD (含 ZIP64)，记录按原始字节保存
+//  追加模式只重写文件尾部：保留的记录原样写回，本地条目不动
+//
+
+#ifndef ZipCentralDirectory_hpp
+#define ZipCentralDirectory_hpp
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <vector>
+
+struct ZipCentralRecord {
+    std::string name;               // 条目名原始字节
+    uint16_t versionMadeBy = 0;     // 高字节为生成系统，3 为 unix
+    uint16_t flags = 0;
+    uint16_t method = 0;
+    uint32_t crc = 0;
+    uint64_t compressedSize = 0;    // 以下三项已按 ZIP64 扩展字段修正
+    uint64_t uncompressedSize = 0;
+    uint64_t localHeaderOffset = 0;
+    uint32_t externalAttributes = 0;
+    std::vector<uint8_t> raw;       // 完整记录：固定部分 + 文件名 + 扩展字段 + 注释
+};
+
+struct ZipCentralDirectory {
+    std::vector<ZipCentralRecord> records;
+    uint64_t offset = 0;            // 中央目录起始位置，即最后一个本地条目之后
+    uint64_t size = 0;
+    uint64_t end = 0;               // EOCD (含注释) 的结束位置
+    std::string comment;
+};
+
+// 要求中央目录之后紧跟 (ZIP64) EOCD，且 EOCD 位于文件末尾；分卷与其他布局返回 false
+bool ReadZipCentralDirectory(const std::filesystem::path &path, ZipCentralDirectory &directory);
+
+// 本地文件头之后数据的起始位置；本地头的文件名与扩展字段长度可能与中央目录不同，需读取本地头
+bool ReadZipEntryDataOffset(std::istream &in, const ZipCentralRecord &record, uint64_t *dataOffset);
+
+// 在 offset 处写入记录与 EOCD，需要时写 ZIP64 EOCD 与定位器，并把文件截断到结尾
+bool WriteZipCentralDirectory(const std::filesystem::path &path, uint64_t offset, const std::vector<ZipCentralRecord> &records, const std::string &comment, uint64_t *end = nullptr);
+
+#endif /* ZipCentralDirectory_hpp */
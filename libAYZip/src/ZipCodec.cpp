@@ -0,0 +1,520 @@
+﻿//
+//  ZipCodec.cpp
+//  libAYZip
+//
+
+#include "ZipCodec.hpp"
+#include "Crc32.hpp"
+#include <algorithm>
+#include <vector>
+#include <zlib.h>
+#include "ZStreamCodec.hpp"
+
+#ifdef AYZIP_WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#ifdef AYZIP_WITH_ISAL
+#include <isa-l/crc.h>
+#include <isa-l/igzip_lib.h>
+#endif
+
+/********************************************
+ *                                          *
+ *                  zlib                    *
+ *                                          *
+ ********************************************/
+struct ZlibApi {
+    using Stream = z_stream;
+
+    static int DeflateInit(Stream *stream, int level) { return deflateInit2(stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY); }
+    static int Deflate(Stream *stream, int flush) { return deflate(stream, flush); }
+    static int DeflateReset(Stream *stream) { return deflateReset(stream); }
+    static void DeflateEnd(Stream *stream) { deflateEnd(stream); }
+    static int InflateInit(Stream *stream) { return inflateInit2(stream, -MAX_WBITS); }
+    static int Inflate(Stream *stream, int flush) { return inflate(stream, flush); }
+    static int InflateReset(Stream *stream) { return inflateReset(stream); }
+    static void InflateEnd(Stream *stream) { inflateEnd(stream); }
+};
+
+static std::unique_ptr<DeflateStream> NewZlibDeflater(int level, uint64_t)
+{
+    return NewZStreamDeflater<ZStreamDeflater<ZlibApi>>(level);
+}
+
+static std::unique_ptr<InflateStream> NewZlibInflater(uint64_t)
+{
+    return NewZStreamInflater<ZStreamInflater<ZlibApi>>();
+}
+
+static bool ZlibInflateBuffer(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize)
+{
+    return ZStreamInflateBuffer<ZlibApi>(in, inSize, out, outSize);
+}
+
+static const ZipCodec kZlibCodec = { "zlib", 0, NewZlibDeflater, NewZlibInflater, ZlibInflateBuffer, Crc32Update };
+
+/********************************************
+ *                                          *
+ *               libdeflate                 *
+ *                                          *
+ ********************************************/
+#ifdef AYZIP_WITH_LIBDEFLATE
+// libdeflate 只有整块接口，条目数据先缓存，finish 时一次完成
+constexpr uint64_t kLibdeflateMaxEntrySize = 64 * 1024 * 1024;
+
+class LibdeflateDeflater : public DeflateStream
+{
+public:
+    LibdeflateDeflater(libdeflate_compressor *compressor, uint64_t sizeHint) : compressor_(compressor)
+    {
+        input_.reserve(static_cast<size_t>(std::min<uint64_t>(sizeHint, kLibdeflateMaxEntrySize)));
+    }
+
+    ~LibdeflateDeflater() override
+    {
+        libdeflate_free_compressor(compressor_);
+    }
+
+    bool Deflate(const uint8_t *data, size_t size, bool finish, const CodecSink &sink) override
+    {
+        // 整个条目在一次调用中给出时不必复制
+        const uint8_t *in = data;
+        size_t inSize = size;
+        if (!finish || !input_.empty()) {
+            input_.insert(input_.end(), data, data + size);
+            if (!finish) {
+                return true;
+            }
+            in = input_.data();
+            inSize = input_.size();
+        }
+
+        out_.resize(libdeflate_deflate_compress_bound(compressor_, inSize));
+        size_t compressed = libdeflate_deflate_compress(compressor_, in, inSize, out_.data(), out_.size());
+        input_.clear();
+        return compressed > 0 && sink(out_.data(), compressed);
+    }
+
+    bool Reset(uint64_t sizeHint) override
+    {
+        input_.clear();
+        input_.reserve(static_cast<size_t>(std::min<uint64_t>(sizeHint, kLibdeflateMaxEntrySize)));
+        return true;
+    }
+
+private:
+    libdeflate_compressor *compressor_;
+    std::vector<uint8_t> input_;
+    std::vector<uint8_t> out_;
+};
+
+class LibdeflateInflater : public InflateStream
+{
+public:
+    LibdeflateInflater(libdeflate_decompressor *decompressor, uint64_t uncompressedSize)
+        : decompressor_(decompressor), uncompressedSize_(static_cast<size_t>(uncompressedSize))
+    {
+    }
+
+    ~LibdeflateInflater() override
+    {
+        libdeflate_free_decompressor(decompressor_);
+    }
+
+    bool Inflate(const uint8_t *data, size_t size, bool finish, const CodecSink &sink) override
+    {
+        const uint8_t *in = data;
+        size_t inSize = size;
+        if (!finish || !input_.empty()) {
+            input_.insert(input_.end(), data, data + size);
+            if (!finish) {
+                return true;
+            }
+            in = input_.data();
+            inSize = input_.size();
+        }
+
+        out_.resize(uncompressedSize_);
+        libdeflate_result result = libdeflate_deflate_decompress(decompressor_, in, inSize, out_.data(), out_.size(), nullptr);
+        input_.clear();
+        return result == LIBDEFLATE_SUCCESS && (out_.empty() || sink(out_.data(), out_.size()));
+    }
+
+    bool Reset(uint64_t uncompressedSize) override
+    {
+        if (uncompressedSize > kLibdeflateMaxEntrySize) {
+            return false;
+        }
+        uncompressedSize_ = static_cast<size_t>(uncompressedSize);
+        input_.clear();
+        return true;
+    }
+
+private:
+    libdeflate_decompressor *decompressor_;
+    size_t uncompressedSize_;
+    std::vector<uint8_t> input_;
+    std::vector<uint8_t> out_;
+};
+
+static std::unique_ptr<DeflateStream> NewLibdeflateDeflater(int level, uint64_t sizeHint)
+{
+    libdeflate_compressor *compressor = libdeflate_alloc_compressor(level < 0 ? 6 : level);
+    if (compressor == nullptr) {
+        return nullptr;
+    }
+    return std::unique_ptr<DeflateStream>(new LibdeflateDeflater(compressor, sizeHint));
+}
+
+static std::unique_ptr<InflateStream> NewLibdeflateInflater(uint64_t uncompressedSize)
+{
+    if (uncompressedSize > kLibdeflateMaxEntrySize) {
+        return nullptr;
+    }
+    libdeflate_decompressor *decompressor = libdeflate_alloc_decompressor();
+    if (decompressor == nullptr) {
+        return nullptr;
+    }
+    return std::unique_ptr<InflateStream>(new LibdeflateInflater(decompressor, uncompressedSize));
+}
+
+// 每个线程保留一个 decompressor，小条目之间不重复分配
+struct LibdeflateThreadDecompressor {
+    libdeflate_decompressor *decompressor = libdeflate_alloc_decompressor();
+
+    ~LibdeflateThreadDecompressor()
+    {
+        if (decompressor) {
+            libdeflate_free_decompressor(decompressor);
+        }
+    }
+};
+
+static bool LibdeflateInflateBuffer(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize)
+{
+    static thread_local LibdeflateThreadDecompressor threadDecompressor;
+    if (threadDecompressor.decompressor == nullptr) {
+        return false;
+    }
+    libdeflate_result result = libdeflate_deflate_decompress(threadDecompressor.decompressor, in, inSize, out, outSize, nullptr);
+    return result == LIBDEFLATE_SUCCESS;
+}
+
+static uint32_t LibdeflateCrc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    return libdeflate_crc32(crc, data, size);
+}
+
+static const ZipCodec kLibdeflateCodec = { "libdeflate", kLibdeflateMaxEntrySize, NewLibdeflateDeflater, NewLibdeflateInflater, LibdeflateInflateBuffer, LibdeflateCrc32 };
+#endif
+
+/********************************************
+ *                                          *
+ *              ISA-L igzip                 *
+ *                                          *
+ ********************************************/
+#ifdef AYZIP_WITH_ISAL
+// zip 压缩级别 -> igzip 级别 (0-3)，默认级别对应 igzip 1
+static uint32_t IsalLevel(int level)
+{
+    if (level < 0)
+        return 1;
+    if (level <= 2)
+        return 0;
+    if (level <= 5)
+        return 1;
+    if (level <= 7)
+        return 2;
+    return 3;
+}
+
+static size_t IsalLevelBufSize(uint32_t level)
+{
+    switch (level) {
+        case 1: return ISAL_DEF_LVL1_DEFAULT;
+        case 2: return ISAL_DEF_LVL2_DEFAULT;
+        case 3: return ISAL_DEF_LVL3_DEFAULT;
+    }
+    return 0;
+}
+
+class IsalDeflater : public DeflateStream
+{
+public:
+    explicit IsalDeflater(int level)
+    {
+        isal_deflate_init(&stream_);
+        stream_.level = IsalLevel(level);
+        levelBuf_.resize(IsalLevelBufSize(stream_.level));
+        stream_.level_buf = levelBuf_.empty() ? nullptr : levelBuf_.data();
+        stream_.level_buf_size = static_cast<uint32_t>(levelBuf_.size());
+        stream_.flush = NO_FLUSH;
+    }
+
+    bool Deflate(const uint8_t *data, size_t size, bool finish, const CodecSink &sink) override
+    {
+        do {
+            size_t chunk = std::min<size_t>(size, UINT32_MAX);
+            stream_.next_in = const_cast<uint8_t *>(data);
+            stream_.avail_in = static_cast<uint32_t>(chunk);
+            data += chunk;
+            size -= chunk;
+            stream_.end_of_stream = (finish && size == 0) ? 1 : 0;
+
+            do {
+                stream_.next_out = out_;
+                stream_.avail_out = sizeof(out_);
+                if (isal_deflate(&stream_) != COMP_OK) {
+                    return false;
+                }
+                size_t produced = sizeof(out_) - stream_.avail_out;
+                if (produced > 0 && !sink(out_, produced)) {
+                    return false;
+                }
+            } while (stream_.avail_out == 0 || (stream_.end_of_stream && stream_.internal_state.state != ZSTATE_END));
+        } while (size > 0);
+        return true;
+    }
+
+    bool Reset(uint64_t) override
+    {
+        // isal_deflate_reset 保留 level 与 level_buf
+        isal_deflate_reset(&stream_);
+        stream_.flush = NO_FLUSH;
+        stream_.end_of_stream = 0;
+        return true;
+    }
+
+private:
+    isal_zstream stream_;
+    std::vector<uint8_t> levelBuf_;
+    uint8_t out_[kZStreamBufSize];
+};
+
+class IsalInflater : public InflateStream
+{
+public:
+    IsalInflater()
+    {
+        isal_inflate_init(&state_);
+    }
+
+    bool Inflate(const uint8_t *data, size_t size, bool finish, const CodecSink &sink) override
+    {
+        while (!done_ && size > 0) {
+            size_t chunk = std::min<size_t>(size, UINT32_MAX);
+            state_.next_in = const_cast<uint8_t *>(data);
+            state_.avail_in = static_cast<uint32_t>(chunk);
+            data += chunk;
+            size -= chunk;
+
+            do {
+                state_.next_out = out_;
+                state_.avail_out = sizeof(out_);
+                if (isal_inflate(&state_) < 0) {
+                    return false;
+                }
+                size_t produced = sizeof(out_) - state_.avail_out;
+                if (produced > 0 && !sink(out_, produced)) {
+                    return false;
+                }
+                if (state_.block_state == ISAL_BLOCK_FINISH) {
+                    done_ = true;
+                    break;
+                }
+            } while (state_.avail_out == 0);
+        }
+        return !finish || done_;
+    }
+
+    bool Reset(uint64_t) override
+    {
+        isal_inflate_reset(&state_);
+        done_ = false;
+        return true;
+    }
+
+private:
+    inflate_state state_;
+    bool done_ = false;
+    uint8_t out_[kZStreamBufSize];
+};
+
+static std::unique_ptr<DeflateStream> NewIsalDeflater(int level, uint64_t)
+{
+    return std::unique_ptr<DeflateStream>(new IsalDeflater(level));
+}
+
+static std::unique_ptr<InflateStream> NewIsalInflater(uint64_t)
+{
+    return std::unique_ptr<InflateStream>(new IsalInflater());
+}
+
+static bool IsalInflateBuffer(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize)
+{
+    if (inSize > UINT32_MAX || outSize > UINT32_MAX) {
+        return false;
+    }
+
+    // inflate_state 含解码表，较大，每个线程保留一个
+    static thread_local inflate_state state;
+    static thread_local bool initialized = false;
+    if (!initialized) {
+        isal_inflate_init(&state);
+        initialized = true;
+    }
+    else {
+        isal_inflate_reset(&state);
+    }
+    state.next_in = const_cast<uint8_t *>(in);
+    state.avail_in = static_cast<uint32_t>(inSize);
+    state.next_out = out;
+    state.avail_out = static_cast<uint32_t>(outSize);
+    return isal_inflate(&state) >= 0 && state.block_state == ISAL_BLOCK_FINISH && state.avail_out == 0;
+}
+
+static uint32_t IsalCrc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    return crc32_gzip_refl(crc, data, size);
+}
+
+static const ZipCodec kIsalCodec = { "isal", 0, NewIsalDeflater, NewIsalInflater, IsalInflateBuffer, IsalCrc32 };
+#endif
+
+#ifdef AYZIP_WITH_ZLIB_NG
+extern const ZipCodec kZlibNgCodec;     // ZipCodecZlibNg.cpp
+#endif
+
+// "auto" 按此顺序选择第一个
+static const ZipCodec *const kZipCodecs[] = {
+#ifdef AYZIP_WITH_LIBDEFLATE
+    &kLibdeflateCodec,
+#endif
+#ifdef AYZIP_WITH_ISAL
+    &kIsalCodec,
+#endif
+#ifdef AYZIP_WITH_ZLIB_NG
+    &kZlibNgCodec,
+#endif
+    &kZlibCodec,
+};
+
+/********************************************
+ *                                          *
+ *               上下文池                    *
+ *                                          *
+ ********************************************/
+// 每个线程、每种后端 (与压缩级别) 最多保留的空闲上下文数；通常同一时刻每个线程只处理一个条目
+constexpr size_t kCodecPoolMaxIdle = 2;
+
+struct CodecContextPool {
+    struct IdleDeflater {
+        const ZipCodec *codec;
+        int level;
+        std::unique_ptr<DeflateStream> deflater;
+    };
+    struct IdleInflater {
+        const ZipCodec *codec;
+        std::unique_ptr<InflateStream> inflater;
+    };
+
+    std::vector<IdleDeflater> deflaters;
+    std::vector<IdleInflater> inflaters;
+};
+
+static CodecContextPool &ThreadCodecPool()
+{
+    static thread_local CodecContextPool pool;
+    return pool;
+}
+
+void DeflaterRelease::operator()(DeflateStream *deflater) const
+{
+    std::unique_ptr<DeflateStream> owned(deflater);
+    CodecContextPool &pool = ThreadCodecPool();
+    size_t idle = std::count_if(pool.deflaters.begin(), pool.deflaters.end(), [&](const CodecContextPool::IdleDeflater &item) {
+        return item.codec == codec && item.level == level;
+    });
+    if (idle < kCodecPoolMaxIdle) {
+        pool.deflaters.push_back({ codec, level, std::move(owned) });
+    }
+}
+
+void InflaterRelease::operator()(InflateStream *inflater) const
+{
+    std::unique_ptr<InflateStream> owned(inflater);
+    CodecContextPool &pool = ThreadCodecPool();
+    size_t idle = std::count_if(pool.inflaters.begin(), pool.inflaters.end(), [&](const CodecContextPool::IdleInflater &item) {
+        return item.codec == codec;
+    });
+    if (idle < kCodecPoolMaxIdle) {
+        pool.inflaters.push_back({ codec, std::move(owned) });
+    }
+}
+
+PooledDeflater AcquireDeflater(const ZipCodec *codec, int level, uint64_t sizeHint)
+{
+    CodecContextPool &pool = ThreadCodecPool();
+    for (auto it = pool.deflaters.rbegin(); it != pool.deflaters.rend(); ++it) {
+        if (it->codec == codec && it->level == level) {
+            std::unique_ptr<DeflateStream> deflater = std::move(it->deflater);
+            pool.deflaters.erase(std::next(it).base());
+            if (deflater->Reset(sizeHint)) {
+                return PooledDeflater(deflater.release(), DeflaterRelease{ codec, level });
+            }
+            break;
+        }
+    }
+    return PooledDeflater(codec->newDeflater(level, sizeHint).release(), DeflaterRelease{ codec, level });
+}
+
+PooledInflater AcquireInflater(const ZipCodec *codec, uint64_t uncompressedSize)
+{
+    CodecContextPool &pool = ThreadCodecPool();
+    for (auto it = pool.inflaters.rbegin(); it != pool.inflaters.rend(); ++it) {
+        if (it->codec == codec) {
+            std::unique_ptr<InflateStream> inflater = std::move(it->inflater);
+            pool.inflaters.erase(std::next(it).base());
+            if (inflater->Reset(uncompressedSize)) {
+                return PooledInflater(inflater.release(), InflaterRelease{ codec });
+            }
+            // 不能复用时 (如 libdeflate 条目过大) 丢弃，下面按条目参数新建
+            break;
+        }
+    }
+    return PooledInflater(codec->newInflater(uncompressedSize).release(), InflaterRelease{ codec });
+}
+
+const ZipCodec *FindZipCodec(const std::string &name)
+{
+    if (name == "auto") {
+        return kZipCodecs[0];
+    }
+    for (const ZipCodec *codec : kZipCodecs) {
+        if (name == codec->name) {
+            return codec;
+        }
+    }
+    return nullptr;
+}
+
+const ZipCodec *ZipCodecForEntry(const ZipCodec *codec, uint64_t entrySize)
+{
+    if (codec->maxEntrySize != 0 && entrySize > codec->maxEntrySize) {
+        return &kZlibCodec;
+    }
+    return codec;
+}
+
+std::string AvailableZipCodecs()
+{
+    std::string result;
+    for (const ZipCodec *codec : kZipCodecs) {
+        if (!result.empty()) {
+            result += ',';
+        }
+        result += codec->name;
+    }
+    return result;
+}
@@ -0,0 +1,86 @@
+﻿//
+//  ZipCodec.hpp
+//  libAYZip
+//
+//  可替换的 deflate / inflate 后端
+//  编译期定义 AYZIP_WITH_ZLIB_NG / AYZIP_WITH_LIBDEFLATE / AYZIP_WITH_ISAL 启用对应后端，zlib 始终可用；
+//  运行期按名称选择。所有后端读写标准 raw deflate 流，与 minizip 写出的条目互相兼容。
+//
+
+#ifndef ZipCodec_hpp
+#define ZipCodec_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// 接收压缩 / 解压输出，返回 false 时中止
+using CodecSink = std::function<bool(const uint8_t *data, size_t size)>;
+
+class DeflateStream
+{
+public:
+    virtual ~DeflateStream() {}
+
+    // 压缩一段输入，finish 为 true 时写出结束块
+    virtual bool Deflate(const uint8_t *data, size_t size, bool finish, const CodecSink &sink) = 0;
+
+    // 回到初始状态以压缩下一个条目，保留已分配的窗口与哈希表，压缩级别不变
+    virtual bool Reset(uint64_t sizeHint) = 0;
+};
+
+class InflateStream
+{
+public:
+    virtual ~InflateStream() {}
+
+    // 解压一段 raw deflate 输入，finish 表示输入已全部给出；数据损坏或流未结束时返回 false
+    virtual bool Inflate(const uint8_t *data, size_t size, bool finish, const CodecSink &sink) = 0;
+
+    // 回到初始状态以解压下一个条目
+    virtual bool Reset(uint64_t uncompressedSize) = 0;
+};
+
+struct ZipCodec {
+    const char *name;
+    // 整块处理的后端 (libdeflate) 需要把整个条目放进内存，超过该大小的条目退回 zlib；0 表示不限
+    uint64_t maxEntrySize;
+    // level 为 minizip 的压缩级别，MZ_COMPRESS_LEVEL_DEFAULT (-1) 由后端选择默认值；失败返回 nullptr
+    std::unique_ptr<DeflateStream> (*newDeflater)(int level, uint64_t sizeHint);
+    std::unique_ptr<InflateStream> (*newInflater)(uint64_t uncompressedSize);
+    // 一次解压到大小已知的缓冲区，输入须为完整的流且输出恰好 outSize 字节
+    bool (*inflateBuffer)(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize);
+    uint32_t (*crc32)(uint32_t crc, const uint8_t *data, size_t size);
+};
+
+// 从当前线程的上下文池取出，析构时归还，供下一个条目 Reset 后复用
+struct DeflaterRelease {
+    const ZipCodec *codec;
+    int level;
+    void operator()(DeflateStream *deflater) const;
+};
+
+struct InflaterRelease {
+    const ZipCodec *codec;
+    void operator()(InflateStream *inflater) const;
+};
+
+using PooledDeflater = std::unique_ptr<DeflateStream, DeflaterRelease>;
+using PooledInflater = std::unique_ptr<InflateStream, InflaterRelease>;
+
+// 池中有同一后端 (与级别) 的空闲上下文时 Reset 后返回，否则新建；失败返回空
+PooledDeflater AcquireDeflater(const ZipCodec *codec, int level, uint64_t sizeHint);
+PooledInflater AcquireInflater(const ZipCodec *codec, uint64_t uncompressedSize);
+
+// "zlib" / "zlib-ng" / "libdeflate" / "isal"；"auto" 返回已编译的最快后端；未编译或未知的名称返回 nullptr
+const ZipCodec *FindZipCodec(const std::string &name);
+
+// 条目超过 codec->maxEntrySize 时返回 zlib 后端
+const ZipCodec *ZipCodecForEntry(const ZipCodec *codec, uint64_t entrySize);
+
+// 已编译的后端名，逗号分隔，如 "libdeflate,zlib"
+std::string AvailableZipCodecs();
+
+#endif /* ZipCodec_hpp */
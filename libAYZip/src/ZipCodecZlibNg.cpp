@@ -0,0 +1,49 @@
+﻿//
+//  ZipCodecZlibNg.cpp
+//  libAYZip
+//
+//  zlib-ng 原生 API (zng_*)，与 vcpkg 的 zlib 同时链接，不使用 zlib 兼容模式
+//
+
+#ifdef AYZIP_WITH_ZLIB_NG
+
+#include "ZipCodec.hpp"
+#include <zlib-ng.h>
+#include "ZStreamCodec.hpp"
+
+struct ZlibNgApi {
+    using Stream = zng_stream;
+
+    static int DeflateInit(Stream *stream, int level) { return zng_deflateInit2(stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY); }
+    static int Deflate(Stream *stream, int flush) { return zng_deflate(stream, flush); }
+    static int DeflateReset(Stream *stream) { return zng_deflateReset(stream); }
+    static void DeflateEnd(Stream *stream) { zng_deflateEnd(stream); }
+    static int InflateInit(Stream *stream) { return zng_inflateInit2(stream, -MAX_WBITS); }
+    static int Inflate(Stream *stream, int flush) { return zng_inflate(stream, flush); }
+    static int InflateReset(Stream *stream) { return zng_inflateReset(stream); }
+    static void InflateEnd(Stream *stream) { zng_inflateEnd(stream); }
+};
+
+static std::unique_ptr<DeflateStream> NewZlibNgDeflater(int level, uint64_t)
+{
+    return NewZStreamDeflater<ZStreamDeflater<ZlibNgApi>>(level);
+}
+
+static std::unique_ptr<InflateStream> NewZlibNgInflater(uint64_t)
+{
+    return NewZStreamInflater<ZStreamInflater<ZlibNgApi>>();
+}
+
+static bool ZlibNgInflateBuffer(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize)
+{
+    return ZStreamInflateBuffer<ZlibNgApi>(in, inSize, out, outSize);
+}
+
+static uint32_t ZlibNgCrc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    return zng_crc32_z(crc, data, size);
+}
+
+extern const ZipCodec kZlibNgCodec = { "zlib-ng", 0, NewZlibNgDeflater, NewZlibNgInflater, ZlibNgInflateBuffer, ZlibNgCrc32 };
+
+#endif
@@ -0,0 +1,139 @@
+﻿//
+//  ZipLog.cpp
+//  libAYZip
+//
+
+#include "ZipLog.hpp"
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <spdlog/async.h>
+#include <spdlog/async_logger.h>
+#include <spdlog/sinks/base_sink.h>
+
+namespace ZipLog {
+
+std::atomic<int> g_level(static_cast<int>(spdlog::level::info));
+
+// 攒够一批或收到 flush 时再回调宿主，减少跨 DLL 回调次数
+constexpr size_t kLogBatchSize = 64;
+constexpr size_t kDefaultQueueSize = 8192;
+
+class BatchCallbackSink : public spdlog::sinks::base_sink<std::mutex>
+{
+public:
+    explicit BatchCallbackSink(Callback callback) : callback_(std::move(callback))
+    {
+        pending_.reserve(kLogBatchSize);
+    }
+
+    ~BatchCallbackSink() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flush_();
+    }
+
+protected:
+    void sink_it_(const spdlog::details::log_msg &msg) override
+    {
+        pending_.emplace_back(msg.level, std::string(msg.payload.data(), msg.payload.size()));
+        if (pending_.size() >= kLogBatchSize) {
+            flush_();
+        }
+    }
+
+    void flush_() override
+    {
+        for (const auto &item : pending_) {
+            auto levelName = spdlog::level::to_string_view(item.first);
+            callback_(std::string(levelName.data(), levelName.size()).c_str(), item.second.c_str());
+        }
+        pending_.clear();
+    }
+
+private:
+    Callback callback_;
+    std::vector<std::pair<spdlog::level::level_enum, std::string>> pending_;
+};
+
+static std::mutex g_asyncMutex;
+static std::shared_ptr<spdlog::details::thread_pool> g_threadPool;
+static std::shared_ptr<spdlog::async_logger> g_asyncLogger;
+
+void SetLevel(spdlog::level::level_enum level)
+{
+    g_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+spdlog::level::level_enum ParseLevel(const char *level)
+{
+    auto lvl = spdlog::level::from_str(level);
+    if (lvl == spdlog::level::off && std::strcmp(level, "off") != 0) {
+        return spdlog::level::info;
+    }
+    return lvl;
+}
+
+void StartAsync(Callback callback, size_t queueSize)
+{
+    Stop();
+
+    auto threadPool = std::make_shared<spdlog::details::thread_pool>(queueSize ? queueSize : kDefaultQueueSize, 1);
+    auto sink = std::make_shared<BatchCallbackSink>(std::move(callback));
+    auto logger = std::make_shared<spdlog::async_logger>("AYZipAsync", sink, threadPool, spdlog::async_overflow_policy::overrun_oldest);
+    logger->set_level(spdlog::level::trace);    // 级别已在入队前过滤
+    logger->flush_on(spdlog::level::err);       // 错误立即投递
+
+    std::lock_guard<std::mutex> lock(g_asyncMutex);
+    g_threadPool = threadPool;
+    std::atomic_store(&g_asyncLogger, logger);
+}
+
+void Dispatch(const char *level, const char *message)
+{
+    auto logger = std::atomic_load(&g_asyncLogger);
+    if (!logger || level == nullptr || message == nullptr) {
+        return;
+    }
+
+    // 不认识的级别按 info 投递，明确的 "off" 不投递
+    auto lvl = ParseLevel(level);
+    if (lvl == spdlog::level::off) {
+        return;
+    }
+    if (!ShouldLog(lvl)) {
+        return;
+    }
+    logger->log(lvl, spdlog::string_view_t(message));
+}
+
+void Flush()
+{
+    auto logger = std::atomic_load(&g_asyncLogger);
+    if (logger) {
+        logger->flush();
+    }
+}
+
+void Stop()
+{
+    std::shared_ptr<spdlog::async_logger> logger;
+    std::shared_ptr<spdlog::details::thread_pool> threadPool;
+    {
+        std::lock_guard<std::mutex> lock(g_asyncMutex);
+        logger = std::atomic_exchange(&g_asyncLogger, std::shared_ptr<spdlog::async_logger>());
+        threadPool.swap(g_threadPool);
+    }
+
+    if (logger) {
+        logger->flush();
+    }
+    // 先释放 logger，thread_pool 析构时处理完队列再回收线程
+    logger.reset();
+    threadPool.reset();
+}
+
+}
@@ -0,0 +1,48 @@
+﻿//
+//  ZipLog.hpp
+//  libAYZip
+//
+//  日志级别过滤与异步投递
+//  AYLog 的回调由宿主提供且同步调用，多线程下会成为串行点；
+//  异步模式下回调只负责入队，由后台线程批量回调宿主。
+//
+
+#ifndef ZipLog_hpp
+#define ZipLog_hpp
+
+#include <atomic>
+#include <functional>
+#include <spdlog/AYLog.h>
+#include <spdlog/common.h>
+
+namespace ZipLog {
+
+using Callback = std::function<void(const char *level, const char *message)>;
+
+extern std::atomic<int> g_level;
+
+// 在格式化之前判断，未开启的级别只有一次原子读
+inline bool ShouldLog(spdlog::level::level_enum level)
+{
+    return static_cast<int>(level) >= g_level.load(std::memory_order_relaxed);
+}
+
+void SetLevel(spdlog::level::level_enum level);
+// 级别名转为级别：不认识的名字按 info 处理，只有 "off" 关闭 (spdlog 的 from_str 会把它们都当作 off)
+spdlog::level::level_enum ParseLevel(const char *level);
+
+// 启动异步投递，queueSize 为队列容量（条），队列满时丢弃最旧的日志而不阻塞调用线程
+void StartAsync(Callback callback, size_t queueSize);
+// AYLog 回调入口：异步模式下入队，否则直接丢弃
+void Dispatch(const char *level, const char *message);
+// 非阻塞，请求后台线程尽快把已入队的日志交给宿主
+void Flush();
+// 投递完剩余日志并停止后台线程；不可在 DllMain 中调用
+void Stop();
+
+}
+
+#define AYZipLogDebug(...) do { if (ZipLog::ShouldLog(spdlog::level::debug)) { AYDebug(__VA_ARGS__); } } while (0)
+#define AYZipLogInfo(...)  do { if (ZipLog::ShouldLog(spdlog::level::info)) { AYInfo(__VA_ARGS__); } } while (0)
+
+#endif /* ZipLog_hpp */
@@ -1,19 +1,1143 @@
 ﻿// testAYZip.cpp : 此文件包含 "main" 函数。程序执行将在此处开始并结束。
 //
+// 不带参数运行时执行自检，返回失败的检查数；testAYZip <ipa> <输出目录> 解压指定的包
+// testAYZip --benchmark-crc32 [KB] 输出 CRC-32 各实现的吞吐量
+//
 
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
 #include "../libAYZip/libAYZip.h"
+#include "../libAYZip/src/Crc32.hpp"
+#include "../libAYZip/src/MachOPageHasher.hpp"
+#include "../libAYZip/src/PathConverter.hpp"
 #ifndef NDEBUG
 #pragma comment(lib, "../Debug/libAYZipd.lib")
 #else
 #pragma comment(lib, "../Release/libAYZip.lib")
 #endif
 
+namespace fs = std::filesystem;
+
+static int g_failures = 0;
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            g_failures++; \
+            std::cout << "  FAILED " << __LINE__ << ": " << #expr << std::endl; \
+        } \
+    } while (0)
+
+static std::vector<uint8_t> RandomBytes(size_t size, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data(size);
+    for (uint8_t &byte : data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+static void WriteFile(const fs::path &path, const std::vector<uint8_t> &data)
+{
+    fs::create_directories(path.parent_path());
+    std::ofstream ofs(path, std::ios::binary);
+    ofs.write(reinterpret_cast<const char *>(data.data()), data.size());
+}
+
+static void WriteFile(const fs::path &path, const std::string &text)
+{
+    WriteFile(path, std::vector<uint8_t>(text.begin(), text.end()));
+}
+
+static std::vector<uint8_t> ReadFile(const fs::path &path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+static std::vector<uint8_t> Bytes(const std::string &text)
+{
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static bool IsPresent(const fs::path &path)
+{
+    std::error_code ec;
+    return fs::exists(fs::symlink_status(path, ec));
+}
+
+// 覆盖空文件、小条目快速路径、大于一个缓冲区的随机 (不可压缩) 与可压缩数据、空目录，POSIX 下还有符号链接
+static fs::path MakeTestApp(const fs::path &root)
+{
+    fs::path app = root / "Test.app";
+    WriteFile(app / "Info.plist", std::string("<?xml version=\"1.0\"?><plist><dict/></plist>\n"));
+    WriteFile(app / "Empty.txt", std::string());
+    WriteFile(app / "Frameworks" / "Big.bin", RandomBytes(300 * 1024 + 7, 1));
+    WriteFile(app / "Resources" / "Zeros.dat", std::vector<uint8_t>(1024 * 1024, 0));
+    WriteFile(app / "Resources" / "en.lproj" / "Localizable.strings", std::string("\"a\" = \"b\";\n"));
+    fs::create_directories(app / "EmptyDirectory");
+#ifndef _WIN32
+    fs::create_symlink("Resources", app / "Current");
+#endif
+    return app;
+}
+
+// expected 中的每个文件、符号链接与目录在 actual 中都存在且内容相同
+static bool SameTree(const fs::path &expected, const fs::path &actual)
+{
+    bool same = true;
+    for (auto it = fs::recursive_directory_iterator(expected); it != fs::recursive_directory_iterator(); ++it) {
+        fs::path relative = it->path().lexically_relative(expected);
+        fs::path other = actual / relative;
+        if (it->is_symlink()) {
+            same = same && fs::is_symlink(fs::symlink_status(other)) && fs::read_symlink(other) == fs::read_symlink(it->path());
+            it.disable_recursion_pending();
+        }
+        else if (it->is_directory()) {
+            same = same && fs::is_directory(other);
+        }
+        else {
+            same = same && fs::is_regular_file(other) && ReadFile(other) == ReadFile(it->path());
+        }
+        if (!same) {
+            std::cout << "  differs: " << relative.string() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool UnzipToNewDirectory(const fs::path &archive, const fs::path &output, const AYZipOptions *options = nullptr)
+{
+    fs::remove_all(output);
+    fs::create_directories(output);
+    return AYUnzipAppEx(archive.string().c_str(), output.string().c_str(), options);
+}
+
+/**** CRC-32 ****/
+static void TestCrc32Kernels()
+{
+    std::cout << "crc32 kernels" << std::endl;
+    std::vector<uint8_t> data = RandomBytes((1 << 20) + 64, 2);
+    const size_t lengths[] = {0, 1, 3, 7, 15, 16, 17, 31, 63, 64, 65, 127, 255, 256, 257, 1023, 4096, 65537, 1 << 20};
+
+    for (const Crc32Kernel &kernel : AvailableCrc32Kernels()) {
+        bool match = true;
+        for (size_t length : lengths) {
+            for (size_t offset = 0; offset < 8; offset++) {
+                const uint8_t *p = data.data() + offset;
+                uint32_t expected = static_cast<uint32_t>(crc32(0, p, static_cast<uInt>(length)));
+                match = match && kernel.update(0, p, length) == expected;
+                // 分两段更新与一次更新结果相同
+                size_t half = length / 3;
+                match = match && kernel.update(kernel.update(0, p, half), p + half, length - half) == expected;
+            }
+        }
+        std::cout << "  " << kernel.name << std::endl;
+        CHECK(match);
+    }
+
+    std::mt19937 rng(3);
+    bool combined = true;
+    for (int i = 0; i < 200; i++) {
+        size_t size1 = rng() % 70000;
+        size_t size2 = rng() % 70000;
+        uint32_t crc1 = Crc32Update(0, data.data(), size1);
+        uint32_t crc2 = Crc32Update(0, data.data() + size1, size2);
+        combined = combined && Crc32Combine(crc1, crc2, size2) == static_cast<uint32_t>(crc32_combine(crc1, crc2, static_cast<z_off_t>(size2)));
+    }
+    CHECK(combined);
+}
+
+/**** Mach-O 页哈希 ****/
+static void PutLittle32(std::vector<uint8_t> &data, size_t offset, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        data[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static void PutBig32(std::vector<uint8_t> &data, size_t offset, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        data[offset + i] = static_cast<uint8_t>(value >> (8 * (3 - i)));
+    }
+}
+
+// 64 位小端切片：一条 LC_UUID，signed 时再加 LC_CODE_SIGNATURE，签名数据从 codeLimit 开始
+static std::vector<uint8_t> MakeMachOSlice(size_t size, uint32_t codeLimit, bool sign, uint32_t seed)
+{
+    std::vector<uint8_t> slice = RandomBytes(size, seed);
+    PutLittle32(slice, 0, 0xFEEDFACF);
+    PutLittle32(slice, 4, 0x0100000C);
+    PutLittle32(slice, 8, 0);
+    PutLittle32(slice, 12, 6);
+    PutLittle32(slice, 16, sign ? 2 : 1);
+    PutLittle32(slice, 20, sign ? 24 + 16 : 24);
+    PutLittle32(slice, 24, 0);
+    PutLittle32(slice, 28, 0);
+    PutLittle32(slice, 32, 0x1B);
+    PutLittle32(slice, 36, 24);
+    if (sign) {
+        PutLittle32(slice, 56, 0x1D);
+        PutLittle32(slice, 60, 16);
+        PutLittle32(slice, 64, codeLimit);
+        PutLittle32(slice, 68, static_cast<uint32_t>(size - codeLimit));
+    }
+    return slice;
+}
+
+static std::vector<MachOSlice> HashInChunks(const std::vector<uint8_t> &data, size_t chunk)
+{
+    MachOPageHasher hasher;
+    for (size_t offset = 0; offset < data.size(); offset += chunk) {
+        hasher.Update(data.data() + offset, std::min(chunk, data.size() - offset));
+    }
+    return hasher.Final();
+}
+
+static void TestMachOPageHashes()
+{
+    std::cout << "mach-o page hashes" << std::endl;
+    // 两个切片按 16 KB 对齐；第一个已签名，codeLimit 不在页边界上
+    const size_t offsets[] = {0x4000, 0x10000};
+    const size_t sizes[] = {3 * kMachOPageSize + 1000, 2 * kMachOPageSize + 123};
+    const uint32_t codeLimits[] = {2 * kMachOPageSize + 100, static_cast<uint32_t>(sizes[1])};
+    std::vector<uint8_t> fat(offsets[1] + sizes[1], 0);
+    PutBig32(fat, 0, 0xCAFEBABE);
+    PutBig32(fat, 4, 2);
+    for (size_t i = 0; i < 2; i++) {
+        std::vector<uint8_t> slice = MakeMachOSlice(sizes[i], codeLimits[i], i == 0, static_cast<uint32_t>(5 + i));
+        std::copy(slice.begin(), slice.end(), fat.begin() + offsets[i]);
+        size_t arch = 8 + i * 20;
+        PutBig32(fat, arch, 0x0100000C);
+        PutBig32(fat, arch + 4, 0);
+        PutBig32(fat, arch + 8, static_cast<uint32_t>(offsets[i]));
+        PutBig32(fat, arch + 12, static_cast<uint32_t>(sizes[i]));
+        PutBig32(fat, arch + 16, 14);
+    }
+
+    std::vector<MachOSlice> whole = HashInChunks(fat, fat.size());
+    CHECK(whole.size() == 2);
+    if (whole.size() != 2) {
+        return;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        CHECK(whole[i].hasCodeSignature == (i == 0));
+        CHECK(whole[i].codeLimit == codeLimits[i]);
+        size_t pages = (codeLimits[i] + kMachOPageSize - 1) / kMachOPageSize;
+        CHECK(whole[i].sha256Pages.size() == pages && whole[i].sha1Pages.size() == pages);
+        bool match = true;
+        for (size_t page = 0; page < whole[i].sha256Pages.size(); page++) {
+            size_t begin = offsets[i] + page * kMachOPageSize;
+            size_t size = std::min<size_t>(kMachOPageSize, offsets[i] + codeLimits[i] - begin);
+            match = match && whole[i].sha256Pages[page] == Sha256Of(fat.data() + begin, size);
+            match = match && whole[i].sha1Pages[page] == Sha1Of(fat.data() + begin, size);
+        }
+        CHECK(match);
+    }
+
+    // 头部跨越多次 Update 时页哈希不变
+    for (size_t chunk : {size_t(1), size_t(16), size_t(40), size_t(kMachOPageSize)}) {
+        std::vector<MachOSlice> chunked = HashInChunks(fat, chunk);
+        bool same = chunked.size() == whole.size();
+        for (size_t i = 0; same && i < chunked.size(); i++) {
+            same = chunked[i].sha1Pages == whole[i].sha1Pages && chunked[i].sha256Pages == whole[i].sha256Pages;
+        }
+        CHECK(same);
+    }
+}
+
+/**** 路径转换 ****/
+static void TestPathConverter()
+{
+    std::cout << "path converter" << std::endl;
+    const char *entries[] = {
+        "Payload/Test.app/Info.plist",
+        "Payload/Test.app/Resources/a:b<c>d\"e|f?g*h.png",
+        "Payload/Test.app/Resources/en.lproj/",
+        "Payload/Test.app/_underscore_/x_y",
+        "Payload/",
+    };
+    std::string local;
+    std::string zip;
+    for (const char *entry : entries) {
+        CHECK(ZipPathToLocalPath(entry, local));
+#ifdef _WIN32
+        CHECK(local.find_first_of(":<>\"|?*/") == std::string::npos);
+#endif
+        bool isDirectory = entry[strlen(entry) - 1] == '/';
+        LocalPathToZipPath(local, isDirectory, zip);
+        CHECK("Payload/" + zip == entry || (zip.empty() && std::string(entry) == "Payload/"));
+    }
+
+    // 需要规范化或不在 Payload/ 下的路径交给调用方
+    CHECK(!ZipPathToLocalPath("Payload/Test.app/../x", local));
+    CHECK(!ZipPathToLocalPath("Payload/Test.app/./x", local));
+    CHECK(!ZipPathToLocalPath("Payload//x", local));
+    CHECK(!ZipPathToLocalPath("iTunesMetadata.plist", local));
 
-int main()
+    const std::string name = "a:b<c>d\"e|f?g*h";
+    CHECK(ToWindowsSafePath(name).find_first_of(":<>\"|?*") == std::string::npos);
+    CHECK(FromWindowsSafePath(ToWindowsSafePath(name)) == name);
+    // 占位符按映射表顺序替换，与最初的 replace_all 链一致
+    CHECK(FromWindowsSafePath("__lt__colon__") == "__lt:");
+    CHECK(FromWindowsSafePath("dir\\__star__") == "dir\\*");
+}
+
+/**** 各后端压缩、解压往返 ****/
+static std::vector<std::string> TestCodecs()
+{
+    std::vector<std::string> codecs;
+    std::string available = AYZipAvailableCodecs();
+    size_t start = 0;
+    while (start <= available.size()) {
+        size_t comma = available.find(',', start);
+        std::string name = available.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (!name.empty()) {
+            codecs.push_back(name);
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        start = comma + 1;
+    }
+    codecs.push_back("minizip");
+    return codecs;
+}
+
+static void TestCodecRoundTrip(const fs::path &root, const fs::path &app)
+{
+    for (const std::string &codec : TestCodecs()) {
+        std::cout << "round trip " << codec << std::endl;
+        fs::path archive = root / ("RoundTrip-" + codec + ".ipa");
+        AYZipOptions options = {};
+        options.codec = codec.c_str();
+        CHECK(AYZipAppEx(app.string().c_str(), archive.string().c_str(), &options));
+
+        fs::path output = root / ("RoundTrip-" + codec);
+        CHECK(UnzipToNewDirectory(archive, output, &options));
+        CHECK(SameTree(app, output / "Test.app"));
+
+        // 与压缩时不同的后端解压
+        AYZipOptions minizip = {};
+        minizip.codec = "minizip";
+        CHECK(UnzipToNewDirectory(archive, output, &minizip));
+        CHECK(SameTree(app, output / "Test.app"));
+    }
+}
+
+/**** 打补丁 ****/
+static void TestPatch(const fs::path &root, const fs::path &app)
 {
-    AYUnzipApp("C:\\Users\\Young\\Desktop\\Payload\\unc0ver-v5.0.1.ipa", "C:\\Users\\Young\\Desktop\\Payload\\Payload");
+    std::cout << "patch" << std::endl;
+    fs::path archive = root / "Patch.ipa";
+    CHECK(AYZipApp(app.string().c_str(), archive.string().c_str()));
+
+    const std::string plist = "<plist><dict><key>Patched</key><true/></dict></plist>\n";
+    std::vector<uint8_t> big = RandomBytes(200 * 1024, 4);
+    AYZipPatch patches[3] = {};
+    patches[0].path = "Payload/Test.app/Info.plist";
+    patches[0].data = plist.data();
+    patches[0].size = plist.size();
+    patches[1].path = "Payload/Test.app/Added/Big.bin";
+    patches[1].data = big.data();
+    patches[1].size = big.size();
+    patches[2].path = "Payload/Test.app/EmptyDirectory/";
+    patches[2].remove = true;
+
+    fs::path patched = root / "Patched.ipa";
+    CHECK(AYPatchApp(archive.string().c_str(), patched.string().c_str(), patches, 3, nullptr));
+    fs::path output = root / "Patched";
+    CHECK(UnzipToNewDirectory(patched, output));
+    CHECK(ReadFile(output / "Test.app" / "Info.plist") == Bytes(plist));
+    CHECK(ReadFile(output / "Test.app" / "Added" / "Big.bin") == big);
+    CHECK(!IsPresent(output / "Test.app" / "EmptyDirectory"));
+    CHECK(ReadFile(output / "Test.app" / "Frameworks" / "Big.bin") == ReadFile(app / "Frameworks" / "Big.bin"));
+}
+
+/**** 原地追加与压实 ****/
+static void TestAppend(const fs::path &root, const fs::path &app)
+{
+    std::cout << "append and compact" << std::endl;
+    fs::path archive = root / "Append.ipa";
+    CHECK(AYZipApp(app.string().c_str(), archive.string().c_str()));
+
+    // 原地追加：旧条目数据留在包内，只重写中央目录
+    const std::string appended = "appended\n";
+    std::vector<uint8_t> big = RandomBytes(200 * 1024, 4);
+    AYZipPatch append[3] = {};
+    append[0].path = "Payload/Test.app/Info.plist";
+    append[0].data = appended.data();
+    append[0].size = appended.size();
+    append[1].path = "Payload/Test.app/Resources/en.lproj/Localizable.strings";
+    append[1].remove = true;
+    append[2].path = "Payload/Test.app/Added/Big.bin";
+    append[2].data = big.data();
+    append[2].size = big.size();
+    CHECK(AYAppendApp(archive.string().c_str(), append, 3, nullptr));
+    fs::path output = root / "Append";
+    CHECK(UnzipToNewDirectory(archive, output));
+    CHECK(ReadFile(output / "Test.app" / "Info.plist") == Bytes(appended));
+    CHECK(!IsPresent(output / "Test.app" / "Resources" / "en.lproj" / "Localizable.strings"));
+    CHECK(ReadFile(output / "Test.app" / "Added" / "Big.bin") == big);
+    CHECK(ReadFile(output / "Test.app" / "Frameworks" / "Big.bin") == ReadFile(app / "Frameworks" / "Big.bin"));
+
+    fs::path compacted = root / "Compacted.ipa";
+    CHECK(AYCompactApp(archive.string().c_str(), compacted.string().c_str(), nullptr));
+    std::error_code ec;
+    CHECK(fs::file_size(compacted, ec) < fs::file_size(archive, ec) && !ec);
+    CHECK(UnzipToNewDirectory(compacted, output));
+    CHECK(ReadFile(output / "Test.app" / "Info.plist") == Bytes(appended));
+    CHECK(ReadFile(output / "Test.app" / "Added" / "Big.bin") == big);
+}
+
+/**** 内存中的 ipa ****/
+static bool BundleEntryEquals(AYZipBundle *bundle, const char *path, const std::vector<uint8_t> &expected)
+{
+    size_t size = 0;
+    const uint8_t *data = static_cast<const uint8_t *>(AYZipBundleRead(bundle, path, &size));
+    return data && std::vector<uint8_t>(data, data + size) == expected;
+}
+
+static void TestBundle(const fs::path &root, const fs::path &app)
+{
+    std::cout << "bundle" << std::endl;
+    fs::path archive = root / "Bundle.ipa";
+    CHECK(AYZipApp(app.string().c_str(), archive.string().c_str()));
+
+    AYZipBundle *bundle = AYZipBundleOpen(archive.string().c_str());
+    CHECK(bundle != nullptr);
+    if (bundle == nullptr) {
+        return;
+    }
+    CHECK(BundleEntryEquals(bundle, "Payload/Test.app/Frameworks/Big.bin", ReadFile(app / "Frameworks" / "Big.bin")));
+    size_t count = AYZipBundleCount(bundle);
+    AYZipBundleEntry entry = {};
+    bool foundModified = false;
+    for (size_t i = 0; i < count; i++) {
+        CHECK(AYZipBundleGetEntry(bundle, i, &entry));
+        foundModified = foundModified || entry.modified;
+    }
+    CHECK(!foundModified);
+
+    const std::string plist = "<plist><dict><key>Bundle</key><true/></dict></plist>\n";
+    CHECK(AYZipBundleSetFile(bundle, "Payload/Test.app/Info.plist", plist.data(), plist.size(), 0));
+    CHECK(AYZipBundleSetFile(bundle, "Payload/Test.app/Added.txt", "added", 5, 0755));
+    CHECK(AYZipBundleAddDirectory(bundle, "Payload/Test.app/NewDirectory/"));
+    CHECK(AYZipBundleRemove(bundle, "Payload/Test.app/Resources/en.lproj/") == 2);
+    CHECK(BundleEntryEquals(bundle, "Payload/Test.app/Info.plist", Bytes(plist)));
+    CHECK(AYZipBundleCount(bundle) == count + 2 - 2);
+
+    // 写回载入时的路径，未修改的条目原样复制
+    CHECK(AYZipBundleSave(bundle, archive.string().c_str(), nullptr));
+    AYZipBundleClose(bundle);
+
+    fs::path output = root / "Bundle";
+    CHECK(UnzipToNewDirectory(archive, output));
+    CHECK(ReadFile(output / "Test.app" / "Info.plist") == Bytes(plist));
+    CHECK(ReadFile(output / "Test.app" / "Added.txt") == Bytes("added"));
+    CHECK(fs::is_directory(output / "Test.app" / "NewDirectory"));
+    CHECK(!IsPresent(output / "Test.app" / "Resources" / "en.lproj"));
+    CHECK(ReadFile(output / "Test.app" / "Frameworks" / "Big.bin") == ReadFile(app / "Frameworks" / "Big.bin"));
+#ifndef _WIN32
+    CHECK((fs::status(output / "Test.app" / "Added.txt").permissions() & fs::perms::owner_exec) != fs::perms::none);
+#endif
+}
+
+/**** 拒绝写到解压目录之外的条目 ****/
+#ifndef _WIN32
+struct HostileEntry {
+    const char *path;
+    const char *target;     // 非 NULL 为符号链接，否则为文件
+};
+
+// 在正常的包后追加 entries，解压必须失败，且解压目录的上一级不能出现 escaped
+static void ExpectRejected(const fs::path &root, const fs::path &base, const char *name, std::initializer_list<HostileEntry> entries, const char *escaped)
+{
+    std::cout << "  " << name << std::endl;
+    AYZipBundle *bundle = AYZipBundleOpen(base.string().c_str());
+    CHECK(bundle != nullptr);
+    if (bundle == nullptr) {
+        return;
+    }
+    const char content[] = "evil";
+    for (const HostileEntry &entry : entries) {
+        bool added = entry.target ? AYZipBundleSetSymlink(bundle, entry.path, entry.target)
+                                  : AYZipBundleSetFile(bundle, entry.path, content, sizeof(content) - 1, 0644);
+        CHECK(added);
+    }
+    fs::path archive = root / (std::string(name) + ".ipa");
+    CHECK(AYZipBundleSave(bundle, archive.string().c_str(), nullptr));
+    AYZipBundleClose(bundle);
+
+    fs::path sandbox = root / name;
+    fs::path output = sandbox / "out";
+    CHECK(!UnzipToNewDirectory(archive, output));
+    CHECK(!IsPresent(sandbox / escaped));
+    CHECK(!IsPresent(root / escaped));
+}
+
+static void TestSymlinkEscape(const fs::path &root, const fs::path &app)
+{
+    std::cout << "symlink escape" << std::endl;
+    fs::path base = root / "Base.ipa";
+    CHECK(AYZipApp(app.string().c_str(), base.string().c_str()));
+
+    ExpectRejected(root, base, "absolute", {{"Payload/Test.app/abs", "/tmp"}}, "abs");
+    ExpectRejected(root, base, "dotdot", {{"Payload/Test.app/up", "../../evil"}}, "evil");
+    // 父目录是已解压出的符号链接
+    ExpectRejected(root, base, "through-dot", {{"Payload/Test.app/d", "."}, {"Payload/Test.app/d/x", "../../evil"}}, "evil");
+    ExpectRejected(root, base, "through-parent", {{"Payload/Test.app/up", ".."}, {"Payload/Test.app/up/esc", ".."}, {"Payload/Test.app/up/esc/evil", nullptr}}, "evil");
+    // 经由链接写入文件，即使最终位置仍在解压目录内也拒绝
+    ExpectRejected(root, base, "file-through-link", {{"Payload/Test.app/up", ".."}, {"Payload/Test.app/up/evil", nullptr}}, "evil");
+    // 词法上在目录内，实际经由另一个链接回到上一级
+    ExpectRejected(root, base, "dotdot-after-link", {{"Payload/Test.app/l", "."}, {"Payload/Test.app/e", "l/../../evil"}}, "evil");
+    ExpectRejected(root, base, "entry-path", {{"Payload/../evil", nullptr}}, "evil");
+}
+#endif
+
+/**** 按需读取单个条目 ****/
+// 可压缩但各处内容不同，读错偏移时能发现
+static std::vector<uint8_t> NumberedLines(size_t size)
+{
+    std::string text;
+    for (size_t line = 0; text.size() < size; line++) {
+        text += "line " + std::to_string(line) + " " + std::to_string(line * 2654435761u % 1000003) + "\n";
+    }
+    text.resize(size);
+    return Bytes(text);
+}
+
+static void TestArchiveRandomRead(const fs::path &root)
+{
+    std::cout << "archive random read" << std::endl;
+    fs::path app = root / "RandomRead" / "Test.app";
+    WriteFile(app / "Text.txt", NumberedLines(3 * 1024 * 1024 + 11));
+    WriteFile(app / "Random.bin", RandomBytes(700 * 1024 + 3, 5));
+    fs::path archive = root / "RandomRead.ipa";
+    CHECK(AYZipApp(app.string().c_str(), archive.string().c_str()));
+    fs::path output = root / "RandomRead-Extracted";
+    CHECK(UnzipToNewDirectory(archive, output));
+
+    // 只缓存一块，间隔取得小且不与 64KB 块对齐，读取大多要从检查点重新解压
+    AYArchive *reader = AYArchiveOpen(archive.string().c_str(), 1);
+    CHECK(reader != nullptr);
+    if (reader == nullptr) {
+        return;
+    }
+    AYArchiveSetCheckpointSpacing(reader, 80 * 1024 + 1);
+    std::mt19937 rng(6);
+    for (const char *name : {"Text.txt", "Random.bin"}) {
+        std::vector<uint8_t> expected = ReadFile(output / "Test.app" / name);
+        const AYArchiveEntry *entry = AYArchiveFind(reader, (std::string("Payload/Test.app/") + name).c_str());
+        CHECK(entry != nullptr && !expected.empty());
+        if (entry == nullptr) {
+            continue;
+        }
+        AYArchiveEntryInfo info = {};
+        CHECK(AYArchiveGetEntryInfo(entry, &info) && info.compressionMethod == 8 && info.size == expected.size());
+
+        // 先读到末尾记录检查点，再随机向前、向后跳，包括越过条目末尾的读取
+        std::vector<uint8_t> buffer(128 * 1024);
+        CHECK(AYArchiveRead(reader, entry, expected.size() - 10, buffer.data(), buffer.size()) == 10);
+        for (int i = 0; i < 200; i++) {
+            uint64_t offset = rng() % (expected.size() + 1);
+            size_t size = rng() % buffer.size();
+            int64_t read = AYArchiveRead(reader, entry, offset, buffer.data(), size);
+            size_t available = static_cast<size_t>(std::min<uint64_t>(size, expected.size() - offset));
+            CHECK(read == static_cast<int64_t>(available) &&
+                  std::equal(buffer.begin(), buffer.begin() + available, expected.begin() + static_cast<size_t>(offset)));
+        }
+    }
+    AYArchiveClose(reader);
+}
+
+/**** 修改时间往返 ****/
+// zip 中的时间精度为秒 (无扩展字段时为 DOS 时间的 2 秒)
+static bool SameTime(fs::file_time_type expected, fs::file_time_type actual)
+{
+    auto difference = expected > actual ? expected - actual : actual - expected;
+    return difference <= std::chrono::seconds(2);
+}
+
+static void TestFileTimes(const fs::path &root, const fs::path &app)
+{
+    std::cout << "file times" << std::endl;
+    fs::path copy = root / "TimesSource" / "Test.app";
+    fs::create_directories(copy.parent_path());
+    fs::copy(app, copy, fs::copy_options::recursive | fs::copy_options::copy_symlinks);
+
+    // 每个文件与目录一个不同的过去时间，解压时间或错位的时间都会被发现；包的根目录不是 zip 条目，不检查
+    std::vector<std::pair<fs::path, fs::file_time_type>> times;
+    fs::file_time_type base = fs::last_write_time(copy / "Info.plist") - std::chrono::hours(24 * 400);
+    for (auto it = fs::recursive_directory_iterator(copy); it != fs::recursive_directory_iterator(); ++it) {
+        if (it->is_symlink()) {
+            it.disable_recursion_pending();
+            continue;
+        }
+        times.emplace_back(it->path().lexically_relative(copy), base - std::chrono::hours(times.size() + 1));
+    }
+    for (const auto &item : times) {
+        fs::last_write_time(copy / item.first, item.second);
+    }
+
+    fs::path archive = root / "Times.ipa";
+    CHECK(AYZipApp(copy.string().c_str(), archive.string().c_str()));
+    fs::path output = root / "Times";
+    CHECK(UnzipToNewDirectory(archive, output / "Restored"));
+    for (const auto &item : times) {
+        std::error_code ec;
+        bool same = SameTime(item.second, fs::last_write_time(output / "Restored" / "Test.app" / item.first, ec)) && !ec;
+        if (!same) {
+            std::cout << "  time differs: " << item.first.string() << std::endl;
+        }
+        CHECK(same);
+    }
+
+    AYZipOptions options = {};
+    options.keepCurrentTimestamps = true;
+    CHECK(UnzipToNewDirectory(archive, output / "Current", &options));
+    CHECK(!SameTime(fs::last_write_time(copy / "Info.plist"), fs::last_write_time(output / "Current" / "Test.app" / "Info.plist")));
+}
+
+/**** 增量解压 ****/
+// 统计只记录实际写出的文件；条目少于 slowest 的容量 (10) 时每个写出的文件都列在其中
+static bool StatsListsEntry(const std::string &json, const std::string &name)
+{
+    return json.find("\"name\":\"" + name + "\"") != std::string::npos;
+}
+
+static void TestIncrementalUnzip(const fs::path &root, const fs::path &app)
+{
+    std::cout << "incremental unzip" << std::endl;
+    fs::path source = root / "IncrementalSource" / "Test.app";
+    fs::create_directories(source.parent_path());
+    fs::copy(app, source, fs::copy_options::recursive | fs::copy_options::copy_symlinks);
+    fs::path first = root / "Incremental-1.ipa";
+    CHECK(AYZipApp(source.string().c_str(), first.string().c_str()));
+
+    AYZipOptions options = {};
+    options.incremental = true;
+    fs::path output = root / "Incremental";
+    CHECK(UnzipToNewDirectory(first, output, &options));
+    CHECK(SameTree(source, output / "Test.app"));
+
+    // 新包：改一个、删一个、加一个
+    WriteFile(source / "Info.plist", std::string("<plist><dict><key>Version</key><string>2</string></dict></plist>\n"));
+    fs::remove(source / "Resources" / "en.lproj" / "Localizable.strings");
+    WriteFile(source / "Added" / "New.txt", std::string("new\n"));
+    fs::path second = root / "Incremental-2.ipa";
+    CHECK(AYZipApp(source.string().c_str(), second.string().c_str()));
+
+    // 解压出的文件被改动过时重写；不是上次解压写出的文件不受影响
+    WriteFile(output / "Test.app" / "Empty.txt", std::string("edited"));
+    WriteFile(output / "Test.app" / "User.txt", std::string("user"));
+
+    AYZipStats *stats = AYZipStatsCreate();
+    options.stats = stats;
+    CHECK(AYUnzipAppEx(second.string().c_str(), output.string().c_str(), &options));
+    std::string json = AYZipStatsToJson(stats);
+    CHECK(json.find("\"files\":3") != std::string::npos);
+    for (const char *written : {"Info.plist", "Empty.txt", "Added/New.txt"}) {
+        CHECK(StatsListsEntry(json, std::string("Payload/Test.app/") + written));
+    }
+    for (const char *kept : {"Frameworks/Big.bin", "Resources/Zeros.dat"}) {
+        CHECK(!StatsListsEntry(json, std::string("Payload/Test.app/") + kept));
+    }
+    AYZipStatsDestroy(stats);
+
+    CHECK(SameTree(source, output / "Test.app"));
+    CHECK(ReadFile(output / "Test.app" / "Empty.txt").empty());
+    CHECK(!IsPresent(output / "Test.app" / "Resources" / "en.lproj" / "Localizable.strings"));
+    CHECK(ReadFile(output / "Test.app" / "User.txt") == Bytes("user"));
+}
+
+/**** 解压到多个目录 ****/
+#ifndef _WIN32
+// expected 中每个文件与目录的权限在 actual 中相同 (符号链接不比较)
+static bool SameModes(const fs::path &expected, const fs::path &actual)
+{
+    for (auto it = fs::recursive_directory_iterator(expected); it != fs::recursive_directory_iterator(); ++it) {
+        if (it->is_symlink()) {
+            it.disable_recursion_pending();
+            continue;
+        }
+        fs::path relative = it->path().lexically_relative(expected);
+        std::error_code ec;
+        if (fs::symlink_status(actual / relative, ec).permissions() != it->symlink_status().permissions()) {
+            std::cout << "  mode differs: " << relative.string() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+static void TestExtraDestinations(const fs::path &root, const fs::path &app)
+{
+    std::cout << "extra destinations" << std::endl;
+    fs::path source = root / "ReplicaSource" / "Test.app";
+    fs::create_directories(source.parent_path());
+    fs::copy(app, source, fs::copy_options::recursive | fs::copy_options::copy_symlinks);
+#ifndef _WIN32
+    // 压缩时目录总会补上 0755，组可写位可以保留下来；其余权限不随 umask 变化
+    fs::permissions(source / "Resources", fs::perms::owner_all | fs::perms::group_all | fs::perms::others_read | fs::perms::others_exec);
+    fs::permissions(source / "EmptyDirectory", fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec | fs::perms::others_read | fs::perms::others_exec);
+    fs::permissions(source / "Frameworks" / "Big.bin", fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec);
+#endif
+    fs::path archive = root / "Replica.ipa";
+    CHECK(AYZipApp(source.string().c_str(), archive.string().c_str()));
+
+    // 0 自动 (reflink 或复制)，2 硬链接，3 复制
+    for (unsigned int cloneMode : {0u, 2u, 3u}) {
+        std::cout << "  clone mode " << cloneMode << std::endl;
+        fs::path output = root / ("Replica-" + std::to_string(cloneMode));
+        fs::remove_all(output);
+        std::vector<std::string> destinations = {(output / "Second").string(), (output / "Third").string()};
+        const char *extra[] = {destinations[0].c_str(), destinations[1].c_str()};
+        AYZipOptions options = {};
+        options.extraDestinations = extra;
+        options.extraDestinationCount = 2;
+        options.cloneMode = cloneMode;
+        CHECK(UnzipToNewDirectory(archive, output / "First", &options));
+
+        for (const char *name : {"First", "Second", "Third"}) {
+            fs::path extracted = output / name / "Test.app";
+            CHECK(SameTree(source, extracted));
+            CHECK(SameTree(extracted, source));
+#ifndef _WIN32
+            CHECK(fs::is_symlink(fs::symlink_status(extracted / "Current")));
+            CHECK(SameModes(output / "First" / "Test.app", extracted));
+            CHECK(fs::status(extracted / "Resources").permissions() == (fs::perms::owner_all | fs::perms::group_all | fs::perms::others_read | fs::perms::others_exec));
+            CHECK(fs::status(extracted / "EmptyDirectory").permissions() == (fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec | fs::perms::others_read | fs::perms::others_exec));
+            CHECK(fs::status(extracted / "Frameworks" / "Big.bin").permissions() == (fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec));
+#endif
+        }
+    }
+}
+
+/**** 压缩缓存 ****/
+// 统计 JSON 中的整数字段，不存在时为 -1
+static long long JsonNumber(const std::string &json, const std::string &key)
+{
+    size_t position = json.find("\"" + key + "\":");
+    return position == std::string::npos ? -1 : std::stoll(json.substr(position + key.size() + 3));
+}
+
+static void TestCompressedCache(const fs::path &root, const fs::path &app)
+{
+    std::cout << "compressed cache" << std::endl;
+    fs::path uncached = root / "Cache-None.ipa";
+    CHECK(AYZipApp(app.string().c_str(), uncached.string().c_str()));
+
+    AYZipCompressedCache *cache = AYZipCompressedCacheCreate((root / "CompressedCache").string().c_str(), 0);
+    CHECK(cache != nullptr);
+    if (cache == nullptr) {
+        return;
+    }
+    // 小文件也经过缓存，覆盖小条目路径
+    AYZipCompressedCacheSetMinEntrySize(cache, 1);
+    AYZipOptions options = {};
+    options.compressedCache = cache;
+
+    fs::path miss = root / "Cache-Miss.ipa";
+    CHECK(AYZipAppEx(app.string().c_str(), miss.string().c_str(), &options));
+    std::string json = AYZipCompressedCacheGetStatsJson(cache);
+    CHECK(JsonNumber(json, "hits") == 0 && JsonNumber(json, "inserted") > 0);
+
+    AYZipCompressedCacheResetStats(cache);
+    fs::path hit = root / "Cache-Hit.ipa";
+    CHECK(AYZipAppEx(app.string().c_str(), hit.string().c_str(), &options));
+    json = AYZipCompressedCacheGetStatsJson(cache);
+    CHECK(JsonNumber(json, "hits") > 0 && JsonNumber(json, "hits") == JsonNumber(json, "lookups"));
+    AYZipCompressedCacheDestroy(cache);
+
+    std::vector<uint8_t> expected = ReadFile(uncached);
+    CHECK(!expected.empty() && ReadFile(miss) == expected && ReadFile(hit) == expected);
+    fs::path output = root / "Cache-Hit";
+    CHECK(UnzipToNewDirectory(hit, output));
+    CHECK(SameTree(app, output / "Test.app"));
+}
+
+/**** CodeResources ****/
+// 嵌套代码的 cdhash 每字节为路径长度，指定要求含路径，能看出每一项取自哪个回调
+static bool GoldenNestedCode(void *context, const char *path, uint8_t cdhash[20], const char **requirement)
+{
+    std::string &text = *static_cast<std::string *>(context);
+    std::memset(cdhash, static_cast<int>(std::strlen(path)), 20);
+    text = std::string("identifier ") + path;
+    *requirement = text.c_str();
+    return true;
+}
+
+// 摘要由 Python hashlib 另行算出；规则与 codesign 对 iOS 包的默认规则相同
+static const char kGoldenCodeResources[] =
+R"(<?xml version="1.0" encoding="UTF-8"?>
+<!DOCTYPE plist PUBLIC "-//Apple//DTD PLIST 1.0//EN" "http://www.apple.com/DTDs/PropertyList-1.0.dtd">
+<plist version="1.0">
+<dict>
+	<key>files</key>
+	<dict>
+		<key>.DS_Store</key>
+		<data>
+		ukhos/J3yOOHtV2ePQvnwEXN2J4=
+		</data>
+		<key>Base.lproj/Main.nib</key>
+		<data>
+		rpCaBc7aWVvWfwsy3ooxmbwbzlY=
+		</data>
+		<key>Frameworks/Kit.framework/Info.plist</key>
+		<data>
+		ka3kBY074BjpdvcQHwYQz7YqM+I=
+		</data>
+		<key>Frameworks/Kit.framework/Kit</key>
+		<data>
+		B5/9Rg1MLlFAbjIR/8G7Bjg6QsA=
+		</data>
+		<key>Frameworks/libFoo.dylib</key>
+		<data>
+		uEvBfpypFg4WTtbxFAallfNSST0=
+		</data>
+		<key>Frameworks/readme.txt</key>
+		<data>
+		B1PdpykhfZvYktJSvdNfLuZ3Sls=
+		</data>
+		<key>Info.plist</key>
+		<data>
+		wr9ySb5AWARmwHIsqVsStorB4VE=
+		</data>
+		<key>PlugIns/Ext.appex/Ext</key>
+		<data>
+		WArukLliQfWYZW2YylyTbJVMXto=
+		</data>
+		<key>PlugIns/Ext.appex/Frameworks/Inner.framework/Info.plist</key>
+		<data>
+		ka3kBY074BjpdvcQHwYQz7YqM+I=
+		</data>
+		<key>PlugIns/Ext.appex/Info.plist</key>
+		<data>
+		ka3kBY074BjpdvcQHwYQz7YqM+I=
+		</data>
+		<key>Resources/a.txt</key>
+		<data>
+		P3hoUOOHVQ/auDbtfm3Igd4jABs=
+		</data>
+		<key>en.lproj/Localizable.strings</key>
+		<dict>
+			<key>hash</key>
+			<data>
+			fzQHRTGNlrbUR4BKMvTjuFFLjOk=
+			</data>
+			<key>optional</key>
+			<true/>
+		</dict>
+	</dict>
+	<key>files2</key>
+	<dict>
+		<key>Base.lproj/Main.nib</key>
+		<dict>
+			<key>hash</key>
+			<data>
+			rpCaBc7aWVvWfwsy3ooxmbwbzlY=
+			</data>
+			<key>hash2</key>
+			<data>
+			u7Kek8ya7LmYuRjFiMqsMvLlCTrnShPo90hcqb7ijjE=
+			</data>
+		</dict>
+)"
+#ifndef _WIN32
+R"(		<key>Current</key>
+		<dict>
+			<key>symlink</key>
+			<string>Resources</string>
+		</dict>
+)"
+#endif
+R"(		<key>Frameworks/Kit.framework</key>
+		<dict>
+			<key>cdhash</key>
+			<data>
+			GBgYGBgYGBgYGBgYGBgYGBgYGBg=
+			</data>
+			<key>requirement</key>
+			<string>identifier Frameworks/Kit.framework</string>
+		</dict>
+		<key>Frameworks/libFoo.dylib</key>
+		<dict>
+			<key>cdhash</key>
+			<data>
+			FxcXFxcXFxcXFxcXFxcXFxcXFxc=
+			</data>
+			<key>requirement</key>
+			<string>identifier Frameworks/libFoo.dylib</string>
+		</dict>
+		<key>Frameworks/readme.txt</key>
+		<dict>
+			<key>hash</key>
+			<data>
+			B1PdpykhfZvYktJSvdNfLuZ3Sls=
+			</data>
+			<key>hash2</key>
+			<data>
+			ANdbUXa0jMxx2RvMHXuQ/CggQpsWKbd/0dX0xdzuT20=
+			</data>
+		</dict>
+		<key>PlugIns/Ext.appex</key>
+		<dict>
+			<key>cdhash</key>
+			<data>
+			ERERERERERERERERERERERERERE=
+			</data>
+			<key>requirement</key>
+			<string>identifier PlugIns/Ext.appex</string>
+		</dict>
+		<key>Resources/a.txt</key>
+		<dict>
+			<key>hash</key>
+			<data>
+			P3hoUOOHVQ/auDbtfm3Igd4jABs=
+			</data>
+			<key>hash2</key>
+			<data>
+			h0KPxSKAPTEGXnvOPPA/5HUJZjHl4Hu9eg/eYMTPJcc=
+			</data>
+		</dict>
+		<key>en.lproj/Localizable.strings</key>
+		<dict>
+			<key>hash</key>
+			<data>
+			fzQHRTGNlrbUR4BKMvTjuFFLjOk=
+			</data>
+			<key>hash2</key>
+			<data>
+			lpG5XludHRtWqrpF/LB042MW2EO3hqiUHPDIWNgqSmg=
+			</data>
+			<key>optional</key>
+			<true/>
+		</dict>
+	</dict>
+	<key>rules</key>
+	<dict>
+		<key>^.*</key>
+		<true/>
+		<key>^.*\.lproj/</key>
+		<dict>
+			<key>optional</key>
+			<true/>
+			<key>weight</key>
+			<real>1000</real>
+		</dict>
+		<key>^.*\.lproj/locversion.plist$</key>
+		<dict>
+			<key>omit</key>
+			<true/>
+			<key>weight</key>
+			<real>1100</real>
+		</dict>
+		<key>^Base\.lproj/</key>
+		<dict>
+			<key>weight</key>
+			<real>1010</real>
+		</dict>
+		<key>^version.plist$</key>
+		<true/>
+	</dict>
+	<key>rules2</key>
+	<dict>
+		<key>.*\.dSYM($|/)</key>
+		<dict>
+			<key>weight</key>
+			<real>11</real>
+		</dict>
+		<key>^(.*/)?\.DS_Store$</key>
+		<dict>
+			<key>omit</key>
+			<true/>
+			<key>weight</key>
+			<real>2000</real>
+		</dict>
+		<key>^(Frameworks|SharedFrameworks|PlugIns|Plug-ins|XPCServices|Helpers|MacOS|Library/(Automator|Spotlight|LoginItems))/</key>
+		<dict>
+			<key>nested</key>
+			<true/>
+			<key>weight</key>
+			<real>10</real>
+		</dict>
+		<key>^.*</key>
+		<true/>
+		<key>^.*\.lproj/</key>
+		<dict>
+			<key>optional</key>
+			<true/>
+			<key>weight</key>
+			<real>1000</real>
+		</dict>
+		<key>^.*\.lproj/locversion.plist$</key>
+		<dict>
+			<key>omit</key>
+			<true/>
+			<key>weight</key>
+			<real>1100</real>
+		</dict>
+		<key>^Base\.lproj/</key>
+		<dict>
+			<key>weight</key>
+			<real>1010</real>
+		</dict>
+		<key>^Info\.plist$</key>
+		<dict>
+			<key>omit</key>
+			<true/>
+			<key>weight</key>
+			<real>20</real>
+		</dict>
+		<key>^PkgInfo$</key>
+		<dict>
+			<key>omit</key>
+			<true/>
+			<key>weight</key>
+			<real>20</real>
+		</dict>
+		<key>^embedded\.provisionprofile$</key>
+		<dict>
+			<key>weight</key>
+			<real>20</real>
+		</dict>
+		<key>^version\.plist$</key>
+		<dict>
+			<key>weight</key>
+			<real>20</real>
+		</dict>
+	</dict>
+</dict>
+</plist>
+)";
+
+// 覆盖 files 与 files2 的差异 (omit / optional / 符号链接)、嵌套包与单独的 dylib、被排除的主可执行文件与旧签名
+static void TestCodeResources(const fs::path &root)
+{
+    std::cout << "CodeResources" << std::endl;
+    const std::string bundlePlist = "<plist><dict/></plist>\n";
+    fs::path app = root / "CodeResources" / "Golden.app";
+    WriteFile(app / "Info.plist", std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\">\n<dict>\n"
+                                              "\t<key>CFBundleExecutable</key>\n\t<string>Golden</string>\n</dict>\n</plist>\n"));
+    WriteFile(app / "Golden", std::string("\xcf\xfa\xed\xfe main"));
+    WriteFile(app / ".DS_Store", std::string("ds"));
+    WriteFile(app / "Base.lproj" / "Main.nib", std::string("nib"));
+    WriteFile(app / "Resources" / "a.txt", std::string("a\n"));
+    WriteFile(app / "en.lproj" / "Localizable.strings", std::string("\"a\" = \"b\";\n"));
+    WriteFile(app / "en.lproj" / "locversion.plist", std::string("<plist/>\n"));
+    WriteFile(app / "Frameworks" / "Kit.framework" / "Info.plist", bundlePlist);
+    WriteFile(app / "Frameworks" / "Kit.framework" / "Kit", std::string("\xcf\xfa\xed\xfe kit"));
+    WriteFile(app / "Frameworks" / "libFoo.dylib", std::string("\xcf\xfa\xed\xfe foo"));
+    WriteFile(app / "Frameworks" / "readme.txt", std::string("readme\n"));
+    WriteFile(app / "PlugIns" / "Ext.appex" / "Info.plist", bundlePlist);
+    WriteFile(app / "PlugIns" / "Ext.appex" / "Ext", std::string("\xcf\xfa\xed\xfe ext"));
+    WriteFile(app / "PlugIns" / "Ext.appex" / "Frameworks" / "Inner.framework" / "Info.plist", bundlePlist);
+    WriteFile(app / "_CodeSignature" / "CodeResources", std::string("old\n"));
+#ifndef _WIN32
+    fs::create_symlink("Resources", app / "Current");
+#endif
+
+    AYZipCodeResources *codeResources = AYZipCodeResourcesCreate(nullptr, true);
+    std::string requirement;
+    AYZipCodeResourcesSetNestedCodeCallback(codeResources, GoldenNestedCode, &requirement);
+    AYZipOptions options = {};
+    options.codeResources = codeResources;
+    fs::path archive = root / "CodeResources.ipa";
+    CHECK(AYZipAppEx(app.string().c_str(), archive.string().c_str(), &options));
+
+    const char *document = AYZipCodeResourcesGetDocument(codeResources);
+    bool same = document != nullptr && std::string(document) == kGoldenCodeResources;
+    if (!same && document) {
+        std::cout << document;
+    }
+    CHECK(same);
+    AYZipCodeResourcesDestroy(codeResources);
+
+    // 写入包内的文档替换了旧的 CodeResources
+    fs::path output = root / "CodeResources-Extracted";
+    CHECK(UnzipToNewDirectory(archive, output));
+    CHECK(ReadFile(output / "Golden.app" / "_CodeSignature" / "CodeResources") == Bytes(kGoldenCodeResources));
+}
+
+/**** 可复现的 ipa ****/
+static void TestDeterministic(const fs::path &root, const fs::path &app)
+{
+    std::cout << "deterministic" << std::endl;
+    fs::path copy = root / "Deterministic" / "Test.app";
+    fs::create_directories(copy.parent_path());
+    fs::copy(app, copy, fs::copy_options::recursive | fs::copy_options::copy_symlinks);
+
+    AYZipOptions options = {};
+    options.deterministic = true;
+    fs::path first = root / "Deterministic-1.ipa";
+    CHECK(AYZipAppEx(copy.string().c_str(), first.string().c_str(), &options));
+
+    // 只改时间戳与不影响可执行位的权限，第二次压缩必须逐字节相同
+    fs::file_time_type past = fs::last_write_time(copy / "Info.plist") - std::chrono::hours(24 * 400);
+    for (auto it = fs::recursive_directory_iterator(copy); it != fs::recursive_directory_iterator(); ++it) {
+        if (it->is_symlink()) {
+            it.disable_recursion_pending();
+            continue;
+        }
+        fs::last_write_time(it->path(), past);
+#ifndef _WIN32
+        fs::permissions(it->path(), it->is_directory() ? fs::perms::owner_all : fs::perms::owner_read | fs::perms::owner_write);
+#endif
+    }
+    fs::last_write_time(copy, past);
+    fs::path second = root / "Deterministic-2.ipa";
+    CHECK(AYZipAppEx(copy.string().c_str(), second.string().c_str(), &options));
+    CHECK(!ReadFile(first).empty() && ReadFile(first) == ReadFile(second));
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "--benchmark-crc32") == 0) {
+        size_t sizeKB = argc >= 3 ? std::stoul(argv[2]) : 64 * 1024;
+        std::cout << BenchmarkCrc32Kernels(sizeKB * 1024) << std::endl;
+        return 0;
+    }
+    if (argc >= 3) {
+        return AYUnzipApp(argv[1], argv[2]) ? 0 : 1;
+    }
+
+    fs::path root = fs::temp_directory_path() / "testAYZip";
+    fs::remove_all(root);
+    fs::create_directories(root);
+    fs::path app = MakeTestApp(root / "Source");
+
+    TestCrc32Kernels();
+    TestPathConverter();
+    TestMachOPageHashes();
+    TestCodecRoundTrip(root, app);
+    TestPatch(root, app);
+    TestAppend(root, app);
+    TestBundle(root, app);
+    TestDeterministic(root, app);
+    TestArchiveRandomRead(root);
+    TestFileTimes(root, app);
+    TestIncrementalUnzip(root, app);
+    TestExtraDestinations(root, app);
+    TestCompressedCache(root, app);
+    TestCodeResources(root);
+#ifndef _WIN32
+    TestSymlinkEscape(root, app);
+#endif
 
-    //AYZipApp("C:\\Users\\Young\\Desktop\\Payload\\Payload\\unc0ver.app", "C:\\Users\\Young\\Desktop\\1.ipa");
-    std::cout << "Hello World!\n";
-}
\ No newline at end of file
+    fs::remove_all(root);
+    std::cout << (g_failures == 0 ? "all passed" : "FAILED") << " (" << g_failures << " failures)" << std::endl;
+    return g_failures;
+}